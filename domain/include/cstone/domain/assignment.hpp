@@ -31,6 +31,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
 #include "cstone/domain/domaindecomp_mpi.hpp"
 #include "cstone/domain/layout.hpp"
 #include "cstone/tree/octree_internal.hpp"
@@ -55,11 +59,17 @@ template<class KeyType, class T>
 class GlobalAssignment
 {
 public:
-    GlobalAssignment(int rank, int nRanks, unsigned bucketSize, const Box<T>& box = Box<T>{0, 1})
+    GlobalAssignment(int rank,
+                     int nRanks,
+                     unsigned bucketSize,
+                     const Box<T>& box = Box<T>{0, 1},
+                     MPI_Comm comm     = MPI_COMM_WORLD)
         : myRank_(rank)
         , numRanks_(nRanks)
         , bucketSize_(bucketSize)
         , box_(box)
+        , comm_(comm)
+        , transport_(comm)
     {
         std::vector<KeyType> init{0, nodeRange<KeyType>(0)};
         tree_.update(init.data(), nNodes(init));
@@ -85,7 +95,7 @@ public:
         // number of locally assigned particles to consider for global tree building
         LocalIndex numParticles = bufDesc.end - bufDesc.start;
 
-        box_ = makeGlobalBox(x + bufDesc.start, y + bufDesc.start, z + bufDesc.start, numParticles, box_);
+        box_ = makeGlobalBox(x + bufDesc.start, y + bufDesc.start, z + bufDesc.start, numParticles, box_, comm_);
 
         gsl::span<KeyType> keyView(particleKeys + bufDesc.start, numParticles);
 
@@ -104,22 +114,55 @@ public:
         }
         oldBoundaries.back() = nodeRange<KeyType>(0);
 
-        updateOctreeGlobal(keyView.begin(), keyView.end(), bucketSize_, tree_, nodeCounts_, numRanks_);
+        unsigned coarsening = coarsening_;
+        if (coarsening > 1) { updateCoarseTree(keyView, oldBoundaries, coarsening); }
+        else
+        {
+            updateOctreeGlobal(keyView.begin(), keyView.end(), bucketSize_, tree_, nodeCounts_, numRanks_, comm_);
+        }
 
-        if (firstCall_)
+        if (firstCall_ && coarsening == 1)
         {
             firstCall_ = false;
-            while (!updateOctreeGlobal(keyView.begin(), keyView.end(), bucketSize_, tree_, nodeCounts_, numRanks_))
+            while (
+                !updateOctreeGlobal(keyView.begin(), keyView.end(), bucketSize_, tree_, nodeCounts_, numRanks_, comm_))
                 ;
         }
 
-        auto newAssignment = singleRangeSfcSplit(nodeCounts_, numRanks_);
+        auto newAssignment = prediction_.dt > 0 ? predictedSplit(bufDesc, x, y, z)
+                                                : singleRangeSfcSplit(nodeCounts_, numRanks_);
         limitBoundaryShifts<KeyType>(oldBoundaries, tree_.treeLeaves(), nodeCounts_, newAssignment);
         assignment_ = std::move(newAssignment);
 
         return assignment_.totalCount(myRank_);
     }
 
+    /*! @brief split the SFC on particle counts predicted for the sync after the next assign() call
+     *
+     * @param vx,vy,vz  velocities of the particles that are passed as x,y,z to the next assign() call
+     * @param dt        time until the following sync
+     *
+     * The next assign() call moves the particles by v * dt, counts them in the updated tree and places the rank
+     * boundaries on these predicted counts, such that boundaries move ahead of bulk flows. The particle counts
+     * assigned to ranks are those of the actual positions. The velocities are only used in the next assign() call.
+     */
+    void setPrediction(const T* vx, const T* vy, const T* vz, T dt) { prediction_ = {vx, vy, vz, dt}; }
+
+    /*! @brief build the global tree with leaves larger than the bucket size away from rank boundaries
+     *
+     * @param factor  global tree leaves hold up to bucketSize * factor particles, 1 gives the full resolution
+     *
+     * The number of global tree leaves and with it the size of the count reduction in assign() shrink by about
+     * 1/factor. The leaves on either side of each rank boundary are refined back to about bucketSize particles,
+     * such that rank boundaries keep the resolution of the full tree. Leaf counts stay exact.
+     */
+    void setTreeCoarsening(unsigned factor)
+    {
+        if (factor == 0) { throw std::runtime_error("The global tree coarsening factor must be at least 1\n"); }
+        coarsening_ = factor;
+        baseLeaves_.clear();
+    }
+
     /*! @brief Distribute particles to their assigned ranks based on previous assignment
      *
      * @param[in]    bufDesc            Buffer description with range of assigned particles and total buffer size
@@ -159,7 +202,7 @@ public:
         // Assigned particles are now inside the [particleStart:particleEnd] range, but not exclusively.
         // Leftover particles from the previous step can also be contained in the range.
         auto [newStart, newEnd] =
-            exchangeParticles(domainExchangeSends, myRank_, bufDesc.start, bufDesc.end, bufDesc.size,
+            exchangeParticles(transport_, domainExchangeSends, myRank_, bufDesc.start, bufDesc.end, bufDesc.size,
                               newNParticlesAssigned, reorderFunctor.getReorderMap(), x, y, z, particleProperties...);
 
         LocalIndex envelopeSize = newEnd - newStart;
@@ -178,6 +221,26 @@ public:
         return std::make_tuple(newStart, keyView.subspan(offset, newNParticlesAssigned));
     }
 
+    /*! @brief set the global tree and its leaf counts, e.g. from a previous run
+     *
+     * @param[in] leaves  cornerstone leaf keys, identical on all ranks
+     * @param[in] counts  global particle counts per leaf, length nNodes(leaves)
+     *
+     * The next call to assign() starts from the provided tree instead of converging from the root node.
+     */
+    void setTree(gsl::span<const KeyType> leaves, gsl::span<const unsigned> counts)
+    {
+        if (nNodes(leaves) < 1 || size_t(nNodes(leaves)) != counts.size() || leaves.front() != 0 ||
+            leaves.back() != nodeRange<KeyType>(0))
+        {
+            throw std::runtime_error("Invalid global tree provided to domain\n");
+        }
+        tree_.update(leaves.data(), nNodes(leaves));
+        nodeCounts_.assign(counts.begin(), counts.end());
+        assignment_ = singleRangeSfcSplit(nodeCounts_, numRanks_);
+        firstCall_  = false;
+    }
+
     //! @brief read only visibility of the global octree leaves to the outside
     gsl::span<const KeyType> treeLeaves() const { return tree_.treeLeaves(); }
     //! @brief the octree, including the internal part
@@ -188,14 +251,129 @@ public:
     const Box<T>& box() const { return box_; }
     //! @brief return the space filling curve rank assignment
     const SpaceCurveAssignment& assignment() const { return assignment_; }
+    //! @brief bytes sent by this rank in particle exchanges so far
+    const TransportVolume& transportVolume() const { return transport_.volume(); }
 
 private:
+    /*! @brief update the global tree with coarse leaves, except next to rank boundaries
+     *
+     * @param[in] keys        sorted local particle keys
+     * @param[in] anchors     SFC keys of the rank boundaries of the previous step
+     * @param[in] coarsening  ratio of the coarse bucket size to bucketSize_
+     *
+     * A coarse cornerstone tree with buckets of coarsening * bucketSize_ particles is rebalanced on its counts from
+     * the last step. The leaves on either side of each anchor are then subdivided log8(coarsening) times towards the
+     * anchor. The counts of the refined tree are exact and obtained with a single reduction.
+     */
+    void updateCoarseTree(gsl::span<const KeyType> keys, std::vector<KeyType> anchors, unsigned coarsening)
+    {
+        unsigned coarseBucket = bucketSize_ * coarsening;
+        unsigned maxCount     = std::numeric_limits<unsigned>::max() / numRanks_;
+        const KeyType* keysEnd = keys.data() + keys.size();
+
+        std::vector<TreeNodeIndex> nodeOps;
+        if (baseLeaves_.empty())
+        {
+            baseLeaves_ = {0, nodeRange<KeyType>(0)};
+            baseCounts_ = {coarseBucket + 1};
+            while (!updateOctreeGlobal(keys.data(), keysEnd, coarseBucket, baseLeaves_, baseCounts_, comm_))
+                ;
+            auto coarseAssignment = singleRangeSfcSplit(baseCounts_, numRanks_);
+            for (int rank = 0; rank < numRanks_; ++rank)
+            {
+                anchors.push_back(baseLeaves_[coarseAssignment.firstNodeIdx(rank)]);
+            }
+        }
+        else
+        {
+            nodeOps.resize(baseLeaves_.size());
+            rebalanceDecision(baseLeaves_.data(), baseCounts_.data(), nNodes(baseLeaves_), coarseBucket,
+                              nodeOps.data());
+            std::vector<KeyType> rebalanced;
+            rebalanceTree(baseLeaves_, rebalanced, nodeOps.data());
+            swap(baseLeaves_, rebalanced);
+        }
+
+        std::vector<KeyType> leaves = baseLeaves_, refined;
+        for (unsigned level = 0; level < log8ceil(coarsening); ++level)
+        {
+            nodeOps.assign(leaves.size(), 1);
+            for (KeyType anchor : anchors)
+            {
+                if (anchor == 0 || anchor == nodeRange<KeyType>(0)) { continue; }
+                for (KeyType key : {anchor - 1, anchor})
+                {
+                    TreeNodeIndex leafIdx = findNodeBelow<KeyType>(leaves, key);
+                    if (treeLevel(leaves[leafIdx + 1] - leaves[leafIdx]) < maxTreeLevel<KeyType>{})
+                    {
+                        nodeOps[leafIdx] = 8;
+                    }
+                }
+            }
+            rebalanceTree(leaves, refined, nodeOps.data());
+            swap(leaves, refined);
+        }
+        tree_.update(leaves.data(), nNodes(leaves));
+
+        nodeCounts_.resize(nNodes(leaves));
+        computeNodeCounts(leaves.data(), nodeCounts_.data(), nNodes(leaves), keys.data(), keysEnd, maxCount);
+        MPI_Allreduce(MPI_IN_PLACE, nodeCounts_.data(), nodeCounts_.size(), MPI_UNSIGNED, MPI_SUM, comm_);
+
+        // coarse leaves are unions of refined leaves
+        baseCounts_.assign(nNodes(baseLeaves_), 0);
+        for (TreeNodeIndex i = 0, j = 0; i < TreeNodeIndex(nNodes(baseLeaves_)); ++i)
+        {
+            for (; leaves[j] < baseLeaves_[i + 1]; ++j)
+            {
+                baseCounts_[i] += nodeCounts_[j];
+            }
+        }
+    }
+
+    //! @brief assignment with boundaries placed on the counts of predicted particle positions
+    SpaceCurveAssignment predictedSplit(BufferDescription bufDesc, const T* x, const T* y, const T* z)
+    {
+        LocalIndex numParticles = bufDesc.end - bufDesc.start;
+        std::vector<KeyType> predictedKeys(numParticles);
+
+        auto [vx, vy, vz, dt] = prediction_;
+#pragma omp parallel for schedule(static)
+        for (LocalIndex i = 0; i < numParticles; ++i)
+        {
+            LocalIndex j = bufDesc.start + i;
+            Vec3<T> X    = putInBox(Vec3<T>{x[j] + vx[j] * dt, y[j] + vy[j] * dt, z[j] + vz[j] * dt}, box_);
+            X            = {std::clamp(X[0], box_.xmin(), box_.xmax()), std::clamp(X[1], box_.ymin(), box_.ymax()),
+                            std::clamp(X[2], box_.zmin(), box_.zmax())};
+            predictedKeys[i] = sfc3D<SfcKind<KeyType>>(X[0], X[1], X[2], box_);
+        }
+        std::sort(predictedKeys.begin(), predictedKeys.end());
+        prediction_ = {};
+
+        std::vector<unsigned> predictedCounts(nodeCounts_.size());
+        unsigned maxCount = std::numeric_limits<unsigned>::max() / numRanks_;
+        computeNodeCounts(tree_.treeLeaves().data(), predictedCounts.data(), nNodes(tree_.treeLeaves()),
+                          predictedKeys.data(), predictedKeys.data() + predictedKeys.size(), maxCount, false);
+        MPI_Allreduce(MPI_IN_PLACE, predictedCounts.data(), predictedCounts.size(), MPI_UNSIGNED, MPI_SUM, comm_);
+
+        auto predicted = singleRangeSfcSplit(predictedCounts, numRanks_);
+        SpaceCurveAssignment ret(numRanks_);
+        for (int rank = 0; rank < numRanks_; ++rank)
+        {
+            TreeNodeIndex first = predicted.firstNodeIdx(rank), last = predicted.lastNodeIdx(rank);
+            ret.addRange(Rank(rank), first, last,
+                         std::accumulate(nodeCounts_.begin() + first, nodeCounts_.begin() + last, size_t(0)));
+        }
+        return ret;
+    }
+
     int myRank_;
     int numRanks_;
     unsigned bucketSize_;
 
     //! @brief global coordinate bounding box
     Box<T> box_;
+    //! @brief communicator of all ranks in the domain
+    MPI_Comm comm_;
 
     SpaceCurveAssignment assignment_;
 
@@ -205,6 +383,23 @@ private:
     Octree<KeyType> tree_;
 
     bool firstCall_{true};
+
+    struct Prediction
+    {
+        const T *vx, *vy, *vz;
+        T dt;
+    };
+    //! @brief velocities for the next assign() call, dt == 0 disables prediction
+    Prediction prediction_{nullptr, nullptr, nullptr, 0};
+
+    //! @brief factor by which global tree leaves away from rank boundaries are larger than bucketSize_
+    unsigned coarsening_{1};
+    //! @brief the coarse global tree before refinement around rank boundaries and its counts
+    std::vector<KeyType> baseLeaves_;
+    std::vector<unsigned> baseCounts_;
+
+    //! @brief shared memory transport to ranks on the same node, used in distribute()
+    mutable NodeTransport transport_;
 };
 
 } // namespace cstone
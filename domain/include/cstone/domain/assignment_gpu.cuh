@@ -60,11 +60,16 @@ template<class KeyType, class T>
 class GlobalAssignmentGpu
 {
 public:
-    GlobalAssignmentGpu(int rank, int nRanks, unsigned bucketSize, const Box<T>& box = Box<T>{0, 1})
+    GlobalAssignmentGpu(int rank,
+                        int nRanks,
+                        unsigned bucketSize,
+                        const Box<T>& box = Box<T>{0, 1},
+                        MPI_Comm comm     = MPI_COMM_WORLD)
         : myRank_(rank)
         , numRanks_(nRanks)
         , bucketSize_(bucketSize)
         , box_(box)
+        , comm_(comm)
     {
         std::vector<KeyType> init{0, nodeRange<KeyType>(0)};
         tree_.update(init.data(), nNodes(init));
@@ -91,7 +96,7 @@ public:
         LocalIndex numParticles = bufDesc.end - bufDesc.start;
         LocalIndex start = bufDesc.start;
 
-        box_ = makeGlobalBox<T, MinMaxGpu<T>>(x + start, y + start, z + start, numParticles, box_);
+        box_ = makeGlobalBox<T, MinMaxGpu<T>>(x + start, y + start, z + start, numParticles, box_, comm_);
         gsl::span<KeyType> keyView(particleKeys + start, numParticles);
 
         // compute SFC particle keys only for particles participating in tree build
@@ -109,12 +114,12 @@ public:
         oldBoundaries.back() = nodeRange<KeyType>(0);
 
         updateOctreeGlobalGpu(keyView.begin(), keyView.end(), bucketSize_, tree_, d_csTree_, nodeCounts_, d_nodeCounts_,
-                              numRanks_);
+                              numRanks_, comm_);
         if (firstCall_)
         {
             firstCall_ = false;
             while (!updateOctreeGlobalGpu(keyView.begin(), keyView.end(), bucketSize_, tree_, d_csTree_, nodeCounts_,
-                                          d_nodeCounts_, numRanks_))
+                                          d_nodeCounts_, numRanks_, comm_))
                 ;
         }
 
@@ -165,7 +170,7 @@ public:
 
         // Assigned particles are now inside the [newStart:newEnd] range, but not exclusively.
         // Leftover particles from the previous step can also be contained in the range.
-        auto [newStart, newEnd] = exchangeParticlesGpu(domainExchangeSends, myRank_, bufDesc.start, bufDesc.end,
+        auto [newStart, newEnd] = exchangeParticlesGpu(comm_, domainExchangeSends, myRank_, bufDesc.start, bufDesc.end,
                                                        bufDesc.size, newNParticlesAssigned, sendScratch, receiveScratch,
                                                        reorderFunctor.getReorderMap(), x, y, z, particleProperties...);
 
@@ -186,6 +191,32 @@ public:
         return std::make_tuple(newStart, keyView.subspan(offset, newNParticlesAssigned));
     }
 
+    //! @brief coarsened global tree builds are only supported on CPUs, see GlobalAssignment::setTreeCoarsening
+    void setTreeCoarsening(unsigned factor)
+    {
+        if (factor != 1) { throw std::runtime_error("Coarsened global tree builds are not supported on GPUs\n"); }
+    }
+
+    //! @brief predictive assignment is only supported on CPUs, see GlobalAssignment::setPrediction
+    void setPrediction(const T*, const T*, const T*, T)
+    {
+        throw std::runtime_error("Predictive domain assignment is not supported on GPUs\n");
+    }
+
+    //! @brief set the global tree and its leaf counts, see GlobalAssignment::setTree
+    void setTree(gsl::span<const KeyType> leaves, gsl::span<const unsigned> counts)
+    {
+        if (nNodes(leaves) < 1 || size_t(nNodes(leaves)) != counts.size() || leaves.front() != 0 ||
+            leaves.back() != nodeRange<KeyType>(0))
+        {
+            throw std::runtime_error("Invalid global tree provided to domain\n");
+        }
+        tree_.update(leaves.data(), nNodes(leaves));
+        nodeCounts_.assign(counts.begin(), counts.end());
+        assignment_ = singleRangeSfcSplit(nodeCounts_, numRanks_);
+        firstCall_  = false;
+    }
+
     //! @brief read only visibility of the global octree leaves to the outside
     gsl::span<const KeyType> treeLeaves() const { return tree_.treeLeaves(); }
     //! @brief the octree, including the internal part
@@ -204,6 +235,8 @@ private:
 
     //! @brief global coordinate bounding box
     Box<T> box_;
+    //! @brief communicator of all ranks in the domain
+    MPI_Comm comm_;
 
     SpaceCurveAssignment assignment_;
 
@@ -78,20 +78,24 @@ public:
      * @param box             global bounding box, default is non-pbc box
      *                        for each periodic dimension in @a box, the coordinate min/max
      *                        limits will never be changed for the lifetime of the Domain
-     *
+     * @param comm            communicator of the ranks that share the domain, @a rank and @a nRanks refer to it.
+     *                        All communication of the Domain stays within @a comm, such that several domains
+     *                        can be operated concurrently on disjoint communicators.
      */
     Domain(int rank,
            int nRanks,
            unsigned bucketSize,
            unsigned bucketSizeFocus,
            float theta,
-           const Box<T>& box = Box<T>{0, 1})
+           const Box<T>& box = Box<T>{0, 1},
+           MPI_Comm comm     = MPI_COMM_WORLD)
         : myRank_(rank)
         , numRanks_(nRanks)
         , bucketSizeFocus_(bucketSizeFocus)
         , theta_(theta)
-        , focusTree_(rank, numRanks_, bucketSizeFocus_, theta_)
-        , global_(rank, nRanks, bucketSize, box)
+        , comm_(comm)
+        , focusTree_(rank, numRanks_, bucketSizeFocus_, theta_, comm)
+        , global_(rank, nRanks, bucketSize, box, comm)
     {
         if (bucketSize < bucketSizeFocus_)
         {
@@ -100,6 +104,82 @@ public:
         }
     }
 
+    /*! @brief start the global tree from @p leaves and @p counts instead of converging it from scratch
+     *
+     * Must be called before the first sync. Intended for restarts, where the global tree of the previous run
+     * was stored along with the particles. The tree is still rebalanced in each sync, so a tree obtained with
+     * a different bucket size or rank count is a valid starting point as well.
+     */
+    void setGlobalTree(gsl::span<const KeyType> leaves, gsl::span<const unsigned> counts)
+    {
+        if (!firstCall_) { throw std::runtime_error("The global tree can only be set before the first sync\n"); }
+        global_.setTree(leaves, counts);
+    }
+
+    /*! @brief start the focus tree of the executing rank from a converged state, e.g. of a previous run
+     *
+     * @param leaves      focus tree leaves of the executing rank, see focusTree().treeLeaves()
+     * @param leafCounts  particle counts per leaf, see focusTree().leafCounts()
+     * @param macs        MAC status per node in the internal order, see focusTree().macs()
+     *
+     * Must be called before the first sync on all ranks, together with setGlobalTree and with the state stored
+     * by the same rank of a run with the same number of ranks. The first sync then skips the convergence of the
+     * focus tree and continues with the incremental update of subsequent syncs.
+     */
+    void setFocusTree(gsl::span<const KeyType> leaves, gsl::span<const unsigned> leafCounts, gsl::span<const char> macs)
+    {
+        if (!firstCall_) { throw std::runtime_error("The focus tree can only be set before the first sync\n"); }
+        focusTree_.setTree(leaves, leafCounts, macs);
+        focusConverged_ = true;
+    }
+
+    /*! @brief build the global tree with leaves up to @p factor times the bucket size away from rank boundaries
+     *
+     * Global tree builds then reduce counts of fewer leaves. Leaves next to rank boundaries keep the full resolution
+     * and all global counts stay exact. CPU only.
+     */
+    void setGlobalTreeCoarsening(unsigned factor) { global_.setTreeCoarsening(factor); }
+
+    /*! @brief place the rank boundaries of the next sync on particle counts predicted from velocities
+     *
+     * @param vx,vy,vz  particle velocities in the layout of the coordinates passed to the next sync
+     * @param dt        time until the sync after the next one
+     *
+     * Only affects the next sync. Boundaries are placed as if all particles had moved by v * dt, which keeps
+     * ranks balanced in bulk flows where the damped boundary shifts would otherwise lag behind. CPU only.
+     */
+    template<class Vector>
+    void predictAssignment(const Vector& vx, const Vector& vy, const Vector& vz, T dt)
+    {
+        global_.setPrediction(rawPtr(vx), rawPtr(vy), rawPtr(vz), dt);
+    }
+
+    /*! @brief remove and add locally assigned particles in the next sync, CPU only
+     *
+     * @param keep      one flag per particle in [startIndex():endIndex()], particles with a zero flag are removed.
+     *                  An empty span keeps all particles.
+     * @param numAdded  number of new particles that the caller appended to all arrays of the next sync,
+     *                  behind the nParticlesWithHalos() elements of the previous sync
+     *
+     * The next sync compacts the kept and added particles into the assigned range before the global tree update,
+     * such that the global particle count changes accordingly.
+     */
+    void changeParticles(gsl::span<const char> keep, LocalIndex numAdded)
+    {
+        if constexpr (HaveGpu<Accelerator>{})
+        {
+            throw std::runtime_error("Particle creation and removal is not supported on GPUs\n");
+        }
+        if (firstCall_) { throw std::runtime_error("Particles can only be changed after the first sync\n"); }
+        if (!keep.empty() && keep.size() != nParticles())
+        {
+            throw std::runtime_error("Particle removal requires one flag per assigned particle\n");
+        }
+        keep_.assign(keep.begin(), keep.end());
+        numAdded_         = numAdded;
+        particlesChanged_ = true;
+    }
+
     /*! @brief Domain update sequence for particles with coordinates x,y,z, interaction radius h and their properties
      *
      * @param[out]   particleKeys        SFC particleKeys
@@ -116,13 +196,10 @@ public:
      * ============================================================================================================
      *
      *   - Array sizes of x,y,z,h and particleProperties are identical
-     *     AND equal to the internally stored value of localNParticles_ from the previous call, except
-     *     on the first call. This is checked.
+     *     AND equal to nParticlesWithHalos() from the previous call, except on the first call. This is checked.
      *
-     *     This means that none of the argument arrays can be resized between calls of this function.
-     *     Or in other words, particles cannot be created or destroyed.
-     *     (If this should ever be required though, it can be easily enabled by allowing the assigned
-     *     index range from startIndex() to endIndex() to be modified from the outside.)
+     *     This means that none of the argument arrays can be resized between calls of this function,
+     *     unless particles are created or destroyed with changeParticles() before the call.
      *
      *   - The particle order is irrelevant
      *
@@ -207,7 +284,7 @@ public:
         float invThetaEff      = invThetaMinMac(theta_);
         std::vector<int> peers = findPeersMac(myRank_, global_.assignment(), global_.octree(), box(), invThetaEff);
 
-        if (firstCall_)
+        if (firstCall_ && !focusConverged_)
         {
             focusTree_.converge(box(), keyView, peers, global_.assignment(), global_.treeLeaves(), global_.nodeCounts(),
                                 invThetaEff, std::get<0>(scratch));
@@ -253,7 +330,7 @@ public:
         float invThetaEff      = invThetaVecMac(theta_);
         std::vector<int> peers = findPeersMac(myRank_, global_.assignment(), global_.octree(), box(), invThetaEff);
 
-        if (firstCall_)
+        if (firstCall_ && !focusConverged_)
         {
             int converged = 0;
             while (converged != numRanks_)
@@ -264,7 +341,7 @@ public:
                 focusTree_.updateCenters(rawPtr(x), rawPtr(y), rawPtr(z), rawPtr(m), global_.assignment(),
                                          global_.octree(), box(), std::get<0>(scratch), std::get<1>(scratch));
                 focusTree_.updateMacs(box(), global_.assignment(), global_.treeLeaves());
-                MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+                MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, comm_);
             }
         }
         focusTree_.updateMinMac(box(), global_.assignment(), global_.treeLeaves(), invThetaEff);
@@ -288,12 +365,19 @@ public:
         firstCall_ = false;
     }
 
-    //! @brief repeat the halo exchange pattern from the previous sync operation for a different set of arrays
+    /*! @brief repeat the halo exchange pattern from the previous sync operation for a different set of arrays
+     *
+     * With a reduced @p precision, the selected double arrays are sent as float or scaled 16-bit values,
+     * see HaloPrecision. Coordinates and smoothing lengths exchanged in sync() are always exact.
+     */
     template<class... Vectors, class SendBuffer, class ReceiveBuffer>
-    void exchangeHalos(std::tuple<Vectors&...> arrays, SendBuffer& sendBuffer, ReceiveBuffer& receiveBuffer) const
+    void exchangeHalos(std::tuple<Vectors&...> arrays,
+                       SendBuffer& sendBuffer,
+                       ReceiveBuffer& receiveBuffer,
+                       HaloPrecision precision = {}) const
     {
         std::apply([this](auto&... arrays) { this->template checkSizesEqual(this->bufDesc_.size, arrays...); }, arrays);
-        this->halos_.exchangeHalos(arrays, sendBuffer, receiveBuffer);
+        this->halos_.exchangeHalos(arrays, sendBuffer, receiveBuffer, precision);
     }
 
     //! @brief return the index of the first particle that's part of the local assignment
@@ -306,6 +390,10 @@ public:
     [[nodiscard]] LocalIndex nParticlesWithHalos() const { return bufDesc_.size; }
     //! @brief read only visibility of the global octree leaves to the outside
     const Octree<KeyType>& globalTree() const { return global_.octree(); }
+    //! @brief global particle counts per leaf of globalTree()
+    gsl::span<const unsigned> globalCounts() const { return global_.nodeCounts(); }
+    //! @brief the assignment of the global tree leaves to ranks
+    const SpaceCurveAssignment& assignment() const { return global_.assignment(); }
     //! @brief read only visibility of the focused octree
     const FocusedOctree<KeyType, T, Accelerator>& focusTree() const { return focusTree_; }
     //! @brief the index of the first locally assigned cell in focusTree()
@@ -316,6 +404,17 @@ public:
     gsl::span<const LocalIndex> layout() const { return layout_; }
     //! @brief return the coordinate bounding box from the previous sync call
     const Box<T>& box() const { return global_.box(); }
+    //! @brief the communicator of all ranks that share the domain
+    MPI_Comm comm() const { return comm_; }
+
+    //! @brief bytes sent by this rank in halo exchanges so far, split into intra- and inter-node, CPU only
+    const TransportVolume& haloExchangeVolume() const { return halos_.transportVolume(); }
+    //! @brief bytes sent by this rank in particle exchanges of sync() so far, split into intra- and inter-node
+    TransportVolume domainExchangeVolume() const
+    {
+        if constexpr (HaveGpu<Accelerator>{}) { return {}; }
+        else { return global_.transportVolume(); }
+    }
 
 private:
     //! @brief bounds initialization on first call, use all particles
@@ -375,6 +474,11 @@ private:
                     std::tuple<Vectors2&...> scratchBuffers)
     {
         initBounds(x.size());
+        if (particlesChanged_)
+        {
+            reallocateDestructive(keys, x.size(), 1.01);
+            compactParticles(std::tuple_cat(std::tie(x, y, z), particleProperties), scratchBuffers);
+        }
         auto distributedArrays = std::tuple_cat(std::tie(keys, x, y, z), particleProperties);
         std::apply([size = x.size()](auto&... arrays) { checkSizesEqual(size, arrays...); }, distributedArrays);
 
@@ -394,6 +498,48 @@ private:
             distributedArrays);
     }
 
+    /*! @brief move the kept assigned particles and the appended particles into one range starting at startIndex()
+     *
+     * The assigned range of bufDesc_ is updated, the buffer size becomes the size of the arrays.
+     */
+    template<class... Arrays, class... Scratch>
+    void compactParticles(std::tuple<Arrays&...> arrays, std::tuple<Scratch&...> scratchBuffers)
+    {
+        particlesChanged_ = false;
+        size_t newSize    = std::get<0>(arrays).size();
+        if (newSize != size_t(bufDesc_.size) + numAdded_)
+        {
+            throw std::runtime_error("Domain sync: array sizes must grow by the number of added particles\n");
+        }
+
+        std::vector<LocalIndex> sources;
+        sources.reserve(nParticles() + numAdded_);
+        for (LocalIndex i = 0; i < nParticles(); ++i)
+        {
+            if (keep_.empty() || keep_[i]) { sources.push_back(bufDesc_.start + i); }
+        }
+        for (LocalIndex i = 0; i < numAdded_; ++i)
+        {
+            sources.push_back(bufDesc_.size + i);
+        }
+
+        if constexpr (!HaveGpu<Accelerator>{})
+        {
+            auto compact = [&sources, &scratchBuffers, start = bufDesc_.start](auto& array)
+            {
+                auto& swapSpace = util::pickType<decltype(array)>(scratchBuffers);
+                if (swapSpace.size() < sources.size()) { reallocate(swapSpace, sources.size(), 1.01); }
+                gather<LocalIndex>(sources, array.data(), swapSpace.data());
+                omp_copy(swapSpace.begin(), swapSpace.begin() + sources.size(), array.begin() + start);
+            };
+            for_each_tuple(compact, arrays);
+        }
+
+        bufDesc_ = {bufDesc_.start, LocalIndex(bufDesc_.start + sources.size()), LocalIndex(newSize)};
+        keep_.clear();
+        numAdded_ = 0;
+    }
+
     template<class KeyVec, class VectorX, class VectorH, class... Vs>
     void setupHalos(KeyVec& keys, VectorX& x, VectorX& y, VectorX& z, VectorH& h, std::tuple<Vs&...> scratch)
     {
@@ -514,7 +660,7 @@ private:
                 }
                 std::cout << std::endl;
             }
-            MPI_Barrier(MPI_COMM_WORLD);
+            MPI_Barrier(comm_);
         }
     }
 
@@ -525,6 +671,8 @@ private:
     //! @brief MAC parameter for focus resolution and gravity treewalk
     float theta_;
 
+    MPI_Comm comm_;
+
     /*! @brief description of particle buffers, storing start and end indices of assigned particles and total size
      *
      *  First element: array index of first local particle belonging to the assignment
@@ -549,9 +697,16 @@ private:
     //! @brief particle offsets of each leaf node in focusedTree_, length = focusedTree_.treeLeaves().size()
     std::vector<LocalIndex> layout_;
 
-    Halos<KeyType, Accelerator> halos_{myRank_};
+    Halos<KeyType, Accelerator> halos_{myRank_, comm_};
 
     bool firstCall_{true};
+    //! @brief whether the focus tree was set to a converged state before the first sync
+    bool focusConverged_{false};
+
+    //! @brief particle changes for the next sync, see changeParticles()
+    std::vector<char> keep_;
+    LocalIndex numAdded_{0};
+    bool particlesChanged_{false};
 
     std::vector<KeyType> swapKeys_;
 };
@@ -34,13 +34,21 @@
 #include "domaindecomp.hpp"
 
 #include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/primitives/node_transport.hpp"
+#include "cstone/util/scratch_arena.hpp"
 
 namespace cstone
 {
 
+namespace detail
+{
+
+struct DomainExchangeSendScratch;
+
 /*! @brief exchange array elements with other ranks according to the specified ranges
  *
  * @tparam Arrays                 pointers to particles buffers
+ * @param[inout] transport        shared memory transport for ranks on the same node, or nullptr
  * @param[in] sendList            List of index ranges to be sent to each rank, indices
  *                                are valid w.r.t to arrays present on @p thisRank relative to @p particleStart.
  * @param[in] thisRank            Rank of the executing process
@@ -52,7 +60,8 @@ namespace cstone
  * @param[inout] arrays           Pointers of different types but identical sizes. The index range based exchange
  *                                operations performed are identical for each input array. Upon completion, arrays will
  *                                contain elements from the specified ranges and ranks.
- *                                The order in which the incoming ranges are grouped is random.
+ *                                Incoming ranges from ranks on the same node come first, followed by the
+ *                                other ranges in ascending order of the source rank.
  * @return                        (newStart, newEnd) tuple of indices delimiting the new range of assigned
  *                                particles post-exchange. Note: this range may contain left-over particles
  *                                from the previous assignment. Those can be removed with a subsequent call to
@@ -64,9 +73,17 @@ namespace cstone
  *           No information about incoming particles to @p thisRank is contained in the function arguments,
  *           only their total number @p nParticlesAssigned, which also includes any assigned particles
  *           already present on @p thisRank.
+ *
+ *  If @p transport is not null, particles for ranks on the same node are exchanged through its shared memory window.
+ *  Ranks are numbered in @p comm. Collective on @p comm, because the number of incoming particles from each rank
+ *  is exchanged first. Particles from other ranks are then received directly into @p arrays with one derived
+ *  datatype per source rank, while outgoing particles are gathered into a thread-local buffer that is reused
+ *  across calls.
  */
 template<class... Arrays>
-std::tuple<LocalIndex, LocalIndex> exchangeParticles(const SendList& sendList,
+std::tuple<LocalIndex, LocalIndex> exchangeParticles(MPI_Comm comm,
+                                                     NodeTransport* transport,
+                                                     const SendList& sendList,
                                                      int thisRank,
                                                      LocalIndex particleStart,
                                                      LocalIndex particleEnd,
@@ -82,43 +99,19 @@ std::tuple<LocalIndex, LocalIndex> exchangeParticles(const SendList& sendList,
 
     int numRanks = int(sendList.size());
 
-    std::vector<std::vector<char>> sendBuffers;
-    std::vector<MPI_Request> sendRequests;
-    sendBuffers.reserve(27);
-    sendRequests.reserve(27);
+    size_t bytesPerParticle = std::accumulate(elementSizes.begin(), elementSizes.end(), size_t(0));
+    auto onNode             = [transport](int rank) { return transport && transport->onNode(rank); };
 
-    std::array<char*, numArrays> sourceArrays{reinterpret_cast<char*>(arrays + particleStart)...};
-    for (int destinationRank = 0; destinationRank < numRanks; ++destinationRank)
+    std::vector<LocalIndex> sendCounts(numRanks), receiveCounts(numRanks);
+    for (int rank = 0; rank < numRanks; ++rank)
     {
-        const auto& sends = sendList[destinationRank];
-        size_t sendCount  = sends.totalCount();
-        if (destinationRank == thisRank || sendCount == 0) { continue; }
-
-        util::array<size_t, numArrays> arrayByteOffsets = sendCount * elementSizes;
-        size_t totalBytes = std::accumulate(arrayByteOffsets.begin(), arrayByteOffsets.end(), size_t(0));
-        std::exclusive_scan(arrayByteOffsets.begin(), arrayByteOffsets.end(), arrayByteOffsets.begin(), size_t(0));
-
-        std::vector<char> sendBuffer(totalBytes);
-
-        auto gatherArray = [sendPtr = sendBuffer.data(), sendCount, ordering, &sourceArrays, &arrayByteOffsets,
-                            &elementSizes, rStart = sends.rangeStart(0)](auto arrayIndex)
-        {
-            size_t outputOffset = arrayByteOffsets[arrayIndex];
-            char* bufferPtr     = sendPtr + outputOffset;
-
-            using ElementType = util::array<float, elementSizes[arrayIndex] / sizeof(float)>;
-            static_assert(elementSizes[arrayIndex] % sizeof(float) == 0, "elementSize must be a multiple of float");
-            gather<LocalIndex>({ordering + rStart, sendCount}, reinterpret_cast<ElementType*>(sourceArrays[arrayIndex]),
-                               reinterpret_cast<ElementType*>(bufferPtr));
-        };
-        for_each_tuple(gatherArray, indices);
-
-        mpiSendAsync(sendBuffer.data(), sendBuffer.size(), destinationRank, domainExchangeTag, sendRequests);
-        sendBuffers.push_back(std::move(sendBuffer));
+        sendCounts[rank] = rank == thisRank ? 0 : sendList[rank].totalCount();
     }
+    MPI_Alltoall(sendCounts.data(), 1, MpiType<LocalIndex>{}, receiveCounts.data(), 1, MpiType<LocalIndex>{}, comm);
 
     LocalIndex numParticlesPresent = sendList[thisRank].totalCount();
     LocalIndex numIncoming         = numParticlesAssigned - numParticlesPresent;
+    assert(std::accumulate(receiveCounts.begin(), receiveCounts.end(), size_t(0)) == numIncoming);
 
     bool fitHead = particleStart >= numIncoming;
     bool fitTail = arraySize - particleEnd >= numIncoming;
@@ -143,69 +136,187 @@ std::tuple<LocalIndex, LocalIndex> exchangeParticles(const SendList& sendList,
         newParticleEnd   = numParticlesAssigned;
     }
 
-    std::array<char*, numArrays> destinationArrays{reinterpret_cast<char*>(arrays + receiveStart)...};
+    // incoming particles are placed behind the particles that stay on this rank in the order
+    // [particles from ranks on the same node, particles from ranks in ascending order]
+    bool receiveOverlapsSource = !fitHead && !fitTail;
+    std::array<char*, numArrays> receiveArrays{reinterpret_cast<char*>(arrays + receiveStart)...};
+    std::array<char*, numArrays> destinationArrays = receiveArrays;
+    if (receiveOverlapsSource)
+    {
+        for (int i = 0; i < numArrays; ++i)
+        {
+            destinationArrays[i] += numParticlesPresent * elementSizes[i];
+        }
+    }
 
-    if (!fitHead && !fitTail && numIncoming > 0 && numParticlesPresent > 0)
+    std::vector<MPI_Request> receiveRequests;
+    receiveRequests.reserve(27);
+    //! @brief receive directly into the final locations in all arrays with a derived datatype
+    auto postReceives = [&]()
     {
-        std::vector<char> tempBuffer(numParticlesPresent * *std::max_element(elementSizes.begin(), elementSizes.end()));
+        LocalIndex offset = 0;
+        for (int rank = 0; rank < numRanks; ++rank)
+        {
+            if (onNode(rank)) { offset += receiveCounts[rank]; }
+        }
+        for (int sourceRank = 0; sourceRank < numRanks; ++sourceRank)
+        {
+            LocalIndex count = receiveCounts[sourceRank];
+            if (count == 0 || onNode(sourceRank)) { continue; }
 
-        auto gatherArray = [bufferPtr = tempBuffer.data(), ordering, &sourceArrays, &destinationArrays, &elementSizes,
-                            rStart = sendList[thisRank].rangeStart(0), count = numParticlesPresent](auto index)
+            std::array<int, numArrays> blockBytes;
+            std::array<MPI_Aint, numArrays> displacements;
+            for (int i = 0; i < numArrays; ++i)
+            {
+                blockBytes[i] = int(count * elementSizes[i]);
+                MPI_Get_address(destinationArrays[i] + offset * elementSizes[i], &displacements[i]);
+            }
+
+            MPI_Datatype receiveType;
+            MPI_Type_create_hindexed(numArrays, blockBytes.data(), displacements.data(), MPI_BYTE, &receiveType);
+            MPI_Type_commit(&receiveType);
+            receiveRequests.push_back(MPI_Request{});
+            MPI_Irecv(MPI_BOTTOM, 1, receiveType, sourceRank, domainExchangeTag, comm, &receiveRequests.back());
+            MPI_Type_free(&receiveType);
+            offset += count;
+        }
+    };
+    // if the received particles do not overwrite any particles to be sent, receives can be posted before sending
+    if (!receiveOverlapsSource) { postReceives(); }
+
+    std::array<char*, numArrays> sourceArrays{reinterpret_cast<char*>(arrays + particleStart)...};
+    auto packParticles =
+        [&sendList, ordering, &sourceArrays, &elementSizes, &indices](int destinationRank, char* sendPtr)
+    {
+        const auto& sends = sendList[destinationRank];
+        size_t sendCount  = sends.totalCount();
+
+        util::array<size_t, numArrays> arrayByteOffsets = sendCount * elementSizes;
+        std::exclusive_scan(arrayByteOffsets.begin(), arrayByteOffsets.end(), arrayByteOffsets.begin(), size_t(0));
+
+        auto gatherArray = [sendPtr, sendCount, ordering, &sourceArrays, &arrayByteOffsets, &elementSizes,
+                            rStart = sends.rangeStart(0)](auto arrayIndex)
         {
-            using ElementType = util::array<float, elementSizes[index] / sizeof(float)>;
-            gather<LocalIndex>({ordering + rStart, count}, reinterpret_cast<ElementType*>(sourceArrays[index]),
+            size_t outputOffset = arrayByteOffsets[arrayIndex];
+            char* bufferPtr     = sendPtr + outputOffset;
+
+            using ElementType = util::array<float, elementSizes[arrayIndex] / sizeof(float)>;
+            static_assert(elementSizes[arrayIndex] % sizeof(float) == 0, "elementSize must be a multiple of float");
+            gather<LocalIndex>({ordering + rStart, sendCount}, reinterpret_cast<ElementType*>(sourceArrays[arrayIndex]),
                                reinterpret_cast<ElementType*>(bufferPtr));
-            std::copy(bufferPtr, bufferPtr + count * elementSizes[index], destinationArrays[index]);
-            destinationArrays[index] += count * elementSizes[index];
         };
         for_each_tuple(gatherArray, indices);
-    }
+    };
 
-    size_t bytesPerParticle = std::accumulate(elementSizes.begin(), elementSizes.end(), size_t(0));
-    std::vector<char> receiveBuffer;
-    while (numParticlesPresent != numParticlesAssigned)
+    // messages to all ranks off the node are packed into a single buffer
+    std::vector<size_t> nodeSendBytes(numRanks, 0);
+    std::vector<size_t> sendOffsets(numRanks + 1, 0);
+    for (int destinationRank = 0; destinationRank < numRanks; ++destinationRank)
     {
-        MPI_Status status;
-        MPI_Probe(MPI_ANY_SOURCE, domainExchangeTag, MPI_COMM_WORLD, &status);
-        int receiveRank = status.MPI_SOURCE;
-        int receiveCountBytes;
-        MPI_Get_count(&status, MPI_CHAR, &receiveCountBytes);
+        size_t sendBytes = size_t(sendCounts[destinationRank]) * bytesPerParticle;
+        if (onNode(destinationRank))
+        {
+            nodeSendBytes[destinationRank] = sendBytes;
+            sendBytes                      = 0;
+        }
+        sendOffsets[destinationRank + 1] = sendOffsets[destinationRank] + sendBytes;
+    }
 
-        size_t receiveCount = receiveCountBytes / bytesPerParticle;
-        assert(numParticlesPresent + receiveCount <= numParticlesAssigned);
+    char* sendBuffer = util::ThreadScratch<char, DomainExchangeSendScratch>::get(sendOffsets.back());
+    std::vector<MPI_Request> sendRequests;
+    sendRequests.reserve(27);
+    for (int destinationRank = 0; destinationRank < numRanks; ++destinationRank)
+    {
+        size_t sendBytes = sendOffsets[destinationRank + 1] - sendOffsets[destinationRank];
+        if (sendBytes == 0) { continue; }
 
-        util::array<size_t, numArrays> arrayByteOffsets = receiveCount * elementSizes;
-        std::exclusive_scan(arrayByteOffsets.begin(), arrayByteOffsets.end(), arrayByteOffsets.begin(), size_t(0));
+        char* sendPtr = sendBuffer + sendOffsets[destinationRank];
+        packParticles(destinationRank, sendPtr);
+        mpiSendAsync(sendPtr, sendBytes, destinationRank, domainExchangeTag, sendRequests, comm);
+        if (transport) { transport->countInterNode(sendBytes); }
+    }
+    // particles to ranks on the same node are packed before the local particles are moved below
+    if (transport) { transport->publish(nodeSendBytes, packParticles); }
 
-        receiveBuffer.resize(receiveCountBytes);
-        mpiRecvSync(receiveBuffer.data(), receiveCountBytes, receiveRank, domainExchangeTag, &status);
+    if (receiveOverlapsSource && numParticlesPresent > 0)
+    {
+        std::vector<char> tempBuffer(numParticlesPresent * *std::max_element(elementSizes.begin(), elementSizes.end()));
 
-        for (int arrayIndex = 0; arrayIndex < numArrays; ++arrayIndex)
+        auto gatherArray = [bufferPtr = tempBuffer.data(), ordering, &sourceArrays, &receiveArrays, &elementSizes,
+                            rStart = sendList[thisRank].rangeStart(0), count = numParticlesPresent](auto index)
         {
-            auto source = receiveBuffer.begin() + arrayByteOffsets[arrayIndex];
-            std::copy(source, source + receiveCount * elementSizes[arrayIndex], destinationArrays[arrayIndex]);
-            destinationArrays[arrayIndex] += receiveCount * elementSizes[arrayIndex];
-        }
+            using ElementType = util::array<float, elementSizes[index] / sizeof(float)>;
+            gather<LocalIndex>({ordering + rStart, count}, reinterpret_cast<ElementType*>(sourceArrays[index]),
+                               reinterpret_cast<ElementType*>(bufferPtr));
+            omp_copy(bufferPtr, bufferPtr + count * elementSizes[index], receiveArrays[index]);
+        };
+        for_each_tuple(gatherArray, indices);
+    }
+    if (receiveOverlapsSource) { postReceives(); }
 
-        numParticlesPresent += receiveCount;
+    if (transport)
+    {
+        transport->receive(
+            [&destinationArrays, &elementSizes, bytesPerParticle](int, const char* buffer, size_t numBytes)
+            {
+                size_t receiveCount = numBytes / bytesPerParticle;
+                for (int arrayIndex = 0; arrayIndex < numArrays; ++arrayIndex)
+                {
+                    size_t arrayBytes = receiveCount * elementSizes[arrayIndex];
+                    omp_copy(buffer, buffer + arrayBytes, destinationArrays[arrayIndex]);
+                    destinationArrays[arrayIndex] += arrayBytes;
+                    buffer += arrayBytes;
+                }
+            });
     }
 
+    if (not receiveRequests.empty())
+    {
+        MPI_Waitall(int(receiveRequests.size()), receiveRequests.data(), MPI_STATUSES_IGNORE);
+    }
     if (not sendRequests.empty())
     {
-        MPI_Status status[sendRequests.size()];
-        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), status);
+        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUSES_IGNORE);
     }
 
     return {newParticleStart, newParticleEnd};
+}
+
+} // namespace detail
 
-    // If this process is going to send messages with rank/tag combinations
-    // already sent in this function, this can lead to messages being mixed up
-    // on the receiver side. This happens e.g. with repeated consecutive calls of
-    // this function.
+//! @brief exchange particles with point-to-point messages, see detail::exchangeParticles
+template<class... Arrays>
+std::tuple<LocalIndex, LocalIndex> exchangeParticles(const SendList& sendList,
+                                                     int thisRank,
+                                                     LocalIndex particleStart,
+                                                     LocalIndex particleEnd,
+                                                     LocalIndex arraySize,
+                                                     LocalIndex numParticlesAssigned,
+                                                     const LocalIndex* ordering,
+                                                     Arrays... arrays)
+{
+    return detail::exchangeParticles(MPI_COMM_WORLD, nullptr, sendList, thisRank, particleStart, particleEnd,
+                                     arraySize, numParticlesAssigned, ordering, arrays...);
+}
 
-    // MUST call MPI_Barrier or any other collective MPI operation that enforces synchronization
-    // across all ranks before calling this function again.
-    // MPI_Barrier(MPI_COMM_WORLD);
+/*! @brief exchange particles, through shared memory with ranks on the same node and point-to-point messages otherwise
+ *
+ * Ranks are numbered in transport.comm(). Collective on transport.comm().
+ */
+template<class... Arrays>
+std::tuple<LocalIndex, LocalIndex> exchangeParticles(NodeTransport& transport,
+                                                     const SendList& sendList,
+                                                     int thisRank,
+                                                     LocalIndex particleStart,
+                                                     LocalIndex particleEnd,
+                                                     LocalIndex arraySize,
+                                                     LocalIndex numParticlesAssigned,
+                                                     const LocalIndex* ordering,
+                                                     Arrays... arrays)
+{
+    transport.setup();
+    return detail::exchangeParticles(transport.comm(), &transport, sendList, thisRank, particleStart, particleEnd,
+                                     arraySize, numParticlesAssigned, ordering, arrays...);
 }
 
 } // namespace cstone
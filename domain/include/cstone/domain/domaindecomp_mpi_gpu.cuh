@@ -58,6 +58,7 @@ char* decodeSendCount(char* recvPtr, size_t* count, size_t alignment)
 /*! @brief exchange array elements with other ranks according to the specified ranges
  *
  * @tparam Arrays                  pointers to particles buffers
+ * @param[in] comm                 communicator in which the ranks of @p sendList and @p thisRank are numbered
  * @param[in] sendList             List of index ranges to be sent to each rank, indices
  *                                 are valid w.r.t to arrays present on @p thisRank relative to @p particleStart.
  * @param[in] thisRank             Rank of the executing process
@@ -85,7 +86,8 @@ char* decodeSendCount(char* recvPtr, size_t* count, size_t alignment)
  *           already present on @p thisRank.
  */
 template<class DeviceVector, class... Arrays>
-std::tuple<LocalIndex, LocalIndex> exchangeParticlesGpu(const SendList& sendList,
+std::tuple<LocalIndex, LocalIndex> exchangeParticlesGpu(MPI_Comm comm,
+                                                        const SendList& sendList,
                                                         int thisRank,
                                                         LocalIndex particleStart,
                                                         LocalIndex particleEnd,
@@ -133,7 +135,7 @@ std::tuple<LocalIndex, LocalIndex> exchangeParticlesGpu(const SendList& sendList
         checkGpuErrors(cudaDeviceSynchronize());
 
         mpiSendGpuDirect(sendPtr, alignment + byteOffsets.back(), destinationRank, domainExchangeTag, sendRequests,
-                         sendBuffers);
+                         sendBuffers, comm);
         sendPtr += alignment + byteOffsets.back();
     }
 
@@ -188,14 +190,14 @@ std::tuple<LocalIndex, LocalIndex> exchangeParticlesGpu(const SendList& sendList
     while (numParticlesPresent != numParticlesAssigned)
     {
         MPI_Status status;
-        MPI_Probe(MPI_ANY_SOURCE, domainExchangeTag, MPI_COMM_WORLD, &status);
+        MPI_Probe(MPI_ANY_SOURCE, domainExchangeTag, comm, &status);
         int receiveRank = status.MPI_SOURCE;
         int receiveCountBytes;
         MPI_Get_count(&status, MPI_CHAR, &receiveCountBytes);
 
         reallocateBytes(receiveScratchBuffer, receiveCountBytes);
         char* receiveBuffer = reinterpret_cast<char*>(rawPtr(receiveScratchBuffer));
-        mpiRecvGpuDirect(receiveBuffer, receiveCountBytes, receiveRank, domainExchangeTag, &status);
+        mpiRecvGpuDirect(receiveBuffer, receiveCountBytes, receiveRank, domainExchangeTag, &status, comm);
 
         size_t receiveCount;
         receiveBuffer = decodeSendCount(receiveBuffer, &receiveCount, alignment);
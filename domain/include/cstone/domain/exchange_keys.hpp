@@ -47,6 +47,7 @@ namespace cstone
  *                      are accessed
  * @param peerRanks     list of peer rank IDs
  * @param layout        particle location (index in buffers) of each node in @a treeLeaves
+ * @param comm          communicator of all ranks in the domain
  * @return              a SendList, containing ranges of local particle indices to send out
  *                      to each peer rank in subsequent halo particle exchanges.
  *
@@ -64,7 +65,8 @@ SendList exchangeRequestKeys(gsl::span<const KeyType> treeLeaves,
                              gsl::span<const int> haloFlags,
                              gsl::span<const TreeIndexPair> assignment,
                              gsl::span<const int> peerRanks,
-                             gsl::span<const LocalIndex> layout)
+                             gsl::span<const LocalIndex> layout,
+                             MPI_Comm comm = MPI_COMM_WORLD)
 {
     std::vector<std::vector<KeyType>> sendBuffers;
     sendBuffers.reserve(peerRanks.size());
@@ -77,7 +79,7 @@ SendList exchangeRequestKeys(gsl::span<const KeyType> treeLeaves,
     {
         auto requestKeys =
             extractMarkedElements(treeLeaves, haloFlags, assignment[peer].start(), assignment[peer].end());
-        mpiSendAsync(requestKeys.data(), int(requestKeys.size()), peer, haloRequestKeyTag, sendRequests);
+        mpiSendAsync(requestKeys.data(), int(requestKeys.size()), peer, haloRequestKeyTag, sendRequests, comm);
         sendBuffers.push_back(std::move(requestKeys));
     }
 
@@ -89,7 +91,7 @@ SendList exchangeRequestKeys(gsl::span<const KeyType> treeLeaves,
     while (numMessages > 0)
     {
         MPI_Status status;
-        mpiRecvSync(receiveBuffer.data(), receiveBuffer.size(), MPI_ANY_SOURCE, haloRequestKeyTag, &status);
+        mpiRecvSync(receiveBuffer.data(), receiveBuffer.size(), MPI_ANY_SOURCE, haloRequestKeyTag, &status, comm);
         int receiveRank = status.MPI_SOURCE;
         TreeNodeIndex numKeys;
         MPI_Get_count(&status, MpiType<KeyType>{}, &numKeys);
@@ -107,8 +107,8 @@ void exchangeTreelets(gsl::span<const int> peerRanks,
                       gsl::span<const IndexPair<TreeNodeIndex>> focusAssignment,
                       gsl::span<const KeyType> localLeaves,
                       std::vector<std::vector<KeyType>>& peerTrees,
-                      std::vector<MPI_Request>& receiveRequests)
-
+                      std::vector<MPI_Request>& receiveRequests,
+                      MPI_Comm comm = MPI_COMM_WORLD)
 {
     constexpr int keyTag = static_cast<int>(P2pTags::focusPeerCounts);
     size_t numPeers      = peerRanks.size();
@@ -119,7 +119,7 @@ void exchangeTreelets(gsl::span<const int> peerRanks,
     {
         // +1 to include the upper key boundary for the last node
         TreeNodeIndex sendCount = focusAssignment[peer].count() + 1;
-        mpiSendAsync(localLeaves.data() + focusAssignment[peer].start(), sendCount, peer, keyTag, sendRequests);
+        mpiSendAsync(localLeaves.data() + focusAssignment[peer].start(), sendCount, peer, keyTag, sendRequests, comm);
     }
 
     receiveRequests.reserve(numPeers);
@@ -127,13 +127,13 @@ void exchangeTreelets(gsl::span<const int> peerRanks,
     while (numMessages > 0)
     {
         MPI_Status status;
-        MPI_Probe(MPI_ANY_SOURCE, keyTag, MPI_COMM_WORLD, &status);
+        MPI_Probe(MPI_ANY_SOURCE, keyTag, comm, &status);
         int receiveRank = status.MPI_SOURCE;
         TreeNodeIndex receiveSize;
         MPI_Get_count(&status, MpiType<KeyType>{}, &receiveSize);
         peerTrees[receiveRank].resize(receiveSize);
 
-        mpiRecvAsync(peerTrees[receiveRank].data(), receiveSize, receiveRank, keyTag, receiveRequests);
+        mpiRecvAsync(peerTrees[receiveRank].data(), receiveSize, receiveRank, keyTag, receiveRequests, comm);
 
         numMessages--;
     }
@@ -147,7 +147,8 @@ void exchangeTreeletCounts(gsl::span<const int> peerRanks,
                            gsl::span<const IndexPair<TreeNodeIndex>> focusAssignment,
                            gsl::span<const KeyType> localLeaves,
                            gsl::span<unsigned> localCounts,
-                           std::vector<MPI_Request>& treeletRequests)
+                           std::vector<MPI_Request>& treeletRequests,
+                           MPI_Comm comm = MPI_COMM_WORLD)
 {
     size_t numPeers = peerRanks.size();
     std::vector<std::vector<unsigned>> sendBuffers;
@@ -170,7 +171,7 @@ void exchangeTreeletCounts(gsl::span<const int> peerRanks,
         countRequestParticles<KeyType>(localLeaves, localCounts, peerTrees[peer], countBuffer);
 
         // send back answer with the counts for the requested nodes
-        mpiSendAsync(countBuffer.data(), numNodes, peer, countTag, sendRequests);
+        mpiSendAsync(countBuffer.data(), numNodes, peer, countTag, sendRequests, comm);
         sendBuffers.push_back(std::move(countBuffer));
 
         numMessages--;
@@ -180,7 +181,8 @@ void exchangeTreeletCounts(gsl::span<const int> peerRanks,
     for (auto peer : peerRanks)
     {
         TreeNodeIndex receiveCount = focusAssignment[peer].count();
-        mpiRecvAsync(localCounts.data() + focusAssignment[peer].start(), receiveCount, peer, countTag, treeletRequests);
+        mpiRecvAsync(localCounts.data() + focusAssignment[peer].start(), receiveCount, peer, countTag, treeletRequests,
+                     comm);
     }
 
     MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUS_IGNORE);
@@ -194,7 +196,8 @@ void exchangeTreeletGeneral(gsl::span<const int> peerRanks,
                             gsl::span<const TreeNodeIndex> levelRange,
                             gsl::span<const TreeNodeIndex> csToInternalMap,
                             gsl::span<T> quantities,
-                            int commTag)
+                            int commTag,
+                            MPI_Comm comm = MPI_COMM_WORLD)
 {
     size_t numPeers = peerRanks.size();
     std::vector<std::vector<T>> sendBuffers;
@@ -223,7 +226,7 @@ void exchangeTreeletGeneral(gsl::span<const int> peerRanks,
             buffer[i] = quantities[internalIdx];
         }
 
-        mpiSendAsync(buffer.data(), treeletSize, peer, commTag, sendRequests);
+        mpiSendAsync(buffer.data(), treeletSize, peer, commTag, sendRequests, comm);
         sendBuffers.push_back(std::move(buffer));
     }
 
@@ -232,7 +235,7 @@ void exchangeTreeletGeneral(gsl::span<const int> peerRanks,
     {
         TreeNodeIndex receiveCount = focusAssignment[peer].count();
         buffer.resize(receiveCount);
-        mpiRecvSync(buffer.data(), receiveCount, peer, commTag, MPI_STATUS_IGNORE);
+        mpiRecvSync(buffer.data(), receiveCount, peer, commTag, MPI_STATUS_IGNORE, comm);
 
         auto mapToInternal = csToInternalMap.subspan(focusAssignment[peer].start(), receiveCount);
         scatter(mapToInternal, buffer.data(), quantities.data());
@@ -241,6 +244,94 @@ void exchangeTreeletGeneral(gsl::span<const int> peerRanks,
     MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUS_IGNORE);
 }
 
+/*! @brief exchange only the changed quantities of treelet nodes with peer ranks
+ *
+ * @param[in]    changed   length = numTreeNodes, non-zero for internal nodes whose quantities need to be sent
+ * @param[in]    sendAll   length = numRanks, if non-zero, all treelet nodes of the rank are sent
+ * @param[inout] quantities internal node quantities, entries of peer cells that are not received remain untouched
+ *
+ * Same communication pattern as exchangeTreeletGeneral, except that each peer receives the indices of the sent
+ * treelet nodes on @p commTag and the corresponding quantities on @p commTag + 1. The receiver is responsible for
+ * keeping the values of all unsent entries valid, i.e. equal to the last received values.
+ */
+template<class T, class KeyType>
+void exchangeTreeletChanged(gsl::span<const int> peerRanks,
+                            const std::vector<std::vector<KeyType>>& peerTrees,
+                            gsl::span<const IndexPair<TreeNodeIndex>> focusAssignment,
+                            gsl::span<const KeyType> octree,
+                            gsl::span<const TreeNodeIndex> levelRange,
+                            gsl::span<const TreeNodeIndex> csToInternalMap,
+                            gsl::span<const char> changed,
+                            gsl::span<const char> sendAll,
+                            gsl::span<T> quantities,
+                            int commTag,
+                            MPI_Comm comm = MPI_COMM_WORLD)
+{
+    size_t numPeers = peerRanks.size();
+    std::vector<std::vector<TreeNodeIndex>> sendIndices;
+    std::vector<std::vector<T>> sendBuffers;
+    sendIndices.reserve(numPeers);
+    sendBuffers.reserve(numPeers);
+
+    std::vector<MPI_Request> sendRequests;
+    sendRequests.reserve(2 * numPeers);
+    for (auto peer : peerRanks)
+    {
+        TreeNodeIndex treeletSize = nNodes(peerTrees[peer]);
+        gsl::span<const KeyType> treelet(peerTrees[peer]);
+        std::vector<TreeNodeIndex> indices;
+        std::vector<T> buffer;
+
+        for (TreeNodeIndex i = 0; i < treeletSize; ++i)
+        {
+            KeyType nodeStart = treelet[i];
+            KeyType nodeEnd   = treelet[i + 1];
+            unsigned level    = treeLevel(nodeEnd - nodeStart);
+            KeyType prefix    = encodePlaceholderBit(nodeStart, 3 * level);
+
+            TreeNodeIndex internalIdx =
+                stl::lower_bound(octree.data() + levelRange[level], octree.data() + levelRange[level + 1], prefix) -
+                octree.data();
+            assert(prefix == octree[internalIdx]);
+
+            if (sendAll[peer] || changed[internalIdx])
+            {
+                indices.push_back(i);
+                buffer.push_back(quantities[internalIdx]);
+            }
+        }
+
+        mpiSendAsync(indices.data(), int(indices.size()), peer, commTag, sendRequests, comm);
+        mpiSendAsync(buffer.data(), int(buffer.size()), peer, commTag + 1, sendRequests, comm);
+        sendIndices.push_back(std::move(indices));
+        sendBuffers.push_back(std::move(buffer));
+    }
+
+    std::vector<TreeNodeIndex> indices;
+    std::vector<T> buffer;
+    for (auto peer : peerRanks)
+    {
+        MPI_Status status;
+        MPI_Probe(peer, commTag, comm, &status);
+        int receiveCount;
+        MPI_Get_count(&status, MpiType<TreeNodeIndex>{}, &receiveCount);
+        assert(receiveCount <= focusAssignment[peer].count());
+
+        indices.resize(receiveCount);
+        buffer.resize(receiveCount);
+        mpiRecvSync(indices.data(), receiveCount, peer, commTag, MPI_STATUS_IGNORE, comm);
+        mpiRecvSync(buffer.data(), receiveCount, peer, commTag + 1, MPI_STATUS_IGNORE, comm);
+
+        auto mapToInternal = csToInternalMap.subspan(focusAssignment[peer].start(), focusAssignment[peer].count());
+        for (int i = 0; i < receiveCount; ++i)
+        {
+            quantities[mapToInternal[indices[i]]] = buffer[i];
+        }
+    }
+
+    MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUS_IGNORE);
+}
+
 /*! @brief exchange particle counts with specified peer ranks
  *
  * @tparam KeyType                  32- or 64-bit unsigned integer
@@ -251,6 +342,7 @@ void exchangeTreeletGeneral(gsl::span<const int> peerRanks,
  *                                  of the executing rank
  * @param[out] localCounts          particle counts associated with @p localLeaves
  *                                  length(localCounts) = length(localLeaves) - 1
+ * @param[in]  comm                 communicator of all ranks in the domain
  *
  * Procedure on each rank:
  *  1. Send out the SFC keys for which it wants to get particle counts to peer ranks
@@ -261,14 +353,14 @@ template<class KeyType>
 void exchangePeerCounts(gsl::span<const int> peerRanks,
                         gsl::span<const IndexPair<TreeNodeIndex>> exchangeIndices,
                         gsl::span<const KeyType> localLeaves,
-                        gsl::span<unsigned> localCounts)
-
+                        gsl::span<unsigned> localCounts,
+                        MPI_Comm comm = MPI_COMM_WORLD)
 {
     std::vector<std::vector<KeyType>> treelets(exchangeIndices.size());
     std::vector<MPI_Request> treeletRequests;
 
-    exchangeTreelets(peerRanks, exchangeIndices, localLeaves, treelets, treeletRequests);
-    exchangeTreeletCounts(peerRanks, treelets, exchangeIndices, localLeaves, localCounts, treeletRequests);
+    exchangeTreelets(peerRanks, exchangeIndices, localLeaves, treelets, treeletRequests, comm);
+    exchangeTreeletCounts(peerRanks, treelets, exchangeIndices, localLeaves, localCounts, treeletRequests, comm);
 
     MPI_Waitall(int(peerRanks.size()), treeletRequests.data(), MPI_STATUS_IGNORE);
 
@@ -288,6 +380,7 @@ void exchangePeerCounts(gsl::span<const int> peerRanks,
  * @param[in]    newFocusEnd
  * @param[inout] buffer         cell keys of parts of a remote rank's @p cstree for the newly assigned area of @p myRank
  *                              will be appended to this
+ * @param[in]    comm           communicator of all ranks in the domain
  *
  * When the assignment boundaries change, we let the previous owning rank pass on its focus tree of the part that it
  * lost to the new owning rank. Thanks to doing so we can guarantee that each rank always has the highest focus
@@ -303,7 +396,8 @@ void focusTransfer(gsl::span<const KeyType> cstree,
                    KeyType oldFocusEnd,
                    KeyType newFocusStart,
                    KeyType newFocusEnd,
-                   std::vector<KeyType>& buffer)
+                   std::vector<KeyType>& buffer,
+                   MPI_Comm comm = MPI_COMM_WORLD)
 {
     constexpr int ownerTag = static_cast<int>(P2pTags::focusTransfer);
 
@@ -320,7 +414,7 @@ void focusTransfer(gsl::span<const KeyType> cstree,
         auto treelet    = updateTreelet(gsl::span<const KeyType>(cstree.data() + start, numNodes + 1),
                                         gsl::span<const unsigned>(counts.data() + start, numNodes), bucketSize);
 
-        mpiSendAsync(treelet.data(), int(treelet.size() - 1), myRank - 1, ownerTag, sendRequests);
+        mpiSendAsync(treelet.data(), int(treelet.size() - 1), myRank - 1, ownerTag, sendRequests, comm);
         sendBuffers.push_back(std::move(treelet));
     }
 
@@ -334,7 +428,7 @@ void focusTransfer(gsl::span<const KeyType> cstree,
         auto treelet    = updateTreelet(gsl::span<const KeyType>(cstree.data() + start, numNodes + 1),
                                         gsl::span<const unsigned>(counts.data() + start, numNodes), bucketSize);
 
-        mpiSendAsync(treelet.data(), int(treelet.size() - 1), myRank + 1, ownerTag, sendRequests);
+        mpiSendAsync(treelet.data(), int(treelet.size() - 1), myRank + 1, ownerTag, sendRequests, comm);
         sendBuffers.push_back(std::move(treelet));
     }
 
@@ -342,24 +436,25 @@ void focusTransfer(gsl::span<const KeyType> cstree,
     {
         // current rank gained range [newFocusStart : oldFocusStart] from rank below
         MPI_Status status;
-        MPI_Probe(myRank - 1, ownerTag, MPI_COMM_WORLD, &status);
+        MPI_Probe(myRank - 1, ownerTag, comm, &status);
         TreeNodeIndex receiveSize;
         MPI_Get_count(&status, MpiType<KeyType>{}, &receiveSize);
 
         buffer.resize(buffer.size() + receiveSize);
-        mpiRecvSync(buffer.data() + buffer.size() - receiveSize, receiveSize, myRank - 1, ownerTag, &status);
+        mpiRecvSync(buffer.data() + buffer.size() - receiveSize, receiveSize, myRank - 1, ownerTag, &status, comm);
     }
 
     if (oldFocusEnd < newFocusEnd)
     {
         // current rank gained range [oldFocusEnd : newFocusEnd] from rank above
         MPI_Status status;
-        MPI_Probe(myRank + 1, ownerTag, MPI_COMM_WORLD, &status);
+        MPI_Probe(myRank + 1, ownerTag, comm, &status);
         TreeNodeIndex receiveSize;
         MPI_Get_count(&status, MpiType<KeyType>{}, &receiveSize);
 
         buffer.resize(buffer.size() + receiveSize);
-        mpiRecvSync(buffer.data() + buffer.size() - receiveSize, receiveSize, myRank + 1, ownerTag, MPI_STATUS_IGNORE);
+        mpiRecvSync(buffer.data() + buffer.size() - receiveSize, receiveSize, myRank + 1, ownerTag, MPI_STATUS_IGNORE,
+                    comm);
     }
 
     MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUS_IGNORE);
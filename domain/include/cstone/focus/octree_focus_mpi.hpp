@@ -58,10 +58,12 @@ public:
      *                      In a converged FocusedOctree, each node outside the focus area
      *                      passes the min-distance MAC with theta as the parameter w.r.t
      *                      to any point inside the focus area.
+     * @param comm          communicator of all ranks in the domain
      */
-    FocusedOctree(int myRank, int numRanks, unsigned bucketSize, float theta)
+    FocusedOctree(int myRank, int numRanks, unsigned bucketSize, float theta, MPI_Comm comm = MPI_COMM_WORLD)
         : myRank_(myRank)
         , numRanks_(numRanks)
+        , comm_(comm)
         , theta_(theta)
         , bucketSize_(bucketSize)
         , treelets_(numRanks_)
@@ -109,7 +111,7 @@ public:
         enforcedKeys.reserve(peers_.size() * 2);
 
         focusTransfer(treeLeaves(), leafCounts(), bucketSize_, myRank_, prevFocusStart, prevFocusEnd, focusStart,
-                      focusEnd, enforcedKeys);
+                      focusEnd, enforcedKeys, comm_);
         for (int peer : peers_)
         {
             enforcedKeys.push_back(globalTreeLeaves[assignment.firstNodeIdx(peer)]);
@@ -178,8 +180,8 @@ public:
 
         // counts from neighboring peers
         std::vector<MPI_Request> treeletRequests;
-        exchangeTreelets(peers_, assignment_, leaves, treelets_, treeletRequests);
-        exchangeTreeletCounts(peers_, treelets_, assignment_, leaves, leafCounts_, treeletRequests);
+        exchangeTreelets(peers_, assignment_, leaves, treelets_, treeletRequests, comm_);
+        exchangeTreeletCounts(peers_, treelets_, assignment_, leaves, leafCounts_, treeletRequests, comm_);
         MPI_Waitall(int(peers_.size()), treeletRequests.data(), MPI_STATUS_IGNORE);
 
         // global counts
@@ -208,7 +210,24 @@ public:
     void peerExchange(gsl::span<T> quantities, int commTag) const
     {
         exchangeTreeletGeneral<T>(peers_, treelets_, assignment_, tree_.nodeKeys(), tree_.levelRange(),
-                                  tree_.internalOrder(), quantities, commTag);
+                                  tree_.internalOrder(), quantities, commTag, comm_);
+    }
+
+    /*! @brief like peerExchange, but only send the quantities of cells flagged in @p changed
+     *
+     * @param[inout] quantities  internal node quantities, peer cells that are not received keep their values
+     * @param[in]    changed     length = numTreeNodes, non-zero for cells whose quantities changed since the last call
+     * @param[in]    sendAll     length = numRanks, non-zero for ranks that need all of their treelet cells
+     * @param[in]    commTag     MPI tag, commTag and commTag + 1 are used
+     */
+    template<class T>
+    void peerExchangeChanged(gsl::span<T> quantities,
+                             gsl::span<const char> changed,
+                             gsl::span<const char> sendAll,
+                             int commTag) const
+    {
+        exchangeTreeletChanged<T>(peers_, treelets_, assignment_, tree_.nodeKeys(), tree_.levelRange(),
+                                  tree_.internalOrder(), changed, sendAll, quantities, commTag, comm_);
     }
 
     /*! @brief transfer quantities of leaf cells inside the focus into a global array
@@ -337,7 +356,7 @@ public:
         //! global exchange for the top nodes that are bigger than local domains
         std::vector<SourceCenterType<T>> globalLeafCenters(globalTree.numLeafNodes());
         populateGlobal<SourceCenterType<T>>(globalTree.treeLeaves(), centers_, globalLeafCenters);
-        mpiAllreduce(MPI_IN_PLACE, globalLeafCenters.data(), globalLeafCenters.size(), MPI_SUM);
+        mpiAllreduce(MPI_IN_PLACE, globalLeafCenters.data(), globalLeafCenters.size(), MPI_SUM, comm_);
         scatter(globalTree.internalOrder(), globalLeafCenters.data(), globalCenters_.data());
         upsweep(globalTree.levelRange(), globalTree.childOffsets(), globalCenters_.data(), CombineSourceCenter<T>{});
         extractGlobal<SourceCenterType<T>>(globalTree, globalCenters_, centers_);
@@ -411,16 +430,49 @@ public:
             converged = updateTree(peers, assignment, globalTreeLeaves);
             updateCounts(particleKeys, globalTreeLeaves, globalCounts, scratch);
             updateMinMac(box, assignment, globalTreeLeaves, invThetaEff);
-            MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, comm_);
+        }
+    }
+
+    /*! @brief set the tree structure and rebalance criteria, e.g. from a previous run
+     *
+     * @param[in] leaves      cornerstone leaf keys of a focus tree of the executing rank
+     * @param[in] leafCounts  particle counts per leaf, length nNodes(leaves)
+     * @param[in] macs        MAC status of each node of the tree in the internal order, see macs()
+     *
+     * The next call to updateTree() continues from the provided state instead of the root node.
+     */
+    void setTree(gsl::span<const KeyType> leaves, gsl::span<const unsigned> leafCounts, gsl::span<const char> macs)
+    {
+        if (nNodes(leaves) < 1 || size_t(nNodes(leaves)) != leafCounts.size() || leaves.front() != 0 ||
+            leaves.back() != nodeRange<KeyType>(0))
+        {
+            throw std::runtime_error("Invalid focus tree provided\n");
+        }
+        tree_.update(leaves.data(), nNodes(leaves));
+        if (size_t(tree_.numTreeNodes()) != macs.size())
+        {
+            throw std::runtime_error("Number of MACs does not match the provided focus tree\n");
         }
+
+        leafCounts_.assign(leafCounts.begin(), leafCounts.end());
+        counts_.resize(tree_.numTreeNodes());
+        scatter(tree_.internalOrder(), leafCounts_.data(), counts_.data());
+        upsweep(tree_.levelRange(), tree_.childOffsets(), counts_.data(), SumCombination<unsigned>{});
+        macs_.assign(macs.begin(), macs.end());
+        rebalanceStatus_ = valid;
     }
 
     //! @brief the fully linked traversable octree
     const Octree<KeyType>& octree() const { return tree_; }
+    //! @brief communicator of all ranks in the domain
+    MPI_Comm comm() const { return comm_; }
     //! @brief the cornerstone leaf cell array
     gsl::span<const KeyType> treeLeaves() const { return tree_.treeLeaves(); }
     //! @brief the assignment of the focus tree leaves to peer ranks
     gsl::span<const TreeIndexPair> assignment() const { return assignment_; }
+    //! @brief the tree structures that the peers have for the domain of the executing rank, one entry per rank
+    const std::vector<std::vector<KeyType>>& treelets() const { return treelets_; }
     //! @brief Expansion (com) centers of each cell
     gsl::span<const SourceCenterType<RealType>> expansionCenters() const { return centers_; }
     //! @brief Expansion (com) centers of each global cell
@@ -455,6 +507,8 @@ private:
     int myRank_;
     //! @brief the total number of ranks
     int numRanks_;
+    //! @brief communicator of all ranks in the domain
+    MPI_Comm comm_;
     //! @brief opening angle refinement criterion
     float theta_;
     //! @brief bucket size (ncrit) inside the focus are
@@ -527,7 +581,7 @@ void globalFocusExchange(const Octree<KeyType>& globalOctree,
     focusTree.template populateGlobal<Q>(globalOctree.treeLeaves(), quantities, globalLeafQuantities);
 
     //! exchange global leaves
-    mpiAllreduce(MPI_IN_PLACE, globalLeafQuantities.data(), numGlobalLeaves, MPI_SUM);
+    mpiAllreduce(MPI_IN_PLACE, globalLeafQuantities.data(), numGlobalLeaves, MPI_SUM, focusTree.comm());
 
     std::vector<Q> globalQuantities(globalOctree.numTreeNodes());
     scatter(globalOctree.internalOrder(), globalLeafQuantities.data(), globalQuantities.data());
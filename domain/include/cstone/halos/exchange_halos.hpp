@@ -24,30 +24,241 @@
  */
 
 /*! @file
- * @brief  Halo particle exchange with MPI point-to-point communication
+ * @brief  Halo particle exchange with MPI point-to-point communication and shared memory within nodes
  *
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
 #include <numeric>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/primitives/node_transport.hpp"
 #include "cstone/domain/index_ranges.hpp"
+#include "cstone/util/util.hpp"
 
 namespace cstone
 {
 
+/*! @brief precision of the halo values sent in one halo exchange
+ *
+ * Coordinates and smoothing lengths are exchanged during Domain::sync and are always exact. Derived fields that are
+ * only used as kernel inputs can be sent in a reduced format: float32 halves the bytes of a double field, scaled16
+ * maps the values of each message and field linearly to 16-bit integers between their minimum and maximum. Only
+ * double arrays are reduced, arrays of other types are always sent exactly.
+ */
+struct HaloPrecision
+{
+    enum Format : int
+    {
+        exact    = 0,
+        float32  = 1,
+        scaled16 = 2,
+    };
+
+    Format format{exact};
+    //! @brief bit i selects array i of an exchange for the reduced format
+    uint64_t arrays{~uint64_t(0)};
+
+    //! @brief reduce only the arrays at positions @p indices of an exchange
+    static HaloPrecision select(Format format, std::initializer_list<int> indices)
+    {
+        uint64_t mask = 0;
+        for (int i : indices)
+        {
+            mask |= uint64_t(1) << i;
+        }
+        return {format, mask};
+    }
+
+    //! @brief the format of array @p i of an exchange with element type T
+    template<class T>
+    Format arrayFormat(int i) const
+    {
+        return std::is_same_v<T, double> && (arrays >> i & 1) ? format : exact;
+    }
+};
+
+namespace detail
+{
+
+//! @brief bytes of @p count elements of type T in @p format
+template<class T>
+size_t haloWireBytes(size_t count, HaloPrecision::Format format)
+{
+    if (format == HaloPrecision::float32) { return count * sizeof(float); }
+    if (format == HaloPrecision::scaled16) { return 2 * sizeof(double) + count * sizeof(uint16_t); }
+    return count * sizeof(T);
+}
+
+/*! @brief copy the elements of @p src in @p ranges into @p buffer in @p format
+ *
+ * @return the number of bytes written, equals haloWireBytes(ranges.totalCount(), format)
+ *
+ * Arrays of different types are packed back to back, @p buffer may therefore be unaligned.
+ */
+template<class T>
+size_t packHaloArray(const SendManifest& ranges, const T* src, HaloPrecision::Format format, char* buffer)
+{
+    char* out = buffer;
+    if (format == HaloPrecision::exact)
+    {
+        for (size_t r = 0; r < ranges.nRanges(); ++r)
+        {
+            out = std::copy(reinterpret_cast<const char*>(src + ranges.rangeStart(r)),
+                            reinterpret_cast<const char*>(src + ranges.rangeEnd(r)), out);
+        }
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        auto store = [&out](auto value)
+        {
+            std::memcpy(out, &value, sizeof(value));
+            out += sizeof(value);
+        };
+
+        if (format == HaloPrecision::float32)
+        {
+            for (size_t r = 0; r < ranges.nRanges(); ++r)
+            {
+                for (size_t i = ranges.rangeStart(r); i < ranges.rangeEnd(r); ++i)
+                {
+                    store(float(src[i]));
+                }
+            }
+        }
+        else
+        {
+            double minValue = std::numeric_limits<double>::max(), maxValue = std::numeric_limits<double>::lowest();
+            for (size_t r = 0; r < ranges.nRanges(); ++r)
+            {
+                auto [lo, hi] = std::minmax_element(src + ranges.rangeStart(r), src + ranges.rangeEnd(r));
+                minValue      = std::min(minValue, double(*lo));
+                maxValue      = std::max(maxValue, double(*hi));
+            }
+            double scale = maxValue > minValue ? (maxValue - minValue) / 65535.0 : 1.0;
+
+            store(minValue);
+            store(scale);
+            for (size_t r = 0; r < ranges.nRanges(); ++r)
+            {
+                for (size_t i = ranges.rangeStart(r); i < ranges.rangeEnd(r); ++i)
+                {
+                    store(uint16_t(std::lround((src[i] - minValue) / scale)));
+                }
+            }
+        }
+    }
+    return out - buffer;
+}
+
+//! @brief inverse of packHaloArray, widens reduced formats back to T, returns the number of bytes read
+template<class T>
+size_t unpackHaloArray(const SendManifest& ranges, T* dest, HaloPrecision::Format format, const char* buffer)
+{
+    const char* in = buffer;
+    if (format == HaloPrecision::exact)
+    {
+        for (size_t r = 0; r < ranges.nRanges(); ++r)
+        {
+            size_t numBytes = ranges.count(r) * sizeof(T);
+            std::copy(in, in + numBytes, reinterpret_cast<char*>(dest + ranges.rangeStart(r)));
+            in += numBytes;
+        }
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        auto load = [&in](auto& value)
+        {
+            std::memcpy(&value, in, sizeof(value));
+            in += sizeof(value);
+        };
+
+        if (format == HaloPrecision::float32)
+        {
+            float value;
+            for (size_t r = 0; r < ranges.nRanges(); ++r)
+            {
+                for (size_t i = ranges.rangeStart(r); i < ranges.rangeEnd(r); ++i)
+                {
+                    load(value);
+                    dest[i] = value;
+                }
+            }
+        }
+        else
+        {
+            double   minValue, scale;
+            uint16_t value;
+            load(minValue);
+            load(scale);
+            for (size_t r = 0; r < ranges.nRanges(); ++r)
+            {
+                for (size_t i = ranges.rangeStart(r); i < ranges.rangeEnd(r); ++i)
+                {
+                    load(value);
+                    dest[i] = T(minValue + value * scale);
+                }
+            }
+        }
+    }
+    return in - buffer;
+}
+
 template<class... Arrays>
-void haloexchange(int epoch, const SendList& incomingHalos, const SendList& outgoingHalos, Arrays... arrays)
+void haloexchange(MPI_Comm comm,
+                  NodeTransport* transport,
+                  int epoch,
+                  HaloPrecision precision,
+                  const SendList& incomingHalos,
+                  const SendList& outgoingHalos,
+                  Arrays... arrays)
 {
-    using IndexType         = SendManifest::IndexType;
     constexpr int numArrays = sizeof...(Arrays);
-    constexpr util::array<size_t, numArrays> elementSizes{sizeof(std::decay_t<decltype(*arrays)>)...};
+    constexpr auto indices  = makeIntegralTuple(std::make_index_sequence<numArrays>{});
+
+    std::tuple<Arrays...> data{arrays...};
+    std::array<HaloPrecision::Format, numArrays> formats;
+    for_each_tuple(
+        [&precision, &formats](auto i)
+        { formats[i] = precision.arrayFormat<std::decay_t<decltype(*std::get<i>(data))>>(i); },
+        indices);
+
+    auto onNode = [transport](int rank) { return transport && transport->onNode(rank); };
+
+    auto messageBytes = [&formats, &data, &indices](size_t count)
+    {
+        size_t bytes = 0;
+        for_each_tuple(
+            [&](auto i)
+            { bytes += haloWireBytes<std::decay_t<decltype(*std::get<i>(data))>>(count, formats[i]); },
+            indices);
+        return bytes;
+    };
+
+    auto packHalos = [&outgoingHalos, &formats, &data, &indices](int destinationRank, char* buffer)
+    {
+        for_each_tuple([&](auto i)
+                       { buffer += packHaloArray(outgoingHalos[destinationRank], std::get<i>(data), formats[i], buffer); },
+                       indices);
+    };
 
-    std::array<char*, numArrays> data{reinterpret_cast<char*>(arrays)...};
+    auto unpackHalos = [&incomingHalos, &formats, &data, &indices](int receiveRank, const char* buffer)
+    {
+        for_each_tuple([&](auto i)
+                       { buffer += unpackHaloArray(incomingHalos[receiveRank], std::get<i>(data), formats[i], buffer); },
+                       indices);
+    };
 
     std::vector<std::vector<char>> sendBuffers;
     std::vector<MPI_Request> sendRequests;
@@ -57,66 +268,45 @@ void haloexchange(int epoch, const SendList& incomingHalos, const SendList& outg
     for (std::size_t destinationRank = 0; destinationRank < outgoingHalos.size(); ++destinationRank)
     {
         size_t sendCount = outgoingHalos[destinationRank].totalCount();
-        if (sendCount == 0) continue;
-
-        util::array<size_t, numArrays> arrayByteOffsets = sendCount * elementSizes;
-        size_t totalBytes = std::accumulate(arrayByteOffsets.begin(), arrayByteOffsets.end(), size_t(0));
-        std::exclusive_scan(arrayByteOffsets.begin(), arrayByteOffsets.end(), arrayByteOffsets.begin(), size_t(0));
+        if (sendCount == 0 || onNode(destinationRank)) continue;
 
+        size_t totalBytes = messageBytes(sendCount);
         std::vector<char> buffer(totalBytes);
-        for (int arrayIndex = 0; arrayIndex < numArrays; ++arrayIndex)
-        {
-            size_t outputOffset = arrayByteOffsets[arrayIndex];
-            for (std::size_t rangeIdx = 0; rangeIdx < outgoingHalos[destinationRank].nRanges(); ++rangeIdx)
-            {
-                size_t lowerIndex = outgoingHalos[destinationRank].rangeStart(rangeIdx) * elementSizes[arrayIndex];
-                size_t upperIndex = outgoingHalos[destinationRank].rangeEnd(rangeIdx) * elementSizes[arrayIndex];
-
-                std::copy(data[arrayIndex] + lowerIndex, data[arrayIndex] + upperIndex, buffer.data() + outputOffset);
-                outputOffset += upperIndex - lowerIndex;
-            }
-        }
+        packHalos(destinationRank, buffer.data());
 
-        mpiSendAsync(buffer.data(), totalBytes, destinationRank, haloExchangeTag, sendRequests);
+        mpiSendAsync(buffer.data(), totalBytes, destinationRank, haloExchangeTag, sendRequests, comm);
         sendBuffers.push_back(std::move(buffer));
+        if (transport) { transport->countInterNode(totalBytes); }
+    }
+
+    if (transport)
+    {
+        std::vector<size_t> sendBytes(outgoingHalos.size());
+        for (std::size_t rank = 0; rank < outgoingHalos.size(); ++rank)
+        {
+            size_t sendCount = outgoingHalos[rank].totalCount();
+            sendBytes[rank]  = sendCount ? messageBytes(sendCount) : 0;
+        }
+        transport->exchange(sendBytes, packHalos,
+                            [&unpackHalos](int sourceRank, const char* src, size_t) { unpackHalos(sourceRank, src); });
     }
 
     int numMessages            = 0;
     std::size_t maxReceiveSize = 0;
     for (std::size_t sourceRank = 0; sourceRank < incomingHalos.size(); ++sourceRank)
-        if (incomingHalos[sourceRank].totalCount() > 0)
+        if (incomingHalos[sourceRank].totalCount() > 0 && !onNode(sourceRank))
         {
             numMessages++;
             maxReceiveSize = std::max(maxReceiveSize, incomingHalos[sourceRank].totalCount());
         }
 
-    size_t bytesPerParticle = std::accumulate(elementSizes.begin(), elementSizes.end(), size_t(0));
-    std::vector<char> receiveBuffer(maxReceiveSize * bytesPerParticle);
+    std::vector<char> receiveBuffer(messageBytes(maxReceiveSize));
 
     while (numMessages > 0)
     {
         MPI_Status status;
-        mpiRecvSync(receiveBuffer.data(), receiveBuffer.size(), MPI_ANY_SOURCE, haloExchangeTag, &status);
-        int receiveRank     = status.MPI_SOURCE;
-        size_t receiveCount = incomingHalos[receiveRank].totalCount();
-
-        util::array<size_t, numArrays> arrayByteOffsets = receiveCount * elementSizes;
-        std::exclusive_scan(arrayByteOffsets.begin(), arrayByteOffsets.end(), arrayByteOffsets.begin(), size_t(0));
-
-        for (int arrayIndex = 0; arrayIndex < numArrays; ++arrayIndex)
-        {
-            size_t inputOffset = arrayByteOffsets[arrayIndex];
-            for (std::size_t rangeIdx = 0; rangeIdx < incomingHalos[receiveRank].nRanges(); ++rangeIdx)
-            {
-                IndexType offset  = incomingHalos[receiveRank].rangeStart(rangeIdx) * elementSizes[arrayIndex];
-                size_t countBytes = incomingHalos[receiveRank].count(rangeIdx) * elementSizes[arrayIndex];
-
-                std::copy(receiveBuffer.data() + inputOffset, receiveBuffer.data() + inputOffset + countBytes,
-                          data[arrayIndex] + offset);
-
-                inputOffset += countBytes;
-            }
-        }
+        mpiRecvSync(receiveBuffer.data(), receiveBuffer.size(), MPI_ANY_SOURCE, haloExchangeTag, &status, comm);
+        unpackHalos(status.MPI_SOURCE, receiveBuffer.data());
         numMessages--;
     }
 
@@ -131,4 +321,51 @@ void haloexchange(int epoch, const SendList& incomingHalos, const SendList& outg
     // MPI_Barrier(MPI_COMM_WORLD);
 }
 
+} // namespace detail
+
+//! @brief exchange halos with point-to-point messages
+template<class... Arrays>
+void haloexchange(int epoch, const SendList& incomingHalos, const SendList& outgoingHalos, Arrays... arrays)
+{
+    detail::haloexchange(MPI_COMM_WORLD, nullptr, epoch, HaloPrecision{}, incomingHalos, outgoingHalos, arrays...);
+}
+
+//! @brief exchange halos with point-to-point messages, with the selected arrays sent in reduced precision
+template<class... Arrays>
+void haloexchange(int epoch,
+                  HaloPrecision precision,
+                  const SendList& incomingHalos,
+                  const SendList& outgoingHalos,
+                  Arrays... arrays)
+{
+    detail::haloexchange(MPI_COMM_WORLD, nullptr, epoch, precision, incomingHalos, outgoingHalos, arrays...);
+}
+
+/*! @brief exchange halos, through shared memory with ranks on the same node and point-to-point messages otherwise
+ *
+ * Ranks are numbered in transport.comm(). Collective on transport.comm() on the first call with @p transport,
+ * collective on the node afterwards.
+ */
+template<class... Arrays>
+void haloexchange(NodeTransport& transport,
+                  int epoch,
+                  HaloPrecision precision,
+                  const SendList& incomingHalos,
+                  const SendList& outgoingHalos,
+                  Arrays... arrays)
+{
+    transport.setup();
+    detail::haloexchange(transport.comm(), &transport, epoch, precision, incomingHalos, outgoingHalos, arrays...);
+}
+
+template<class... Arrays>
+void haloexchange(NodeTransport& transport,
+                  int epoch,
+                  const SendList& incomingHalos,
+                  const SendList& outgoingHalos,
+                  Arrays... arrays)
+{
+    haloexchange(transport, epoch, HaloPrecision{}, incomingHalos, outgoingHalos, arrays...);
+}
+
 } // namespace cstone
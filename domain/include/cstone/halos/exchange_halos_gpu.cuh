@@ -48,7 +48,8 @@ namespace cstone
 {
 
 template<class DevVec1, class DevVec2, class... Arrays>
-void haloExchangeGpu(int epoch,
+void haloExchangeGpu(MPI_Comm comm,
+                     int epoch,
                      const SendList& incomingHalos,
                      const SendList& outgoingHalos,
                      DevVec1& sendScratchBuffer,
@@ -106,7 +107,7 @@ void haloExchangeGpu(int epoch,
         for_each_tuple(gatherArray, indices);
         checkGpuErrors(cudaDeviceSynchronize());
 
-        mpiSendGpuDirect(sendPtr, sendBytes, destinationRank, haloExchangeTag, sendRequests, sendBuffers);
+        mpiSendGpuDirect(sendPtr, sendBytes, destinationRank, haloExchangeTag, sendRequests, sendBuffers, comm);
         sendPtr += sendBytes;
     }
 
@@ -127,7 +128,8 @@ void haloExchangeGpu(int epoch,
     while (numMessages > 0)
     {
         MPI_Status status;
-        mpiRecvGpuDirect(receiveBuffer, maxReceiveSize * bytesPerElement, MPI_ANY_SOURCE, haloExchangeTag, &status);
+        mpiRecvGpuDirect(receiveBuffer, maxReceiveSize * bytesPerElement, MPI_ANY_SOURCE, haloExchangeTag, &status,
+                         comm);
         int receiveRank     = status.MPI_SOURCE;
         const auto& inHalos = incomingHalos[receiveRank];
         size_t receiveCount = inHalos.totalCount();
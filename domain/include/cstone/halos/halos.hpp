@@ -45,6 +45,7 @@
 #include "cstone/tree/accel_switch.hpp"
 #include "cstone/util/gsl-lite.hpp"
 #include "cstone/util/reallocate.hpp"
+#include "cstone/util/scratch_arena.hpp"
 
 namespace cstone
 {
@@ -69,7 +70,10 @@ void checkIndices(const SendList& sendList,
 }
 
 //! @brief check halo discovery for sanity
-void checkHalos(int myRank, gsl::span<const TreeIndexPair> focusAssignment, gsl::span<const int> haloFlags)
+void checkHalos(int myRank,
+                gsl::span<const TreeIndexPair> focusAssignment,
+                gsl::span<const int> haloFlags,
+                MPI_Comm comm)
 {
     TreeNodeIndex firstAssignedNode = focusAssignment[myRank].start();
     TreeNodeIndex lastAssignedNode  = focusAssignment[myRank].end();
@@ -96,7 +100,7 @@ void checkHalos(int myRank, gsl::span<const TreeIndexPair> focusAssignment, gsl:
                               << " of similar magnitude than the rank domain volume. In that case, either"
                               << " the number of ranks needs to be decreased or the number of particles"
                               << " increased, leading to shorter smoothing lengths\n";
-                    MPI_Abort(MPI_COMM_WORLD, 35);
+                    MPI_Abort(comm, 35);
                 }
             }
         }
@@ -105,8 +109,12 @@ void checkHalos(int myRank, gsl::span<const TreeIndexPair> focusAssignment, gsl:
 
 } // namespace detail
 
+//! @brief tag for the halo radii scratch buffer used in halo discovery
+struct HaloRadiiScratch;
+
 template<class DevVec1, class DevVec2, class... Arrays>
-void haloExchangeGpu(int epoch,
+void haloExchangeGpu(MPI_Comm comm,
+                     int epoch,
                      const SendList& incomingHalos,
                      const SendList& outgoingHalos,
                      DevVec1& sendScratchBuffer,
@@ -117,8 +125,10 @@ template<class KeyType, class Accelerator>
 class Halos
 {
 public:
-    Halos(int myRank)
+    Halos(int myRank, MPI_Comm comm = MPI_COMM_WORLD)
         : myRank_(myRank)
+        , comm_(comm)
+        , transport_(comm)
     {
     }
 
@@ -147,7 +157,8 @@ public:
         TreeNodeIndex numNodes          = lastNode - firstNode;
 
         std::exclusive_scan(counts.begin() + firstNode, counts.begin() + lastNode + 1, layout.begin(), 0);
-        std::vector<float> haloRadii(nNodes(leaves), 0.0f);
+        float* haloRadii = util::ThreadScratch<float, HaloRadiiScratch>::get(nNodes(leaves));
+        std::fill(haloRadii, haloRadii + nNodes(leaves), 0.0f);
 
         if constexpr (HaveGpu<Accelerator>{})
         {
@@ -161,9 +172,9 @@ public:
 
             memcpyH2D(layout.data(), numNodes + 1, d_segments);
             segmentMax(h, d_segments, numNodes, d_radii);
-            memcpyD2H(d_radii, numNodes, haloRadii.data() + firstNode);
+            memcpyD2H(d_radii, numNodes, haloRadii + firstNode);
 
-            std::for_each(haloRadii.begin(), haloRadii.end(), [](float& r) { r *= 2.f; });
+            std::for_each(haloRadii + firstNode, haloRadii + lastNode, [](float& r) { r *= 2.f; });
             reallocateDevice(scratch, origSize, 1.0);
         }
         else
@@ -181,7 +192,7 @@ public:
 
         reallocate(nNodes(leaves), haloFlags_);
         std::fill(begin(haloFlags_), end(haloFlags_), 0);
-        findHalos(focusedTree, haloRadii.data(), box, firstNode, lastNode, haloFlags_.data());
+        findHalos(focusedTree, haloRadii, box, firstNode, lastNode, haloFlags_.data());
     }
 
     /*! @brief Compute particle offsets of each tree node and determine halo send/receive indices
@@ -207,9 +218,9 @@ public:
         auto newParticleStart = layout[assignment[myRank_].start()];
         auto newParticleEnd   = layout[assignment[myRank_].end()];
 
-        outgoingHaloIndices_ = exchangeRequestKeys<KeyType>(leaves, haloFlags_, assignment, peers, layout);
+        outgoingHaloIndices_ = exchangeRequestKeys<KeyType>(leaves, haloFlags_, assignment, peers, layout, comm_);
 
-        detail::checkHalos(myRank_, assignment, haloFlags_);
+        detail::checkHalos(myRank_, assignment, haloFlags_, comm_);
         detail::checkIndices(outgoingHaloIndices_, newParticleStart, newParticleEnd, layout.back());
 
         incomingHaloIndices_ = computeHaloReceiveList(layout, haloFlags_, assignment, peers);
@@ -217,13 +228,17 @@ public:
 
     /*! @brief repeat the halo exchange pattern from the previous sync operation for a different set of arrays
      *
-     * @param[inout] arrays  std::vector<float or double> of size particleBufferSize_
+     * @param[inout] arrays     std::vector<float or double> of size particleBufferSize_
+     * @param[in]    precision  format of the exchanged double arrays on the CPU, GPU exchanges are always exact
      *
      * Arrays are not resized or reallocated. Function is const, but modifies mutable haloEpoch_ counter.
      * Note that if the ScratchVectors are on device, all arrays need to be on the device too.
      */
     template<class Scratch1, class Scratch2, class... Vectors>
-    void exchangeHalos(std::tuple<Vectors&...> arrays, Scratch1& sendBuffer, Scratch2& receiveBuffer) const
+    void exchangeHalos(std::tuple<Vectors&...> arrays,
+                       Scratch1& sendBuffer,
+                       Scratch2& receiveBuffer,
+                       HaloPrecision precision = {}) const
     {
         if constexpr (HaveGpu<Accelerator>{})
         {
@@ -231,23 +246,31 @@ public:
             std::apply(
                 [this, &sendBuffer, &receiveBuffer](auto&... arrays)
                 {
-                    haloExchangeGpu(haloEpoch_++, incomingHaloIndices_, outgoingHaloIndices_, sendBuffer, receiveBuffer,
-                                    rawPtr(arrays)...);
+                    haloExchangeGpu(comm_, haloEpoch_++, incomingHaloIndices_, outgoingHaloIndices_, sendBuffer,
+                                    receiveBuffer, rawPtr(arrays)...);
                 },
                 arrays);
         }
         else
         {
-            std::apply([this](auto&... arrays)
-                       { haloexchange(haloEpoch_++, incomingHaloIndices_, outgoingHaloIndices_, rawPtr(arrays)...); },
+            std::apply([this, precision](auto&... arrays)
+                       {
+                           haloexchange(transport_, haloEpoch_++, precision, incomingHaloIndices_,
+                                        outgoingHaloIndices_, rawPtr(arrays)...);
+                       },
                        arrays);
         }
     }
 
     gsl::span<int> haloFlags() { return haloFlags_; }
 
+    //! @brief bytes sent by this rank in halo exchanges on the CPU so far
+    const TransportVolume& transportVolume() const { return transport_.volume(); }
+
 private:
     int myRank_;
+    //! @brief communicator of all ranks in the domain
+    MPI_Comm comm_;
 
     SendList incomingHaloIndices_;
     SendList outgoingHaloIndices_;
@@ -259,6 +282,9 @@ private:
      * should get different MPI tags, because there is no global MPI_Barrier or MPI collective in between them.
      */
     mutable int haloEpoch_{0};
+
+    //! @brief shared memory transport to ranks on the same node, used in CPU halo exchanges
+    mutable NodeTransport transport_;
 };
 
 } // namespace cstone
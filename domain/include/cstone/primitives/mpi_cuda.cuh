@@ -50,30 +50,31 @@ auto mpiSendGpuDirect(T* data,
                       int rank,
                       int tag,
                       std::vector<MPI_Request>& requests,
-                      [[maybe_unused]] std::vector<std::vector<T, util::DefaultInitAdaptor<T>>>& buffers)
+                      [[maybe_unused]] std::vector<std::vector<T, util::DefaultInitAdaptor<T>>>& buffers,
+                      MPI_Comm comm = MPI_COMM_WORLD)
 {
     if constexpr (!useGpuDirect)
     {
         std::vector<T, util::DefaultInitAdaptor<T>> hostBuffer(count);
         checkGpuErrors(cudaMemcpy(hostBuffer.data(), data, count * sizeof(T), cudaMemcpyDeviceToHost));
-        auto errCode = mpiSendAsync(hostBuffer.data(), count, rank, tag, requests);
+        auto errCode = mpiSendAsync(hostBuffer.data(), count, rank, tag, requests, comm);
         buffers.push_back(std::move(hostBuffer));
 
         return errCode;
     }
-    else { return mpiSendAsync(data, count, rank, tag, requests); }
+    else { return mpiSendAsync(data, count, rank, tag, requests, comm); }
 }
 
 template<class T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
-auto mpiRecvGpuDirect(T* data, int count, int rank, int tag, MPI_Status* status)
+auto mpiRecvGpuDirect(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
     if constexpr (!useGpuDirect)
     {
         std::vector<T, util::DefaultInitAdaptor<T>> hostBuffer(count);
-        auto errCode = mpiRecvSync(hostBuffer.data(), count, rank, tag, status);
+        auto errCode = mpiRecvSync(hostBuffer.data(), count, rank, tag, status, comm);
         checkGpuErrors(cudaMemcpy(data, hostBuffer.data(), count * sizeof(T), cudaMemcpyHostToDevice));
 
         return errCode;
     }
-    else { return mpiRecvSync(data, count, rank, tag, status); }
+    else { return mpiRecvSync(data, count, rank, tag, status, comm); }
 }
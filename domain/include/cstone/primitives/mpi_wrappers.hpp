@@ -107,67 +107,71 @@ struct MpiType<unsigned long long>
 };
 
 template<class T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
-auto mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+auto mpiSendAsync(
+    T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    return MPI_Isend(data, count, MpiType<std::decay_t<T>>{}, rank, tag, MPI_COMM_WORLD, &requests.back());
+    return MPI_Isend(data, count, MpiType<std::decay_t<T>>{}, rank, tag, comm, &requests.back());
 }
 
 //! @brief adaptor to wrap compile-time size arrays into flattened arrays of the underlying type
 template<class T, std::enable_if_t<!std::is_arithmetic_v<T>, int> = 0>
-auto mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+auto mpiSendAsync(
+    T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     using ValueType    = typename T::value_type;
     constexpr size_t N = T{}.size();
     ValueType* ptr     = reinterpret_cast<ValueType*>(data);
 
-    return mpiSendAsync(ptr, count * N, rank, tag, requests);
+    return mpiSendAsync(ptr, count * N, rank, tag, requests, comm);
 }
 
 template<class T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
-auto mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+auto mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    return MPI_Recv(data, count, MpiType<std::decay_t<T>>{}, rank, tag, MPI_COMM_WORLD, status);
+    return MPI_Recv(data, count, MpiType<std::decay_t<T>>{}, rank, tag, comm, status);
 }
 
 //! @brief adaptor to wrap compile-time size arrays into flattened arrays of the underlying type
 template<class T, std::enable_if_t<!std::is_arithmetic_v<T>, int> = 0>
-auto mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+auto mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
     using ValueType    = typename T::value_type;
     constexpr size_t N = T{}.size();
     ValueType* ptr     = reinterpret_cast<ValueType*>(data);
 
-    return mpiRecvSync(ptr, count * N, rank, tag, status);
+    return mpiRecvSync(ptr, count * N, rank, tag, status, comm);
 }
 
 template<class T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
-auto mpiRecvAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+auto mpiRecvAsync(
+    T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    return MPI_Irecv(data, count, MpiType<std::decay_t<T>>{}, rank, tag, MPI_COMM_WORLD, &requests.back());
+    return MPI_Irecv(data, count, MpiType<std::decay_t<T>>{}, rank, tag, comm, &requests.back());
 }
 
 //! @brief adaptor to wrap compile-time size arrays into flattened arrays of the underlying type
 template<class T, std::enable_if_t<!std::is_arithmetic_v<T>, int> = 0>
-auto mpiRecvAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+auto mpiRecvAsync(
+    T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     using ValueType    = typename T::value_type;
     constexpr size_t N = T{}.size();
     ValueType* ptr     = reinterpret_cast<ValueType*>(data);
 
-    return mpiRecvAsync(ptr, count * N, rank, tag, requests);
+    return mpiRecvAsync(ptr, count * N, rank, tag, requests, comm);
 }
 
 template<class Ts, class Td, std::enable_if_t<std::is_arithmetic_v<Td>, int> = 0>
-auto mpiAllreduce(const Ts* src, Td* dest, int count, MPI_Op op)
+auto mpiAllreduce(const Ts* src, Td* dest, int count, MPI_Op op, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    return MPI_Allreduce(src, dest, count, MpiType<Td>{}, op, MPI_COMM_WORLD);
+    return MPI_Allreduce(src, dest, count, MpiType<Td>{}, op, comm);
 }
 
 //! @brief adaptor to wrap compile-time size arrays into flattened arrays of the underlying type
 template<class Ts, class Td, std::enable_if_t<!std::is_arithmetic_v<Td>, int> = 0>
-auto mpiAllreduce(const Ts* src, Td* dest, int count, MPI_Op op)
+auto mpiAllreduce(const Ts* src, Td* dest, int count, MPI_Op op, MPI_Comm comm = MPI_COMM_WORLD)
 {
     using ValueType    = typename Td::value_type;
     constexpr size_t N = Td{}.size();
@@ -176,5 +180,5 @@ auto mpiAllreduce(const Ts* src, Td* dest, int count, MPI_Op op)
     auto src_ptr  = reinterpret_cast<const SrcType*>(src);
     auto dest_ptr = reinterpret_cast<ValueType*>(dest);
 
-    return mpiAllreduce(src_ptr, dest_ptr, count * N, op);
+    return mpiAllreduce(src_ptr, dest_ptr, count * N, op, comm);
 }
@@ -0,0 +1,279 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Node-aware transport of point-to-point messages through MPI-3 shared memory windows
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+
+namespace cstone
+{
+
+//! @brief number of bytes sent by a rank, split by transport
+struct TransportVolume
+{
+    //! @brief bytes sent to ranks on the same node through shared memory
+    uint64_t intraNode{0};
+    //! @brief bytes sent to ranks on other nodes with point-to-point messages
+    uint64_t interNode{0};
+};
+
+/*! @brief Exchanges messages between ranks of the same node through an MPI-3 shared memory window
+ *
+ * Each rank packs its messages for all other ranks on the node into its own segment of the window, preceded by a
+ * table with the offset and size of the message for each node rank. After a barrier on the node communicator,
+ * receivers unpack the messages directly from the segments of the senders. Compared to point-to-point messages,
+ * this saves the copy through MPI buffers and the per-message matching overhead.
+ *
+ * Messages to ranks on other nodes are not handled here, callers keep sending them with point-to-point messages
+ * and only count their volume with countInterNode().
+ *
+ * Ranks are numbered within the communicator passed to the constructor. The node communicator and the window are
+ * created on the first call to setup(). All ranks of the node have to call setup() and exchange() collectively.
+ * Copies of a transport share no MPI resources with the original.
+ */
+class NodeTransport
+{
+public:
+    explicit NodeTransport(MPI_Comm comm = MPI_COMM_WORLD)
+        : comm_(comm)
+    {
+    }
+
+    //! @brief copies only the communicator and the volume, the copy creates its own node communicator and window
+    NodeTransport(const NodeTransport& other)
+        : comm_(other.comm_)
+        , volume_(other.volume_)
+    {
+    }
+
+    NodeTransport(NodeTransport&& other) noexcept { swap(other); }
+
+    NodeTransport& operator=(NodeTransport other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~NodeTransport()
+    {
+        int finalized;
+        MPI_Finalized(&finalized);
+        // objects that outlive MPI_Finalize cannot release their MPI resources anymore
+        if (finalized) { return; }
+
+        if (win_ != MPI_WIN_NULL)
+        {
+            MPI_Win_unlock_all(win_);
+            MPI_Win_free(&win_);
+        }
+        if (nodeComm_ != MPI_COMM_NULL) { MPI_Comm_free(&nodeComm_); }
+    }
+
+    //! @brief split comm() into nodes, collective on comm() on the first call, no-op afterwards
+    void setup()
+    {
+        if (nodeComm_ != MPI_COMM_NULL) { return; }
+
+        int numRanks;
+        MPI_Comm_rank(comm_, &myRank_);
+        MPI_Comm_size(comm_, &numRanks);
+        MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, myRank_, MPI_INFO_NULL, &nodeComm_);
+        MPI_Comm_rank(nodeComm_, &myNodeRank_);
+        MPI_Comm_size(nodeComm_, &nodeSize_);
+
+        // translate node ranks into ranks of comm
+        MPI_Group group, nodeGroup;
+        MPI_Comm_group(comm_, &group);
+        MPI_Comm_group(nodeComm_, &nodeGroup);
+        std::vector<int> nodeRanks(nodeSize_);
+        std::iota(nodeRanks.begin(), nodeRanks.end(), 0);
+        globalRanks_.resize(nodeSize_);
+        MPI_Group_translate_ranks(nodeGroup, nodeSize_, nodeRanks.data(), group, globalRanks_.data());
+        MPI_Group_free(&group);
+        MPI_Group_free(&nodeGroup);
+
+        nodeRanks_.assign(numRanks, -1);
+        for (int i = 0; i < nodeSize_; ++i)
+        {
+            nodeRanks_[globalRanks_[i]] = i;
+        }
+    }
+
+    //! @brief the communicator that numbers the ranks passed to and from this transport
+    MPI_Comm comm() const { return comm_; }
+
+    //! @brief true if @p rank is another rank on the same node, false before setup()
+    bool onNode(int rank) const { return !nodeRanks_.empty() && rank != myRank_ && nodeRanks_[rank] >= 0; }
+
+    /*! @brief exchange messages with all other ranks of the node, collective on the node
+     *
+     * @param sendBytes  size of the message to each rank, entries of ranks for which onNode() is false are ignored
+     * @param pack       called as pack(destinationRank, char* dest) to write each non-empty outgoing message
+     * @param unpack     called as unpack(sourceRank, const char* src, size_t numBytes) for each non-empty incoming
+     *                   message, @p src is valid until unpack returns
+     */
+    template<class Pack, class Unpack>
+    void exchange(const std::vector<size_t>& sendBytes, Pack&& pack, Unpack&& unpack)
+    {
+        publish(sendBytes, pack);
+        receive(unpack);
+    }
+
+    /*! @brief first half of exchange(): pack the outgoing messages into the window
+     *
+     * All data read by @p pack may be modified once publish returns, before the matching call to receive().
+     */
+    template<class Pack>
+    void publish(const std::vector<size_t>& sendBytes, Pack&& pack)
+    {
+        if (nodeSize_ < 2) { return; }
+
+        std::vector<uint64_t> table(2 * nodeSize_, 0);
+        size_t segmentBytes = alignUp(table.size() * sizeof(uint64_t));
+        for (int i = 0; i < nodeSize_; ++i)
+        {
+            if (!onNode(globalRanks_[i]) || sendBytes[globalRanks_[i]] == 0) { continue; }
+            table[2 * i]     = segmentBytes;
+            table[2 * i + 1] = sendBytes[globalRanks_[i]];
+            segmentBytes += alignUp(table[2 * i + 1]);
+            volume_.intraNode += table[2 * i + 1];
+        }
+
+        // the reduction also guarantees that all ranks finished reading the segments of the previous exchange
+        size_t maxSegmentBytes;
+        MPI_Allreduce(&segmentBytes, &maxSegmentBytes, 1, MpiType<size_t>{}, MPI_MAX, nodeComm_);
+        if (maxSegmentBytes > capacity_) { reallocate(maxSegmentBytes + maxSegmentBytes / 2); }
+
+        char* mySegment = segments_[myNodeRank_];
+        std::copy(table.begin(), table.end(), reinterpret_cast<uint64_t*>(mySegment));
+        for (int i = 0; i < nodeSize_; ++i)
+        {
+            if (table[2 * i + 1] > 0) { pack(globalRanks_[i], mySegment + table[2 * i]); }
+        }
+
+        MPI_Win_sync(win_);
+        MPI_Barrier(nodeComm_);
+    }
+
+    //! @brief second half of exchange(): unpack the incoming messages published by the other ranks of the node
+    template<class Unpack>
+    void receive(Unpack&& unpack)
+    {
+        if (nodeSize_ < 2) { return; }
+
+        MPI_Win_sync(win_);
+        for (int i = 0; i < nodeSize_; ++i)
+        {
+            if (i == myNodeRank_) { continue; }
+            const uint64_t* senderTable = reinterpret_cast<const uint64_t*>(segments_[i]);
+            uint64_t offset             = senderTable[2 * myNodeRank_];
+            uint64_t numBytes           = senderTable[2 * myNodeRank_ + 1];
+            if (numBytes > 0) { unpack(globalRanks_[i], segments_[i] + offset, numBytes); }
+        }
+    }
+
+    //! @brief add @p numBytes sent with point-to-point messages to ranks of other nodes to the volume
+    void countInterNode(size_t numBytes) { volume_.interNode += numBytes; }
+
+    //! @brief bytes sent so far by the executing rank
+    const TransportVolume& volume() const { return volume_; }
+
+private:
+    static size_t alignUp(size_t numBytes) { return (numBytes + alignment - 1) / alignment * alignment; }
+
+    //! @brief replace the window by one with @p numBytes per rank, collective on the node
+    void reallocate(size_t numBytes)
+    {
+        if (win_ != MPI_WIN_NULL)
+        {
+            MPI_Win_unlock_all(win_);
+            MPI_Win_free(&win_);
+        }
+
+        MPI_Info info;
+        MPI_Info_create(&info);
+        // segments may be placed in memory local to the NUMA domain of their rank
+        MPI_Info_set(info, "alloc_shared_noncontig", "true");
+        char* base;
+        MPI_Win_allocate_shared(MPI_Aint(numBytes), 1, info, nodeComm_, &base, &win_);
+        MPI_Info_free(&info);
+
+        segments_.resize(nodeSize_);
+        for (int i = 0; i < nodeSize_; ++i)
+        {
+            MPI_Aint size;
+            int displacementUnit;
+            MPI_Win_shared_query(win_, i, &size, &displacementUnit, &segments_[i]);
+        }
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+        capacity_ = numBytes;
+    }
+
+    void swap(NodeTransport& other) noexcept
+    {
+        std::swap(comm_, other.comm_);
+        std::swap(nodeComm_, other.nodeComm_);
+        std::swap(win_, other.win_);
+        std::swap(myRank_, other.myRank_);
+        std::swap(myNodeRank_, other.myNodeRank_);
+        std::swap(nodeSize_, other.nodeSize_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(nodeRanks_, other.nodeRanks_);
+        std::swap(globalRanks_, other.globalRanks_);
+        std::swap(segments_, other.segments_);
+        std::swap(volume_, other.volume_);
+    }
+
+    //! @brief messages are aligned to cache lines
+    static constexpr size_t alignment = 64;
+
+    MPI_Comm comm_{MPI_COMM_WORLD};
+    MPI_Comm nodeComm_{MPI_COMM_NULL};
+    MPI_Win win_{MPI_WIN_NULL};
+    int myRank_{0};
+    int myNodeRank_{0};
+    int nodeSize_{1};
+    //! @brief size of the window segment of each rank
+    size_t capacity_{0};
+    //! @brief node rank of each rank, -1 for ranks on other nodes
+    std::vector<int> nodeRanks_;
+    //! @brief rank of each node rank
+    std::vector<int> globalRanks_;
+    //! @brief base address of the window segment of each node rank
+    std::vector<char*> segments_;
+    TransportVolume volume_;
+};
+
+} // namespace cstone
@@ -0,0 +1,255 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief  Batching of small global reductions into a single non-blocking collective
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+
+namespace cstone
+{
+
+enum class ReduceOp : uint64_t
+{
+    sum = 0,
+    min = 1,
+    max = 2,
+};
+
+//! @brief handle to consecutive values of type T registered in a ReductionBatch
+template<class T>
+struct ReductionSlot
+{
+    uint64_t generation;
+    size_t   first;
+    size_t   count;
+};
+
+/*! @brief Collects min/max/sum reductions of different producers and serves them with one MPI_Iallreduce
+ *
+ * Producers register their local values with add() and keep the returned slot. start() reduces all values
+ * registered since the last start() in one non-blocking collective, get() waits for the collective on first use.
+ * Like any collective, all ranks of the communicator have to register the same slots in the same order.
+ *
+ * Floating point values are reduced in double precision, integral values as int64_t. The values are packed together
+ * with their operation into a single buffer, such that one user-defined MPI_Op applies min, max and sum to the
+ * respective entries.
+ */
+class ReductionBatch
+{
+public:
+    ReductionBatch() = default;
+
+    ReductionBatch(const ReductionBatch&)            = delete;
+    ReductionBatch& operator=(const ReductionBatch&) = delete;
+
+    ~ReductionBatch()
+    {
+        int finalized;
+        MPI_Finalized(&finalized);
+        if (!finalized && request_ != MPI_REQUEST_NULL) { MPI_Wait(&request_, MPI_STATUS_IGNORE); }
+    }
+
+    //! @brief register @p count local values to be reduced with @p op in the next start()
+    template<class T>
+    ReductionSlot<T> add(ReduceOp op, const T* values, size_t count)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+        ReductionSlot<T> slot{generation_, values_.size(), count};
+        for (size_t i = 0; i < count; ++i)
+        {
+            ops_.push_back(encodeOp<T>(op));
+            values_.push_back(encode(values[i]));
+        }
+        return slot;
+    }
+
+    template<class T>
+    ReductionSlot<T> add(ReduceOp op, T value)
+    {
+        return add(op, &value, 1);
+    }
+
+    //! @brief start reducing all values registered since the last call across @p comm, collective on @p comm
+    void start(MPI_Comm comm)
+    {
+        if (values_.empty()) { return; }
+        wait();
+
+        uint64_t n = values_.size();
+        sendBuffer_.resize(2 * n + 1);
+        recvBuffer_.resize(2 * n + 1);
+        sendBuffer_[0] = n;
+        std::copy(ops_.begin(), ops_.end(), sendBuffer_.begin() + 1);
+        std::copy(values_.begin(), values_.end(), sendBuffer_.begin() + 1 + n);
+
+        MPI_Datatype batchType;
+        MPI_Type_contiguous(2 * n + 1, MPI_UINT64_T, &batchType);
+        MPI_Type_commit(&batchType);
+        MPI_Iallreduce(sendBuffer_.data(), recvBuffer_.data(), 1, batchType, batchOp(), comm, &request_);
+        // deallocation is deferred until the pending reduction completes
+        MPI_Type_free(&batchType);
+
+        ops_.clear();
+        values_.clear();
+        started_ = generation_++;
+    }
+
+    //! @brief the reduced value @p i of @p slot, waits for the reduction of @p slot to complete if necessary
+    template<class T>
+    T get(const ReductionSlot<T>& slot, size_t i = 0)
+    {
+        if (slot.generation == generation_) { throw std::runtime_error("Reduction slot was not started\n"); }
+        if (slot.generation != started_)
+        {
+            throw std::runtime_error("Reduction slot was overwritten by a later reduction\n");
+        }
+        wait();
+        return decode<T>(recvBuffer_[1 + recvBuffer_[0] + slot.first + i]);
+    }
+
+    //! @brief true if a reduction was started and did not complete yet
+    bool pending() const { return request_ != MPI_REQUEST_NULL; }
+
+    void wait()
+    {
+        if (request_ != MPI_REQUEST_NULL) { MPI_Wait(&request_, MPI_STATUS_IGNORE); }
+    }
+
+private:
+    enum ValueType : uint64_t
+    {
+        real    = 0,
+        integer = 1,
+    };
+
+    template<class T>
+    static uint64_t encodeOp(ReduceOp op)
+    {
+        uint64_t type = std::is_floating_point_v<T> ? real : integer;
+        return 4 * type + uint64_t(op);
+    }
+
+    template<class T>
+    static uint64_t encode(T value)
+    {
+        uint64_t word;
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            double v = value;
+            std::memcpy(&word, &v, sizeof(word));
+        }
+        else
+        {
+            int64_t v = value;
+            std::memcpy(&word, &v, sizeof(word));
+        }
+        return word;
+    }
+
+    template<class T>
+    static T decode(uint64_t word)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            double v;
+            std::memcpy(&v, &word, sizeof(v));
+            return T(v);
+        }
+        else
+        {
+            int64_t v;
+            std::memcpy(&v, &word, sizeof(v));
+            return T(v);
+        }
+    }
+
+    template<class T>
+    static void combine(ReduceOp op, uint64_t in, uint64_t& inout)
+    {
+        T a = decode<T>(in), b = decode<T>(inout);
+
+        if (op == ReduceOp::sum) { inout = encode(a + b); }
+        else if (op == ReduceOp::min) { inout = encode(std::min(a, b)); }
+        else { inout = encode(std::max(a, b)); }
+    }
+
+    //! @brief MPI_User_function for buffers of [n, ops[n], values[n]]
+    static void batchReduce(void* in, void* inout, int* len, MPI_Datatype*)
+    {
+        auto* a = static_cast<const uint64_t*>(in);
+        auto* b = static_cast<uint64_t*>(inout);
+        for (int e = 0; e < *len; ++e)
+        {
+            uint64_t n = b[0];
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                uint64_t code = b[1 + i];
+                auto     op   = ReduceOp(code % 4);
+                if (code / 4 == real) { combine<double>(op, a[1 + n + i], b[1 + n + i]); }
+                else { combine<int64_t>(op, a[1 + n + i], b[1 + n + i]); }
+            }
+            a += 2 * n + 1;
+            b += 2 * n + 1;
+        }
+    }
+
+    static MPI_Op batchOp()
+    {
+        static MPI_Op op = []()
+        {
+            MPI_Op newOp;
+            MPI_Op_create(batchReduce, 1, &newOp);
+            return newOp;
+        }();
+        return op;
+    }
+
+    //! @brief operations and values registered since the last start()
+    std::vector<uint64_t> ops_;
+    std::vector<uint64_t> values_;
+
+    std::vector<uint64_t> sendBuffer_;
+    std::vector<uint64_t> recvBuffer_;
+    MPI_Request           request_{MPI_REQUEST_NULL};
+
+    //! @brief generation of slots added since the last start() and of the last started reduction
+    uint64_t generation_{1};
+    uint64_t started_{0};
+};
+
+} // namespace cstone
@@ -75,13 +75,19 @@ struct MinMax
  * @param[in]  z            z coordinate array start
  * @param[in]  numElements  length of @a x,y,z arrays
  * @param[in]  previousBox  previous coordinate bounding box, default open-boundary box with limits ignored
+ * @param[in]  comm         communicator of all ranks that hold particles
  * @return                  the new bounding box
  *
  * For each periodic dimension, limits are fixed and will not be modified.
  * For non-periodic dimensions, limits are determined by global min/max.
  */
 template<class T, class Op = MinMax<T>>
-auto makeGlobalBox(const T* x, const T* y, const T* z, size_t numElements, const Box<T>& previousBox = Box<T>(0, 1))
+auto makeGlobalBox(const T* x,
+                   const T* y,
+                   const T* z,
+                   size_t numElements,
+                   const Box<T>& previousBox = Box<T>(0, 1),
+                   MPI_Comm comm             = MPI_COMM_WORLD)
 {
     bool pbcX = (previousBox.boundaryX() == BoundaryType::periodic);
     bool pbcY = (previousBox.boundaryY() == BoundaryType::periodic);
@@ -100,7 +106,7 @@ auto makeGlobalBox(const T* x, const T* y, const T* z, size_t numElements, const
         extrema[1] = -extrema[1];
         extrema[3] = -extrema[3];
         extrema[5] = -extrema[5];
-        MPI_Allreduce(MPI_IN_PLACE, extrema.data(), extrema.size(), MpiType<T>{}, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, extrema.data(), extrema.size(), MpiType<T>{}, MPI_MIN, comm);
         extrema[1] = -extrema[1];
         extrema[3] = -extrema[3];
         extrema[5] = -extrema[5];
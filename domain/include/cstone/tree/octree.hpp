@@ -58,6 +58,7 @@
 #include <tuple>
 
 #include "cstone/sfc/common.hpp"
+#include "cstone/util/scratch_arena.hpp"
 #include "cstone/primitives/scan.hpp"
 #include "cstone/util/gsl-lite.hpp"
 #include "cstone/util/tuple.hpp"
@@ -402,6 +403,9 @@ void rebalanceTree(const InputVector& tree, OutputVector& newTree, TreeNodeIndex
     newTree.back() = tree.back();
 }
 
+//! @brief tag for the rebalance op-code scratch buffer used in octree updates
+struct NodeOpsScratch;
+
 /*! @brief update the octree with a single rebalance/count step
  *
  * @tparam       KeyType     32- or 64-bit unsigned integer for SFC code
@@ -428,11 +432,11 @@ bool updateOctree(const KeyType* codesStart,
                   std::vector<unsigned>& counts,
                   unsigned maxCount = std::numeric_limits<unsigned>::max())
 {
-    std::vector<TreeNodeIndex> nodeOps(nNodes(tree) + 1);
-    bool converged = rebalanceDecision(tree.data(), counts.data(), nNodes(tree), bucketSize, nodeOps.data());
+    TreeNodeIndex* nodeOps   = util::ThreadScratch<TreeNodeIndex, NodeOpsScratch>::get(nNodes(tree) + 1);
+    bool           converged = rebalanceDecision(tree.data(), counts.data(), nNodes(tree), bucketSize, nodeOps);
 
     std::vector<KeyType> newTree;
-    rebalanceTree(tree, newTree, nodeOps.data());
+    rebalanceTree(tree, newTree, nodeOps);
     swap(tree, newTree);
 
     counts.resize(nNodes(tree));
@@ -472,11 +476,11 @@ template<class KeyType>
 std::vector<KeyType>
 updateTreelet(gsl::span<const KeyType> treelet, gsl::span<const unsigned> counts, unsigned bucketSize)
 {
-    std::vector<TreeNodeIndex> nodeOps(nNodes(treelet) + 1);
-    rebalanceDecision(treelet.data(), counts.data(), nNodes(treelet), bucketSize, nodeOps.data());
+    TreeNodeIndex* nodeOps = util::ThreadScratch<TreeNodeIndex, NodeOpsScratch>::get(nNodes(treelet) + 1);
+    rebalanceDecision(treelet.data(), counts.data(), nNodes(treelet), bucketSize, nodeOps);
 
     std::vector<KeyType> newTreelet;
-    rebalanceTree(treelet, newTreelet, nodeOps.data());
+    rebalanceTree(treelet, newTreelet, nodeOps);
 
     return newTreelet;
 }
@@ -49,15 +49,16 @@ bool updateOctreeGlobal(const KeyType* keyStart,
                         const KeyType* keyEnd,
                         unsigned bucketSize,
                         std::vector<KeyType>& tree,
-                        std::vector<unsigned>& counts)
+                        std::vector<unsigned>& counts,
+                        MPI_Comm comm = MPI_COMM_WORLD)
 {
     int numRanks;
-    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+    MPI_Comm_size(comm, &numRanks);
     // to prevent 32-bit overflow we limit the maximum count to 2^32-1, divided by numRanks due to MPI_Allreduce
     unsigned maxCount = std::numeric_limits<unsigned>::max() / numRanks;
 
     bool converged = updateOctree(keyStart, keyEnd, bucketSize, tree, counts, maxCount);
-    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, comm);
 
     return converged;
 }
@@ -71,6 +72,7 @@ bool updateOctreeGlobal(const KeyType* keyStart,
  * @param[inout]  tree        a fully linked octree
  * @param[inout]  counts      leaf node particle counts
  * @param[in]     numRanks    number of MPI ranks
+ * @param[in]     comm        communicator of all ranks in the domain
  * @return                    true if tree was not changed
  */
 template<class KeyType>
@@ -79,7 +81,8 @@ bool updateOctreeGlobal(const KeyType* keyStart,
                         unsigned bucketSize,
                         Octree<KeyType>& tree,
                         std::vector<unsigned>& counts,
-                        int numRanks)
+                        int numRanks,
+                        MPI_Comm comm = MPI_COMM_WORLD)
 {
     // to prevent 32-bit overflow we limit the maximum count to 2^32-1, divided by numRanks due to MPI_Allreduce
     unsigned maxCount = std::numeric_limits<unsigned>::max() / numRanks;
@@ -88,7 +91,7 @@ bool updateOctreeGlobal(const KeyType* keyStart,
 
     counts.resize(tree.numLeafNodes());
     computeNodeCounts(tree.treeLeaves().data(), counts.data(), tree.numLeafNodes(), keyStart, keyEnd, maxCount, true);
-    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, comm);
 
     return converged;
 }
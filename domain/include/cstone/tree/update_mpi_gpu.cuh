@@ -49,6 +49,7 @@ namespace cstone
  * @param[inout]  tree        a fully linked octree
  * @param[inout]  counts      leaf node particle counts
  * @param[in]     numRanks    number of MPI ranks
+ * @param[in]     comm        communicator of all ranks in the domain
  * @return                    true if tree was not changed
  */
 template<class KeyType, class DevKeyVec, class DevCountVec>
@@ -59,7 +60,8 @@ bool updateOctreeGlobalGpu(const KeyType* keyStart,
                            DevKeyVec& d_csTree,
                            std::vector<unsigned>& counts,
                            DevCountVec& d_counts,
-                           int numRanks)
+                           int numRanks,
+                           MPI_Comm comm = MPI_COMM_WORLD)
 {
     // to prevent 32-bit overflow we limit the maximum count to 2^32-1, divided by numRanks due to MPI_Allreduce
     unsigned maxCount = std::numeric_limits<unsigned>::max() / numRanks;
@@ -73,7 +75,7 @@ bool updateOctreeGlobalGpu(const KeyType* keyStart,
     computeNodeCountsGpu(rawPtr(d_csTree), rawPtr(d_counts), tree.numLeafNodes(), keyStart, keyEnd, maxCount, true);
     thrust::copy(d_counts.begin(), d_counts.end(), counts.begin());
 
-    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, comm);
 
     return converged;
 }
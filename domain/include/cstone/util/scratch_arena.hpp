@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *               2022 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Thread-local scratch arenas
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "cstone/util/noinit_alloc.hpp"
+#include "cstone/util/reallocate.hpp"
+
+namespace util
+{
+
+/*! @brief Scratch memory owned by the calling thread that persists across calls
+ *
+ * @tparam T    element type
+ * @tparam Tag  distinguishes independent arenas, use a separate tag for buffers that are in use at the same time
+ *
+ * Each thread has its own buffer that is allocated and first touched by the thread itself, placing the memory
+ * on the NUMA node of the thread. Buffers are never shrunk and their contents are not initialized, so repeated
+ * calls within a time-step loop do not allocate once the largest required size has been reached.
+ * OpenMP thread pools are persistent, such that a worker thread retrieves the same buffer in subsequent
+ * parallel regions.
+ */
+template<class T, class Tag>
+class ThreadScratch
+{
+public:
+    //! @brief return a pointer to at least @p n uninitialized elements owned by the calling thread
+    static T* get(std::size_t n)
+    {
+        auto& buf = buffer();
+        if (n > buf.size()) { reallocateDestructive(buf, n, 1.05); }
+        return buf.data();
+    }
+
+    //! @brief current capacity of the calling thread's buffer
+    static std::size_t size() { return buffer().size(); }
+
+    //! @brief deallocate the calling thread's buffer
+    static void release() { std::vector<T, DefaultInitAdaptor<T>>().swap(buffer()); }
+
+private:
+    static std::vector<T, DefaultInitAdaptor<T>>& buffer()
+    {
+        thread_local std::vector<T, DefaultInitAdaptor<T>> buf;
+        return buf;
+    }
+};
+
+} // namespace util
@@ -76,7 +76,8 @@ void initCoordinates(std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, Bo
 }
 
 template<class KeyType, class T, class DomainType>
-void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalizeH = false)
+void randomGaussianDomain(
+    DomainType domain, int rank, int nRanks, bool equalizeH = false, MPI_Comm comm = MPI_COMM_WORLD)
 {
     LocalIndex numParticles = (1000 / nRanks) * nRanks;
     Box<T> box              = domain.box();
@@ -114,7 +115,7 @@ void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalize
     LocalIndex localCount    = domain.endIndex() - domain.startIndex();
     LocalIndex localCountSum = localCount;
     // int extractedCount = x.size();
-    MPI_Allreduce(MPI_IN_PLACE, &localCountSum, 1, MpiType<int>{}, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &localCountSum, 1, MpiType<int>{}, MPI_SUM, comm);
     EXPECT_EQ(localCountSum, numParticles);
 
     // box got updated if not using PBC
@@ -133,7 +134,7 @@ void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalize
                   sfcKindPointer(keysRef.data()), neighbors.data(), neighborsCount.data(), ngmax);
 
     int neighborSum = std::accumulate(begin(neighborsCount), end(neighborsCount), 0);
-    MPI_Allreduce(MPI_IN_PLACE, &neighborSum, 1, MpiType<int>{}, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &neighborSum, 1, MpiType<int>{}, MPI_SUM, comm);
 
     {
         // Note: global coordinates are not yet in Morton order
@@ -224,6 +225,26 @@ TEST(FocusDomain, randomGaussianNeighborSumPbc)
     }
 }
 
+//! @brief two domains with different numbers of ranks operate concurrently on disjoint communicators
+TEST(FocusDomain, splitCommunicator)
+{
+    int worldRank = 0, worldSize = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, int(worldRank < (worldSize + 1) / 2), worldRank, &comm);
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nRanks);
+
+    {
+        Domain<uint64_t, double> domain(rank, nRanks, 50, 10, 0.75, {-1, 1}, comm);
+        randomGaussianDomain<uint64_t, double>(domain, rank, nRanks, false, comm);
+    }
+    MPI_Comm_free(&comm);
+}
+
 TEST(FocusDomain, assignmentShift)
 {
     int rank = 0, numRanks = 0;
@@ -274,3 +295,370 @@ TEST(FocusDomain, assignmentShift)
     EXPECT_TRUE(std::count(property.begin(), property.end(), -1) == 0);
     EXPECT_TRUE(std::count(property.begin(), property.end(), rank) == domain.nParticles());
 }
+
+//! @brief coarsened global trees assign exact particle counts and balance ranks
+TEST(FocusDomain, coarsenedGlobalTree)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    {
+        Domain<uint64_t, double> domain(rank, numRanks, 50, 10, 0.75, {-1, 1});
+        domain.setGlobalTreeCoarsening(4);
+        randomGaussianDomain<uint64_t, double>(domain, rank, numRanks);
+    }
+
+    using Real    = double;
+    using KeyType = uint64_t;
+
+    Box<Real> box{-1, 1};
+    LocalIndex numParticlesPerRank = 20010;
+    size_t numParticlesGlobal      = numParticlesPerRank * numRanks;
+
+    std::vector<Real> x(numParticlesPerRank), y(numParticlesPerRank), z(numParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    // the generator is seeded identically on all ranks
+    std::for_each(x.begin(), x.end(), [rank](Real& v) { v = std::max(-1.0, std::min(1.0, v + 0.01 * rank)); });
+    std::vector<Real> h(numParticlesPerRank, 0.05);
+
+    unsigned bucketSize = numParticlesGlobal / (100 * numRanks);
+    Domain<KeyType, Real> domain(rank, numRanks, bucketSize, 64, 0.5, box);
+    Domain<KeyType, Real> fullDomain(rank, numRanks, bucketSize, 64, 0.5, box);
+    EXPECT_THROW(domain.setGlobalTreeCoarsening(0), std::runtime_error);
+    domain.setGlobalTreeCoarsening(10);
+
+    std::vector<KeyType> keys(x.size());
+    std::vector<Real> s1, s2, s3;
+    for (int step = 0; step < 3; ++step)
+    {
+        {
+            std::vector<Real> xf = x, yf = y, zf = z, hf = h;
+            std::vector<KeyType> keysFull(x.size());
+            fullDomain.sync(keysFull, xf, yf, zf, hf, std::tuple{}, std::tie(s1, s2, s3));
+        }
+        domain.sync(keys, x, y, z, h, std::tuple{}, std::tie(s1, s2, s3));
+
+        size_t numAssigned = domain.nParticles();
+        size_t sumAssigned = numAssigned;
+        MPI_Allreduce(MPI_IN_PLACE, &sumAssigned, 1, MpiType<size_t>{}, MPI_SUM, MPI_COMM_WORLD);
+        EXPECT_EQ(sumAssigned, numParticlesGlobal);
+        EXPECT_NEAR(double(numAssigned), double(numParticlesPerRank), 0.05 * numParticlesPerRank);
+
+        // coarse leaves away from rank boundaries, but exact counts on all leaves
+        auto leaves = domain.globalTree().treeLeaves();
+        EXPECT_LT(nNodes(leaves), fullDomain.globalTree().numLeafNodes() / 2);
+
+        std::vector<unsigned> exactCounts(nNodes(leaves));
+        computeNodeCounts(leaves.data(), exactCounts.data(), nNodes(leaves), keys.data() + domain.startIndex(),
+                          keys.data() + domain.endIndex(), std::numeric_limits<unsigned>::max());
+        MPI_Allreduce(MPI_IN_PLACE, exactCounts.data(), exactCounts.size(), MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+        auto counts = domain.globalCounts();
+        EXPECT_TRUE(std::equal(counts.begin(), counts.end(), exactCounts.begin()));
+
+        for (LocalIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+        {
+            x[i] = std::max(-1.0, std::min(1.0, x[i] + 0.01 * std::sin(10 * y[i])));
+        }
+    }
+}
+
+//! @brief max/mean of the particles with keys @p sortedKeys per rank of the current domain assignment
+template<class KeyType, class Real>
+static double assignmentImbalance(const Domain<KeyType, Real>& domain, const std::vector<KeyType>& sortedKeys)
+{
+    const auto& assignment = domain.assignment();
+    auto leaves            = domain.globalTree().treeLeaves();
+
+    std::vector<uint64_t> counts(assignment.numRanks());
+    for (int rank = 0; rank < assignment.numRanks(); ++rank)
+    {
+        auto first   = std::lower_bound(sortedKeys.begin(), sortedKeys.end(), leaves[assignment.firstNodeIdx(rank)]);
+        auto last    = std::lower_bound(sortedKeys.begin(), sortedKeys.end(), leaves[assignment.lastNodeIdx(rank)]);
+        counts[rank] = last - first;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    uint64_t total = std::accumulate(counts.begin(), counts.end(), uint64_t(0));
+    return double(*std::max_element(counts.begin(), counts.end())) * counts.size() / total;
+}
+
+/*! @brief rank boundaries placed on predicted positions balance the particles after a contraction
+ *
+ * Two domains are synced on the same particles. One of them gets the velocities of a homologous contraction for
+ * its second sync. The imbalance is evaluated for the positions after the contraction.
+ */
+TEST(FocusDomain, predictedAssignment)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    using Real    = double;
+    using KeyType = uint64_t;
+
+    Box<Real> box{-1, 1};
+    LocalIndex numParticlesPerRank = 20000;
+    size_t numParticlesGlobal      = numParticlesPerRank * numRanks;
+    Real dt                        = 1;
+
+    std::vector<Real> xInit(numParticlesPerRank), yInit(numParticlesPerRank), zInit(numParticlesPerRank);
+    initCoordinates(xInit, yInit, zInit, box);
+    std::for_each(xInit.begin(), xInit.end(), [rank](Real& v) { v = std::max(-1.0, std::min(1.0, v + 0.01 * rank)); });
+
+    double imbalance[2];
+    for (int predict = 0; predict < 2; ++predict)
+    {
+        std::vector<Real> x = xInit, y = yInit, z = zInit;
+        std::vector<Real> h(numParticlesPerRank, 0.05);
+
+        Domain<KeyType, Real> domain(rank, numRanks, numParticlesGlobal / (100 * numRanks), 64, 0.5, box);
+
+        std::vector<KeyType> keys(x.size());
+        std::vector<Real> s1, s2, s3;
+        domain.sync(keys, x, y, z, h, std::tuple{}, std::tie(s1, s2, s3));
+
+        std::vector<Real> vx(x.size()), vy(x.size()), vz(x.size());
+        for (size_t i = 0; i < x.size(); ++i)
+        {
+            vx[i] = -0.4 * x[i];
+            vy[i] = -0.4 * y[i];
+            vz[i] = -0.4 * z[i];
+        }
+        if (predict) { domain.predictAssignment(vx, vy, vz, dt); }
+        domain.sync(keys, x, y, z, h, std::tie(vx, vy, vz), std::tie(s1, s2, s3));
+
+        size_t sumAssigned = domain.nParticles();
+        MPI_Allreduce(MPI_IN_PLACE, &sumAssigned, 1, MpiType<size_t>{}, MPI_SUM, MPI_COMM_WORLD);
+        EXPECT_EQ(sumAssigned, numParticlesGlobal);
+        auto counts = domain.globalCounts();
+        EXPECT_EQ(std::accumulate(counts.begin(), counts.end(), size_t(0)), numParticlesGlobal);
+
+        std::vector<KeyType> movedKeys;
+        for (LocalIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+        {
+            movedKeys.push_back(sfc3D<SfcKind<KeyType>>(x[i] + vx[i] * dt, y[i] + vy[i] * dt, z[i] + vz[i] * dt, box));
+        }
+        std::sort(movedKeys.begin(), movedKeys.end());
+        imbalance[predict] = assignmentImbalance(domain, movedKeys);
+    }
+
+    EXPECT_LT(imbalance[1], imbalance[0]);
+    EXPECT_LT(imbalance[1], 1.1);
+}
+
+/*! @brief a domain started from the converged global and focus trees of another domain continues identically
+ *
+ * The restarted domain gets the particles, global tree and focus tree of the original domain after its second sync.
+ * Its first sync skips the focus tree convergence and must produce the same trees and halos as the third sync of
+ * the original domain.
+ */
+TEST(FocusDomain, warmStart)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    using Real    = double;
+    using KeyType = uint64_t;
+
+    Box<Real> box{-1, 1};
+    LocalIndex numParticlesPerRank = 10000;
+    unsigned bucketSize            = numParticlesPerRank / 100;
+
+    std::vector<Real> x(numParticlesPerRank), y(numParticlesPerRank), z(numParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    std::for_each(x.begin(), x.end(), [rank](Real& v) { v = std::max(-1.0, std::min(1.0, v + 0.01 * rank)); });
+    std::vector<Real> h(numParticlesPerRank, 0.05);
+
+    Domain<KeyType, Real> domain(rank, numRanks, bucketSize, 64, 0.5, box);
+    std::vector<KeyType> keys(x.size());
+    std::vector<Real> s1, s2, s3;
+    domain.sync(keys, x, y, z, h, std::tuple{}, std::tie(s1, s2, s3));
+    domain.sync(keys, x, y, z, h, std::tuple{}, std::tie(s1, s2, s3));
+
+    // state of a checkpoint: assigned particles, global tree and focus tree
+    auto assigned = [&domain](const std::vector<Real>& v)
+    { return std::vector<Real>(v.begin() + domain.startIndex(), v.begin() + domain.endIndex()); };
+    std::vector<Real> xr = assigned(x), yr = assigned(y), zr = assigned(z), hr = assigned(h);
+    std::vector<KeyType> globalLeaves(domain.globalTree().treeLeaves().begin(), domain.globalTree().treeLeaves().end());
+    std::vector<unsigned> globalCounts(domain.globalCounts().begin(), domain.globalCounts().end());
+    const auto& focus = domain.focusTree();
+    std::vector<KeyType> focusLeaves(focus.treeLeaves().begin(), focus.treeLeaves().end());
+    std::vector<unsigned> focusCounts(focus.leafCounts().begin(), focus.leafCounts().end());
+    std::vector<char> focusMacs(focus.macs().begin(), focus.macs().end());
+
+    domain.sync(keys, x, y, z, h, std::tuple{}, std::tie(s1, s2, s3));
+
+    Domain<KeyType, Real> restarted(rank, numRanks, bucketSize, 64, 0.5, box);
+    restarted.setGlobalTree(globalLeaves, globalCounts);
+    restarted.setFocusTree(focusLeaves, focusCounts, focusMacs);
+    EXPECT_THROW(restarted.setFocusTree(focusLeaves, focusCounts, std::vector<char>(1)), std::runtime_error);
+
+    std::vector<KeyType> keysr(xr.size());
+    restarted.sync(keysr, xr, yr, zr, hr, std::tuple{}, std::tie(s1, s2, s3));
+    EXPECT_THROW(restarted.setFocusTree(focusLeaves, focusCounts, focusMacs), std::runtime_error);
+
+    auto leaves  = domain.focusTree().treeLeaves();
+    auto leavesr = restarted.focusTree().treeLeaves();
+    EXPECT_TRUE(std::equal(leaves.begin(), leaves.end(), leavesr.begin(), leavesr.end()));
+    EXPECT_EQ(restarted.startIndex(), domain.startIndex());
+    EXPECT_EQ(restarted.nParticles(), domain.nParticles());
+    EXPECT_EQ(restarted.nParticlesWithHalos(), domain.nParticlesWithHalos());
+}
+
+/*! @brief particles removed and added between syncs leave and join the domain
+ *
+ * Each rank removes its assigned particles with x > 0.5 and appends new particles. Particle ids are carried as a
+ * property to check that exactly the kept and added particles are assigned after the sync.
+ */
+TEST(FocusDomain, changeParticles)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    using Real    = double;
+    using KeyType = uint64_t;
+
+    Box<Real> box{-1, 1};
+    LocalIndex numParticlesPerRank = 10000;
+    LocalIndex numAdded            = 100 * (rank + 1);
+
+    std::vector<Real> x(numParticlesPerRank), y(numParticlesPerRank), z(numParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    std::for_each(x.begin(), x.end(), [rank](Real& v) { v = std::max(-1.0, std::min(1.0, v + 0.01 * rank)); });
+    std::vector<Real> h(numParticlesPerRank, 0.05);
+    std::vector<Real> id(numParticlesPerRank);
+    std::iota(id.begin(), id.end(), Real(rank * numParticlesPerRank));
+
+    Domain<KeyType, Real> domain(rank, numRanks, numParticlesPerRank / 100, 64, 0.5, box);
+    EXPECT_THROW(domain.changeParticles({}, 1), std::runtime_error);
+
+    std::vector<KeyType> keys(x.size());
+    std::vector<Real> s1, s2, s3;
+    domain.sync(keys, x, y, z, h, std::tie(id), std::tie(s1, s2, s3));
+
+    EXPECT_THROW(domain.changeParticles(std::vector<char>(domain.nParticles() + 1), 0), std::runtime_error);
+
+    std::vector<char> keep(domain.nParticles());
+    double keptIds = 0;
+    for (LocalIndex i = 0; i < domain.nParticles(); ++i)
+    {
+        LocalIndex j = domain.startIndex() + i;
+        keep[i]      = x[j] <= 0.5;
+        if (keep[i]) { keptIds += id[j]; }
+    }
+
+    size_t oldSize = x.size();
+    for (auto* v : {&x, &y, &z, &h, &id})
+    {
+        v->resize(oldSize + numAdded);
+    }
+    size_t numGlobal = numParticlesPerRank * numRanks;
+    for (LocalIndex i = 0; i < numAdded; ++i)
+    {
+        x[oldSize + i]  = -0.9 + 1.8 * i / numAdded;
+        y[oldSize + i]  = 0.1 * rank;
+        z[oldSize + i]  = 0;
+        h[oldSize + i]  = 0.05;
+        id[oldSize + i] = numGlobal + rank * 1000 + i;
+        keptIds += id[oldSize + i];
+    }
+
+    domain.changeParticles(keep, numAdded);
+    domain.sync(keys, x, y, z, h, std::tie(id), std::tie(s1, s2, s3));
+
+    size_t expectedCount = std::count(keep.begin(), keep.end(), 1) + numAdded;
+    double assignedIds   = std::accumulate(id.begin() + domain.startIndex(), id.begin() + domain.endIndex(), 0.0);
+    size_t assignedCount = domain.nParticles();
+    MPI_Allreduce(MPI_IN_PLACE, &expectedCount, 1, MpiType<size_t>{}, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &assignedCount, 1, MpiType<size_t>{}, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &keptIds, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &assignedIds, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    EXPECT_EQ(assignedCount, expectedCount);
+    EXPECT_EQ(assignedIds, keptIds);
+    auto counts = domain.globalCounts();
+    EXPECT_EQ(std::accumulate(counts.begin(), counts.end(), size_t(0)), expectedCount);
+    EXPECT_TRUE(std::is_sorted(keys.begin() + domain.startIndex(), keys.begin() + domain.endIndex()));
+    for (LocalIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        EXPECT_TRUE(x[i] <= 0.5 || id[i] >= numGlobal);
+    }
+
+    // array sizes that do not match the added particles are rejected
+    domain.changeParticles({}, 1);
+    EXPECT_THROW(domain.sync(keys, x, y, z, h, std::tie(id), std::tie(s1, s2, s3)), std::runtime_error);
+}
+
+/*! @brief halos of derived fields exchanged in reduced precision preserve global halo sums
+ *
+ * The sums of a smooth field and of its product with the particle mass over all halos enter the SPH kernel sums
+ * of each rank. They are compared between exact and reduced precision exchanges.
+ */
+TEST(FocusDomain, reducedPrecisionHalos)
+{
+    using KeyType = uint64_t;
+    using Real    = double;
+
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    Box<Real> box{-1, 1};
+    LocalIndex numParticlesPerRank = 2000;
+
+    RandomCoordinates<Real, SfcKind<KeyType>> coordinates(numParticlesPerRank, box, rank);
+
+    std::vector<Real> x(coordinates.x().begin(), coordinates.x().end());
+    std::vector<Real> y(coordinates.y().begin(), coordinates.y().end());
+    std::vector<Real> z(coordinates.z().begin(), coordinates.z().end());
+    std::vector<Real> h(numParticlesPerRank, 0.1);
+    std::vector<Real> m(numParticlesPerRank);
+    std::iota(m.begin(), m.end(), rank * numParticlesPerRank + 1.0);
+
+    Domain<KeyType, Real> domain(rank, numRanks, 64, 8, 0.5, box);
+
+    std::vector<KeyType> particleKeys(x.size());
+    std::vector<Real> s1, s2, s3;
+    domain.sync(particleKeys, x, y, z, h, std::tie(m), std::tie(s1, s2, s3));
+    domain.exchangeHalos(std::tie(m), s1, s2);
+
+    auto field = [](Real x, Real y, Real z) { return 1.0 + x * x + 0.5 * y - z * z * z; };
+    auto haloSums = [&](HaloPrecision precision)
+    {
+        std::vector<Real> u(domain.nParticlesWithHalos(), 0), um(domain.nParticlesWithHalos(), 0);
+        for (LocalIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+        {
+            u[i]  = field(x[i], y[i], z[i]);
+            um[i] = u[i] * m[i];
+        }
+        domain.exchangeHalos(std::tie(u, um), s1, s2, precision);
+
+        auto checkHalos = [&](LocalIndex first, LocalIndex last)
+        {
+            for (LocalIndex i = first; i < last; ++i)
+            {
+                EXPECT_NEAR(u[i], field(x[i], y[i], z[i]), 1e-4);
+                EXPECT_NEAR(um[i], field(x[i], y[i], z[i]) * m[i], 1e-4 * numRanks * numParticlesPerRank);
+            }
+        };
+        checkHalos(0, domain.startIndex());
+        checkHalos(domain.endIndex(), domain.nParticlesWithHalos());
+
+        std::array<Real, 2> sums{std::accumulate(u.begin(), u.end(), 0.0), std::accumulate(um.begin(), um.end(), 0.0)};
+        MPI_Allreduce(MPI_IN_PLACE, sums.data(), 2, MpiType<Real>{}, MPI_SUM, MPI_COMM_WORLD);
+        return sums;
+    };
+
+    auto exact    = haloSums({});
+    auto float32  = haloSums({HaloPrecision::float32});
+    auto scaled16 = haloSums({HaloPrecision::scaled16});
+
+    for (int k = 0; k < 2; ++k)
+    {
+        EXPECT_NEAR(float32[k], exact[k], 1e-7 * std::abs(exact[k]));
+        EXPECT_NEAR(scaled16[k], exact[k], 1e-5 * std::abs(exact[k]));
+    }
+}
@@ -102,8 +102,8 @@ void exchangeAllToAll(int thisRank, int numRanks)
     thrust::device_vector<T> d_x                 = x;
     thrust::device_vector<T> d_y                 = y;
 
-    exchangeParticlesGpu(sendList, Rank(thisRank), 0, gridSize, d_x.size(), numParticlesThisRank, sendScratch,
-                         receiveScratch, raw_pointer_cast(d_ordering.data()), raw_pointer_cast(d_x.data()),
+    exchangeParticlesGpu(MPI_COMM_WORLD, sendList, Rank(thisRank), 0, gridSize, d_x.size(), numParticlesThisRank,
+                         sendScratch, receiveScratch, raw_pointer_cast(d_ordering.data()), raw_pointer_cast(d_x.data()),
                          raw_pointer_cast(d_y.data()));
 
     thrust::copy(d_x.begin(), d_x.end(), x.begin());
@@ -177,8 +177,8 @@ void exchangeCyclicNeighbors(int thisRank, int numRanks)
     thrust::device_vector<float> d_y                       = y;
     thrust::device_vector<util::array<int, 2>> d_testArray = testArray;
 
-    exchangeParticlesGpu(sendList, Rank(thisRank), 0, gridSize, gridSize, gridSize, sendScratch, receiveScratch,
-                         raw_pointer_cast(d_ordering.data()), raw_pointer_cast(d_x.data()),
+    exchangeParticlesGpu(MPI_COMM_WORLD, sendList, Rank(thisRank), 0, gridSize, gridSize, gridSize, sendScratch,
+                         receiveScratch, raw_pointer_cast(d_ordering.data()), raw_pointer_cast(d_x.data()),
                          raw_pointer_cast(d_y.data()), raw_pointer_cast(d_testArray.data()));
 
     thrust::copy(d_x.begin(), d_x.end(), x.begin());
@@ -35,7 +35,8 @@
 
 using namespace cstone;
 
-void simpleTest(int thisRank)
+//! @brief exchange with point-to-point messages if @p transport is null, through @p transport otherwise
+void simpleTest(int thisRank, NodeTransport* transport = nullptr)
 {
     int nRanks = 2;
     std::vector<int> nodeList{0, 1, 10, 11};
@@ -100,7 +101,8 @@ void simpleTest(int thisRank)
         EXPECT_EQ(yOrig, y);
     }
 
-    haloexchange(0, incomingHalos, outgoingHalos, x.data(), y.data(), velocity.data());
+    if (transport) { haloexchange(*transport, 0, incomingHalos, outgoingHalos, x.data(), y.data(), velocity.data()); }
+    else { haloexchange(0, incomingHalos, outgoingHalos, x.data(), y.data(), velocity.data()); }
 
     std::vector<double> xRef{20, 21, 22, 23, 24, 25, 26, 27, 28, 29};
     std::vector<float> yRef{30, 31, 32, 33, 34, 35, 36, 37, 38, 39};
@@ -122,4 +124,87 @@ TEST(HaloExchange, simpleTest)
     if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
 
     simpleTest(rank);
-}
\ No newline at end of file
+}
+//! @brief both ranks of the test run on the same node, all halos go through shared memory
+TEST(HaloExchange, nodeTransport)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    if (nRanks != 2) throw std::runtime_error("this test needs 2 ranks\n");
+
+    NodeTransport transport;
+    simpleTest(rank, &transport);
+    // the second exchange reuses the window
+    simpleTest(rank, &transport);
+
+    size_t bytesPerParticle = sizeof(double) + sizeof(float) + sizeof(util::array<int, 3>);
+    size_t numSent          = rank == 0 ? 3 : 7;
+    EXPECT_EQ(transport.volume().intraNode, 2 * numSent * bytesPerParticle);
+    EXPECT_EQ(transport.volume().interNode, 0);
+}
+
+/*! @brief double arrays selected for a reduced precision arrive in that precision, all other arrays exactly
+ *
+ * Rank 0 owns particles [0:5], rank 1 owns [5:10], each rank receives four particles of the other rank as halos.
+ */
+void reducedPrecisionTest(int thisRank, HaloPrecision::Format format, NodeTransport* transport = nullptr)
+{
+    int otherRank         = 1 - thisRank;
+    LocalIndex myStart    = 5 * thisRank;
+    LocalIndex otherStart = 5 * otherRank;
+
+    SendList incomingHalos(2);
+    SendList outgoingHalos(2);
+    incomingHalos[otherRank].addRange(otherStart, otherStart + 2);
+    incomingHalos[otherRank].addRange(otherStart + 3, otherStart + 5);
+    outgoingHalos[otherRank].addRange(myStart, myStart + 2);
+    outgoingHalos[otherRank].addRange(myStart + 3, myStart + 5);
+
+    auto value = [](LocalIndex i) { return 1.0 + i / 3.0; };
+
+    std::vector<double> a(10, 0), b(10, 0);
+    std::vector<float> c(10, 0);
+    for (LocalIndex i = myStart; i < myStart + 5; ++i)
+    {
+        a[i] = value(i);
+        b[i] = value(i);
+        c[i] = value(i);
+    }
+
+    // c is selected, but not reduced, because it is not a double array
+    auto precision = HaloPrecision::select(format, {0, 2});
+    if (transport) { haloexchange(*transport, 0, precision, incomingHalos, outgoingHalos, a.data(), b.data(), c.data()); }
+    else { haloexchange(0, precision, incomingHalos, outgoingHalos, a.data(), b.data(), c.data()); }
+
+    double range = value(otherStart + 4) - value(otherStart);
+    for (LocalIndex i : {otherStart, otherStart + 1, otherStart + 3, otherStart + 4})
+    {
+        if (format == HaloPrecision::float32) { EXPECT_EQ(a[i], double(float(value(i)))); }
+        else { EXPECT_NEAR(a[i], value(i), 0.5 * range / 65535 * (1 + 1e-12)); }
+        EXPECT_EQ(b[i], value(i));
+        EXPECT_EQ(c[i], float(value(i)));
+    }
+    EXPECT_EQ(a[otherStart + 2], 0);
+    EXPECT_EQ(a[myStart + 2], value(myStart + 2));
+}
+
+TEST(HaloExchange, reducedPrecision)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    if (nRanks != 2) throw std::runtime_error("this test needs 2 ranks\n");
+
+    reducedPrecisionTest(rank, HaloPrecision::float32);
+    reducedPrecisionTest(rank, HaloPrecision::scaled16);
+
+    NodeTransport transport;
+    reducedPrecisionTest(rank, HaloPrecision::float32, &transport);
+    // 4 halos of float32, double and float
+    EXPECT_EQ(transport.volume().intraNode, 4 * (sizeof(float) + sizeof(double) + sizeof(float)));
+
+    reducedPrecisionTest(rank, HaloPrecision::scaled16, &transport);
+}
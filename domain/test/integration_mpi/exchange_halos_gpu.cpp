@@ -180,8 +180,9 @@ void simpleTest(int thisRank)
     thrust::device_vector<char> sendBuffer    = std::vector<char>(7 * 24);
     thrust::device_vector<char> receiveBuffer = std::vector<char>(7 * 24);
 
-    haloExchangeGpu(0, incomingHalos, outgoingHalos, sendBuffer, receiveBuffer, thrust::raw_pointer_cast(d_x.data()),
-                    thrust::raw_pointer_cast(d_y.data()), thrust::raw_pointer_cast(d_velocity.data()));
+    haloExchangeGpu(MPI_COMM_WORLD, 0, incomingHalos, outgoingHalos, sendBuffer, receiveBuffer,
+                    thrust::raw_pointer_cast(d_x.data()), thrust::raw_pointer_cast(d_y.data()),
+                    thrust::raw_pointer_cast(d_velocity.data()));
 
     // download from device
     thrust::copy(d_x.begin(), d_x.end(), x.begin());
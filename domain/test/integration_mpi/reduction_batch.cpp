@@ -0,0 +1,82 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Tests batched global reductions
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include <array>
+
+#include "cstone/primitives/reduction_batch.hpp"
+
+using namespace cstone;
+
+TEST(ReductionBatch, mixedOperations)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    ReductionBatch batch;
+
+    std::array<double, 2> pair{0.5 * rank, 1.0};
+    auto                  sumSlot = batch.add(ReduceOp::sum, pair.data(), pair.size());
+    auto                  minSlot = batch.add(ReduceOp::min, float(rank + 1));
+    auto                  maxSlot = batch.add(ReduceOp::max, int64_t(-rank));
+    auto                  cntSlot = batch.add(ReduceOp::sum, size_t(rank + 1));
+
+    EXPECT_THROW(batch.get(minSlot), std::runtime_error);
+    batch.start(MPI_COMM_WORLD);
+
+    // values added after start go into the next reduction
+    auto nextSlot = batch.add(ReduceOp::max, double(rank));
+
+    EXPECT_EQ(batch.get(sumSlot, 0), 0.25 * numRanks * (numRanks - 1));
+    EXPECT_EQ(batch.get(sumSlot, 1), double(numRanks));
+    EXPECT_EQ(batch.get(minSlot), 1.0f);
+    EXPECT_EQ(batch.get(maxSlot), 0);
+    EXPECT_EQ(batch.get(cntSlot), size_t(numRanks * (numRanks + 1) / 2));
+    EXPECT_FALSE(batch.pending());
+
+    batch.start(MPI_COMM_WORLD);
+    EXPECT_EQ(batch.get(nextSlot), double(numRanks - 1));
+    EXPECT_THROW(batch.get(sumSlot), std::runtime_error);
+}
+
+//! @brief starting without registered values does not communicate
+TEST(ReductionBatch, empty)
+{
+    ReductionBatch batch;
+    batch.start(MPI_COMM_WORLD);
+    EXPECT_FALSE(batch.pending());
+
+    auto slot = batch.add(ReduceOp::min, -1.5);
+    batch.start(MPI_COMM_WORLD);
+    EXPECT_EQ(batch.get(slot), -1.5);
+}
@@ -35,6 +35,7 @@
 
 #include "cstone/util/aligned_alloc.hpp"
 #include "cstone/util/noinit_alloc.hpp"
+#include "cstone/util/scratch_arena.hpp"
 #include "cstone/util/traits.hpp"
 
 using namespace util;
@@ -108,3 +109,26 @@ TEST(Utils, discardLastElement)
         EXPECT_EQ(std::get<0>(tup).data(), v1.data());
     }
 }
+
+TEST(Utils, threadScratch)
+{
+    using ScratchA = ThreadScratch<int, struct TagA>;
+    using ScratchB = ThreadScratch<int, struct TagB>;
+
+    int* a = ScratchA::get(100);
+    std::iota(a, a + 100, 0);
+
+    // buffers are persistent and are not shrunk or reinitialized when a smaller size is requested
+    EXPECT_EQ(ScratchA::get(10), a);
+    EXPECT_EQ(a[99], 99);
+    EXPECT_GE(ScratchA::size(), 100);
+
+    // different tags refer to independent buffers
+    EXPECT_NE(ScratchB::get(10), a);
+
+    ScratchA::get(1000);
+    EXPECT_GE(ScratchA::size(), 1000);
+
+    ScratchA::release();
+    EXPECT_EQ(ScratchA::size(), 0);
+}
@@ -0,0 +1,181 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Initializer decorator that caches generated initial conditions in SFC-partitioned form
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+#include <mpi.h>
+#include <unistd.h>
+
+#include "cstone/fields/data_util.hpp"
+
+#include "io/mpi_native_snapshot.hpp"
+#include "ic_cache.hpp"
+#include "isim_init.hpp"
+#include "native_file_init.hpp"
+
+namespace sphexa
+{
+
+/*! @brief Loads initial conditions from a cache directory if available, otherwise generates and stores them
+ *
+ * On a cache hit, each rank reads only its slice of the SFC index of the cached snapshot, like a restart from a
+ * native snapshot. On a miss, the wrapped initializer generates the particles. They are stored with store() after the
+ * first domain synchronization, once they are SFC-sorted and the global octree of the decomposition is known.
+ * Files are written under a temporary name and renamed when complete, such that concurrent jobs with the same
+ * parameters never read a partially written cache entry.
+ */
+template<class Dataset>
+class CachedInit : public ISimInitializer<Dataset>
+{
+public:
+    /*! @brief wrap an initializer
+     *
+     * @param generator   the initializer that generates the particles on a cache miss
+     * @param cacheDir    directory of the cache, created if it does not exist
+     * @param initCond    name of the test case
+     * @param glassBlock  glass block file used by @p generator, may be empty
+     * @param fields      conserved fields of the propagator, these are stored in the cache
+     */
+    CachedInit(std::unique_ptr<ISimInitializer<Dataset>> generator, std::string cacheDir, std::string initCond,
+               std::string glassBlock, std::vector<std::string> fields)
+        : generator_(std::move(generator))
+        , cacheDir_(std::move(cacheDir))
+        , initCond_(std::move(initCond))
+        , glassBlock_(std::move(glassBlock))
+        , fields_(std::move(fields))
+    {
+    }
+
+    cstone::Box<typename Dataset::RealType> init(int rank, int numRanks, size_t n, Dataset& simData) const override
+    {
+        int hit = 0;
+        if (rank == 0)
+        {
+            uint64_t glassHash = glassBlock_.empty() ? 0 : fileContentHash(glassBlock_);
+            path_ = (std::filesystem::path(cacheDir_) /
+                     icCacheFileName(initCond_, n, glassHash, generator_->constants(), fields_))
+                        .string();
+            hit = fileutils::isNativeSnapshot(path_);
+        }
+        broadcastString(path_, simData.comm);
+        MPI_Bcast(&hit, 1, MPI_INT, 0, simData.comm);
+
+        pending_ = !hit;
+        if (hit)
+        {
+            if (rank == 0) { std::cout << "loading initial conditions from cache " << path_ << std::endl; }
+            return restoreNativeData(path_, rank, numRanks, simData.hydro, simData.sfcIndex);
+        }
+
+        if (rank == 0) { std::cout << "initial conditions not cached, generating " << path_ << std::endl; }
+        return generator_->init(rank, numRanks, n, simData);
+    }
+
+    const std::map<std::string, double>& constants() const override { return generator_->constants(); }
+
+    /*! @brief store the initial conditions generated by init(), if they were not loaded from the cache
+     *
+     * Must be called collectively after the first domain synchronization and before the first step.
+     */
+    template<class Domain>
+    void store(Dataset& simData, const Domain& domain, const cstone::Box<typename Dataset::RealType>& box) const
+    {
+        if (!pending_) { return; }
+        pending_ = false;
+
+        auto&  d     = simData.hydro;
+        size_t first = domain.startIndex();
+        size_t last  = domain.endIndex();
+        transferToHost(d, first, last, fields_);
+        simData.sfcIndex.update(domain.globalTree().treeLeaves(), domain.globalCounts());
+        simData.sfcIndex.updateFocus(domain.focusTree().treeLeaves(), domain.focusTree().leafCounts(),
+                                     domain.focusTree().macs());
+
+        int rank;
+        MPI_Comm_rank(simData.comm, &rank);
+
+        uint64_t jobId = getpid();
+        MPI_Bcast(&jobId, 1, MPI_UINT64_T, 0, simData.comm);
+        std::string tmpPath = path_ + ".tmp" + std::to_string(jobId);
+        if (rank == 0) { std::filesystem::create_directories(cacheDir_); }
+        MPI_Barrier(simData.comm);
+
+        uint64_t numLocal = last - first;
+        uint64_t numGlobal;
+        MPI_Allreduce(&numLocal, &numGlobal, 1, MPI_UINT64_T, MPI_SUM, simData.comm);
+
+        auto                                  header = fileutils::nativeHeader(d, box, numGlobal);
+        std::vector<fileutils::NativeColumn> columns;
+        auto                                  src = d.data();
+        for (int i : cstone::fieldStringsToInt(fields_, d.fieldNames))
+        {
+            std::visit([&](auto* field)
+                       { columns.push_back({std::string(d.fieldNames[i]), field->data() + first, numLocal, true}); },
+                       src[i]);
+        }
+        auto indexColumns = fileutils::nativeSfcIndexColumns(simData.sfcIndex, rank);
+        columns.insert(columns.end(), indexColumns.begin(), indexColumns.end());
+
+        // the cache holds the state before the first step, restoreNativeData resumes at header.step + 1
+        header.step = d.iteration - 1;
+        fileutils::writeNativeColumns(tmpPath, header, columns, simData.comm);
+
+        if (rank == 0)
+        {
+            std::filesystem::rename(tmpPath, path_);
+            std::cout << "stored initial conditions in cache " << path_ << std::endl;
+        }
+    }
+
+private:
+    static void broadcastString(std::string& str, MPI_Comm comm)
+    {
+        uint64_t size = str.size();
+        MPI_Bcast(&size, 1, MPI_UINT64_T, 0, comm);
+        str.resize(size);
+        MPI_Bcast(str.data(), int(size), MPI_CHAR, 0, comm);
+    }
+
+    std::unique_ptr<ISimInitializer<Dataset>> generator_;
+    std::string                               cacheDir_, initCond_, glassBlock_;
+    std::vector<std::string>                  fields_;
+
+    //! @brief the cache file of the last call to init()
+    mutable std::string path_;
+    //! @brief whether the initial conditions of the last call to init() still need to be stored
+    mutable bool pending_{false};
+};
+
+} // namespace sphexa
@@ -48,6 +48,7 @@ namespace sphexa
  * @param[inout] y                   y coordinates
  * @param[inout] z                   z coordinates
  * @param[in]    globalBox           global coordinate bounding box
+ * @param[in]    comm                communicator of all ranks holding coordinates
  *
  * This is useful to distribute only the x,y,z coordinates along the space-filling-curve in cases
  * where the initial distribution deviates by a lot from the Cornerstone SFC distribution.
@@ -56,12 +57,12 @@ namespace sphexa
  */
 template<class KeyType, class T, class Vector>
 void syncCoords(size_t rank, size_t numRanks, size_t numParticlesGlobal, Vector& x, Vector& y, Vector& z,
-                const cstone::Box<T>& globalBox)
+                const cstone::Box<T>& globalBox, MPI_Comm comm = MPI_COMM_WORLD)
 {
     size_t                    bucketSize = std::max(64lu, numParticlesGlobal / (100 * numRanks));
     cstone::BufferDescription bufDesc{0, cstone::LocalIndex(x.size()), cstone::LocalIndex(x.size())};
 
-    cstone::GlobalAssignment<KeyType, T> distributor(rank, numRanks, bucketSize, globalBox);
+    cstone::GlobalAssignment<KeyType, T> distributor(rank, numRanks, bucketSize, globalBox, comm);
 
     std::vector<unsigned>                                        orderScratch;
     cstone::SfcSorter<cstone::LocalIndex, std::vector<unsigned>> reorderFunctor(orderScratch);
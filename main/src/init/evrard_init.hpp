@@ -151,7 +151,7 @@ public:
         MPI_Allreduce(MPI_IN_PLACE, &d.numParticlesGlobal, 1, MpiType<size_t>{}, MPI_SUM, simData.comm);
 
         contractRhoProfile(d.x, d.y, d.z);
-        syncCoords<KeyType>(rank, numRanks, d.numParticlesGlobal, d.x, d.y, d.z, globalBox);
+        syncCoords<KeyType>(rank, numRanks, d.numParticlesGlobal, d.x, d.y, d.z, globalBox, simData.comm);
 
         d.resize(d.x.size());
         initEvrardFields(d, constants_);
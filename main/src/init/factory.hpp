@@ -37,6 +37,7 @@
 #include "cstone/sfc/box.hpp"
 
 #include "isim_init.hpp"
+#include "native_file_init.hpp"
 #include "noh_init.hpp"
 #include "sedov_init.hpp"
 #ifdef SPH_EXA_HAVE_H5PART
@@ -68,6 +69,8 @@ std::unique_ptr<ISimInitializer<Dataset>> initializerFactory(std::string testCas
 #endif
     }
 
+    if (fileutils::isNativeSnapshot(testCase)) { return std::make_unique<NativeFileInit<Dataset>>(testCase); }
+
     std::string hdf5_missing = "without HDF5 support";
 
 #ifdef SPH_EXA_HAVE_H5PART
@@ -90,9 +90,16 @@ void initXm1(H5PartFile* h5_file, int rank, Dataset& d)
     }
 }
 
+/*! @brief load the particles of the last step in @p h5File
+ *
+ * If the step has an SFC index that matches the file, each rank reads the particles of the SFC range that the
+ * domain decomposition stored in the index assigns to it and @p sfcIndex is set to the stored index.
+ * Otherwise each rank reads an even share of the particles and @p sfcIndex is cleared.
+ */
 template<class HydroData>
 cstone::Box<typename HydroData::RealType> restoreHydroData(const std::string& h5File, int rank, int numRanks,
-                                                           MPI_Comm comm, HydroData& d)
+                                                           MPI_Comm comm, HydroData& d,
+                                                           SfcIndex<typename HydroData::KeyType>& sfcIndex)
 {
     using T        = typename HydroData::RealType;
     using Boundary = cstone::BoundaryType;
@@ -105,13 +112,20 @@ cstone::Box<typename HydroData::RealType> restoreHydroData(const std::string& h5
     d.numParticlesGlobal = numParticles;
     if (numParticles < 1) { throw std::runtime_error("no particles in input file found\n"); }
 
-    auto [first, last] = partitionRange(numParticles, rank, numRanks);
-    size_t count       = last - first;
-
     H5PartReadStepAttrib(h5_file, "time", &d.ttot);
     H5PartReadStepAttrib(h5_file, "minDt", &d.minDt);
     H5PartReadStepAttrib(h5_file, "minDt_m1", &d.minDt_m1);
     H5PartReadStepAttrib(h5_file, "step", &d.iteration);
+
+    if (!fileutils::readH5SfcIndex(h5_file, d.iteration, sfcIndex) || !sfcIndex.matches(numParticles))
+    {
+        sfcIndex.clear();
+    }
+    auto [first, last] = sfcIndex.empty() ? partitionRange(numParticles, rank, numRanks)
+                                          : sfcIndex.range(rank, numRanks);
+    size_t count       = last - first;
+    if (rank == 0 && !sfcIndex.empty()) { std::cout << "loading particles in SFC order from index\n"; }
+
     d.iteration++;
     H5PartReadStepAttrib(h5_file, "gravConstant", &d.g);
     H5PartReadStepAttrib(h5_file, "gamma", &d.gamma);
@@ -167,7 +181,7 @@ public:
 
     cstone::Box<typename Dataset::RealType> init(int rank, int numRanks, size_t /*n*/, Dataset& simData) const override
     {
-        auto box = restoreHydroData(h5_fname, rank, numRanks, simData.comm, simData.hydro);
+        auto box = restoreHydroData(h5_fname, rank, numRanks, simData.comm, simData.hydro, simData.sfcIndex);
         return box;
     }
 
@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Keys of the initial condition cache
+ *
+ * Generated initial conditions are cached as native snapshots. The file name of a cached initial condition encodes
+ * all inputs that determine the generated particles, such that a launch with different inputs never picks up a
+ * stale file.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace sphexa
+{
+
+//! @brief 64-bit FNV-1a hash of @p size bytes, continuing from @p hash
+inline uint64_t fnv1aHash(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+//! @brief hash of the contents of the file @p path
+inline uint64_t fileContentHash(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { throw std::runtime_error("Cannot open " + path + " to compute its hash\n"); }
+
+    uint64_t          hash = fnv1aHash(nullptr, 0);
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0)
+    {
+        hash = fnv1aHash(buffer.data(), file.gcount(), hash);
+    }
+    return hash;
+}
+
+/*! @brief file name of a cached initial condition
+ *
+ * @param initCond   name of the test case
+ * @param n          value of the -n argument
+ * @param glassHash  content hash of the glass block, 0 if none is used
+ * @param constants  constants of the initializer
+ * @param fields     particle fields that are stored in the cache
+ * @return           a name of the form ic_<initCond>_<n>_<hash>.snap
+ */
+inline std::string icCacheFileName(const std::string& initCond, uint64_t n, uint64_t glassHash,
+                                   const std::map<std::string, double>& constants,
+                                   const std::vector<std::string>&      fields)
+{
+    // strings are hashed including their terminating zero to separate consecutive strings
+    uint64_t hash = fnv1aHash(initCond.c_str(), initCond.size() + 1);
+    hash          = fnv1aHash(&n, sizeof(n), hash);
+    hash          = fnv1aHash(&glassHash, sizeof(glassHash), hash);
+    for (const auto& [name, value] : constants)
+    {
+        hash = fnv1aHash(name.c_str(), name.size() + 1, hash);
+        hash = fnv1aHash(&value, sizeof(value), hash);
+    }
+    for (const auto& field : fields)
+    {
+        hash = fnv1aHash(field.c_str(), field.size() + 1, hash);
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016lx", (unsigned long)hash);
+    return "ic_" + initCond + "_" + std::to_string(n) + "_" + hex + ".snap";
+}
+
+} // namespace sphexa
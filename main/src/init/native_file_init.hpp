@@ -0,0 +1,239 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Restart from a native binary snapshot
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <iostream>
+#include <map>
+
+#include "cstone/sfc/box.hpp"
+
+#include "io/native_delta.hpp"
+#include "io/sfc_index.hpp"
+#include "grid.hpp"
+#include "isim_init.hpp"
+
+namespace sphexa
+{
+
+template<class Vector>
+void initNativeField(const fileutils::NativeCheckpoint& snap, int rank, size_t first, Vector& field, std::string name,
+                     double defaultValue)
+{
+    if (field.size())
+    {
+        if (snap.hasField(name))
+        {
+            if (rank == 0) std::cout << "loading " + name + " from file\n";
+            snap.readField(name, first, field.size(), field.data());
+        }
+        else
+        {
+            if (rank == 0) std::cout << name << " not provided, initializing to " << defaultValue << std::endl;
+            std::fill(field.begin(), field.end(), defaultValue);
+        }
+    }
+}
+
+//! @brief load the SFC index stored in @p snap, returns false if there is none or if its key type does not match
+template<class KeyType>
+bool readNativeSfcIndex(const fileutils::NativeSnapshot& snap, SfcIndex<KeyType>& index)
+{
+    using namespace fileutils;
+    if (!snap.hasField(nativeSfcLeaves) || !snap.hasField(nativeSfcCounts)) { return false; }
+    if (snap.fieldType(nativeSfcLeaves) != nativeType<KeyType>()) { return false; }
+
+    index.update(snap.field<KeyType>(nativeSfcLeaves), snap.field<unsigned>(nativeSfcCounts));
+    return true;
+}
+
+/*! @brief load the focus tree of @p rank stored in @p snap into @p index
+ *
+ * Returns false if the snapshot has no focus trees, or if they were written by a different number of ranks.
+ */
+template<class KeyType>
+bool readNativeFocusTree(const fileutils::NativeSnapshot& snap, int rank, int numRanks, SfcIndex<KeyType>& index)
+{
+    using namespace fileutils;
+    index.clearFocus();
+    for (auto name : {nativeFocusLeaves, nativeFocusCounts, nativeFocusMacs, nativeFocusSizes})
+    {
+        if (!snap.hasField(name)) { return false; }
+    }
+    if (snap.fieldType(nativeFocusLeaves) != nativeType<KeyType>()) { return false; }
+
+    auto sizes = snap.field<uint64_t>(nativeFocusSizes);
+    if (sizes.ssize() != numRanks) { return false; }
+
+    // leaves of each rank are stored with the closing key, macs are stored for the leaves and internal nodes
+    auto     numMacs    = [](uint64_t numLeaves) { return numLeaves + (numLeaves - 1) / 7; };
+    uint64_t leafOffset = 0, macOffset = 0, totalLeaves = 0, totalMacs = 0;
+    for (int i = 0; i < numRanks; ++i)
+    {
+        if (sizes[i] == 0) { return false; }
+        if (i == rank)
+        {
+            leafOffset = totalLeaves;
+            macOffset  = totalMacs;
+        }
+        totalLeaves += sizes[i];
+        totalMacs += numMacs(sizes[i]);
+    }
+    if (snap.fieldCount(nativeFocusLeaves) != totalLeaves + numRanks ||
+        snap.fieldCount(nativeFocusCounts) != totalLeaves || snap.fieldCount(nativeFocusMacs) != totalMacs)
+    {
+        return false;
+    }
+    uint64_t numLeaves = sizes[rank];
+
+    index.focusLeaves.resize(numLeaves + 1);
+    index.focusCounts.resize(numLeaves);
+    index.focusMacs.resize(numMacs(numLeaves));
+    snap.readField(nativeFocusLeaves, leafOffset + rank, index.focusLeaves.size(), index.focusLeaves.data());
+    snap.readField(nativeFocusCounts, leafOffset, index.focusCounts.size(), index.focusCounts.data());
+    snap.readField(nativeFocusMacs, macOffset, index.focusMacs.size(), index.focusMacs.data());
+    index.numFocusLeaves = numLeaves;
+
+    if (!index.focusMatches()) { index.clearFocus(); }
+    return index.hasFocus();
+}
+
+/*! @brief load the particles of a native snapshot, each rank takes a contiguous slice
+ *
+ * Equivalent of restoreHydroData for native snapshots. The file is memory mapped, each rank only touches the pages
+ * of its own slice. If the snapshot has an SFC index, the slices follow the domain decomposition of the index.
+ * Delta checkpoints are resolved against the files of their chain.
+ */
+template<class HydroData>
+cstone::Box<typename HydroData::RealType> restoreNativeData(const std::string& path, int rank, int numRanks,
+                                                             HydroData& d,
+                                                             SfcIndex<typename HydroData::KeyType>& sfcIndex)
+{
+    using T        = typename HydroData::RealType;
+    using Boundary = cstone::BoundaryType;
+
+    fileutils::NativeCheckpoint snap(path);
+    const auto&                 header = snap.header();
+
+    size_t numParticles  = header.numParticles;
+    d.numParticlesGlobal = numParticles;
+    if (numParticles < 1) { throw std::runtime_error("no particles in input file found\n"); }
+
+    if (rank == 0 && snap.isDelta())
+    {
+        std::cout << "restoring delta checkpoint from a chain of " << snap.chainLength() << " files\n";
+    }
+    if (!readNativeSfcIndex(snap.snapshot(), sfcIndex) || !sfcIndex.matches(numParticles)) { sfcIndex.clear(); }
+    if (!sfcIndex.empty()) { readNativeFocusTree(snap.snapshot(), rank, numRanks, sfcIndex); }
+    auto [first, last] = sfcIndex.empty() ? partitionRange(numParticles, rank, numRanks)
+                                          : sfcIndex.range(rank, numRanks);
+    if (rank == 0 && !sfcIndex.empty()) { std::cout << "loading particles in SFC order from index\n"; }
+
+    d.ttot      = header.time;
+    d.minDt     = header.minDt;
+    d.minDt_m1  = header.minDt_m1;
+    d.iteration = header.step + 1;
+    d.g         = header.gravConstant;
+    d.gamma     = header.gamma;
+    d.muiConst  = header.muiConst;
+
+    const double* e           = header.box;
+    Boundary      boundary[3] = {static_cast<Boundary>(header.boundaryType[0]),
+                                 static_cast<Boundary>(header.boundaryType[1]),
+                                 static_cast<Boundary>(header.boundaryType[2])};
+    cstone::Box<T> box(e[0], e[1], e[2], e[3], e[4], e[5], boundary[0], boundary[1], boundary[2]);
+
+    d.resize(last - first);
+
+    for (auto name : {"x", "y", "z", "h", "m", "temp"})
+    {
+        if (!snap.hasField(name)) { throw std::runtime_error("Could not read essential fields x,y,z,h,m,temp\n"); }
+    }
+    snap.readField("x", first, d.x.size(), d.x.data());
+    snap.readField("y", first, d.y.size(), d.y.data());
+    snap.readField("z", first, d.z.size(), d.z.data());
+    snap.readField("h", first, d.h.size(), d.h.data());
+    snap.readField("m", first, d.m.size(), d.m.data());
+    snap.readField("temp", first, d.temp.size(), d.temp.data());
+
+    initNativeField(snap, rank, first, d.vx, "vx", 0.0);
+    initNativeField(snap, rank, first, d.vy, "vy", 0.0);
+    initNativeField(snap, rank, first, d.vz, "vz", 0.0);
+
+    initNativeField(snap, rank, first, d.du_m1, "du_m1", 0.0);
+    initNativeField(snap, rank, first, d.alpha, "alpha", d.alphamin);
+    initNativeField(snap, rank, first, d.mui, "mui", d.muiConst);
+
+    if (snap.hasField("x_m1") && snap.hasField("y_m1") && snap.hasField("z_m1"))
+    {
+        if (rank == 0) std::cout << "loading previous time-step coordinates from file\n";
+        snap.readField("x_m1", first, d.x_m1.size(), d.x_m1.data());
+        snap.readField("y_m1", first, d.y_m1.size(), d.y_m1.data());
+        snap.readField("z_m1", first, d.z_m1.size(), d.z_m1.data());
+    }
+    else
+    {
+        if (rank == 0)
+            std::cout << "no previous time-step coordinates provided, initializing from current coordinates and "
+                         "velocities\n";
+
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < d.x.size(); ++i)
+        {
+            d.x_m1[i] = d.vx[i] * d.minDt;
+            d.y_m1[i] = d.vy[i] * d.minDt;
+            d.z_m1[i] = d.vz[i] * d.minDt;
+        }
+    }
+
+    return box;
+}
+
+template<class Dataset>
+class NativeFileInit : public ISimInitializer<Dataset>
+{
+    std::map<std::string, double> constants_;
+    std::string                   fname_;
+
+public:
+    NativeFileInit(std::string fname)
+        : fname_(fname)
+    {
+    }
+
+    cstone::Box<typename Dataset::RealType> init(int rank, int numRanks, size_t /*n*/, Dataset& simData) const override
+    {
+        return restoreNativeData(fname_, rank, numRanks, simData.hydro, simData.sfcIndex);
+    }
+
+    const std::map<std::string, double>& constants() const override { return constants_; }
+};
+
+} // namespace sphexa
@@ -11,7 +11,7 @@ namespace sphexa
 {
 
 //! @brief returns true if all characters of @p str together represent a valid integral number
-bool strIsIntegral(const std::string& str)
+inline bool strIsIntegral(const std::string& str)
 {
     char* ptr;
     std::strtol(str.c_str(), &ptr, 10);
@@ -61,6 +61,19 @@ public:
         return list;
     }
 
+    //! @brief return the arguments of all occurrences of @p option
+    std::vector<std::string> getAll(const std::string& option) const
+    {
+        std::vector<std::string> values;
+        char**                   itr = std::find(begin, end, option);
+        while (itr != end && itr + 1 != end)
+        {
+            values.emplace_back(*(itr + 1));
+            itr = std::find(itr + 1, end, option);
+        }
+        return values;
+    }
+
     bool exists(const std::string& option) const { return std::find(begin, end, option) != end; }
 
 private:
@@ -76,7 +89,7 @@ private:
  * @return              true if @p step matches any integral numbers in @p extraOutput or
  *                      if any floating point number therein falls into the interval @p [t1, t2)
  */
-bool isExtraOutputStep(size_t step, double t1, double t2, const std::vector<std::string>& extraOutputs)
+inline bool isExtraOutputStep(size_t step, double t1, double t2, const std::vector<std::string>& extraOutputs)
 {
     auto matchStepOrTime = [step, t1, t2](const std::string& token)
     {
@@ -95,7 +108,7 @@ bool isExtraOutputStep(size_t step, double t1, double t2, const std::vector<std:
  * @param frequencyStr  frequency time to output the simulation as string
  * @return              true if the interval [t1, t2] contains an integer multiple of the output frequency
  */
-bool isPeriodicOutputTime(double t1, double t2, const std::string& frequencyStr)
+inline bool isPeriodicOutputTime(double t1, double t2, const std::string& frequencyStr)
 {
     double frequency = std::stod(frequencyStr);
     if (strIsIntegral(frequencyStr) || frequency == 0.0) { return false; }
@@ -110,7 +123,7 @@ bool isPeriodicOutputTime(double t1, double t2, const std::string& frequencyStr)
  * @param frequencyStr  iteration frequency to output the simulation as string
  * @return              true if the step is an integral multiple of the output frequency
  */
-bool isPeriodicOutputStep(size_t step, const std::string& frequencyStr)
+inline bool isPeriodicOutputStep(size_t step, const std::string& frequencyStr)
 {
     int frequency = std::stoi(frequencyStr);
     return strIsIntegral(frequencyStr) && frequency != 0 && (step % frequency == 0);
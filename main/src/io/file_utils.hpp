@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
 #include <fstream>
+#include <string>
 #include <vector>
 #include <variant>
 
@@ -55,6 +58,73 @@ void writeAscii(size_t firstIndex, size_t lastIndex, const std::string& path, bo
     dumpFile.close();
 }
 
+/*! @brief format fields as rows of ASCII columns into a memory buffer
+ *
+ * @param   firstIndex     first field index to format
+ * @param   lastIndex      last field index to format
+ * @param   fields         pointers to field array, each field is a column
+ * @param   separator      character to insert before each column
+ * @return                 one line per index in [firstIndex:lastIndex]
+ *
+ * Rows are formatted in parallel in blocks. Floating point values are printed with std::to_chars in their
+ * shortest representation that reads back to the same value.
+ */
+template<class... T>
+std::string formatAscii(size_t firstIndex, size_t lastIndex, const std::vector<std::variant<T*...>>& fields,
+                        char separator)
+{
+    constexpr size_t blockSize = 4096;
+    // upper bound for the length of a single formatted value, e.g. -1.2345678901234567e-308
+    constexpr size_t maxValueSize = 32;
+
+    size_t numRows   = lastIndex - firstIndex;
+    size_t numBlocks = (numRows + blockSize - 1) / blockSize;
+
+    std::vector<std::string> blocks(numBlocks);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (size_t b = 0; b < numBlocks; ++b)
+    {
+        size_t first = firstIndex + b * blockSize;
+        size_t last  = std::min(first + blockSize, lastIndex);
+
+        std::string& buffer = blocks[b];
+        buffer.resize((last - first) * (fields.size() * (maxValueSize + 1) + 1));
+
+        char* pos = buffer.data();
+        char* end = buffer.data() + buffer.size();
+        for (size_t i = first; i < last; ++i)
+        {
+            for (auto field : fields)
+            {
+                *pos++ = separator;
+                std::visit([&pos, end, i](auto* arg) { pos = std::to_chars(pos, end, arg[i]).ptr; }, field);
+            }
+            *pos++ = '\n';
+        }
+        buffer.resize(pos - buffer.data());
+    }
+
+    std::vector<size_t> offsets(numBlocks + 1, 0);
+    for (size_t b = 0; b < numBlocks; ++b)
+    {
+        offsets[b + 1] = offsets[b] + blocks[b].size();
+    }
+
+    std::string ret(offsets.back(), '\0');
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (size_t b = 0; b < numBlocks; ++b)
+    {
+        std::copy(blocks[b].begin(), blocks[b].end(), ret.begin() + offsets[b]);
+    }
+
+    return ret;
+}
+
 /*! @brief read input data from an ASCII file
  *
  * @tparam T         an elementary type or a std::variant thereof
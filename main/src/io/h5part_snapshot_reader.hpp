@@ -0,0 +1,135 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Snapshot reader for H5Part files
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+#include "mpi_file_utils.hpp"
+#include "snapshot_reader.hpp"
+
+namespace sphexa
+{
+
+/*! @brief reader for the steps of an H5Part file
+ *
+ * The file is opened on MPI_COMM_SELF. Reads go through the HDF5 hyperslab selection of H5PartSetView, therefore
+ * only the requested particle range is read from disk. HDF5 converts fields to double on the fly.
+ */
+class H5PartSnapshotReader : public ISnapshotReader
+{
+public:
+    explicit H5PartSnapshotReader(const std::string& path)
+        : h5File_(fileutils::openH5Part(path, H5PART_READ, MPI_COMM_SELF))
+    {
+        if (h5File_ == nullptr) { throw std::runtime_error("Cannot open H5Part file " + path + "\n"); }
+        numSteps_ = H5PartGetNumSteps(h5File_);
+        if (numSteps_ == 0) { throw std::runtime_error("H5Part file " + path + " contains no steps\n"); }
+        setStep(0);
+    }
+
+    H5PartSnapshotReader(const H5PartSnapshotReader&)            = delete;
+    H5PartSnapshotReader& operator=(const H5PartSnapshotReader&) = delete;
+
+    ~H5PartSnapshotReader() override { H5PartCloseFile(h5File_); }
+
+    size_t numSteps() const override { return numSteps_; }
+
+    void setStep(size_t step) override
+    {
+        if (step >= numSteps_) { throw std::runtime_error("Step " + std::to_string(step) + " does not exist\n"); }
+        H5PartSetStep(h5File_, step);
+        numParticles_ = H5PartGetNumParticles(h5File_);
+    }
+
+    uint64_t numParticles() const override { return numParticles_; }
+
+    std::vector<std::string> fieldNames() const override { return fileutils::datasetNames(h5File_); }
+
+    //! @brief numeric step attributes, read through HDF5 directly, which converts any integer or float type
+    std::vector<std::pair<std::string, std::vector<double>>> attributes() const override
+    {
+        std::vector<std::pair<std::string, std::vector<double>>> attribs;
+
+        int numAttributes = H5Aget_num_attrs(h5File_->timegroup);
+        for (int i = 0; i < numAttributes; ++i)
+        {
+            hid_t       attr      = H5Aopen_idx(h5File_->timegroup, i);
+            hid_t       space     = H5Aget_space(attr);
+            hid_t       fileType  = H5Aget_type(attr);
+            H5T_class_t typeClass = H5Tget_class(fileType);
+
+            int  maxlen = 256;
+            char attrName[maxlen];
+            H5Aget_name(attr, maxlen, attrName);
+
+            std::vector<double> values(H5Sget_simple_extent_npoints(space));
+            if ((typeClass == H5T_INTEGER || typeClass == H5T_FLOAT) &&
+                H5Aread(attr, H5T_NATIVE_DOUBLE, values.data()) >= 0)
+            {
+                attribs.emplace_back(std::string(attrName), std::move(values));
+            }
+
+            H5Tclose(fileType);
+            H5Sclose(space);
+            H5Aclose(attr);
+        }
+        return attribs;
+    }
+
+    void readField(const std::string& name, size_t first, size_t count, double* dest) override
+    {
+        if (count == 0) { return; }
+        if (first + count > numParticles_) { throw std::runtime_error("Read beyond end of field " + name + "\n"); }
+
+        H5PartSetView(h5File_, first, first + count - 1);
+        auto err = fileutils::readH5PartField(h5File_, name, dest);
+        H5PartSetView(h5File_, -1, -1);
+        if (err != H5PART_SUCCESS) { throw std::runtime_error("Could not read field " + name + "\n"); }
+    }
+
+    bool sfcIndex(SfcIndex<uint64_t>& index) override
+    {
+        auto step = readAttribute(*this, "step");
+        bool ok   = fileutils::readH5SfcIndex(h5File_, int64_t(step[0]), index) && index.matches(numParticles_);
+        if (!ok) { index.clear(); }
+        return ok;
+    }
+
+    //! @brief HDF5 is in general not built thread-safe
+    bool concurrentReads() const override { return false; }
+
+private:
+    H5PartFile* h5File_;
+    size_t      numSteps_;
+    uint64_t    numParticles_{0};
+};
+
+} // namespace sphexa
@@ -30,13 +30,24 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "cstone/sfc/box.hpp"
 
 #include "file_utils.hpp"
+#include "mpi_ascii.hpp"
+#include "mpi_native_delta.hpp"
+#include "mpi_native_snapshot.hpp"
 #ifdef SPH_EXA_HAVE_H5PART
 #include "mpi_file_utils.hpp"
 #endif
@@ -53,6 +64,9 @@ struct IFileWriter
 
     virtual std::string suffix() const = 0;
 
+    //! @brief block until all previous dumps are written to file
+    virtual void wait() const {}
+
     virtual ~IFileWriter() = default;
 };
 
@@ -66,29 +80,15 @@ struct AsciiWriter : public IFileWriter<Dataset>
         const char separator = ' ';
         path += std::to_string(d.ttot) + ".txt";
 
-        int rank, numRanks;
-        MPI_Comm_rank(simData.comm, &rank);
-        MPI_Comm_size(simData.comm, &numRanks);
-
-        for (int turn = 0; turn < numRanks; turn++)
+        try
         {
-            if (turn == rank)
-            {
-                try
-                {
-                    auto fieldPointers = getOutputArrays(d);
-
-                    bool append = rank != 0;
-                    fileutils::writeAscii(firstIndex, lastIndex, path, append, fieldPointers, separator);
-                }
-                catch (std::runtime_error& ex)
-                {
-                    if (rank == 0) fprintf(stderr, "ERROR: %s Terminating\n", ex.what());
-                    MPI_Abort(simData.comm, 1);
-                }
-            }
-
-            MPI_Barrier(simData.comm);
+            auto fieldPointers = getOutputArrays(d);
+            fileutils::writeAsciiCollective(firstIndex, lastIndex, path, fieldPointers, separator, simData.comm);
+        }
+        catch (std::runtime_error& ex)
+        {
+            fprintf(stderr, "ERROR: %s Terminating\n", ex.what());
+            MPI_Abort(simData.comm, 1);
         }
     }
 
@@ -105,7 +105,7 @@ struct H5PartWriter : public IFileWriter<Dataset>
     {
         auto& d = simData.hydro;
 #ifdef SPH_EXA_HAVE_H5PART
-        fileutils::writeH5Part(d, firstIndex, lastIndex, box, path, simData.comm);
+        fileutils::writeH5Part(d, firstIndex, lastIndex, box, path, simData.sfcIndex, simData.comm);
 #else
         throw std::runtime_error("Cannot write to HDF5 file: H5Part not enabled\n");
 #endif
@@ -145,11 +145,371 @@ struct H5PartWriter : public IFileWriter<Dataset>
     std::string suffix() const override { return ".h5"; }
 };
 
+/*! @brief Writer of the native binary snapshot format, see native_snapshot.hpp
+ *
+ * Each dump goes to a separate file, named after @p path and the iteration. Does not require HDF5.
+ * Fields are compressed according to @p compression, see native_codec.hpp. If delta checkpoints are configured,
+ * dumps to the same @p path form chains of a full snapshot followed by deltas, see native_delta.hpp.
+ */
 template<class Dataset>
-std::unique_ptr<IFileWriter<Dataset>> fileWriterFactory(bool ascii)
+struct NativeWriter : public IFileWriter<Dataset>
+{
+    using KeyType = typename Dataset::KeyType;
+
+    NativeWriter(fileutils::NativeCompression compression = {}, fileutils::NativeDeltaConfig delta = {})
+        : compression_(std::move(compression))
+        , delta_(delta)
+    {
+    }
+
+    void dump(Dataset& simData, size_t firstIndex, size_t lastIndex, const cstone::Box<typename Dataset::RealType>& box,
+              std::string path) const override
+    {
+        auto&       d        = simData.hydro;
+        std::string fileName = path + "_" + std::to_string(d.iteration) + ".snap";
+        if (delta_.fullEvery <= 1)
+        {
+            fileutils::writeNativeSnapshot(d, firstIndex, lastIndex, box, simData.sfcIndex, fileName, simData.comm,
+                                           compression_);
+            return;
+        }
+
+        auto chain = deltaWriters_.try_emplace(path, delta_).first;
+        chain->second.write(d, firstIndex, lastIndex, box, simData.sfcIndex, fileName, simData.comm, compression_);
+    }
+
+    //! @brief write simulation parameters as (name, value) lines of text, must be called on one rank only
+    void constants(const std::map<std::string, double>& c, std::string path) const override
+    {
+        std::ofstream constantsFile(path + "_constants.txt");
+        constantsFile.precision(17);
+        for (auto it = c.begin(); it != c.end(); ++it)
+        {
+            constantsFile << it->first << " " << it->second << std::endl;
+        }
+    }
+
+    std::string suffix() const override { return ""; }
+
+private:
+    fileutils::NativeCompression compression_;
+    fileutils::NativeDeltaConfig delta_;
+
+    //! @brief checkpoint chain state of each output path
+    mutable std::map<std::string, fileutils::NativeDeltaWriter<KeyType>> deltaWriters_;
+};
+
+//! @brief copy the time step, conserved quantities and physical constants of @p d to @p s
+template<class HydroData>
+void copyScalarAttributes(const HydroData& d, HydroData& s)
+{
+    s.iteration          = d.iteration;
+    s.numParticlesGlobal = d.numParticlesGlobal;
+    s.ttot               = d.ttot;
+    s.etot               = d.etot;
+    s.ecin               = d.ecin;
+    s.eint               = d.eint;
+    s.egrav              = d.egrav;
+    s.linmom             = d.linmom;
+    s.angmom             = d.angmom;
+    s.minDt              = d.minDt;
+    s.minDt_m1           = d.minDt_m1;
+    s.g                  = d.g;
+    s.gamma              = d.gamma;
+    s.muiConst           = d.muiConst;
+}
+
+/*! @brief Decorator that writes the output fields of another writer from a dedicated I/O thread
+ *
+ * dump() copies the scalar attributes and the selected output fields of the assigned particles into a staging
+ * dataset and returns, while the I/O thread writes the staging dataset with the wrapped writer. There are at most
+ * two staging datasets, fewer if two snapshots exceed @p memoryBudget. If no staging dataset is free, dump() blocks
+ * until the oldest pending write finishes (backpressure). The time spent staging, waiting and writing is reported
+ * on @p out by the first rank.
+ *
+ * The I/O thread uses a duplicate of the dataset communicator @p comm for its collective calls, this requires MPI to
+ * be initialized with MPI_THREAD_MULTIPLE. Otherwise, or if the largest snapshot part of any rank exceeds
+ * @p memoryBudget, output is written synchronously. All ranks of @p comm take the same decision.
+ */
+template<class Dataset>
+class AsyncFileWriter : public IFileWriter<Dataset>
+{
+    using Clock   = std::chrono::high_resolution_clock;
+    using Seconds = std::chrono::duration<float>;
+
+public:
+    AsyncFileWriter(std::unique_ptr<IFileWriter<Dataset>> writer, size_t memoryBudget, std::ostream& out,
+                    MPI_Comm comm)
+        : writer_(std::move(writer))
+        , memoryBudget_(memoryBudget)
+        , out_(out)
+    {
+        int threadLevel;
+        MPI_Query_thread(&threadLevel);
+        MPI_Comm_rank(comm, &rank_);
+        if (threadLevel < MPI_THREAD_MULTIPLE && rank_ == 0)
+        {
+            fprintf(stderr, "WARNING: MPI_THREAD_MULTIPLE not available, writing output synchronously\n");
+        }
+        threaded_ = threadLevel >= MPI_THREAD_MULTIPLE;
+    }
+
+    ~AsyncFileWriter() override
+    {
+        if (!ioThread_.joinable()) { return; }
+        {
+            std::lock_guard lock(mutex_);
+            shutdown_ = true;
+        }
+        jobReady_.notify_one();
+        ioThread_.join();
+
+        int finalized;
+        MPI_Finalized(&finalized);
+        if (!finalized) { MPI_Comm_free(&ioComm_); }
+    }
+
+    void dump(Dataset& simData, size_t firstIndex, size_t lastIndex, const cstone::Box<typename Dataset::RealType>& box,
+              std::string path) const override
+    {
+        auto&    d        = simData.hydro;
+        uint64_t numBytes = snapshotBytes(d, lastIndex - firstIndex);
+        // the synchronous path dumps on simData.comm, the asynchronous one on ioComm_, all ranks have to agree
+        if (threaded_) { MPI_Allreduce(MPI_IN_PLACE, &numBytes, 1, MPI_UINT64_T, MPI_MAX, simData.comm); }
+        int maxSlots = std::min(uint64_t(2), numBytes ? memoryBudget_ / numBytes : uint64_t(2));
+
+        if (!threaded_ || maxSlots == 0)
+        {
+            wait();
+            writer_->dump(simData, firstIndex, lastIndex, box, path);
+            return;
+        }
+        if (!ioThread_.joinable()) { startThread(simData.comm); }
+
+        auto t0 = Clock::now();
+        {
+            std::unique_lock lock(mutex_);
+            slotFree_.wait(lock, [this, maxSlots] { return numPending_ < maxSlots; });
+        }
+        auto t1 = Clock::now();
+
+        std::unique_ptr<Dataset> staging;
+        {
+            std::lock_guard lock(mutex_);
+            rethrow();
+            if (!freeSlots_.empty())
+            {
+                staging = std::move(freeSlots_.back());
+                freeSlots_.pop_back();
+            }
+        }
+        if (!staging) { staging = std::make_unique<Dataset>(); }
+        stage(d, firstIndex, lastIndex, *staging);
+        staging->sfcIndex = simData.sfcIndex;
+        staging->comm     = ioComm_;
+
+        {
+            std::lock_guard lock(mutex_);
+            jobs_.push_back({std::move(staging), lastIndex - firstIndex, box, std::move(path)});
+            numPending_++;
+        }
+        jobReady_.notify_one();
+        auto t2 = Clock::now();
+
+        if (rank_ == 0)
+        {
+            out_ << "# Output staging: " << Seconds(t2 - t1).count() << "s, backpressure: " << Seconds(t1 - t0).count()
+                 << "s" << std::endl;
+        }
+        report();
+    }
+
+    void constants(const std::map<std::string, double>& c, std::string path) const override
+    {
+        writer_->constants(c, path);
+    }
+
+    std::string suffix() const override { return writer_->suffix(); }
+
+    void wait() const override
+    {
+        if (!ioThread_.joinable()) { return; }
+        auto t0 = Clock::now();
+        {
+            std::unique_lock lock(mutex_);
+            slotFree_.wait(lock, [this] { return numPending_ == 0; });
+            rethrow();
+        }
+        report();
+        if (rank_ == 0) { out_ << "# Output wait: " << Seconds(Clock::now() - t0).count() << "s" << std::endl; }
+    }
+
+private:
+    struct Job
+    {
+        std::unique_ptr<Dataset>                data;
+        size_t                                  numParticles;
+        cstone::Box<typename Dataset::RealType> box{0, 1};
+        std::string                             path;
+    };
+
+    template<class HydroData>
+    static size_t snapshotBytes(HydroData& d, size_t numParticles)
+    {
+        auto   fields   = d.data();
+        size_t numBytes = 0;
+        for (int i : d.outputFieldIndices)
+        {
+            std::visit([&numBytes, numParticles](auto* field)
+                       { numBytes += numParticles * sizeof(typename std::decay_t<decltype(*field)>::value_type); },
+                       fields[i]);
+        }
+        return numBytes;
+    }
+
+    //! @brief copy scalar attributes and the [firstIndex:lastIndex] range of the output fields into @p staging
+    template<class HydroData>
+    static void stage(HydroData& d, size_t firstIndex, size_t lastIndex, Dataset& staging)
+    {
+        auto& s = staging.hydro;
+
+        copyScalarAttributes(d, s);
+
+        s.setOutputFields(d.outputFieldNames);
+        for (int i : d.outputFieldIndices)
+        {
+            s.setConserved(size_t(i));
+        }
+        s.resize(lastIndex - firstIndex);
+
+        auto src = d.data();
+        auto dst = s.data();
+        for (int i : d.outputFieldIndices)
+        {
+            std::visit(
+                [firstIndex, lastIndex](auto* from, auto* to)
+                {
+                    if constexpr (std::is_same_v<decltype(from), decltype(to)>)
+                    {
+                        std::copy(from->begin() + firstIndex, from->begin() + lastIndex, to->begin());
+                    }
+                },
+                src[i], dst[i]);
+        }
+    }
+
+    void startThread(MPI_Comm comm) const
+    {
+        MPI_Comm_dup(comm, &ioComm_);
+        ioThread_ = std::thread([this] { ioLoop(); });
+    }
+
+    void ioLoop() const
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock lock(mutex_);
+                jobReady_.wait(lock, [this] { return shutdown_ || !jobs_.empty(); });
+                if (jobs_.empty()) { return; }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+
+            auto t0 = Clock::now();
+            try
+            {
+                writer_->dump(*job.data, 0, job.numParticles, job.box, job.path);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(mutex_);
+                error_ = std::current_exception();
+            }
+            float elapsed = Seconds(Clock::now() - t0).count();
+
+            {
+                std::lock_guard lock(mutex_);
+                writeTimes_.push_back(elapsed);
+                freeSlots_.push_back(std::move(job.data));
+                numPending_--;
+            }
+            slotFree_.notify_all();
+        }
+    }
+
+    //! @brief print the durations of writes completed since the last report
+    void report() const
+    {
+        std::vector<float> times;
+        {
+            std::lock_guard lock(mutex_);
+            std::swap(times, writeTimes_);
+        }
+        if (rank_ != 0) { return; }
+        for (float t : times)
+        {
+            out_ << "# Output written in background: " << t << "s" << std::endl;
+        }
+    }
+
+    //! @brief forward exceptions from the I/O thread, mutex_ needs to be held
+    void rethrow() const
+    {
+        if (error_)
+        {
+            auto e = error_;
+            error_ = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    std::unique_ptr<IFileWriter<Dataset>> writer_;
+    size_t                                memoryBudget_;
+    std::ostream&                         out_;
+    int                                   rank_;
+    bool                                  threaded_;
+
+    mutable MPI_Comm    ioComm_;
+    mutable std::thread ioThread_;
+
+    mutable std::mutex              mutex_;
+    mutable std::condition_variable jobReady_;
+    mutable std::condition_variable slotFree_;
+
+    mutable std::deque<Job>                       jobs_;
+    mutable std::vector<std::unique_ptr<Dataset>> freeSlots_;
+    mutable std::vector<float>                    writeTimes_;
+    mutable std::exception_ptr                    error_;
+    mutable int                                   numPending_{0};
+    mutable bool                                  shutdown_{false};
+};
+
+template<class Dataset>
+std::unique_ptr<IFileWriter<Dataset>> fileWriterFactory(bool ascii, bool native = false,
+                                                        const fileutils::NativeCompression& compression = {},
+                                                        const fileutils::NativeDeltaConfig&  delta       = {})
 {
     if (ascii) { return std::make_unique<AsciiWriter<Dataset>>(); }
+    if (native) { return std::make_unique<NativeWriter<Dataset>>(compression, delta); }
     else { return std::make_unique<H5PartWriter<Dataset>>(); }
 }
 
+/*! @brief as above, optionally wrapped in an AsyncFileWriter
+ *
+ * @param memoryBudget  maximum size in bytes of the staging buffers for asynchronous output
+ * @param comm          communicator of the dataset to be written
+ */
+template<class Dataset>
+std::unique_ptr<IFileWriter<Dataset>>
+fileWriterFactory(bool ascii, bool native, const fileutils::NativeCompression& compression,
+                  const fileutils::NativeDeltaConfig& delta, bool async, size_t memoryBudget, std::ostream& out,
+                  MPI_Comm comm)
+{
+    auto writer = fileWriterFactory<Dataset>(ascii, native, compression, delta);
+    if (async) { return std::make_unique<AsyncFileWriter<Dataset>>(std::move(writer), memoryBudget, out, comm); }
+    return writer;
+}
+
 } // namespace sphexa
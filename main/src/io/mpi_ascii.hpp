@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Parallel ASCII output based on MPI-IO
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+#include "file_utils.hpp"
+
+namespace sphexa
+{
+namespace fileutils
+{
+
+/*! @brief write fields of all ranks as columns to an ASCII file
+ *
+ * @param   firstIndex     first field index to write
+ * @param   lastIndex      last field index to write
+ * @param   path           the file name to write to, overwritten if it exists
+ * @param   fields         pointers to field array, each field is a column
+ * @param   separator      character to insert before each column
+ * @param   comm           all ranks in @p comm write their rows in rank order
+ *
+ * Each rank formats its rows into memory, file offsets are obtained from an exclusive scan of the byte counts
+ * and the buffers are written with collective MPI_File_write_at_all calls.
+ */
+template<class... T>
+void writeAsciiCollective(size_t firstIndex, size_t lastIndex, const std::string& path,
+                          const std::vector<std::variant<T*...>>& fields, char separator, MPI_Comm comm)
+{
+    // keep the element count of each MPI call within the range of int
+    constexpr uint64_t maxChunkSize = uint64_t(1) << 30;
+
+    std::string buffer = formatAscii(firstIndex, lastIndex, fields, separator);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    uint64_t numBytes = buffer.size();
+    uint64_t totalBytes, rankOffset = 0;
+    MPI_Exscan(&numBytes, &rankOffset, 1, MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Allreduce(&numBytes, &totalBytes, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) { rankOffset = 0; }
+
+    // collective calls need to be matched on all ranks
+    uint64_t numChunks = (numBytes + maxChunkSize - 1) / maxChunkSize;
+    MPI_Allreduce(MPI_IN_PLACE, &numChunks, 1, MPI_UINT64_T, MPI_MAX, comm);
+
+    MPI_File fh;
+    int      err = MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("Can't open file at path: " + path); }
+    err |= MPI_File_set_size(fh, totalBytes);
+
+    for (uint64_t c = 0; c < numChunks; ++c)
+    {
+        uint64_t first = std::min(c * maxChunkSize, numBytes);
+        uint64_t count = std::min(maxChunkSize, numBytes - first);
+        err |= MPI_File_write_at_all(fh, rankOffset + first, buffer.data() + first, int(count), MPI_CHAR,
+                                     MPI_STATUS_IGNORE);
+    }
+
+    err |= MPI_File_close(&fh);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("Error writing to file at path: " + path); }
+}
+
+} // namespace fileutils
+} // namespace sphexa
@@ -34,6 +34,8 @@
 #include <variant>
 #include "H5Part.h"
 
+#include "sfc_index.hpp"
+
 namespace sphexa
 {
 namespace fileutils
@@ -121,6 +123,88 @@ inline h5part_int64_t writeH5PartField(H5PartFile* h5_file, const std::string& f
     return H5PartWriteDataFloat64(h5_file, fieldName.c_str(), field);
 }
 
+template<class T>
+hid_t h5IndexType()
+{
+    static_assert(std::is_same_v<T, unsigned> || std::is_same_v<T, uint64_t>);
+    return std::is_same_v<T, unsigned> ? H5T_NATIVE_UINT : H5T_NATIVE_UINT64;
+}
+
+/*! @brief name of the group holding the SFC index of output iteration @p step
+ *
+ * The group is stored at the file root. Since its name does not start with the H5Part step prefix,
+ * it is invisible to H5Part step and dataset queries.
+ */
+inline std::string sfcIndexGroupName(int64_t step) { return "SfcIndex#" + std::to_string(step); }
+
+template<class T>
+void writeH5IndexDataset(hid_t group, const char* name, const std::vector<T>& data, bool writeData)
+{
+    hsize_t size  = data.size();
+    hid_t   space = H5Screate_simple(1, &size, nullptr);
+    hid_t   dset  = H5Dcreate2(group, name, h5IndexType<T>(), space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (writeData) { H5Dwrite(dset, h5IndexType<T>(), H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data()); }
+    H5Dclose(dset);
+    H5Sclose(space);
+}
+
+//! @brief read a 1D dataset into @p data, returns false if it does not exist or its element size does not match T
+template<class T>
+bool readH5IndexDataset(hid_t group, const char* name, std::vector<T>& data)
+{
+    if (H5Lexists(group, name, H5P_DEFAULT) <= 0) { return false; }
+
+    hid_t dset      = H5Dopen2(group, name, H5P_DEFAULT);
+    hid_t space     = H5Dget_space(dset);
+    hid_t fileType  = H5Dget_type(dset);
+    bool  typeMatch = H5Tget_size(fileType) == sizeof(T);
+
+    hsize_t size = 0;
+    H5Sget_simple_extent_dims(space, &size, nullptr);
+    data.resize(size);
+
+    bool ok = typeMatch && H5Dread(dset, h5IndexType<T>(), H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data()) >= 0;
+
+    H5Tclose(fileType);
+    H5Sclose(space);
+    H5Dclose(dset);
+    return ok;
+}
+
+/*! @brief store the SFC index of output iteration @p step in @p h5_file
+ *
+ * Must be called by all ranks with identical arguments, only rank 0 writes data.
+ */
+template<class KeyType>
+void writeH5SfcIndex(H5PartFile* h5_file, int64_t step, const SfcIndex<KeyType>& index, int rank)
+{
+    std::string groupName = sfcIndexGroupName(step);
+    if (index.empty() || H5Lexists(h5_file->file, groupName.c_str(), H5P_DEFAULT) > 0) { return; }
+
+    hid_t group = H5Gcreate2(h5_file->file, groupName.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    writeH5IndexDataset(group, "leaves", index.leaves, rank == 0);
+    writeH5IndexDataset(group, "counts", index.counts, rank == 0);
+    H5Gclose(group);
+}
+
+/*! @brief load the SFC index of output iteration @p step from @p h5_file
+ *
+ * @return  true if an index with keys of type KeyType was found
+ */
+template<class KeyType>
+bool readH5SfcIndex(H5PartFile* h5_file, int64_t step, SfcIndex<KeyType>& index)
+{
+    std::string groupName = sfcIndexGroupName(step);
+    if (H5Lexists(h5_file->file, groupName.c_str(), H5P_DEFAULT) <= 0) { return false; }
+
+    hid_t group = H5Gopen2(h5_file->file, groupName.c_str(), H5P_DEFAULT);
+    bool  found = readH5IndexDataset(group, "leaves", index.leaves) && readH5IndexDataset(group, "counts", index.counts);
+    H5Gclose(group);
+
+    if (!found) { index.clear(); }
+    return found;
+}
+
 void sphexaWriteStepAttrib(H5PartFile* h5_file, const std::string& name, double* value, size_t numElements)
 {
     H5PartWriteStepAttrib(h5_file, name.c_str(), H5PART_FLOAT64, value, numElements);
@@ -167,9 +251,9 @@ H5PartFile* openH5Part(const std::string& path, h5part_int64_t mode, MPI_Comm co
     return h5_file;
 }
 
-template<class Dataset, class T>
+template<class Dataset, class T, class KeyType>
 void writeH5Part(Dataset& d, size_t firstIndex, size_t lastIndex, const cstone::Box<T>& box, const std::string& path,
-                 MPI_Comm comm)
+                 const SfcIndex<KeyType>& sfcIndex, MPI_Comm comm)
 {
     H5PartFile* h5_file = nullptr;
 
@@ -210,6 +294,10 @@ void writeH5Part(Dataset& d, size_t firstIndex, size_t lastIndex, const cstone::
                    fieldPointers[fidx]);
     }
 
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    writeH5SfcIndex(h5_file, d.iteration, sfcIndex, rank);
+
     H5PartCloseFile(h5_file);
 }
 
@@ -0,0 +1,330 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Parallel writer of native delta checkpoints, see native_delta.hpp for the format
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "mpi_native_snapshot.hpp"
+#include "native_delta.hpp"
+
+namespace sphexa
+{
+namespace fileutils
+{
+
+/*! @brief Writes a chain of checkpoints, consisting of a full snapshot followed by deltas
+ *
+ * Each rank keeps the checkpointed state of its particles, as it is reconstructed from the chain, and the location
+ * of each (block, field) pair in the chain. A (block, field) pair is stored in the next delta if the block is new
+ * to the rank or if any value of the field in the block differs by more than the tolerance from the checkpointed
+ * state. Blocks are the leaves of the SFC index, such that frozen regions of the simulation are skipped entirely.
+ * The checkpointed state costs one copy of the output fields of the local particles in memory.
+ *
+ * A full snapshot is written every NativeDeltaConfig::fullEvery checkpoints, if the output fields change, or if
+ * the SFC index does not describe the particles of each rank.
+ */
+template<class KeyType>
+class NativeDeltaWriter
+{
+public:
+    explicit NativeDeltaWriter(NativeDeltaConfig config)
+        : config_(config)
+    {
+    }
+
+    template<class HydroData, class T>
+    void write(HydroData& d, size_t firstIndex, size_t lastIndex, const cstone::Box<T>& box,
+               const SfcIndex<KeyType>& sfcIndex, const std::string& path, MPI_Comm comm,
+               const NativeCompression& compression)
+    {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+
+        uint64_t numLocal = lastIndex - firstIndex;
+        uint64_t numGlobal, rankOffset = 0;
+        MPI_Exscan(&numLocal, &rankOffset, 1, MPI_UINT64_T, MPI_SUM, comm);
+        MPI_Allreduce(&numLocal, &numGlobal, 1, MPI_UINT64_T, MPI_SUM, comm);
+        if (rank == 0) { rankOffset = 0; }
+
+        std::vector<Block> blocks;
+        int                haveBlocks = localBlocks(sfcIndex, rankOffset, numLocal, blocks);
+        MPI_Allreduce(MPI_IN_PLACE, &haveBlocks, 1, MPI_INT, MPI_LAND, comm);
+
+        bool full = chain_.empty() || chain_.size() >= config_.fullEvery || !haveBlocks ||
+                    d.outputFieldNames != fieldNames_;
+
+        auto        fieldPointers = cstone::getOutputArrays(d);
+        std::string fileName      = std::filesystem::path(path).filename().string();
+
+        if (full)
+        {
+            writeNativeSnapshot(d, firstIndex, lastIndex, box, sfcIndex, path, comm, compression);
+
+            chain_      = {fileName};
+            fieldNames_ = d.outputFieldNames;
+            refBlocks_  = haveBlocks ? blocks : std::vector<Block>{};
+            refValues_.assign(fieldPointers.size(), {});
+            refSources_.assign(fieldPointers.size(), {});
+            for (size_t f = 0; f < fieldPointers.size(); ++f)
+            {
+                std::visit([&](auto* p) { appendBytes(p + firstIndex, numLocal, refValues_[f]); }, fieldPointers[f]);
+                for (const auto& block : refBlocks_)
+                {
+                    refSources_[f].push_back({0, rankOffset + block.offset});
+                }
+            }
+            return;
+        }
+
+        size_t numFields = fieldPointers.size();
+        size_t numBlocks = blocks.size();
+
+        // reference block of each local block, or -1 if the block is not in the checkpointed state of this rank
+        std::vector<int64_t> refIndex(numBlocks, -1);
+        for (size_t b = 0; b < numBlocks; ++b)
+        {
+            auto it = std::lower_bound(refBlocks_.begin(), refBlocks_.end(), blocks[b],
+                                       [](const Block& lhs, const Block& rhs) { return lhs.start < rhs.start; });
+            if (it != refBlocks_.end() && it->start == blocks[b].start && it->end == blocks[b].end &&
+                it->count == blocks[b].count)
+            {
+                refIndex[b] = it - refBlocks_.begin();
+            }
+        }
+
+        // a (block, field) pair is changed if it has no reference or if any value exceeds the tolerance
+        std::vector<char> changed(numBlocks * numFields);
+        for (size_t f = 0; f < numFields; ++f)
+        {
+            std::visit(
+                [&](auto* p)
+                {
+                    using F          = std::decay_t<decltype(*p)>;
+                    double tolerance = absoluteTolerance(p + firstIndex, numLocal, comm);
+                    auto*  refValues = reinterpret_cast<const F*>(refValues_[f].data());
+
+#pragma omp parallel for schedule(dynamic)
+                    for (size_t b = 0; b < numBlocks; ++b)
+                    {
+                        if (refIndex[b] < 0)
+                        {
+                            changed[b * numFields + f] = 1;
+                            continue;
+                        }
+                        const F* current   = p + firstIndex + blocks[b].offset;
+                        const F* reference = refValues + refBlocks_[refIndex[b]].offset;
+                        changed[b * numFields + f] =
+                            exceedsTolerance(current, reference, blocks[b].count, tolerance);
+                    }
+                },
+                fieldPointers[f]);
+        }
+
+        // pack the changed blocks of each field and compute their position in the columns of the delta
+        std::vector<uint64_t> packedCounts(numFields, 0), packedOffsets(numFields, 0);
+        std::vector<uint64_t> packedPosition(numBlocks * numFields);
+        for (size_t b = 0; b < numBlocks; ++b)
+        {
+            for (size_t f = 0; f < numFields; ++f)
+            {
+                if (!changed[b * numFields + f]) { continue; }
+                packedPosition[b * numFields + f] = packedCounts[f];
+                packedCounts[f] += blocks[b].count;
+            }
+        }
+        MPI_Exscan(packedCounts.data(), packedOffsets.data(), numFields, MPI_UINT64_T, MPI_SUM, comm);
+        if (rank == 0) { std::fill(packedOffsets.begin(), packedOffsets.end(), 0); }
+
+        uint64_t self = chain_.size();
+
+        std::vector<std::vector<char>>                    packed(numFields), newValues(numFields);
+        std::vector<std::vector<std::array<uint64_t, 2>>> newSources(numFields);
+        std::vector<uint64_t>                             records;
+        for (size_t b = 0; b < numBlocks; ++b)
+        {
+            records.insert(records.end(), {rankOffset + blocks[b].offset, blocks[b].count});
+            for (size_t f = 0; f < numFields; ++f)
+            {
+                std::array<uint64_t, 2> source{self, packedOffsets[f] + packedPosition[b * numFields + f]};
+                if (!changed[b * numFields + f]) { source = refSources_[f][refIndex[b]]; }
+                records.insert(records.end(), source.begin(), source.end());
+                newSources[f].push_back(source);
+            }
+        }
+
+        for (size_t f = 0; f < numFields; ++f)
+        {
+            std::visit(
+                [&](auto* p)
+                {
+                    using F          = std::decay_t<decltype(*p)>;
+                    auto* refValues  = reinterpret_cast<const F*>(refValues_[f].data());
+                    newValues[f].reserve(numLocal * sizeof(F));
+                    packed[f].reserve(packedCounts[f] * sizeof(F));
+                    for (size_t b = 0; b < numBlocks; ++b)
+                    {
+                        const F* current = p + firstIndex + blocks[b].offset;
+                        if (changed[b * numFields + f])
+                        {
+                            appendBytes(current, blocks[b].count, packed[f]);
+                            appendBytes(current, blocks[b].count, newValues[f]);
+                        }
+                        else
+                        {
+                            appendBytes(refValues + refBlocks_[refIndex[b]].offset, blocks[b].count, newValues[f]);
+                        }
+                    }
+                },
+                fieldPointers[f]);
+        }
+
+        std::string sourceList;
+        for (const auto& name : chain_)
+        {
+            sourceList += name + "\n";
+        }
+        sourceList += fileName;
+
+        std::vector<NativeColumn> columns;
+        for (size_t f = 0; f < numFields; ++f)
+        {
+            std::visit(
+                [&](auto* p)
+                {
+                    using F = std::decay_t<decltype(*p)>;
+                    columns.push_back({fieldNames_[f], reinterpret_cast<const F*>(packed[f].data()), packedCounts[f],
+                                       true});
+                },
+                fieldPointers[f]);
+        }
+        auto indexColumns = nativeSfcIndexColumns(sfcIndex, rank);
+        columns.insert(columns.end(), indexColumns.begin(), indexColumns.end());
+        columns.push_back({nativeDeltaSources, reinterpret_cast<const uint8_t*>(sourceList.data()),
+                           rank == 0 ? sourceList.size() : 0, false});
+        columns.push_back({nativeDeltaBlocks, records.data(), records.size(), true});
+
+        writeNativeColumns(path, nativeHeader(d, box, numGlobal), columns, comm, compression);
+
+        chain_.push_back(fileName);
+        refBlocks_ = std::move(blocks);
+        swap(refValues_, newValues);
+        swap(refSources_, newSources);
+    }
+
+private:
+    //! @brief a leaf of the SFC index with its local particles, offset is relative to the first local particle
+    struct Block
+    {
+        KeyType  start, end;
+        uint64_t count;
+        uint64_t offset;
+    };
+
+    /*! @brief the leaves of @p sfcIndex that hold the particles [rankOffset:rankOffset+numLocal] of the file
+     *
+     * @return  true if the particles of the executing rank are exactly covered by a range of leaves
+     */
+    static bool localBlocks(const SfcIndex<KeyType>& sfcIndex, uint64_t rankOffset, uint64_t numLocal,
+                            std::vector<Block>& blocks)
+    {
+        if (sfcIndex.empty() || sfcIndex.leaves.size() != sfcIndex.counts.size() + 1) { return false; }
+        if (numLocal == 0) { return true; }
+
+        uint64_t leafOffset = 0;
+        for (size_t i = 0; i < sfcIndex.counts.size() && leafOffset < rankOffset + numLocal; ++i)
+        {
+            uint64_t count = sfcIndex.counts[i];
+            if (leafOffset >= rankOffset && count > 0)
+            {
+                blocks.push_back({sfcIndex.leaves[i], sfcIndex.leaves[i + 1], count, leafOffset - rankOffset});
+            }
+            else if (leafOffset < rankOffset && leafOffset + count > rankOffset) { return false; }
+            leafOffset += count;
+        }
+        return leafOffset == rankOffset + numLocal;
+    }
+
+    template<class F>
+    static void appendBytes(const F* values, size_t n, std::vector<char>& bytes)
+    {
+        auto* begin = reinterpret_cast<const char*>(values);
+        bytes.insert(bytes.end(), begin, begin + n * sizeof(F));
+    }
+
+    //! @brief tolerated absolute change of a field with local values @p values
+    template<class F>
+    double absoluteTolerance(const F* values, size_t n, MPI_Comm comm) const
+    {
+        if (config_.relativeTolerance <= 0) { return 0; }
+        double maxAbs = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            maxAbs = std::max(maxAbs, std::abs(double(values[i])));
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &maxAbs, 1, MPI_DOUBLE, MPI_MAX, comm);
+        return config_.relativeTolerance * maxAbs;
+    }
+
+    template<class F>
+    static bool exceedsTolerance(const F* current, const F* reference, size_t n, double tolerance)
+    {
+        if (tolerance == 0) { return std::memcmp(current, reference, n * sizeof(F)) != 0; }
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!(std::abs(double(current[i]) - double(reference[i])) <= tolerance)) { return true; }
+        }
+        return false;
+    }
+
+    NativeDeltaConfig config_;
+
+    //! @brief file names of the current chain, starting with the full snapshot
+    std::vector<std::string> chain_;
+    std::vector<std::string> fieldNames_;
+
+    //! @brief blocks of the checkpointed state, sorted by start key
+    std::vector<Block> refBlocks_;
+    //! @brief checkpointed values of each field, in block order
+    std::vector<std::vector<char>> refValues_;
+    //! @brief (file in chain, first element in file) of each field and block
+    std::vector<std::vector<std::array<uint64_t, 2>>> refSources_;
+};
+
+} // namespace fileutils
+} // namespace sphexa
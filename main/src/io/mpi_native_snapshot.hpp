@@ -0,0 +1,369 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Parallel writer of the native binary snapshot format based on MPI-IO
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <limits>
+#include <numeric>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <mpi.h>
+
+#include "cstone/fields/data_util.hpp"
+#include "cstone/sfc/box.hpp"
+#include "native_codec.hpp"
+#include "native_snapshot.hpp"
+#include "sfc_index.hpp"
+
+namespace sphexa
+{
+namespace fileutils
+{
+
+/*! @brief encode the local elements of a field in chunks and compute the chunk table of all ranks
+ *
+ * @param[in]    data           local elements of the field
+ * @param[in]    numLocal       number of local elements
+ * @param[in]    rankOffset     index of the first local element within the field
+ * @param[inout] field          field table entry with codec and error bound set, number of chunks and stored size
+ *                              are updated
+ * @param[out]   chunkTable     chunks of all ranks, in rank order
+ * @param[out]   payloadOffset  byte offset of the local encoded chunks from the start of the field
+ * @param[in]    comm           communicator of all ranks writing the field
+ * @return                      the encoded local chunks, concatenated
+ *
+ * Chunks are encoded in parallel.
+ */
+template<class F>
+std::vector<uint8_t> encodeNativeField(const F* data, size_t numLocal, uint64_t rankOffset, NativeField& field,
+                                       std::vector<NativeChunk>& chunkTable, uint64_t& payloadOffset, MPI_Comm comm)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    size_t                            numChunks = (numLocal + nativeChunkSize - 1) / nativeChunkSize;
+    std::vector<std::vector<uint8_t>> chunks(numChunks);
+
+#pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < numChunks; ++c)
+    {
+        size_t first = c * nativeChunkSize;
+        size_t count = std::min(nativeChunkSize, numLocal - first);
+        if constexpr (std::is_floating_point_v<F>)
+        {
+            if (field.codec == NativeCodec::quantize)
+            {
+                chunks[c] = encodeQuantized(data + first, count, field.errorBound);
+                continue;
+            }
+        }
+        chunks[c] = encodeShuffleDelta(data + first, count);
+    }
+
+    // (first element, element count, encoded bytes) of each local chunk
+    std::vector<uint64_t> localChunks(3 * numChunks);
+    for (size_t c = 0; c < numChunks; ++c)
+    {
+        localChunks[3 * c]     = rankOffset + c * nativeChunkSize;
+        localChunks[3 * c + 1] = std::min(nativeChunkSize, numLocal - c * nativeChunkSize);
+        localChunks[3 * c + 2] = chunks[c].size();
+    }
+
+    int              sendCount = localChunks.size();
+    std::vector<int> recvCounts(numRanks), displacements(numRanks + 1, 0);
+    MPI_Allgather(&sendCount, 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+    std::inclusive_scan(recvCounts.begin(), recvCounts.end(), displacements.begin() + 1);
+
+    std::vector<uint64_t> allChunks(displacements.back());
+    MPI_Allgatherv(localChunks.data(), sendCount, MPI_UINT64_T, allChunks.data(), recvCounts.data(),
+                   displacements.data(), MPI_UINT64_T, comm);
+
+    size_t numGlobalChunks = allChunks.size() / 3;
+    chunkTable.resize(numGlobalChunks);
+
+    uint64_t offset = numGlobalChunks * sizeof(NativeChunk);
+    for (size_t c = 0; c < numGlobalChunks; ++c)
+    {
+        chunkTable[c] = {allChunks[3 * c], allChunks[3 * c + 1], offset, allChunks[3 * c + 2]};
+        offset += chunkTable[c].bytes;
+    }
+    size_t firstLocalChunk = displacements[rank] / 3;
+    payloadOffset          = firstLocalChunk < numGlobalChunks ? chunkTable[firstLocalChunk].offset : offset;
+
+    field.numChunks   = numGlobalChunks;
+    field.storedBytes = offset;
+
+    std::vector<uint8_t> payload;
+    payload.reserve(std::accumulate(chunks.begin(), chunks.end(), size_t(0),
+                                    [](size_t sum, const auto& chunk) { return sum + chunk.size(); }));
+    for (auto& chunk : chunks)
+    {
+        payload.insert(payload.end(), chunk.begin(), chunk.end());
+    }
+    return payload;
+}
+
+//! @brief choose the codec of a particle field according to @p compression and @p localData
+template<class F>
+void selectNativeCodec(const F* localData, size_t numLocal, const NativeCompression& compression, NativeField& field,
+                       MPI_Comm comm)
+{
+    bool lossy = std::find(compression.lossyFields.begin(), compression.lossyFields.end(), std::string(field.name)) !=
+                 compression.lossyFields.end();
+
+    field.codec = compression.enabled ? NativeCodec::shuffleDelta : NativeCodec::none;
+    if constexpr (std::is_floating_point_v<F>)
+    {
+        if (!lossy) { return; }
+
+        double maxAbs = 0;
+        for (size_t i = 0; i < numLocal; ++i)
+        {
+            maxAbs = std::max(maxAbs, std::abs(double(localData[i])));
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &maxAbs, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+        double errorBound = compression.relativeError * maxAbs;
+        if (quantizable(maxAbs, errorBound))
+        {
+            field.codec      = NativeCodec::quantize;
+            field.errorBound = errorBound;
+        }
+        else { field.codec = NativeCodec::shuffleDelta; }
+    }
+}
+
+//! @brief pointer to the local elements of a column of a native snapshot
+using NativeColumnData =
+    std::variant<const float*, const double*, const int*, const unsigned*, const uint64_t*, const uint8_t*>;
+
+//! @brief a column of a native snapshot, distributed over the ranks
+struct NativeColumn
+{
+    std::string      name;
+    NativeColumnData data;
+    //! @brief number of elements of the column on the executing rank
+    uint64_t numLocal;
+    //! @brief whether the column may be compressed, columns accessed with NativeSnapshot::field() must not be
+    bool compressible;
+};
+
+//! @brief header of a native snapshot of @p numParticles particles with the attributes of @p d
+template<class HydroData, class T>
+NativeHeader nativeHeader(const HydroData& d, const cstone::Box<T>& box, uint64_t numParticles)
+{
+    NativeHeader header{};
+    header.numParticles = numParticles;
+    header.step         = d.iteration;
+    header.time         = d.ttot;
+    header.minDt        = d.minDt;
+    header.minDt_m1     = d.minDt_m1;
+    header.gravConstant = d.g;
+    header.gamma        = d.gamma;
+    header.muiConst     = d.muiConst;
+
+    double extents[6] = {box.xmin(), box.xmax(), box.ymin(), box.ymax(), box.zmin(), box.zmax()};
+    std::copy(extents, extents + 6, header.box);
+    header.boundaryType[0] = static_cast<int32_t>(box.boundaryX());
+    header.boundaryType[1] = static_cast<int32_t>(box.boundaryY());
+    header.boundaryType[2] = static_cast<int32_t>(box.boundaryZ());
+    return header;
+}
+
+/*! @brief write a native snapshot with the given columns
+ *
+ * @param path         file to write, overwritten if it exists
+ * @param header       header attributes, the field table related members are set by this function
+ * @param columns      the elements of each column are concatenated in rank order
+ * @param comm         communicator of all ranks writing the file
+ * @param compression  per column codec selection, columns are stored uncompressed by default
+ *
+ * Rank 0 writes the header, the field table and the chunk tables of compressed columns, column data is written
+ * collectively with MPI_File_write_at_all. Compressed columns are encoded and written one at a time, such that
+ * at most one encoded column is held in memory.
+ */
+inline void writeNativeColumns(const std::string& path, const NativeHeader& header,
+                               const std::vector<NativeColumn>& columns, MPI_Comm comm,
+                               const NativeCompression& compression = {})
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    size_t                numColumns = columns.size();
+    std::vector<uint64_t> localCounts(numColumns), rankOffsets(numColumns, 0), globalCounts(numColumns);
+    for (size_t c = 0; c < numColumns; ++c)
+    {
+        localCounts[c] = columns[c].numLocal;
+    }
+    MPI_Exscan(localCounts.data(), rankOffsets.data(), numColumns, MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Allreduce(localCounts.data(), globalCounts.data(), numColumns, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) { std::fill(rankOffsets.begin(), rankOffsets.end(), 0); }
+
+    std::vector<std::string> names;
+    std::vector<NativeType>  types;
+    for (const auto& column : columns)
+    {
+        names.push_back(column.name);
+        std::visit([&types](auto* p) { types.push_back(nativeType<std::decay_t<decltype(*p)>>()); }, column.data);
+    }
+    auto table = nativeFieldTable(names, types, globalCounts);
+
+    MPI_File fh;
+    int      err = MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("Cannot open " + path + " for writing\n"); }
+
+    std::vector<std::vector<NativeChunk>> chunkTables(numColumns);
+    for (size_t c = 0; c < numColumns; ++c)
+    {
+        NativeField& field    = table[c];
+        uint64_t     numLocal = columns[c].numLocal;
+        if (columns[c].compressible)
+        {
+            std::visit([&](auto* p) { selectNativeCodec(p, numLocal, compression, field, comm); }, columns[c].data);
+        }
+
+        if (field.codec == NativeCodec::none)
+        {
+            MPI_Datatype elementType;
+            MPI_Type_contiguous(field.elementSize, MPI_BYTE, &elementType);
+            MPI_Type_commit(&elementType);
+
+            MPI_Offset offset = field.offset + rankOffsets[c] * field.elementSize;
+            std::visit([&](auto* p)
+                       { err |= MPI_File_write_at_all(fh, offset, p, int(numLocal), elementType, MPI_STATUS_IGNORE); },
+                       columns[c].data);
+
+            MPI_Type_free(&elementType);
+        }
+        else
+        {
+            uint64_t             payloadOffset;
+            std::vector<uint8_t> payload;
+            std::visit([&](auto* p)
+                       { payload = encodeNativeField(p, numLocal, rankOffsets[c], field, chunkTables[c], payloadOffset,
+                                                     comm); },
+                       columns[c].data);
+            // stored sizes of the columns up to c are final, which fixes the offsets up to c + 1
+            nativeAssignOffsets(table);
+
+            if (payload.size() > size_t(std::numeric_limits<int>::max()))
+            {
+                throw std::runtime_error("Compressed field " + names[c] + " exceeds 2GiB on one rank\n");
+            }
+            err |= MPI_File_write_at_all(fh, field.offset + payloadOffset, payload.data(), int(payload.size()),
+                                         MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+    }
+
+    if (rank == 0)
+    {
+        auto bytes = serializeNativeHeader(header, table);
+        err |= MPI_File_write_at(fh, 0, bytes.data(), int(bytes.size()), MPI_BYTE, MPI_STATUS_IGNORE);
+
+        for (size_t c = 0; c < numColumns; ++c)
+        {
+            const auto& chunks = chunkTables[c];
+            if (chunks.empty()) { continue; }
+            err |= MPI_File_write_at(fh, table[c].offset, chunks.data(), int(chunks.size() * sizeof(NativeChunk)),
+                                     MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+    }
+
+    // truncates leftovers if the file existed and was larger
+    err |= MPI_File_set_size(fh, nativeFileSize(table));
+    err |= MPI_File_close(&fh);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("Error writing native snapshot " + path + "\n"); }
+}
+
+/*! @brief columns of the SFC index
+ *
+ * The global tree is contributed by rank 0 only. If @p sfcIndex has a focus tree, each rank contributes its focus
+ * tree, which requires that all ranks have one.
+ */
+template<class KeyType>
+std::vector<NativeColumn> nativeSfcIndexColumns(const SfcIndex<KeyType>& sfcIndex, int rank)
+{
+    if (sfcIndex.empty()) { return {}; }
+    uint64_t numLeaves = rank == 0 ? sfcIndex.leaves.size() : 0;
+    uint64_t numCounts = rank == 0 ? sfcIndex.counts.size() : 0;
+
+    std::vector<NativeColumn> columns{{nativeSfcLeaves, sfcIndex.leaves.data(), numLeaves, false},
+                                      {nativeSfcCounts, sfcIndex.counts.data(), numCounts, false}};
+    if (sfcIndex.hasFocus())
+    {
+        columns.push_back({nativeFocusLeaves, sfcIndex.focusLeaves.data(), sfcIndex.focusLeaves.size(), false});
+        columns.push_back({nativeFocusCounts, sfcIndex.focusCounts.data(), sfcIndex.focusCounts.size(), false});
+        columns.push_back({nativeFocusMacs, sfcIndex.focusMacs.data(), sfcIndex.focusMacs.size(), false});
+        columns.push_back({nativeFocusSizes, &sfcIndex.numFocusLeaves, 1, false});
+    }
+    return columns;
+}
+
+/*! @brief write the output fields of the assigned particles of all ranks into a native snapshot
+ *
+ * @param d            particle dataset, the fields listed in d.outputFieldIndices are written
+ * @param firstIndex   first assigned particle
+ * @param lastIndex    last assigned particle
+ * @param box          global coordinate bounding box
+ * @param sfcIndex     global domain decomposition of the written particles, stored if not empty
+ * @param path         file to write, overwritten if it exists
+ * @param comm         all ranks in @p comm write their particles in rank order
+ * @param compression  per field codec selection, fields are stored uncompressed by default
+ */
+template<class HydroData, class T, class KeyType>
+void writeNativeSnapshot(HydroData& d, size_t firstIndex, size_t lastIndex, const cstone::Box<T>& box,
+                         const SfcIndex<KeyType>& sfcIndex, const std::string& path, MPI_Comm comm,
+                         const NativeCompression& compression = {})
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    uint64_t numLocal = lastIndex - firstIndex;
+    uint64_t numGlobal;
+    MPI_Allreduce(&numLocal, &numGlobal, 1, MPI_UINT64_T, MPI_SUM, comm);
+
+    auto                      fieldPointers = cstone::getOutputArrays(d);
+    std::vector<NativeColumn> columns;
+    for (size_t i = 0; i < fieldPointers.size(); ++i)
+    {
+        std::visit([&](auto* p) { columns.push_back({d.outputFieldNames[i], p + firstIndex, numLocal, true}); },
+                   fieldPointers[i]);
+    }
+    auto indexColumns = nativeSfcIndexColumns(sfcIndex, rank);
+    columns.insert(columns.end(), indexColumns.begin(), indexColumns.end());
+
+    writeNativeColumns(path, nativeHeader(d, box, numGlobal), columns, comm, compression);
+}
+
+} // namespace fileutils
+} // namespace sphexa
@@ -0,0 +1,278 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Field codecs of the native snapshot format
+ *
+ * Compressed fields are split into chunks that are encoded independently, such that chunks can be compressed
+ * and decompressed in parallel and a range of elements can be read without decoding the entire field.
+ *
+ * Codecs:
+ *  - shuffleDelta: lossless. Bit patterns of consecutive elements are delta coded and zig-zag mapped. Since
+ *    particles are SFC-sorted, neighboring values are close and the deltas have many leading zero bytes.
+ *    The bytes are then shuffled into planes of equal significance and the planes are run-length coded.
+ *  - quantize: lossy, floating point fields only. Values are rounded to the nearest multiple of twice the
+ *    error bound and the resulting integers are encoded as in shuffleDelta. The absolute error of each
+ *    decoded value is at most the error bound.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace sphexa
+{
+namespace fileutils
+{
+
+enum class NativeCodec : uint32_t
+{
+    none         = 0,
+    shuffleDelta = 1,
+    quantize     = 2
+};
+
+//! @brief location of an independently encoded chunk of a field
+struct NativeChunk
+{
+    //! @brief index of the first element of the chunk within the field
+    uint64_t first;
+    uint64_t count;
+    //! @brief byte offset of the encoded chunk from the start of the field
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+static_assert(sizeof(NativeChunk) == 32, "native snapshot layout changed");
+
+//! @brief elements per chunk, the unit of parallelism for compression
+constexpr size_t nativeChunkSize = 65536;
+
+//! @brief which fields of a snapshot to compress and how
+struct NativeCompression
+{
+    //! @brief compress all fields with the lossless codec, unless listed in lossyFields
+    bool enabled{false};
+    //! @brief floating point fields to quantize
+    std::vector<std::string> lossyFields;
+    //! @brief error bound of the lossy codec, relative to the largest absolute value of the field
+    double relativeError{1e-5};
+};
+
+namespace detail
+{
+
+template<size_t Bytes>
+struct UnsignedOfSize;
+
+template<>
+struct UnsignedOfSize<1>
+{
+    using type = uint8_t;
+};
+
+template<>
+struct UnsignedOfSize<4>
+{
+    using type = uint32_t;
+};
+
+template<>
+struct UnsignedOfSize<8>
+{
+    using type = uint64_t;
+};
+
+//! @brief PackBits run-length encoding: control byte c < 128: c + 1 literals follow, else repeat next byte c - 125 times
+inline void packBits(const uint8_t* in, size_t n, std::vector<uint8_t>& out)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+        size_t run = 1;
+        while (i + run < n && run < 130 && in[i + run] == in[i])
+        {
+            run++;
+        }
+
+        if (run >= 3)
+        {
+            out.push_back(uint8_t(run + 125));
+            out.push_back(in[i]);
+            i += run;
+            continue;
+        }
+
+        // collect literals until the next run of at least 3 equal bytes
+        size_t start = i;
+        while (i < n && i - start < 128)
+        {
+            if (i + 2 < n && in[i] == in[i + 1] && in[i] == in[i + 2]) { break; }
+            i++;
+        }
+        out.push_back(uint8_t(i - start - 1));
+        out.insert(out.end(), in + start, in + i);
+    }
+}
+
+inline void unpackBits(const uint8_t* in, size_t n, uint8_t* out, size_t outSize)
+{
+    size_t i = 0, o = 0;
+    while (i < n)
+    {
+        uint8_t c = in[i++];
+        if (c < 128)
+        {
+            size_t len = c + 1;
+            if (i + len > n || o + len > outSize) { throw std::runtime_error("Corrupt compressed chunk\n"); }
+            std::memcpy(out + o, in + i, len);
+            i += len;
+            o += len;
+        }
+        else
+        {
+            size_t len = c - 125;
+            if (i >= n || o + len > outSize) { throw std::runtime_error("Corrupt compressed chunk\n"); }
+            std::memset(out + o, in[i++], len);
+            o += len;
+        }
+    }
+    if (o != outSize) { throw std::runtime_error("Corrupt compressed chunk\n"); }
+}
+
+//! @brief delta, zig-zag and byte shuffle unsigned integers, then run-length code the byte planes
+template<class U>
+void encodeIntegers(const U* in, size_t n, std::vector<uint8_t>& out)
+{
+    static_assert(std::is_unsigned_v<U>);
+    constexpr int numPlanes = sizeof(U);
+
+    std::vector<uint8_t> planes(n * numPlanes);
+    U                    prev = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        U delta  = in[i] - prev;
+        U zigzag = (delta << 1) ^ (U(0) - (delta >> (8 * sizeof(U) - 1)));
+        prev     = in[i];
+        for (int b = 0; b < numPlanes; ++b)
+        {
+            planes[b * n + i] = uint8_t(zigzag >> (8 * b));
+        }
+    }
+    packBits(planes.data(), planes.size(), out);
+}
+
+template<class U>
+void decodeIntegers(const uint8_t* in, size_t numBytes, U* out, size_t n)
+{
+    constexpr int numPlanes = sizeof(U);
+
+    std::vector<uint8_t> planes(n * numPlanes);
+    unpackBits(in, numBytes, planes.data(), planes.size());
+
+    U prev = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        U zigzag = 0;
+        for (int b = 0; b < numPlanes; ++b)
+        {
+            zigzag |= U(planes[b * n + i]) << (8 * b);
+        }
+        U delta = (zigzag >> 1) ^ (U(0) - (zigzag & 1));
+        prev += delta;
+        out[i] = prev;
+    }
+}
+
+} // namespace detail
+
+//! @brief lossless encoding of the bit patterns of @p n elements of @p in
+template<class T>
+std::vector<uint8_t> encodeShuffleDelta(const T* in, size_t n)
+{
+    using U = typename detail::UnsignedOfSize<sizeof(T)>::type;
+    std::vector<U> bits(n);
+    std::memcpy(bits.data(), in, n * sizeof(T));
+
+    std::vector<uint8_t> out;
+    detail::encodeIntegers(bits.data(), n, out);
+    return out;
+}
+
+template<class T>
+void decodeShuffleDelta(const uint8_t* in, size_t numBytes, T* out, size_t n)
+{
+    using U = typename detail::UnsignedOfSize<sizeof(T)>::type;
+    std::vector<U> bits(n);
+    detail::decodeIntegers(in, numBytes, bits.data(), n);
+    std::memcpy(out, bits.data(), n * sizeof(T));
+}
+
+//! @brief true if values up to @p maxAbs can be quantized with @p errorBound without integer overflow
+inline bool quantizable(double maxAbs, double errorBound)
+{
+    return std::isfinite(maxAbs) && errorBound > 0 && maxAbs / (2 * errorBound) < double(uint64_t(1) << 52);
+}
+
+//! @brief lossy encoding of @p n floating point values, decoded values differ by at most @p errorBound
+template<class T>
+std::vector<uint8_t> encodeQuantized(const T* in, size_t n, double errorBound)
+{
+    static_assert(std::is_floating_point_v<T>);
+    double invStep = 1.0 / (2 * errorBound);
+
+    std::vector<uint64_t> q(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        q[i] = uint64_t(std::llround(in[i] * invStep));
+    }
+
+    std::vector<uint8_t> out;
+    detail::encodeIntegers(q.data(), n, out);
+    return out;
+}
+
+template<class T>
+void decodeQuantized(const uint8_t* in, size_t numBytes, T* out, size_t n, double errorBound)
+{
+    std::vector<uint64_t> q(n);
+    detail::decodeIntegers(in, numBytes, q.data(), n);
+
+    double step = 2 * errorBound;
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = T(double(int64_t(q[i])) * step);
+    }
+}
+
+} // namespace fileutils
+} // namespace sphexa
@@ -0,0 +1,211 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Delta checkpoints of the native snapshot format and a reader that resolves them
+ *
+ * A delta checkpoint is a native snapshot that stores only the parts of the particle fields that changed since the
+ * previous checkpoint. Particles are organized in blocks, the leaves of the global octree, which are contiguous
+ * in SFC order. For each block and particle field, the deltaBlocks column holds the file that stores the values
+ * and their position within that file. Unchanged blocks refer to an earlier file of the chain, changed blocks refer
+ * to the delta itself, whose particle columns hold the changed blocks only, concatenated.
+ *
+ * Additional columns of a delta checkpoint:
+ *  - deltaSources: names of the files of the chain, separated by newlines, the delta itself is the last entry.
+ *                  Files are looked up in the directory of the delta.
+ *  - deltaBlocks:  one record per block with 2 + 2 * numParticleFields elements:
+ *                  (first particle, number of particles, then (source file, first element in source) per field)
+ *
+ * Particle fields are all columns except the SFC index and delta columns, in the order of the field table.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "native_snapshot.hpp"
+
+namespace sphexa
+{
+namespace fileutils
+{
+
+constexpr char nativeDeltaSources[] = "deltaSources";
+constexpr char nativeDeltaBlocks[]  = "deltaBlocks";
+
+//! @brief false for the columns of the SFC index and the delta tables, true for particle fields
+inline bool isNativeParticleField(const std::string& name)
+{
+    return name != nativeSfcLeaves && name != nativeSfcCounts && name != nativeFocusLeaves &&
+           name != nativeFocusCounts && name != nativeFocusMacs && name != nativeFocusSizes &&
+           name != nativeDeltaSources && name != nativeDeltaBlocks;
+}
+
+//! @brief delta checkpoint settings
+struct NativeDeltaConfig
+{
+    //! @brief every fullEvery-th checkpoint is a full snapshot, the ones in between are deltas
+    unsigned fullEvery{1};
+    //! @brief tolerated change of a field, relative to the largest absolute value of the field, 0 is exact
+    double relativeTolerance{0};
+};
+
+/*! @brief Reader of full and delta native checkpoints
+ *
+ * Provides the same field access as NativeSnapshot for full snapshots. For deltas, reads of particle fields are
+ * resolved through the block table and served from the files of the chain, which are memory mapped as well.
+ */
+class NativeCheckpoint
+{
+public:
+    explicit NativeCheckpoint(const std::string& path)
+        : snap_(std::make_unique<NativeSnapshot>(path))
+    {
+        if (!snap_->hasField(nativeDeltaBlocks)) { return; }
+
+        auto                     sourceBytes = snap_->field<uint8_t>(nativeDeltaSources);
+        std::string              list(sourceBytes.begin(), sourceBytes.end());
+        std::vector<std::string> sourceNames;
+        for (size_t start = 0; start < list.size();)
+        {
+            size_t end = std::min(list.find('\n', start), list.size());
+            sourceNames.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+        if (sourceNames.empty()) { throw std::runtime_error("Delta checkpoint " + path + " has no sources\n"); }
+
+        auto directory = std::filesystem::path(path).parent_path();
+        for (size_t i = 0; i + 1 < sourceNames.size(); ++i)
+        {
+            sources_.push_back(std::make_shared<NativeSnapshot>((directory / sourceNames[i]).string()));
+        }
+        sources_.push_back(snap_);
+
+        for (const auto& f : snap_->fields())
+        {
+            std::string name(f.name, strnlen(f.name, nativeMaxNameSize));
+            if (isNativeParticleField(name)) { particleFields_.push_back(name); }
+        }
+
+        blocks_.resize(snap_->fieldCount(nativeDeltaBlocks));
+        snap_->readField(nativeDeltaBlocks, 0, blocks_.size(), blocks_.data());
+        size_t recordSize = 2 + 2 * particleFields_.size();
+        if (blocks_.size() % recordSize != 0) { throw std::runtime_error("Corrupt delta checkpoint " + path + "\n"); }
+
+        uint64_t expectedFirst = 0;
+        for (size_t b = 0; b < blocks_.size(); b += recordSize)
+        {
+            bool sourcesOk = true;
+            for (size_t j = 0; j < particleFields_.size(); ++j)
+            {
+                sourcesOk &= blocks_[b + 2 + 2 * j] < sources_.size();
+            }
+            if (blocks_[b] != expectedFirst || !sourcesOk)
+            {
+                throw std::runtime_error("Corrupt delta checkpoint " + path + "\n");
+            }
+            blockStarts_.push_back(blocks_[b]);
+            expectedFirst += blocks_[b + 1];
+        }
+        if (expectedFirst != header().numParticles)
+        {
+            throw std::runtime_error("Corrupt delta checkpoint " + path + "\n");
+        }
+    }
+
+    const NativeHeader& header() const { return snap_->header(); }
+
+    //! @brief the checkpoint file itself, e.g. for access to the SFC index
+    const NativeSnapshot& snapshot() const { return *snap_; }
+
+    bool isDelta() const { return !sources_.empty(); }
+
+    //! @brief number of files that a restart from this checkpoint reads from
+    size_t chainLength() const { return std::max(sources_.size(), size_t(1)); }
+
+    bool hasField(const std::string& name) const { return snap_->hasField(name); }
+
+    //! @brief copy particles [first:first+count] of field @p name into @p dest, converting to T if necessary
+    template<class T>
+    void readField(const std::string& name, size_t first, size_t count, T* dest) const
+    {
+        auto fieldIt = std::find(particleFields_.begin(), particleFields_.end(), name);
+        if (!isDelta() || fieldIt == particleFields_.end())
+        {
+            snap_->readField(name, first, count, dest);
+            return;
+        }
+        if (first + count > header().numParticles)
+        {
+            throw std::runtime_error("Read beyond end of field " + name + "\n");
+        }
+
+        size_t fieldIdx   = fieldIt - particleFields_.begin();
+        size_t recordSize = 2 + 2 * particleFields_.size();
+        size_t last       = first + count;
+
+        // blocks overlapping [first:last], pieces from the same source that are contiguous there are read at once
+        size_t b = std::upper_bound(blockStarts_.begin(), blockStarts_.end(), first) - blockStarts_.begin() - 1;
+        uint64_t runSource = 0, runSourceFirst = 0, runFirst = first, runCount = 0;
+        for (; b < blockStarts_.size() && blockStarts_[b] < last; ++b)
+        {
+            const uint64_t* record      = blocks_.data() + b * recordSize;
+            uint64_t        pieceStart  = std::max(record[0], uint64_t(first));
+            uint64_t        pieceEnd    = std::min(record[0] + record[1], uint64_t(last));
+            uint64_t        source      = record[2 + 2 * fieldIdx];
+            uint64_t        sourceFirst = record[3 + 2 * fieldIdx] + (pieceStart - record[0]);
+            if (pieceEnd <= pieceStart) { continue; }
+
+            if (runCount > 0 && (source != runSource || sourceFirst != runSourceFirst + runCount))
+            {
+                sources_[runSource]->readField(name, runSourceFirst, runCount, dest + (runFirst - first));
+                runCount = 0;
+            }
+            if (runCount == 0)
+            {
+                runSource      = source;
+                runSourceFirst = sourceFirst;
+                runFirst       = pieceStart;
+            }
+            runCount += pieceEnd - pieceStart;
+        }
+        if (runCount > 0) { sources_[runSource]->readField(name, runSourceFirst, runCount, dest + (runFirst - first)); }
+    }
+
+private:
+    std::shared_ptr<NativeSnapshot>              snap_;
+    std::vector<std::shared_ptr<NativeSnapshot>> sources_;
+    std::vector<std::string>                     particleFields_;
+    std::vector<uint64_t>                        blocks_;
+    std::vector<uint64_t>                        blockStarts_;
+};
+
+} // namespace fileutils
+} // namespace sphexa
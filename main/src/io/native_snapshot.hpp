@@ -0,0 +1,420 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Native binary snapshot format: header, field table and memory-mapped reader
+ *
+ * File layout:
+ *  - NativeHeader with step attributes, box and boundary types
+ *  - NativeField table with name, type, byte offset and element count of each field
+ *  - one column per field, each starting at a multiple of nativePageSize. Uncompressed columns store the
+ *    elements contiguously, compressed columns start with a NativeChunk table followed by the encoded chunks,
+ *    see native_codec.hpp
+ *  - optionally the SFC index columns sfcLeaves and sfcCounts, which are not particle fields
+ *
+ * All integers and floating point numbers are stored in the native byte order of the writing machine.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cstone/util/gsl-lite.hpp"
+#include "native_codec.hpp"
+
+namespace sphexa
+{
+namespace fileutils
+{
+
+//! @brief type codes of the fields in a native snapshot
+enum class NativeType : uint32_t
+{
+    float32 = 0,
+    float64 = 1,
+    int32   = 2,
+    uint32  = 3,
+    uint64  = 4,
+    uint8   = 5
+};
+
+template<class T>
+constexpr NativeType nativeType()
+{
+    if constexpr (std::is_same_v<T, float>) { return NativeType::float32; }
+    else if constexpr (std::is_same_v<T, double>) { return NativeType::float64; }
+    else if constexpr (std::is_same_v<T, int>) { return NativeType::int32; }
+    else if constexpr (std::is_same_v<T, unsigned>) { return NativeType::uint32; }
+    else if constexpr (std::is_same_v<T, uint8_t>) { return NativeType::uint8; }
+    else
+    {
+        static_assert(std::is_same_v<T, uint64_t>, "unsupported native snapshot field type");
+        return NativeType::uint64;
+    }
+}
+
+inline uint32_t nativeTypeSize(NativeType type)
+{
+    if (type == NativeType::uint8) { return 1; }
+    return (type == NativeType::float64 || type == NativeType::uint64) ? 8 : 4;
+}
+
+constexpr uint64_t nativePageSize    = 4096;
+constexpr uint32_t nativeVersion     = 2;
+constexpr char     nativeMagic[8]    = {'S', 'P', 'H', 'E', 'X', 'A', 'N', 'S'};
+constexpr size_t   nativeMaxNameSize = 32;
+
+//! @brief names of the non-particle fields that hold the SFC index of the snapshot, see SfcIndex
+constexpr char nativeSfcLeaves[] = "sfcLeaves";
+constexpr char nativeSfcCounts[] = "sfcCounts";
+//! @brief focus trees of all ranks in rank order, with the number of leaves of each rank in nativeFocusSizes
+constexpr char nativeFocusLeaves[] = "focusLeaves";
+constexpr char nativeFocusCounts[] = "focusCounts";
+constexpr char nativeFocusMacs[]   = "focusMacs";
+constexpr char nativeFocusSizes[]  = "focusSizes";
+
+struct NativeHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t numFields;
+    uint64_t numParticles;
+    uint64_t step;
+    double   time;
+    double   minDt;
+    double   minDt_m1;
+    double   gravConstant;
+    double   gamma;
+    double   muiConst;
+    //! @brief xmin, xmax, ymin, ymax, zmin, zmax
+    double box[6];
+    //! @brief cstone::BoundaryType in x,y,z
+    int32_t  boundaryType[3];
+    uint32_t pageSize;
+};
+
+struct NativeField
+{
+    char       name[nativeMaxNameSize];
+    NativeType type;
+    uint32_t   elementSize;
+    //! @brief byte offset of the first element from the start of the file
+    uint64_t    offset;
+    uint64_t    count;
+    NativeCodec codec;
+    uint32_t    numChunks;
+    //! @brief bytes occupied in the file, count * elementSize if not compressed
+    uint64_t storedBytes;
+    //! @brief absolute error bound of lossy codecs
+    double errorBound;
+};
+
+static_assert(sizeof(NativeHeader) == 144 && sizeof(NativeField) == 80, "native snapshot layout changed");
+
+inline uint64_t nativePageAlign(uint64_t bytes) { return (bytes + nativePageSize - 1) / nativePageSize * nativePageSize; }
+
+//! @brief assign page aligned offsets to the fields in @p table, according to their stored sizes
+inline void nativeAssignOffsets(std::vector<NativeField>& table)
+{
+    uint64_t offset = nativePageAlign(sizeof(NativeHeader) + table.size() * sizeof(NativeField));
+    for (auto& field : table)
+    {
+        field.offset = offset;
+        offset       = nativePageAlign(offset + field.storedBytes);
+    }
+}
+
+//! @brief uncompressed field table with @p counts[i] elements in field i and page aligned column offsets
+inline std::vector<NativeField> nativeFieldTable(const std::vector<std::string>& names,
+                                                 const std::vector<NativeType>& types,
+                                                 const std::vector<uint64_t>& counts)
+{
+    std::vector<NativeField> table(names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if (names[i].size() >= nativeMaxNameSize)
+        {
+            throw std::runtime_error("Field name too long for native snapshot: " + names[i] + "\n");
+        }
+        std::memset(table[i].name, 0, nativeMaxNameSize);
+        std::copy(names[i].begin(), names[i].end(), table[i].name);
+        table[i].type        = types[i];
+        table[i].elementSize = nativeTypeSize(types[i]);
+        table[i].count       = counts[i];
+        table[i].codec       = NativeCodec::none;
+        table[i].numChunks   = 0;
+        table[i].storedBytes = counts[i] * table[i].elementSize;
+        table[i].errorBound  = 0;
+    }
+    nativeAssignOffsets(table);
+    return table;
+}
+
+//! @brief field table for @p numParticles elements per field with page aligned column offsets
+inline std::vector<NativeField>
+nativeFieldTable(const std::vector<std::string>& names, const std::vector<NativeType>& types, uint64_t numParticles)
+{
+    return nativeFieldTable(names, types, std::vector<uint64_t>(names.size(), numParticles));
+}
+
+//! @brief total file size of a snapshot with the given field table
+inline uint64_t nativeFileSize(const std::vector<NativeField>& table)
+{
+    if (table.empty()) { return nativePageAlign(sizeof(NativeHeader)); }
+    return table.back().offset + table.back().storedBytes;
+}
+
+//! @brief header and field table as a byte sequence, to be written at the start of the file
+inline std::vector<char> serializeNativeHeader(NativeHeader header, const std::vector<NativeField>& table)
+{
+    std::copy(nativeMagic, nativeMagic + 8, header.magic);
+    header.version   = nativeVersion;
+    header.numFields = table.size();
+    header.pageSize  = nativePageSize;
+
+    std::vector<char> bytes(sizeof(NativeHeader) + table.size() * sizeof(NativeField));
+    std::memcpy(bytes.data(), &header, sizeof(NativeHeader));
+    std::memcpy(bytes.data() + sizeof(NativeHeader), table.data(), table.size() * sizeof(NativeField));
+    return bytes;
+}
+
+//! @brief true if @p path is a file that starts with the native snapshot magic bytes
+inline bool isNativeSnapshot(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char          magic[8];
+    if (!file.read(magic, 8)) { return false; }
+    return std::equal(magic, magic + 8, nativeMagic);
+}
+
+/*! @brief Read-only view of a native snapshot, mapped into memory
+ *
+ * Fields are accessed in place without copying, pages are only loaded from the file when touched.
+ */
+class NativeSnapshot
+{
+public:
+    explicit NativeSnapshot(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) { throw std::runtime_error("Cannot open native snapshot " + path + "\n"); }
+
+        struct stat fileStat;
+        fstat(fd, &fileStat);
+        size_ = fileStat.st_size;
+        if (size_ >= sizeof(NativeHeader)) { data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0); }
+        close(fd);
+
+        if (data_ == nullptr || data_ == MAP_FAILED)
+        {
+            data_ = nullptr;
+            throw std::runtime_error("Cannot map native snapshot " + path + "\n");
+        }
+
+        auto fail = [this](const std::string& msg)
+        {
+            munmap(data_, size_);
+            data_ = nullptr;
+            throw std::runtime_error(msg);
+        };
+
+        std::memcpy(&header_, data_, sizeof(NativeHeader));
+        if (!std::equal(header_.magic, header_.magic + 8, nativeMagic) || header_.version != nativeVersion)
+        {
+            fail(path + " is not a native snapshot of version " + std::to_string(nativeVersion) + "\n");
+        }
+        if (sizeof(NativeHeader) + header_.numFields * sizeof(NativeField) > size_)
+        {
+            fail("Native snapshot " + path + " is truncated\n");
+        }
+
+        fields_.resize(header_.numFields);
+        std::memcpy(fields_.data(), bytes() + sizeof(NativeHeader), header_.numFields * sizeof(NativeField));
+        for (const auto& f : fields_)
+        {
+            bool storedSizeOk = f.codec != NativeCodec::none || f.storedBytes == f.count * f.elementSize;
+            bool chunksOk     = f.codec == NativeCodec::none || f.numChunks * sizeof(NativeChunk) <= f.storedBytes;
+            bool codecOk      = f.codec != NativeCodec::quantize || f.type == NativeType::float32 ||
+                                f.type == NativeType::float64;
+            bool typeOk       = f.type <= NativeType::uint8 && f.elementSize == nativeTypeSize(f.type);
+            if (f.offset + f.storedBytes > size_ || !storedSizeOk || !chunksOk || !codecOk || !typeOk)
+            {
+                fail("Native snapshot " + path + " is truncated or corrupt\n");
+            }
+        }
+    }
+
+    NativeSnapshot(const NativeSnapshot&)            = delete;
+    NativeSnapshot& operator=(const NativeSnapshot&) = delete;
+
+    ~NativeSnapshot()
+    {
+        if (data_) { munmap(data_, size_); }
+    }
+
+    const NativeHeader& header() const { return header_; }
+
+    gsl::span<const NativeField> fields() const { return fields_; }
+
+    bool hasField(const std::string& name) const { return findField(name) != nullptr; }
+
+    NativeType fieldType(const std::string& name) const { return getField(name).type; }
+
+    //! @brief number of elements of field @p name
+    uint64_t fieldCount(const std::string& name) const { return getField(name).count; }
+
+    //! @brief zero-copy access to uncompressed field @p name, T must match the stored type
+    template<class T>
+    gsl::span<const T> field(const std::string& name) const
+    {
+        const NativeField& f = getField(name);
+        if (f.type != nativeType<T>())
+        {
+            throw std::runtime_error("Type mismatch when accessing field " + name + " of native snapshot\n");
+        }
+        if (f.codec != NativeCodec::none)
+        {
+            throw std::runtime_error("Field " + name + " is compressed and can only be accessed with readField\n");
+        }
+        return {reinterpret_cast<const T*>(bytes() + f.offset), f.count};
+    }
+
+    /*! @brief copy elements [first:first+count] of field @p name into @p dest, converting to T if necessary
+     *
+     * Compressed fields are decoded transparently, only the chunks overlapping the requested range are decoded.
+     */
+    template<class T>
+    void readField(const std::string& name, size_t first, size_t count, T* dest) const
+    {
+        const NativeField& f = getField(name);
+        if (first + count > f.count) { throw std::runtime_error("Read beyond end of field " + name + "\n"); }
+
+        switch (f.type)
+        {
+            case NativeType::float32: readTyped<float>(f, first, count, dest); break;
+            case NativeType::float64: readTyped<double>(f, first, count, dest); break;
+            case NativeType::int32: readTyped<int>(f, first, count, dest); break;
+            case NativeType::uint32: readTyped<unsigned>(f, first, count, dest); break;
+            case NativeType::uint64: readTyped<uint64_t>(f, first, count, dest); break;
+            case NativeType::uint8: readTyped<uint8_t>(f, first, count, dest); break;
+        }
+    }
+
+private:
+    const char* bytes() const { return static_cast<const char*>(data_); }
+
+    //! @brief read elements [first:first+count] of @p f, stored as type S, into @p dest
+    template<class S, class T>
+    void readTyped(const NativeField& f, size_t first, size_t count, T* dest) const
+    {
+        const char* src = bytes() + f.offset;
+        if (f.codec == NativeCodec::none)
+        {
+            const S* values = reinterpret_cast<const S*>(src);
+            std::copy(values + first, values + first + count, dest);
+            return;
+        }
+
+        std::vector<NativeChunk> chunks(f.numChunks);
+        std::memcpy(chunks.data(), src, f.numChunks * sizeof(NativeChunk));
+
+        for (const auto& chunk : chunks)
+        {
+            if (chunk.offset + chunk.bytes > f.storedBytes || chunk.first + chunk.count > f.count)
+            {
+                throw std::runtime_error("Corrupt chunk table in native snapshot\n");
+            }
+        }
+
+        size_t last    = first + count;
+        int    corrupt = 0;
+#pragma omp parallel for schedule(dynamic) reduction(| : corrupt)
+        for (size_t c = 0; c < chunks.size(); ++c)
+        {
+            const NativeChunk& chunk = chunks[c];
+            if (chunk.first + chunk.count <= first || chunk.first >= last) { continue; }
+
+            std::vector<S> decoded(chunk.count);
+            auto*          encoded = reinterpret_cast<const uint8_t*>(src + chunk.offset);
+            try
+            {
+                if (f.codec != NativeCodec::quantize)
+                {
+                    decodeShuffleDelta(encoded, chunk.bytes, decoded.data(), chunk.count);
+                }
+                else if constexpr (std::is_floating_point_v<S>)
+                {
+                    decodeQuantized(encoded, chunk.bytes, decoded.data(), chunk.count, f.errorBound);
+                }
+            }
+            catch (std::runtime_error&)
+            {
+                corrupt = 1;
+                continue;
+            }
+
+            size_t copyStart = std::max(size_t(chunk.first), first);
+            size_t copyEnd   = std::min(size_t(chunk.first + chunk.count), last);
+            std::copy(decoded.begin() + (copyStart - chunk.first), decoded.begin() + (copyEnd - chunk.first),
+                      dest + (copyStart - first));
+        }
+        if (corrupt) { throw std::runtime_error("Corrupt compressed field in native snapshot\n"); }
+    }
+
+    const NativeField* findField(const std::string& name) const
+    {
+        auto it = std::find_if(fields_.begin(), fields_.end(), [&name](const NativeField& f)
+                               { return std::string(f.name, strnlen(f.name, nativeMaxNameSize)) == name; });
+        return it == fields_.end() ? nullptr : &(*it);
+    }
+
+    const NativeField& getField(const std::string& name) const
+    {
+        const NativeField* f = findField(name);
+        if (!f) { throw std::runtime_error("Field " + name + " not found in native snapshot\n"); }
+        return *f;
+    }
+
+    void*  data_{nullptr};
+    size_t size_{0};
+
+    NativeHeader             header_;
+    std::vector<NativeField> fields_;
+};
+
+} // namespace fileutils
+} // namespace sphexa
@@ -0,0 +1,364 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Region-of-interest and decimated output streams
+ *
+ * An output stream writes a subset of the particles with its own field list and output frequency to a separate
+ * file, e.g. for visualization. Particles are selected with a spatial filter and a deterministic decimation.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cstone/sfc/box.hpp"
+#include "cstone/sfc/sfc.hpp"
+#include "cstone/util/gsl-lite.hpp"
+
+#include "arg_parser.hpp"
+
+namespace sphexa
+{
+
+//! @brief spatial filter of an output stream
+struct OutputRegion
+{
+    enum class Shape
+    {
+        all,
+        box,
+        sphere,
+        slab
+    };
+
+    //! @brief result of testing a cell against the region
+    enum Overlap
+    {
+        outside,
+        partial,
+        inside
+    };
+
+    Shape shape{Shape::all};
+    //! @brief box: xmin, xmax, ymin, ymax, zmin, zmax, sphere: center x, y, z and radius, slab: min, max
+    double param[6]{};
+    //! @brief slab normal direction, 0, 1 or 2 for x, y or z
+    int axis{0};
+
+    template<class T>
+    bool contains(T x, T y, T z) const
+    {
+        switch (shape)
+        {
+            case Shape::box:
+                return param[0] <= x && x < param[1] && param[2] <= y && y < param[3] && param[4] <= z && z < param[5];
+            case Shape::sphere:
+            {
+                double dx = x - param[0], dy = y - param[1], dz = z - param[2];
+                return dx * dx + dy * dy + dz * dz <= param[3] * param[3];
+            }
+            case Shape::slab:
+            {
+                T r[3] = {x, y, z};
+                return param[0] <= r[axis] && r[axis] < param[1];
+            }
+            default: return true;
+        }
+    }
+
+    //! @brief classify the cell @p cell as completely outside, inside, or partially overlapping with the region
+    template<class T>
+    Overlap overlap(const cstone::FBox<T>& cell) const
+    {
+        double lo[3] = {cell.xmin(), cell.ymin(), cell.zmin()};
+        double hi[3] = {cell.xmax(), cell.ymax(), cell.zmax()};
+
+        switch (shape)
+        {
+            case Shape::box:
+            {
+                bool disjoint = false, contained = true;
+                for (int dim = 0; dim < 3; ++dim)
+                {
+                    disjoint |= hi[dim] <= param[2 * dim] || param[2 * dim + 1] <= lo[dim];
+                    contained &= param[2 * dim] <= lo[dim] && hi[dim] < param[2 * dim + 1];
+                }
+                return disjoint ? outside : (contained ? inside : partial);
+            }
+            case Shape::sphere:
+            {
+                double minDistSq = 0, maxDistSq = 0;
+                for (int dim = 0; dim < 3; ++dim)
+                {
+                    double dLo      = lo[dim] - param[dim];
+                    double dHi      = hi[dim] - param[dim];
+                    double nearest  = std::max({dLo, -dHi, 0.0});
+                    double farthest = std::max(std::abs(dLo), std::abs(dHi));
+                    minDistSq += nearest * nearest;
+                    maxDistSq += farthest * farthest;
+                }
+                double rSq = param[3] * param[3];
+                return minDistSq > rSq ? outside : (maxDistSq <= rSq ? inside : partial);
+            }
+            case Shape::slab:
+            {
+                if (hi[axis] <= param[0] || param[1] <= lo[axis]) { return outside; }
+                return (param[0] <= lo[axis] && hi[axis] < param[1]) ? inside : partial;
+            }
+            default: return inside;
+        }
+    }
+};
+
+//! @brief configuration of an output stream
+struct OutputStream
+{
+    //! @brief appended to the output file name
+    std::string name;
+    //! @brief fields to write, defaults to the fields of the main output if empty
+    std::vector<std::string> fields;
+    //! @brief iteration or time frequency with the syntax of -w, defaults to the main output frequency if empty
+    std::string frequency;
+
+    OutputRegion region;
+    //! @brief keep one in @p decimation particles
+    uint64_t decimation{1};
+    //! @brief octree level of the SFC cells that are kept or dropped as a whole by the decimation
+    unsigned decimationLevel{7};
+
+    bool isOutputStep(size_t step, double t1, double t2) const
+    {
+        return isPeriodicOutputStep(step, frequency) || isPeriodicOutputTime(t1, t2, frequency);
+    }
+
+    /*! @brief deterministic decimation based on the SFC cell of a particle at decimationLevel
+     *
+     * The selection depends only on the particle position, not on the rank that owns it. Only the key prefix of the
+     * enclosing cell is used, such that particles that stay within their cell are selected in consecutive frames,
+     * instead of a different sample in each frame. The prefix is hashed to avoid aliasing between the decimation and
+     * the SFC structure.
+     */
+    template<class KeyType>
+    bool keep(KeyType key) const
+    {
+        if (decimation <= 1) { return true; }
+        unsigned level = std::min(decimationLevel, unsigned(cstone::maxTreeLevel<KeyType>{}));
+        uint64_t h     = uint64_t(cstone::enclosingBoxCode(key, level)) + 0x9e3779b97f4a7c15;
+        h          = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+        h          = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+        h          = h ^ (h >> 31);
+        return h % decimation == 0;
+    }
+};
+
+namespace detail
+{
+
+inline std::vector<double> parseNumbers(const std::string& list, size_t expected, const std::string& spec)
+{
+    std::vector<double> numbers;
+    std::stringstream   ss(list);
+    std::string         token;
+    while (std::getline(ss, token, ','))
+    {
+        numbers.push_back(std::stod(token));
+    }
+    if (numbers.size() != expected)
+    {
+        throw std::runtime_error("Output stream " + spec + ": expected " + std::to_string(expected) + " numbers in " +
+                                 list + "\n");
+    }
+    return numbers;
+}
+
+/*! @brief parse the region option KEY=VALUE of @p spec into @p region
+ *
+ * @return false if KEY is not one of box, sphere or slab
+ */
+inline bool parseRegion(const std::string& key, const std::string& value, const std::string& spec,
+                        OutputRegion& region)
+{
+    if (key == "box")
+    {
+        auto p       = parseNumbers(value, 6, spec);
+        region.shape = OutputRegion::Shape::box;
+        std::copy(p.begin(), p.end(), region.param);
+    }
+    else if (key == "sphere")
+    {
+        auto p       = parseNumbers(value, 4, spec);
+        region.shape = OutputRegion::Shape::sphere;
+        std::copy(p.begin(), p.end(), region.param);
+    }
+    else if (key == "slab")
+    {
+        auto axisEnd = value.find(',');
+        auto axis    = std::string("xyz").find(value.substr(0, axisEnd));
+        if (axisEnd != 1 || axis == std::string::npos)
+        {
+            throw std::runtime_error("Output stream " + spec + ": slab axis must be x, y or z\n");
+        }
+        auto p       = parseNumbers(value.substr(axisEnd + 1), 2, spec);
+        region.shape = OutputRegion::Shape::slab;
+        region.axis  = int(axis);
+        std::copy(p.begin(), p.end(), region.param);
+    }
+    else { return false; }
+    return true;
+}
+
+} // namespace detail
+
+/*! @brief parse an output stream specification
+ *
+ * Syntax: NAME[:f=FIELDS][:w=FREQ][:box=XMIN,XMAX,YMIN,YMAX,ZMIN,ZMAX|:sphere=X,Y,Z,R|:slab=AXIS,MIN,MAX][:every=N]
+ * with comma separated FIELDS and AXIS one of x, y, z. Example: core:f=x,y,z,rho:w=5:sphere=0,0,0,0.1:every=10
+ */
+inline OutputStream parseOutputStream(const std::string& spec)
+{
+    OutputStream stream;
+
+    std::vector<std::string> tokens;
+    std::stringstream        ss(spec);
+    std::string              token;
+    while (std::getline(ss, token, ':'))
+    {
+        tokens.push_back(token);
+    }
+    if (tokens.empty() || tokens[0].empty() || tokens[0].find('=') != std::string::npos)
+    {
+        throw std::runtime_error("Output stream " + spec + " has no name\n");
+    }
+    stream.name = tokens[0];
+
+    for (size_t i = 1; i < tokens.size(); ++i)
+    {
+        auto eq = tokens[i].find('=');
+        if (eq == std::string::npos) { throw std::runtime_error("Output stream " + spec + ": expected KEY=VALUE\n"); }
+        std::string key   = tokens[i].substr(0, eq);
+        std::string value = tokens[i].substr(eq + 1);
+
+        if (key == "f")
+        {
+            std::replace(value.begin(), value.end(), ',', ' ');
+            std::stringstream fieldStream(value);
+            std::string       field;
+            while (fieldStream >> field)
+            {
+                stream.fields.push_back(field);
+            }
+        }
+        else if (key == "w") { stream.frequency = value; }
+        else if (key == "every") { stream.decimation = std::max(std::stoull(value), 1ull); }
+        else if (!detail::parseRegion(key, value, spec, stream.region))
+        {
+            throw std::runtime_error("Output stream " + spec + ": unknown option " + key + "\n");
+        }
+    }
+
+    return stream;
+}
+
+/*! @brief parse a region specification box=XMIN,XMAX,YMIN,YMAX,ZMIN,ZMAX, sphere=X,Y,Z,R or slab=AXIS,MIN,MAX
+ *
+ * Same syntax as the region option of an output stream.
+ */
+inline OutputRegion parseRegion(const std::string& spec)
+{
+    OutputRegion region;
+    auto         eq = spec.find('=');
+    if (eq == std::string::npos || !detail::parseRegion(spec.substr(0, eq), spec.substr(eq + 1), spec, region))
+    {
+        throw std::runtime_error("Invalid region " + spec + ", expected box=, sphere= or slab=\n");
+    }
+    return region;
+}
+
+/*! @brief select the particles of an output stream
+ *
+ * @param[in] stream   stream configuration
+ * @param[in] x,y,z    particle coordinates, SFC-sorted in [first:last]
+ * @param[in] first    index of the first particle to consider
+ * @param[in] last     index of the last particle to consider
+ * @param[in] leaves   cornerstone leaves covering the particles in [first:last]
+ * @param[in] counts   number of particles in each leaf, length leaves.size() - 1
+ * @param[in] box      global coordinate bounding box
+ * @return             indices of the selected particles in ascending order
+ *
+ * The region filter is first evaluated for entire leaves. Particles of leaves that lie completely inside or
+ * outside of the region are accepted or discarded without looking at their coordinates, only particles of leaves
+ * intersecting the boundary of the region are tested individually. If @p counts does not add up to the number
+ * of particles in [first:last], all particles are tested.
+ */
+template<class KeyType, class T>
+std::vector<cstone::LocalIndex> selectStreamParticles(const OutputStream& stream, const T* x, const T* y, const T* z,
+                                                      size_t first, size_t last, gsl::span<const KeyType> leaves,
+                                                      gsl::span<const unsigned> counts, const cstone::Box<T>& box)
+{
+    using cstone::LocalIndex;
+    using Overlap = OutputRegion::Overlap;
+
+    std::vector<LocalIndex> leafOffsets(counts.size() + 1, first);
+    std::inclusive_scan(counts.begin(), counts.end(), leafOffsets.begin() + 1, std::plus<LocalIndex>{},
+                        LocalIndex(first));
+
+    bool                 haveLeaves = !counts.empty() && leafOffsets.back() == last;
+    std::vector<Overlap> overlaps(haveLeaves ? counts.size() : 1, Overlap::partial);
+    if (!haveLeaves) { leafOffsets = {LocalIndex(first), LocalIndex(last)}; }
+    else
+    {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            auto ibox   = cstone::sfcIBox(cstone::sfcKey(leaves[i]), cstone::sfcKey(leaves[i + 1]));
+            overlaps[i] = stream.region.overlap(cstone::createFpBox<KeyType>(ibox, box));
+        }
+    }
+
+    std::vector<LocalIndex> selection;
+    for (size_t i = 0; i < overlaps.size(); ++i)
+    {
+        if (overlaps[i] == Overlap::outside) { continue; }
+        for (LocalIndex j = leafOffsets[i]; j < leafOffsets[i + 1]; ++j)
+        {
+            bool inRegion = overlaps[i] == Overlap::inside || stream.region.contains(x[j], y[j], z[j]);
+            if (inRegion && stream.keep(cstone::sfc3D<cstone::SfcKind<KeyType>>(x[j], y[j], z[j], box)))
+            {
+                selection.push_back(j);
+            }
+        }
+    }
+    return selection;
+}
+
+} // namespace sphexa
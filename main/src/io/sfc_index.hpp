@@ -0,0 +1,140 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief SFC index of snapshots for restarts on arbitrary rank counts
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+#include "cstone/domain/domaindecomp.hpp"
+#include "cstone/util/gsl-lite.hpp"
+
+namespace sphexa
+{
+
+/*! @brief global octree leaves and counts of the domain decomposition at the time a snapshot was written
+ *
+ * Ranks write their assigned particles in rank order and each rank's particles are SFC-sorted, therefore the
+ * particles in a snapshot are globally in SFC order. The prefix sum of the leaf counts is then the file offset
+ * of the first particle in each leaf, which allows any rank count to locate the particles of an SFC range
+ * without reading the rest of the file.
+ *
+ * Optionally, each rank also stores its focus tree. A restart with the same number of ranks then starts the domain
+ * from the converged trees of the snapshot.
+ */
+template<class KeyType>
+struct SfcIndex
+{
+    //! @brief cornerstone leaf keys of the global octree, length counts.size() + 1
+    std::vector<KeyType> leaves;
+    //! @brief number of particles per leaf
+    std::vector<unsigned> counts;
+
+    //! @brief focus tree leaves of the executing rank, empty if not stored
+    std::vector<KeyType> focusLeaves;
+    //! @brief particle counts per focus tree leaf
+    std::vector<unsigned> focusCounts;
+    //! @brief MAC status of each focus tree node in the internal order
+    std::vector<uint8_t> focusMacs;
+    //! @brief number of focus tree leaves of the executing rank, locates the focus tree of each rank in snapshots
+    uint64_t numFocusLeaves{0};
+
+    bool empty() const { return counts.empty(); }
+
+    //! @brief true if a focus tree is stored for the executing rank
+    bool hasFocus() const { return !focusCounts.empty(); }
+
+    void clear()
+    {
+        leaves.clear();
+        counts.clear();
+        clearFocus();
+    }
+
+    void clearFocus()
+    {
+        focusLeaves.clear();
+        focusCounts.clear();
+        focusMacs.clear();
+        numFocusLeaves = 0;
+    }
+
+    void update(gsl::span<const KeyType> treeLeaves, gsl::span<const unsigned> leafCounts)
+    {
+        leaves.assign(treeLeaves.begin(), treeLeaves.end());
+        counts.assign(leafCounts.begin(), leafCounts.end());
+    }
+
+    void updateFocus(gsl::span<const KeyType> treeLeaves, gsl::span<const unsigned> leafCounts,
+                     gsl::span<const char> macs)
+    {
+        focusLeaves.assign(treeLeaves.begin(), treeLeaves.end());
+        focusCounts.assign(leafCounts.begin(), leafCounts.end());
+        focusMacs.assign(macs.begin(), macs.end());
+        numFocusLeaves = focusCounts.size();
+    }
+
+    //! @brief the focus tree MACs in the type of cstone::FocusedOctree::macs()
+    std::vector<char> focusMacStatus() const { return {focusMacs.begin(), focusMacs.end()}; }
+
+    //! @brief true if the focus tree is a cornerstone tree with one count per leaf and one MAC per node
+    bool focusMatches() const
+    {
+        size_t numLeaves = focusCounts.size();
+        if (numLeaves == 0 || focusLeaves.size() != numLeaves + 1) { return false; }
+        if (focusLeaves.front() != 0 || focusLeaves.back() != cstone::nodeRange<KeyType>(0)) { return false; }
+        // an octree with n leaves has (n - 1) / 7 internal nodes
+        return focusMacs.size() == numLeaves + (numLeaves - 1) / 7;
+    }
+
+    //! @brief true if the index is consistent with itself and describes a file with @p numParticles particles
+    bool matches(size_t numParticles) const
+    {
+        if (empty() || leaves.size() != counts.size() + 1) { return false; }
+        if (leaves.front() != 0 || leaves.back() != cstone::nodeRange<KeyType>(0)) { return false; }
+        return std::accumulate(counts.begin(), counts.end(), size_t(0)) == numParticles;
+    }
+
+    /*! @brief particle index range in the snapshot that @p rank gets assigned if the index is split into @p numRanks
+     *
+     * Leaves are assigned to ranks in the same way the domain decomposition does, such that after restart
+     * only particles that moved across a rank boundary since the last decomposition need to be exchanged.
+     */
+    std::tuple<size_t, size_t> range(int rank, int numRanks) const
+    {
+        auto   assignment = cstone::singleRangeSfcSplit(counts, numRanks);
+        size_t first      = std::accumulate(counts.begin(), counts.begin() + assignment.firstNodeIdx(rank), size_t(0));
+        return {first, first + assignment.totalCount(rank)};
+    }
+};
+
+} // namespace sphexa
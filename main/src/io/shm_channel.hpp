@@ -0,0 +1,463 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Shared-memory channel between the simulation and an analysis process on the same node
+ *
+ * A channel is a POSIX shared-memory segment with a header and two frame slots. The publisher writes frame n into
+ * slot n % 2, while the previous frame remains readable in the other slot. A consumer locks the slot of the latest
+ * frame while it reads the fields in place. The publisher never waits: if the slot it needs is locked by a lagging
+ * consumer, the frame is dropped. Consumers detect skipped frames from the frame numbers.
+ *
+ * Slot states are atomic words in the shared segment:
+ *  - free:    the slot holds a complete frame, or no frame yet
+ *  - writing: the publisher is filling the slot
+ *  - reading: a consumer is accessing the slot
+ *
+ * If a frame does not fit into a slot, the publisher marks the segment as superseded and replaces it with a larger
+ * one under the same name. Consumers reopen the segment when they find it superseded. The publisher sets the version
+ * of a new segment last, consumers keep the old segment until the new one has a valid version.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cstone/util/gsl-lite.hpp"
+
+#include "native_snapshot.hpp"
+
+namespace sphexa
+{
+
+constexpr char     shmMagic[8]       = {'S', 'P', 'H', 'E', 'X', 'A', 'S', 'M'};
+constexpr uint32_t shmVersion        = 1;
+constexpr uint32_t shmNumSlots       = 2;
+constexpr uint32_t shmMaxFields      = 32;
+constexpr uint64_t shmFieldAlignment = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared-memory channels need address-free atomics");
+
+enum ShmSlotState : uint32_t
+{
+    shmFree    = 0,
+    shmWriting = 1,
+    shmReading = 2
+};
+
+struct ShmField
+{
+    char                  name[fileutils::nativeMaxNameSize];
+    fileutils::NativeType type;
+    uint32_t              elementSize;
+    //! @brief byte offset of the first element from the start of the slot
+    uint64_t offset;
+    uint64_t count;
+};
+
+//! @brief step metadata of a frame
+struct ShmFrameInfo
+{
+    uint64_t step;
+    double   time;
+    //! @brief number of particles in this frame, which holds the particles of one rank
+    uint64_t numParticles;
+    uint64_t numParticlesGlobal;
+    int32_t  rank;
+    int32_t  numRanks;
+    //! @brief xmin, xmax, ymin, ymax, zmin, zmax
+    double box[6];
+};
+
+struct ShmSlot
+{
+    std::atomic<uint32_t> state;
+    uint32_t              numFields;
+    //! @brief frame number, starting from 1
+    uint64_t     frame;
+    ShmFrameInfo info;
+    ShmField     fields[shmMaxFields];
+};
+
+struct ShmChannelHeader
+{
+    char magic[8];
+    //! @brief stored last when the publisher creates the segment, 0 while the header is not initialized
+    std::atomic<uint32_t> version;
+    //! @brief set when the publisher replaced or removed the segment
+    std::atomic<uint32_t> superseded;
+    uint64_t              slotBytes;
+    //! @brief number of the most recent complete frame, 0 if none
+    std::atomic<uint64_t> latestFrame;
+    //! @brief frames not published because a consumer still held the slot
+    std::atomic<uint64_t> droppedFrames;
+};
+
+//! @brief name of the shared-memory segment of channel @p name on @p rank
+inline std::string shmSegmentName(const std::string& name, int rank)
+{
+    return "/sphexa-" + name + "-" + std::to_string(rank);
+}
+
+inline uint64_t shmSlotOffset(uint32_t slot, uint64_t slotBytes)
+{
+    return fileutils::nativePageAlign(sizeof(ShmChannelHeader)) + slot * slotBytes;
+}
+
+//! @brief description of a field to publish
+struct ShmFieldDesc
+{
+    std::string           name;
+    fileutils::NativeType type;
+    uint64_t              count;
+};
+
+//! @brief bytes of a slot that holds @p fields
+inline uint64_t shmSlotBytes(const std::vector<ShmFieldDesc>& fields)
+{
+    uint64_t bytes = sizeof(ShmSlot);
+    for (const auto& f : fields)
+    {
+        bytes = (bytes + shmFieldAlignment - 1) / shmFieldAlignment * shmFieldAlignment;
+        bytes += f.count * fileutils::nativeTypeSize(f.type);
+    }
+    return bytes;
+}
+
+//! @brief the writing end of a shared-memory channel, removes the segment on destruction
+class ShmPublisher
+{
+public:
+    /*! @brief
+     *
+     * @param segmentName  POSIX shared-memory name, see shmSegmentName
+     * @param headroom     slots are sized for the first frame times this factor, to absorb load balancing
+     */
+    explicit ShmPublisher(std::string segmentName, double headroom = 1.5)
+        : name_(std::move(segmentName))
+        , headroom_(headroom)
+    {
+    }
+
+    ShmPublisher(const ShmPublisher&)            = delete;
+    ShmPublisher& operator=(const ShmPublisher&) = delete;
+
+    ~ShmPublisher() { unmap(); }
+
+    /*! @brief publish a frame without waiting for consumers
+     *
+     * @param info    step metadata
+     * @param fields  names, types and element counts of the fields
+     * @param fill    called as fill(i, dest) to copy field i into the slot
+     * @return        false if the frame was dropped because a consumer holds the slot
+     */
+    template<class F>
+    bool publish(const ShmFrameInfo& info, const std::vector<ShmFieldDesc>& fields, F&& fill)
+    {
+        if (fields.size() > shmMaxFields) { throw std::runtime_error("Too many fields for channel " + name_ + "\n"); }
+        for (const auto& f : fields)
+        {
+            if (f.name.size() >= fileutils::nativeMaxNameSize)
+            {
+                throw std::runtime_error("Field name " + f.name + " too long for channel " + name_ + "\n");
+            }
+        }
+
+        uint64_t required = shmSlotBytes(fields);
+        if (header_ == nullptr || required > header_->slotBytes)
+        {
+            create(fileutils::nativePageAlign(uint64_t(required * headroom_)));
+        }
+
+        uint64_t frame    = nextFrame_;
+        ShmSlot* slot     = slotPtr(frame % shmNumSlots);
+        uint32_t expected = shmFree;
+        if (!slot->state.compare_exchange_strong(expected, shmWriting, std::memory_order_acquire))
+        {
+            header_->droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        slot->numFields = fields.size();
+        slot->info      = info;
+        uint64_t offset = sizeof(ShmSlot);
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            offset = (offset + shmFieldAlignment - 1) / shmFieldAlignment * shmFieldAlignment;
+
+            ShmField& f = slot->fields[i];
+            std::memset(f.name, 0, sizeof(f.name));
+            std::memcpy(f.name, fields[i].name.data(), fields[i].name.size());
+            f.type        = fields[i].type;
+            f.elementSize = fileutils::nativeTypeSize(f.type);
+            f.offset      = offset;
+            f.count       = fields[i].count;
+
+            fill(i, reinterpret_cast<char*>(slot) + offset);
+            offset += f.count * f.elementSize;
+        }
+        slot->frame = frame;
+
+        slot->state.store(shmFree, std::memory_order_release);
+        header_->latestFrame.store(frame, std::memory_order_release);
+        nextFrame_++;
+        return true;
+    }
+
+    uint64_t droppedFrames() const { return header_ ? header_->droppedFrames.load() : 0; }
+
+    const std::string& name() const { return name_; }
+
+private:
+    //! @brief replace the segment with a new one with slots of @p slotBytes
+    void create(uint64_t slotBytes)
+    {
+        uint64_t dropped = droppedFrames();
+        unmap();
+
+        // a stale segment of a previous run might still be mapped by a consumer, it must not be truncated
+        shm_unlink(name_.c_str());
+        size_  = shmSlotOffset(shmNumSlots, slotBytes);
+        int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, size_) != 0)
+        {
+            if (fd >= 0) { close(fd); }
+            throw std::runtime_error("Cannot create shared-memory segment " + name_ + "\n");
+        }
+        void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) { throw std::runtime_error("Cannot map shared-memory segment " + name_ + "\n"); }
+
+        // the segment is zero-filled, which is a valid initial state of the atomics
+        header_ = static_cast<ShmChannelHeader*>(addr);
+        std::copy(shmMagic, shmMagic + 8, header_->magic);
+        header_->slotBytes = slotBytes;
+        header_->droppedFrames.store(dropped);
+        header_->latestFrame.store(0);
+        header_->version.store(shmVersion, std::memory_order_release);
+    }
+
+    void unmap()
+    {
+        if (header_ == nullptr) { return; }
+        header_->superseded.store(1, std::memory_order_release);
+        munmap(header_, size_);
+        shm_unlink(name_.c_str());
+        header_ = nullptr;
+    }
+
+    ShmSlot* slotPtr(uint32_t slot)
+    {
+        return reinterpret_cast<ShmSlot*>(reinterpret_cast<char*>(header_) + shmSlotOffset(slot, header_->slotBytes));
+    }
+
+    std::string       name_;
+    double            headroom_;
+    ShmChannelHeader* header_{nullptr};
+    uint64_t          size_{0};
+    uint64_t          nextFrame_{1};
+};
+
+/*! @brief a frame locked by a consumer, the fields are accessed in place in shared memory
+ *
+ * The slot is released on destruction. Consumers should not hold frames longer than one output interval of the
+ * simulation, otherwise the publisher drops frames. The frame keeps its segment mapped, also if the consumer has
+ * moved on to a replacement segment.
+ */
+class ShmFrame
+{
+public:
+    ShmFrame() = default;
+
+    ShmFrame(ShmSlot* slot, std::shared_ptr<void> mapping)
+        : slot_(slot)
+        , mapping_(std::move(mapping))
+    {
+    }
+
+    ShmFrame(ShmFrame&& other) noexcept
+        : slot_(other.slot_)
+        , mapping_(std::move(other.mapping_))
+    {
+        other.slot_ = nullptr;
+    }
+
+    ShmFrame& operator=(ShmFrame&& other) noexcept
+    {
+        std::swap(slot_, other.slot_);
+        std::swap(mapping_, other.mapping_);
+        return *this;
+    }
+
+    ~ShmFrame()
+    {
+        if (slot_) { slot_->state.store(shmFree, std::memory_order_release); }
+    }
+
+    bool valid() const { return slot_ != nullptr; }
+
+    uint64_t            frame() const { return slot_->frame; }
+    const ShmFrameInfo& info() const { return slot_->info; }
+
+    gsl::span<const ShmField> fields() const { return {slot_->fields, slot_->numFields}; }
+
+    const ShmField* findField(const std::string& name) const
+    {
+        for (const auto& f : fields())
+        {
+            if (name == std::string(f.name, strnlen(f.name, fileutils::nativeMaxNameSize))) { return &f; }
+        }
+        return nullptr;
+    }
+
+    //! @brief view of field @p name in shared memory, T must match the stored type
+    template<class T>
+    gsl::span<const T> field(const std::string& name) const
+    {
+        const ShmField* f = findField(name);
+        if (f == nullptr) { throw std::runtime_error("Field " + name + " not in frame\n"); }
+        if (f->type != fileutils::nativeType<T>())
+        {
+            throw std::runtime_error("Type mismatch of field " + name + "\n");
+        }
+        return {reinterpret_cast<const T*>(reinterpret_cast<const char*>(slot_) + f->offset), f->count};
+    }
+
+    //! @brief element @p i of field @p f, converted to double
+    double value(const ShmField& f, size_t i) const
+    {
+        const char* p = reinterpret_cast<const char*>(slot_) + f.offset + i * f.elementSize;
+        switch (f.type)
+        {
+            case fileutils::NativeType::float32: return *reinterpret_cast<const float*>(p);
+            case fileutils::NativeType::float64: return *reinterpret_cast<const double*>(p);
+            case fileutils::NativeType::int32: return *reinterpret_cast<const int32_t*>(p);
+            case fileutils::NativeType::uint32: return *reinterpret_cast<const uint32_t*>(p);
+            case fileutils::NativeType::uint64: return double(*reinterpret_cast<const uint64_t*>(p));
+            default: return *reinterpret_cast<const uint8_t*>(p);
+        }
+    }
+
+private:
+    ShmSlot*              slot_{nullptr};
+    std::shared_ptr<void> mapping_;
+};
+
+//! @brief the reading end of a shared-memory channel
+class ShmConsumer
+{
+public:
+    //! @brief open segment @p segmentName, throws if the publisher has not created it yet
+    explicit ShmConsumer(std::string segmentName)
+        : name_(std::move(segmentName))
+    {
+        if (!open()) { throw std::runtime_error("Shared-memory segment " + name_ + " does not exist\n"); }
+    }
+
+    ShmConsumer(const ShmConsumer&)            = delete;
+    ShmConsumer& operator=(const ShmConsumer&) = delete;
+
+    /*! @brief lock the latest frame if its frame number is larger than @p after
+     *
+     * Returns an invalid frame if there is no newer frame or if the publisher is currently overwriting it. If the
+     * publisher replaced the segment, the replacement is opened once it is initialized, until then there is no
+     * newer frame.
+     */
+    ShmFrame acquire(uint64_t after)
+    {
+        if (header_->superseded.load(std::memory_order_acquire) && !open()) { return {}; }
+
+        uint64_t latest = header_->latestFrame.load(std::memory_order_acquire);
+        if (latest <= after) { return {}; }
+
+        ShmSlot* slot     = slotPtr(latest % shmNumSlots);
+        uint32_t expected = shmFree;
+        if (!slot->state.compare_exchange_strong(expected, shmReading, std::memory_order_acquire)) { return {}; }
+
+        ShmFrame frame(slot, mapping_);
+        if (slot->frame <= after) { return {}; }
+        return frame;
+    }
+
+    uint64_t latestFrame() const { return header_->latestFrame.load(std::memory_order_acquire); }
+    uint64_t droppedFrames() const { return header_->droppedFrames.load(std::memory_order_relaxed); }
+
+private:
+    /*! @brief map the segment, replacing the current mapping
+     *
+     * @return false if the segment does not exist or the publisher has not initialized it yet, the current mapping
+     *         is then kept. Throws if the segment is not an SPH-EXA channel.
+     */
+    bool open()
+    {
+        int fd = shm_open(name_.c_str(), O_RDWR, 0);
+        if (fd < 0) { return false; }
+
+        struct stat segmentStat;
+        fstat(fd, &segmentStat);
+        uint64_t size = segmentStat.st_size;
+        void*    addr = size >= sizeof(ShmChannelHeader)
+                            ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                            : MAP_FAILED;
+        close(fd);
+        if (addr == MAP_FAILED) { return false; }
+
+        std::shared_ptr<void> mapping(addr, [size](void* p) { munmap(p, size); });
+        auto*                 header  = static_cast<ShmChannelHeader*>(addr);
+        uint32_t              version = header->version.load(std::memory_order_acquire);
+        if (version == 0) { return false; }
+
+        bool ok = version == shmVersion && std::equal(shmMagic, shmMagic + 8, header->magic) &&
+                  shmSlotOffset(shmNumSlots, header->slotBytes) <= size;
+        if (!ok) { throw std::runtime_error(name_ + " is not an SPH-EXA shared-memory channel\n"); }
+
+        header_  = header;
+        mapping_ = std::move(mapping);
+        return true;
+    }
+
+    ShmSlot* slotPtr(uint32_t slot)
+    {
+        return reinterpret_cast<ShmSlot*>(reinterpret_cast<char*>(header_) + shmSlotOffset(slot, header_->slotBytes));
+    }
+
+    std::string           name_;
+    ShmChannelHeader*     header_{nullptr};
+    std::shared_ptr<void> mapping_;
+};
+
+} // namespace sphexa
@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Publishes simulation data into a shared-memory channel for in-situ analysis by a separate process
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include "cstone/fields/data_util.hpp"
+
+#include "shm_channel.hpp"
+#include "stream_writer.hpp"
+
+namespace sphexa
+{
+
+/*! @brief In-situ channel of one rank, configured with the syntax of output streams
+ *
+ * Each rank publishes its assigned particles to the segment shmSegmentName(name, rank). The region and decimation
+ * filters of the stream configuration apply. Publishing copies the selected fields into shared memory once and
+ * never waits for the consumer.
+ */
+template<class Dataset>
+class ShmInsitu
+{
+public:
+    ShmInsitu(OutputStream config, const std::vector<std::string>& defaultFields, const std::string& defaultFrequency,
+              int rank, int numRanks)
+        : config_(std::move(config))
+        , rank_(rank)
+        , numRanks_(numRanks)
+        , publisher_(shmSegmentName(config_.name, rank))
+    {
+        if (config_.fields.empty()) { config_.fields = defaultFields; }
+        if (config_.frequency.empty()) { config_.frequency = defaultFrequency; }
+    }
+
+    bool isOutputStep(size_t step, double t1, double t2) const { return config_.isOutputStep(step, t1, t2); }
+
+    //! @brief publish the selected particles, returns false if the frame was dropped
+    template<class Domain>
+    bool publish(Dataset& simData, const Domain& domain, const cstone::Box<typename Dataset::RealType>& box)
+    {
+        auto& d         = simData.hydro;
+        auto  selection = selectAssignedParticles(config_, d, domain, rank_);
+
+        ShmFrameInfo info{d.iteration, d.ttot, selection.size(), d.numParticlesGlobal, rank_, numRanks_,
+                          {box.xmin(), box.xmax(), box.ymin(), box.ymax(), box.zmin(), box.zmax()}};
+
+        auto                      fieldIndices = cstone::fieldStringsToInt(config_.fields, d.fieldNames);
+        auto                      src          = d.data();
+        std::vector<ShmFieldDesc> fields;
+        for (int i : fieldIndices)
+        {
+            if (!d.isAllocated(i))
+            {
+                throw std::runtime_error("Cannot publish field " + std::string(d.fieldNames[i]) +
+                                         ", because it is not active.");
+            }
+            std::visit(
+                [&](auto* field)
+                {
+                    using T = typename std::decay_t<decltype(*field)>::value_type;
+                    fields.push_back({std::string(d.fieldNames[i]), fileutils::nativeType<T>(), selection.size()});
+                },
+                src[i]);
+        }
+
+        auto fill = [&](size_t f, void* dest)
+        { std::visit([&](auto* field) { gatherField(*field, selection, dest); }, src[fieldIndices[f]]); };
+
+        return publisher_.publish(info, fields, fill);
+    }
+
+    const std::string& name() const { return config_.name; }
+    uint64_t           droppedFrames() const { return publisher_.droppedFrames(); }
+
+private:
+    template<class Vector>
+    static void gatherField(const Vector& field, const std::vector<cstone::LocalIndex>& selection, void* dest)
+    {
+        auto* to = static_cast<typename Vector::value_type*>(dest);
+#pragma omp parallel for schedule(static)
+        for (size_t j = 0; j < selection.size(); ++j)
+        {
+            to[j] = field[selection[j]];
+        }
+    }
+
+    OutputStream config_;
+    int          rank_, numRanks_;
+    ShmPublisher publisher_;
+};
+
+} // namespace sphexa
@@ -0,0 +1,388 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Lazy, field-selective snapshot reader for post-processing
+ *
+ * A reader opens a snapshot once and then reads only the requested fields and particle ranges. Analyses stream
+ * over the particles in blocks, such that their memory footprint does not depend on the size of the snapshot.
+ * If a step has an SFC index, spatial selections only read the particles of leaves that overlap the region.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "cstone/sfc/box.hpp"
+#include "cstone/sfc/sfc.hpp"
+
+#include "native_delta.hpp"
+#include "output_stream.hpp"
+#include "sfc_index.hpp"
+
+namespace sphexa
+{
+
+//! @brief read access to the steps of a snapshot file or of a series of native snapshot files
+class ISnapshotReader
+{
+public:
+    virtual ~ISnapshotReader() = default;
+
+    virtual size_t numSteps() const = 0;
+    //! @brief select the step that all other functions refer to
+    virtual void setStep(size_t step) = 0;
+
+    virtual uint64_t numParticles() const = 0;
+    //! @brief names of the particle fields
+    virtual std::vector<std::string> fieldNames() const = 0;
+    //! @brief names and values of the step attributes, e.g. time, step and box
+    virtual std::vector<std::pair<std::string, std::vector<double>>> attributes() const = 0;
+    //! @brief read particles [first:first+count] of field @p name, converted to double
+    virtual void readField(const std::string& name, size_t first, size_t count, double* dest) = 0;
+    //! @brief SFC index with keys converted to 64 bits, false if the step has none
+    virtual bool sfcIndex(SfcIndex<uint64_t>& index) = 0;
+    //! @brief true if readField may be called concurrently for different fields
+    virtual bool concurrentReads() const = 0;
+};
+
+//! @brief reader for native snapshots and delta checkpoints, each file is one step
+class NativeSnapshotReader : public ISnapshotReader
+{
+public:
+    explicit NativeSnapshotReader(std::vector<std::string> paths)
+        : paths_(std::move(paths))
+        , files_(paths_.size())
+    {
+        if (paths_.empty()) { throw std::runtime_error("No snapshot files to read\n"); }
+        setStep(0);
+    }
+
+    size_t numSteps() const override { return paths_.size(); }
+
+    void setStep(size_t step) override
+    {
+        if (step >= paths_.size()) { throw std::runtime_error("Step " + std::to_string(step) + " does not exist\n"); }
+        if (!files_[step]) { files_[step] = std::make_unique<fileutils::NativeCheckpoint>(paths_[step]); }
+        current_ = files_[step].get();
+    }
+
+    uint64_t numParticles() const override { return current_->header().numParticles; }
+
+    std::vector<std::string> fieldNames() const override
+    {
+        std::vector<std::string> names;
+        for (const auto& f : current_->snapshot().fields())
+        {
+            std::string name(f.name, strnlen(f.name, fileutils::nativeMaxNameSize));
+            if (fileutils::isNativeParticleField(name)) { names.push_back(name); }
+        }
+        return names;
+    }
+
+    std::vector<std::pair<std::string, std::vector<double>>> attributes() const override
+    {
+        const auto& h = current_->header();
+        return {{"step", {double(h.step)}},
+                {"time", {h.time}},
+                {"minDt", {h.minDt}},
+                {"minDt_m1", {h.minDt_m1}},
+                {"gravConstant", {h.gravConstant}},
+                {"gamma", {h.gamma}},
+                {"muiConst", {h.muiConst}},
+                {"box", std::vector<double>(h.box, h.box + 6)},
+                {"boundaryType", std::vector<double>(h.boundaryType, h.boundaryType + 3)}};
+    }
+
+    void readField(const std::string& name, size_t first, size_t count, double* dest) override
+    {
+        if (!current_->hasField(name) || !fileutils::isNativeParticleField(name))
+        {
+            throw std::runtime_error("Field " + name + " does not exist\n");
+        }
+        current_->readField(name, first, count, dest);
+    }
+
+    /*! @brief read the SFC index of the current step
+     *
+     * 32-bit keys have 10 octree levels, 64-bit keys 21. A 32-bit key k therefore corresponds to the 64-bit key
+     * k << 33 and the conversion is exact.
+     */
+    bool sfcIndex(SfcIndex<uint64_t>& index) override
+    {
+        using namespace fileutils;
+        const auto& snap = current_->snapshot();
+        index.clear();
+        if (!snap.hasField(nativeSfcLeaves) || !snap.hasField(nativeSfcCounts)) { return false; }
+
+        auto keyType = snap.fieldType(nativeSfcLeaves);
+        if (keyType != NativeType::uint32 && keyType != NativeType::uint64) { return false; }
+
+        index.leaves.resize(snap.fieldCount(nativeSfcLeaves));
+        index.counts.resize(snap.fieldCount(nativeSfcCounts));
+        snap.readField(nativeSfcLeaves, 0, index.leaves.size(), index.leaves.data());
+        snap.readField(nativeSfcCounts, 0, index.counts.size(), index.counts.data());
+        if (keyType == NativeType::uint32)
+        {
+            for (auto& key : index.leaves)
+            {
+                key <<= 33;
+            }
+        }
+
+        if (!index.matches(numParticles())) { index.clear(); }
+        return !index.empty();
+    }
+
+    bool concurrentReads() const override { return true; }
+
+private:
+    std::vector<std::string>                                  paths_;
+    std::vector<std::unique_ptr<fileutils::NativeCheckpoint>> files_;
+    fileutils::NativeCheckpoint*                              current_{nullptr};
+};
+
+//! @brief return the values of attribute @p name of the current step of @p reader
+inline std::vector<double> readAttribute(const ISnapshotReader& reader, const std::string& name)
+{
+    for (auto& [attrName, values] : reader.attributes())
+    {
+        if (attrName == name) { return values; }
+    }
+    throw std::runtime_error("Attribute " + name + " does not exist\n");
+}
+
+/*! @brief read particles [first:first+count] of each field in @p names
+ *
+ * Fields are read concurrently if the reader supports it. For compressed native snapshots, this also decodes
+ * the fields in parallel.
+ */
+inline std::vector<std::vector<double>> readFields(ISnapshotReader& reader, const std::vector<std::string>& names,
+                                                  size_t first, size_t count)
+{
+    std::vector<std::vector<double>> columns(names.size());
+    std::vector<std::string>         errors(names.size());
+
+#pragma omp parallel for schedule(dynamic) if (reader.concurrentReads())
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        // exceptions must not escape the parallel region
+        try
+        {
+            columns[i].resize(count);
+            reader.readField(names[i], first, count, columns[i].data());
+        }
+        catch (const std::exception& e)
+        {
+            errors[i] = e.what();
+        }
+    }
+
+    for (const auto& error : errors)
+    {
+        if (!error.empty()) { throw std::runtime_error(error); }
+    }
+    return columns;
+}
+
+/*! @brief particle index range [first:last] that contains all particles with SFC keys in [keyStart:keyEnd]
+ *
+ * The range is rounded out to leaf boundaries of the SFC index, it may therefore contain particles with keys
+ * outside [keyStart:keyEnd].
+ */
+inline std::tuple<size_t, size_t> sfcParticleRange(const SfcIndex<uint64_t>& index, uint64_t keyStart, uint64_t keyEnd)
+{
+    size_t firstLeaf = std::upper_bound(index.leaves.begin(), index.leaves.end(), keyStart) - index.leaves.begin();
+    size_t lastLeaf  = std::lower_bound(index.leaves.begin(), index.leaves.end(), keyEnd) - index.leaves.begin();
+    firstLeaf        = std::max(firstLeaf, size_t(1)) - 1;
+    lastLeaf         = std::clamp(lastLeaf, firstLeaf, index.counts.size());
+
+    size_t first = std::accumulate(index.counts.begin(), index.counts.begin() + firstLeaf, size_t(0));
+    size_t last  = std::accumulate(index.counts.begin() + firstLeaf, index.counts.begin() + lastLeaf, first);
+    return {first, last};
+}
+
+/*! @brief particle index ranges of the leaves that overlap with @p region
+ *
+ * Adjacent leaves are merged into a single range. If the step has no SFC index, all particles are returned.
+ */
+inline std::vector<std::tuple<size_t, size_t>> regionParticleRanges(ISnapshotReader& reader,
+                                                                    const OutputRegion& region)
+{
+    SfcIndex<uint64_t> index;
+    if (region.shape == OutputRegion::Shape::all || !reader.sfcIndex(index))
+    {
+        return {{size_t(0), size_t(reader.numParticles())}};
+    }
+
+    auto                b = readAttribute(reader, "box");
+    cstone::Box<double> box(b[0], b[1], b[2], b[3], b[4], b[5]);
+
+    std::vector<std::tuple<size_t, size_t>> ranges;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < index.counts.size(); ++i)
+    {
+        auto ibox   = cstone::sfcIBox(cstone::sfcKey(index.leaves[i]), cstone::sfcKey(index.leaves[i + 1]));
+        bool select = index.counts[i] > 0 &&
+                      region.overlap(cstone::createFpBox<uint64_t>(ibox, box)) != OutputRegion::Overlap::outside;
+        if (select)
+        {
+            bool adjacent = !ranges.empty() && std::get<1>(ranges.back()) == offset;
+            if (adjacent) { std::get<1>(ranges.back()) += index.counts[i]; }
+            else { ranges.emplace_back(offset, offset + index.counts[i]); }
+        }
+        offset += index.counts[i];
+    }
+    return ranges;
+}
+
+/*! @brief stream over the particles inside @p region in blocks of at most @p blockSize particles
+ *
+ * @param[in] func  called as func(columns, selection) for each block, where columns[i] holds @p fields[i] of all
+ *                  particles of the block and selection the indices within the block of particles inside the region
+ *
+ * Only the particles of leaves that overlap the region are read, see regionParticleRanges. Coordinates are read
+ * in addition to @p fields if necessary to test particles against the region.
+ */
+template<class F>
+void forEachInRegion(ISnapshotReader& reader, const OutputRegion& region, const std::vector<std::string>& fields,
+                     size_t blockSize, F&& func)
+{
+    bool testParticles = region.shape != OutputRegion::Shape::all;
+
+    auto                names = fields;
+    std::vector<size_t> coordIdx;
+    if (testParticles)
+    {
+        for (std::string coord : {"x", "y", "z"})
+        {
+            auto it = std::find(names.begin(), names.end(), coord);
+            coordIdx.push_back(it - names.begin());
+            if (it == names.end()) { names.push_back(coord); }
+        }
+    }
+
+    std::vector<size_t> selection;
+    for (auto [first, last] : regionParticleRanges(reader, region))
+    {
+        for (size_t blockStart = first; blockStart < last; blockStart += blockSize)
+        {
+            size_t count   = std::min(blockSize, last - blockStart);
+            auto   columns = readFields(reader, names, blockStart, count);
+
+            selection.clear();
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!testParticles ||
+                    region.contains(columns[coordIdx[0]][i], columns[coordIdx[1]][i], columns[coordIdx[2]][i]))
+                {
+                    selection.push_back(i);
+                }
+            }
+            columns.resize(fields.size());
+            func(columns, selection);
+        }
+    }
+}
+
+//! @brief statistics of a quantity in radial bins of equal width
+struct RadialProfile
+{
+    RadialProfile(double rmax_, size_t numBins)
+        : rmax(rmax_)
+        , count(numBins, 0)
+        , sum(numBins, 0)
+        , sumSq(numBins, 0)
+        , minimum(numBins, std::numeric_limits<double>::infinity())
+        , maximum(numBins, -std::numeric_limits<double>::infinity())
+    {
+    }
+
+    void add(double r, double q)
+    {
+        if (!(r < rmax)) { return; }
+        size_t bin = std::min(size_t(r / rmax * count.size()), count.size() - 1);
+        count[bin]++;
+        sum[bin] += q;
+        sumSq[bin] += q * q;
+        minimum[bin] = std::min(minimum[bin], q);
+        maximum[bin] = std::max(maximum[bin], q);
+    }
+
+    //! @brief inner radius of bin @p i
+    double radius(size_t i) const { return rmax * double(i) / count.size(); }
+
+    double                rmax;
+    std::vector<uint64_t> count;
+    std::vector<double>   sum, sumSq, minimum, maximum;
+};
+
+/*! @brief radial profile of field @p quantity around @p center, streamed in blocks of @p blockSize particles
+ *
+ * As in scripts/radial_profile.py, the quantity "v" denotes the radial velocity, computed from vx, vy, vz.
+ * Particles further than @p rmax from the center are not read if the step has an SFC index.
+ */
+inline RadialProfile radialProfile(ISnapshotReader& reader, const std::string& quantity, const double center[3],
+                                   double rmax, size_t numBins, size_t blockSize)
+{
+    OutputRegion region;
+    region.shape = OutputRegion::Shape::sphere;
+    std::copy(center, center + 3, region.param);
+    region.param[3] = rmax;
+
+    bool                     radialVelocity = quantity == "v";
+    std::vector<std::string> fields{"x", "y", "z"};
+    if (radialVelocity) { fields.insert(fields.end(), {"vx", "vy", "vz"}); }
+    else { fields.push_back(quantity); }
+
+    RadialProfile profile(rmax, numBins);
+    forEachInRegion(reader, region, fields, blockSize,
+                    [&](const std::vector<std::vector<double>>& c, const std::vector<size_t>& selection)
+                    {
+                        for (size_t i : selection)
+                        {
+                            double dx = c[0][i] - center[0], dy = c[1][i] - center[1], dz = c[2][i] - center[2];
+                            double r  = std::sqrt(dx * dx + dy * dy + dz * dz);
+                            double q  = c[3][i];
+                            if (radialVelocity) { q = r > 0 ? (c[3][i] * dx + c[4][i] * dy + c[5][i] * dz) / r : 0; }
+                            profile.add(r, q);
+                        }
+                    });
+    return profile;
+}
+
+} // namespace sphexa
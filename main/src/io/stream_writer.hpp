@@ -0,0 +1,184 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Writer of region-of-interest and decimated output streams
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+
+#include "ifile_writer.hpp"
+#include "output_stream.hpp"
+
+namespace sphexa
+{
+
+//! @brief select the particles of @p stream among the particles assigned to @p rank, see selectStreamParticles
+template<class HydroData, class Domain>
+std::vector<cstone::LocalIndex> selectAssignedParticles(const OutputStream& stream, const HydroData& d,
+                                                        const Domain& domain, int rank)
+{
+    const auto& focusTree = domain.focusTree();
+    auto        assigned  = focusTree.assignment()[rank];
+    auto        leaves    = focusTree.treeLeaves().subspan(assigned.start(), assigned.count() + 1);
+    auto        counts    = focusTree.leafCounts().subspan(assigned.start(), assigned.count());
+
+    return selectStreamParticles(stream, d.x.data(), d.y.data(), d.z.data(), domain.startIndex(), domain.endIndex(),
+                                 leaves, counts, domain.box());
+}
+
+/*! @brief Writes the configured output streams with the file writer of the main output
+ *
+ * Each stream is written to a separate file. The selected particles and fields are compacted into a staging dataset
+ * and passed to the writer, such that the output volume and the time spent in the writer scale with the size of the
+ * selection.
+ */
+template<class Dataset>
+class OutputStreams
+{
+public:
+    /*! @brief
+     *
+     * @param streams           stream configurations, empty fields and frequencies are replaced by the defaults
+     * @param defaultFields     fields of the main output
+     * @param defaultFrequency  frequency of the main output
+     */
+    OutputStreams(std::vector<OutputStream> streams, const std::vector<std::string>& defaultFields,
+                  const std::string& defaultFrequency)
+        : streams_(std::move(streams))
+    {
+        for (auto& s : streams_)
+        {
+            if (s.fields.empty()) { s.fields = defaultFields; }
+            if (s.frequency.empty()) { s.frequency = defaultFrequency; }
+        }
+    }
+
+    //! @brief true if any stream is due for output in the step from @p t1 to @p t2
+    bool isOutputStep(size_t step, double t1, double t2) const
+    {
+        return std::any_of(streams_.begin(), streams_.end(),
+                           [step, t1, t2](const OutputStream& s) { return s.isOutputStep(step, t1, t2); });
+    }
+
+    /*! @brief write all streams that are due for output
+     *
+     * @param simData  simulation data with the output fields on the host
+     * @param domain   the domain, providing the assigned particle range and its focus tree leaves
+     * @param box      global coordinate bounding box to store in the output files
+     * @param writer   file writer of the main output
+     * @param path     output file name of the main output, the stream name is inserted before the writer suffix
+     * @param out      stream for reporting the number of written particles, used on the first rank
+     */
+    template<class Domain>
+    void dump(Dataset& simData, const Domain& domain, const cstone::Box<typename Dataset::RealType>& box,
+              const IFileWriter<Dataset>& writer, const std::string& path, std::ostream& out) const
+    {
+        auto& d = simData.hydro;
+        int   rank;
+        MPI_Comm_rank(simData.comm, &rank);
+
+        std::string suffix = writer.suffix();
+        std::string stem   = path;
+        if (path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            stem.resize(path.size() - suffix.size());
+        }
+
+        for (const auto& stream : streams_)
+        {
+            if (!stream.isOutputStep(d.iteration, d.ttot - d.minDt, d.ttot)) { continue; }
+
+            auto selection = selectAssignedParticles(stream, d, domain, rank);
+
+            Dataset staging;
+            staging.comm = simData.comm;
+            gather(d, stream.fields, selection, staging.hydro);
+
+            size_t numSelected = selection.size();
+            MPI_Allreduce(&numSelected, &staging.hydro.numParticlesGlobal, 1, MpiType<size_t>{}, MPI_SUM, simData.comm);
+
+            writer.dump(staging, 0, selection.size(), box, stem + "_" + stream.name + suffix);
+            if (rank == 0)
+            {
+                out << "# Output stream " << stream.name << ": " << staging.hydro.numParticlesGlobal << " particles"
+                    << std::endl;
+            }
+        }
+    }
+
+    const std::vector<OutputStream>& streams() const { return streams_; }
+
+private:
+    //! @brief copy the scalar attributes and the @p fields of the @p selection of particles of @p d into @p s
+    template<class HydroData>
+    void gather(HydroData& d, const std::vector<std::string>& fields, const std::vector<cstone::LocalIndex>& selection,
+                HydroData& s) const
+    {
+        copyScalarAttributes(d, s);
+
+        s.setOutputFields(fields);
+        for (int i : s.outputFieldIndices)
+        {
+            if (!d.isAllocated(i))
+            {
+                throw std::runtime_error("Cannot output field " + std::string(d.fieldNames[i]) +
+                                         ", because it is not active.");
+            }
+            s.setConserved(size_t(i));
+        }
+        s.resize(selection.size());
+
+        auto src = d.data();
+        auto dst = s.data();
+        for (int i : s.outputFieldIndices)
+        {
+            std::visit(
+                [&selection](auto* from, auto* to)
+                {
+                    if constexpr (std::is_same_v<decltype(from), decltype(to)>)
+                    {
+#pragma omp parallel for schedule(static)
+                        for (size_t j = 0; j < selection.size(); ++j)
+                        {
+                            (*to)[j] = (*from)[selection[j]];
+                        }
+                    }
+                },
+                src[i], dst[i]);
+        }
+    }
+
+    std::vector<OutputStream> streams_;
+};
+
+} // namespace sphexa
@@ -38,6 +38,7 @@
 
 #include "mpi.h"
 
+#include "cstone/primitives/reduction_batch.hpp"
 #include "cstone/util/array.hpp"
 #include "conserved_gpu.h"
 
@@ -84,16 +85,27 @@ auto localConservedQuantities(size_t startIndex, size_t endIndex, Dataset& d)
     return std::make_tuple(0.5 * eKin, eInt, linmom, angmom);
 }
 
-/*! @brief Computation of globally conserved quantities
+//! @brief slots of the conserved quantities in a ReductionBatch
+struct ConservedSlots
+{
+    //! @brief eKin, eInt, egrav, linmom[3], angmom[3]
+    cstone::ReductionSlot<double> quantities;
+    cstone::ReductionSlot<size_t> neighbors;
+    //! @brief assigned particles, the global count changes if particles are created or removed
+    cstone::ReductionSlot<size_t> particles;
+};
+
+/*! @brief add the local contributions to the globally conserved quantities to @p reductions
  *
- * @tparam        T            float or double
  * @tparam        Dataset
  * @param[in]     startIndex   first locally assigned particle index of buffers in @p d
  * @param[in]     endIndex     last locally assigned particle index of buffers in @p d
- * @param[inout]  d            particle data set
+ * @param[in]     d            particle data set
+ * @param[inout]  reductions   batch of global reductions, see getConservedQuantities for the results
  */
 template<class Dataset>
-void computeConservedQuantities(size_t startIndex, size_t endIndex, Dataset& d, MPI_Comm comm)
+ConservedSlots addConservedQuantities(size_t startIndex, size_t endIndex, Dataset& d,
+                                      cstone::ReductionBatch& reductions)
 {
     double               eKin, eInt;
     cstone::Vec3<double> linmom, angmom;
@@ -118,34 +130,48 @@ void computeConservedQuantities(size_t startIndex, size_t endIndex, Dataset& d,
         std::tie(eKin, eInt, linmom, angmom) = localConservedQuantities(startIndex, endIndex, d);
     }
 
-    util::array<double, 10> quantities, globalQuantities;
-    std::fill(globalQuantities.begin(), globalQuantities.end(), double(0));
-
-    quantities[0] = eKin;
-    quantities[1] = eInt;
-    quantities[2] = d.egrav;
-    quantities[3] = linmom[0];
-    quantities[4] = linmom[1];
-    quantities[5] = linmom[2];
-    quantities[6] = angmom[0];
-    quantities[7] = angmom[1];
-    quantities[8] = angmom[2];
-    quantities[9] = double(ncsum);
-
-    int rootRank = 0;
-    MPI_Reduce(quantities.data(), globalQuantities.data(), quantities.size(), MpiType<double>{}, MPI_SUM, rootRank,
-               comm);
-
-    d.ecin  = globalQuantities[0];
-    d.eint  = globalQuantities[1];
-    d.egrav = globalQuantities[2];
+    util::array<double, 9> quantities{eKin,      eInt,      d.egrav,   linmom[0], linmom[1],
+                                      linmom[2], angmom[0], angmom[1], angmom[2]};
+
+    return {reductions.add(cstone::ReduceOp::sum, quantities.data(), quantities.size()),
+            reductions.add(cstone::ReduceOp::sum, ncsum), reductions.add(cstone::ReduceOp::sum, endIndex - startIndex)};
+}
+
+//! @brief store the conserved quantities of @p slots in @p d, waits for the reduction if necessary
+template<class Dataset>
+void getConservedQuantities(const ConservedSlots& slots, cstone::ReductionBatch& reductions, Dataset& d)
+{
+    auto q = [&reductions, &slots](size_t i) { return reductions.get(slots.quantities, i); };
+
+    d.ecin  = q(0);
+    d.eint  = q(1);
+    d.egrav = q(2);
     d.etot  = d.ecin + d.eint + d.egrav;
 
-    util::array<double, 3> globalLinmom{globalQuantities[3], globalQuantities[4], globalQuantities[5]};
-    util::array<double, 3> globalAngmom{globalQuantities[6], globalQuantities[7], globalQuantities[8]};
-    d.linmom         = std::sqrt(norm2(globalLinmom));
-    d.angmom         = std::sqrt(norm2(globalAngmom));
-    d.totalNeighbors = size_t(globalQuantities[9]);
+    util::array<double, 3> globalLinmom{q(3), q(4), q(5)};
+    util::array<double, 3> globalAngmom{q(6), q(7), q(8)};
+    d.linmom             = std::sqrt(norm2(globalLinmom));
+    d.angmom             = std::sqrt(norm2(globalAngmom));
+    d.totalNeighbors     = reductions.get(slots.neighbors);
+    d.numParticlesGlobal = reductions.get(slots.particles);
+}
+
+/*! @brief Computation of globally conserved quantities
+ *
+ * @tparam        Dataset
+ * @param[in]     startIndex   first locally assigned particle index of buffers in @p d
+ * @param[in]     endIndex     last locally assigned particle index of buffers in @p d
+ * @param[inout]  d            particle data set
+ * @param[inout]  reductions   pending reductions of the step are started together with the conserved quantities
+ * @param[in]     comm         communicator of all ranks holding particles
+ */
+template<class Dataset>
+void computeConservedQuantities(size_t startIndex, size_t endIndex, Dataset& d, cstone::ReductionBatch& reductions,
+                                MPI_Comm comm)
+{
+    auto slots = addConservedQuantities(startIndex, endIndex, d, reductions);
+    reductions.start(comm);
+    getConservedQuantities(slots, reductions, d);
 }
 
 } // namespace sphexa
@@ -34,6 +34,7 @@
 #include <string>
 
 #include "cstone/sfc/box.hpp"
+#include "io/native_snapshot.hpp"
 #include "iobservables.hpp"
 #include "time_energy_growth.hpp"
 #include "time_energies.hpp"
@@ -50,10 +51,11 @@ static bool haveH5Attribute(const std::string& fname, const std::string& attribu
 {
     bool found = false;
 
-    if (std::filesystem::exists(fname))
+    if (std::filesystem::exists(fname) && !fileutils::isNativeSnapshot(fname))
     {
-        H5PartFile* h5_file  = nullptr;
-        h5_file              = H5PartOpenFile(fname.c_str(), H5PART_READ);
+        H5PartFile* h5_file = nullptr;
+        h5_file             = H5PartOpenFile(fname.c_str(), H5PART_READ);
+        if (h5_file == nullptr) { return false; }
         size_t numAttributes = H5PartGetNumFileAttribs(h5_file);
 
         h5part_int64_t maxlen = 256;
@@ -30,6 +30,7 @@
 
 #include <array>
 #include "mpi.h"
+#include "cstone/primitives/reduction_batch.hpp"
 #include "iobservables.hpp"
 #include "io/ifile_writer.hpp"
 #include "grav_waves_calculations.hpp"
@@ -48,12 +49,15 @@ namespace sphexa
  * @param m             masses
  * @param viewTheta     viewing angle for the polarization modes
  * @param viewPhi       viewing angle for the polarization modes
+ * @param reductions    pending reductions of the step are started together with the quadrupole moments
+ * @param comm          communicator of all ranks holding particles
  * @return              array containing the polarization modes and the second derivative of the quadpole momentum:
  *                      {httplus, httcross, ixx, iyy, izz, ixy, ixz, iyz}
  */
 template<class Tc, class Tv, class Ta, class Tm>
 auto gravRad(size_t first, size_t last, const Tc* x, const Tc* y, const Tc* z, const Tv* vx, const Tv* vy, const Tv* vz,
-             const Ta* ax, const Ta* ay, const Ta* az, const Tm* m, Tc viewTheta, Tc viewPhi)
+             const Ta* ax, const Ta* ay, const Ta* az, const Tm* m, Tc viewTheta, Tc viewPhi,
+             cstone::ReductionBatch& reductions, MPI_Comm comm)
 {
     struct Dim
     {
@@ -74,9 +78,14 @@ auto gravRad(size_t first, size_t last, const Tc* x, const Tc* y, const Tc* z, c
     d2Q_local[QIdx::xz] = d2QuadpoleMomentum(first, last, Dim::x, Dim::z, x, y, z, vx, vy, vz, ax, ay, az, m);
     d2Q_local[QIdx::yz] = d2QuadpoleMomentum(first, last, Dim::y, Dim::z, x, y, z, vx, vy, vz, ax, ay, az, m);
 
-    int               rootRank = 0;
+    auto d2QSlot = reductions.add(cstone::ReduceOp::sum, d2Q_local.data(), d2Q_local.size());
+    reductions.start(comm);
+
     std::array<Tc, 6> d2Q_global;
-    MPI_Reduce(d2Q_local.data(), d2Q_global.data(), 6, MpiType<Tc>{}, MPI_SUM, rootRank, MPI_COMM_WORLD);
+    for (size_t i = 0; i < d2Q_global.size(); ++i)
+    {
+        d2Q_global[i] = reductions.get(d2QSlot, i);
+    }
 
     Tc httplus;
     Tc httcross;
@@ -110,7 +119,8 @@ public:
         auto& d = simData.hydro;
         auto [httplus, httcross, d2xx, d2yy, d2zz, d2xy, d2xz, d2yz] =
             gravRad(firstIndex, lastIndex, d.x.data(), d.y.data(), d.z.data(), d.vx.data(), d.vy.data(), d.vz.data(),
-                    d.ax.data(), d.ay.data(), d.az.data(), d.m.data(), viewTheta, viewPhi);
+                    d.ax.data(), d.ay.data(), d.az.data(), d.m.data(), viewTheta, viewPhi, simData.reductions,
+                    simData.comm);
 
         int rank;
         MPI_Comm_rank(simData.comm, &rank);
@@ -70,18 +70,19 @@ std::array<Tc, 3> localGrowthRate(size_t startIndex, size_t endIndex, const Tc*
     return {sumsi, sumci, sumdi};
 }
 
-/*! @brief global calculation of the growth rate
+/*! @brief add the local contributions to the growth rate to @p reductions
  *
  * @tparam        T            double or float
  * @tparam        Dataset
- * @tparam        Box
  * @param[in]     startIndex   first locally assigned particle index of buffers in @p d
  * @param[in]     endIndex     last locally assigned particle index of buffers in @p d
  * @param[in]     d            particle data set
  * @param[in]     box          bounding box
+ * @param[inout]  reductions   batch of global reductions, see khGrowthRate for the result
  */
 template<typename T, class Dataset>
-T computeKHGrowthRate(size_t startIndex, size_t endIndex, Dataset& d, const cstone::Box<T>& box, MPI_Comm comm)
+cstone::ReductionSlot<T> addKHGrowthRate(size_t startIndex, size_t endIndex, Dataset& d, const cstone::Box<T>& box,
+                                         cstone::ReductionBatch& reductions)
 {
     if (d.kx.empty())
     {
@@ -91,10 +92,14 @@ T computeKHGrowthRate(size_t startIndex, size_t endIndex, Dataset& d, const csto
     std::array<T, 3> localSum =
         localGrowthRate(startIndex, endIndex, d.x.data(), d.y.data(), d.vy.data(), d.xm.data(), d.kx.data(), box);
 
-    int              rootRank = 0;
-    std::array<T, 3> sum;
-    MPI_Reduce(localSum.data(), sum.data(), 3, MpiType<T>{}, MPI_SUM, rootRank, comm);
+    return reductions.add(cstone::ReduceOp::sum, localSum.data(), localSum.size());
+}
 
+//! @brief global growth rate from the reduced sums of addKHGrowthRate
+template<typename T>
+T khGrowthRate(const cstone::ReductionSlot<T>& slot, cstone::ReductionBatch& reductions)
+{
+    std::array<T, 3> sum{reductions.get(slot, 0), reductions.get(slot, 1), reductions.get(slot, 2)};
     return 2.0 * std::sqrt(sum[0] * sum[0] + sum[1] * sum[1]) / sum[2];
 }
 
@@ -115,8 +120,13 @@ public:
     void computeAndWrite(Dataset& simData, size_t firstIndex, size_t lastIndex, cstone::Box<T>& box)
     {
         auto& d = simData.hydro;
-        computeConservedQuantities(firstIndex, lastIndex, d, simData.comm);
-        T khgr = computeKHGrowthRate<T>(firstIndex, lastIndex, d, box, simData.comm);
+
+        auto conserved = addConservedQuantities(firstIndex, lastIndex, d, simData.reductions);
+        auto growth    = addKHGrowthRate<T>(firstIndex, lastIndex, d, box, simData.reductions);
+        simData.reductions.start(simData.comm);
+
+        getConservedQuantities(conserved, simData.reductions, d);
+        T khgr = khGrowthRate(growth, simData.reductions);
 
         int rank;
         MPI_Comm_rank(simData.comm, &rank);
@@ -56,33 +56,38 @@ size_t localSurvivors(size_t first, size_t last, const Tt* temp, const T* kx, co
     return survivors;
 }
 
-/*!
- *
- * @brief calculates the percent of surviving cloud mass
- *
- * @param[in] first       index of first locally owned particle in @a u,kx,xmass fields
- * @param[in] last        index of last locally owned particle in @a u,kx,xmass fields
- * @param[in] u           internal energy
- * @param[in] kx          VE normalization
- * @param[in] xmass       VE definition
- * @param[in] m           particles masses
- * @param[in] rhoBubble   initial density inside the cloud
- * @param[in] uWind       initial internal energy of the supersonic wind
- * @param[in] initialMass initial total mass of the cloud
- * @return                fraction of particles surviving in the bubble
+/*! @brief add the local number of particles surviving in the cloud to @p reductions
  *
+ * @param[in]    first       index of first locally owned particle in @a u,kx,xmass fields
+ * @param[in]    last        index of last locally owned particle in @a u,kx,xmass fields
+ * @param[in]    u           internal energy
+ * @param[in]    kx          VE normalization
+ * @param[in]    xmass       VE definition
+ * @param[in]    m           particles masses
+ * @param[in]    rhoBubble   initial density inside the cloud
+ * @param[in]    uWind       initial internal energy of the supersonic wind
+ * @param[inout] reductions  batch of global reductions, see survivingFraction for the result
  */
 template<class Tu, class Thydro, class Tm>
-double calculateSurvivingFraction(size_t first, size_t last, const Tu* u, const Thydro* kx, const Thydro* xmass,
-                                  const Tm* m, double rhoBubble, double uWind, double initialMass)
+cstone::ReductionSlot<size_t> addSurvivors(size_t first, size_t last, const Tu* u, const Thydro* kx,
+                                           const Thydro* xmass, const Tm* m, double rhoBubble, double uWind,
+                                           cstone::ReductionBatch& reductions)
 {
-    size_t localSurvived = localSurvivors(first, last, u, kx, xmass, m, rhoBubble, uWind);
-
-    int    rootRank = 0;
-    size_t globalSurvivors;
-    MPI_Reduce(&localSurvived, &globalSurvivors, 1, MpiType<size_t>{}, MPI_SUM, rootRank, MPI_COMM_WORLD);
+    return reductions.add(cstone::ReduceOp::sum, localSurvivors(first, last, u, kx, xmass, m, rhoBubble, uWind));
+}
 
-    return globalSurvivors * m[0] / initialMass;
+/*! @brief fraction of the initial cloud mass that survived
+ *
+ * @param[in]    slot          the survivors added with addSurvivors
+ * @param[inout] reductions    batch of global reductions that contains @p slot
+ * @param[in]    particleMass  mass of a cloud particle
+ * @param[in]    initialMass   initial total mass of the cloud
+ */
+template<class Tm>
+double survivingFraction(const cstone::ReductionSlot<size_t>& slot, cstone::ReductionBatch& reductions,
+                         Tm particleMass, double initialMass)
+{
+    return reductions.get(slot) * particleMass / initialMass;
 }
 
 //! @brief Observables that includes times, energies and bubble surviving fraction
@@ -108,7 +113,6 @@ public:
     void computeAndWrite(Dataset& simData, size_t firstIndex, size_t lastIndex, cstone::Box<T>& box)
     {
         auto& d = simData.hydro;
-        computeConservedQuantities(firstIndex, lastIndex, d, simData.comm);
 
         if (d.kx.empty())
         {
@@ -117,10 +121,16 @@ public:
         }
         transferToHost(d, firstIndex, lastIndex, {"temp", "kx", "xm"});
 
-        T    tempWind       = uWind * sph::idealGasCv(d.muiConst);
-        auto bubbleFraction = calculateSurvivingFraction(firstIndex, lastIndex, d.temp.data(), d.kx.data(), d.xm.data(),
-                                                         d.m.data(), rhoBubble, tempWind, initialMass);
-        int  rank;
+        T    tempWind  = uWind * sph::idealGasCv(d.muiConst);
+        auto conserved = addConservedQuantities(firstIndex, lastIndex, d, simData.reductions);
+        auto survivors = addSurvivors(firstIndex, lastIndex, d.temp.data(), d.kx.data(), d.xm.data(), d.m.data(),
+                                      rhoBubble, tempWind, simData.reductions);
+        simData.reductions.start(simData.comm);
+
+        getConservedQuantities(conserved, simData.reductions, d);
+        double bubbleFraction = survivingFraction(survivors, simData.reductions, d.m[0], initialMass);
+
+        int rank;
         MPI_Comm_rank(simData.comm, &rank);
 
         if (rank == 0)
@@ -39,12 +39,57 @@
 namespace sphexa
 {
 
-template<class MType, class KeyType, class, class, class, class, class>
+//! @brief tag for the per-thread buffers of the multi-rate gravity near-field
+struct FrozenNearScratch;
+
+template<class MType, class KeyType, class Tc, class, class, class, class Tf>
 class MultipoleHolderCpu
 {
+    using T = Tc;
+
 public:
     MultipoleHolderCpu() = default;
 
+    /*! @brief configure multi-rate gravity
+     *
+     * @param farFieldSteps  maximum number of steps between two far-field evaluations, 1 disables multi-rate gravity
+     * @param tolerance      maximum relative change of the coarse multipole moments since the last far-field
+     *                       evaluation before the far-field is re-evaluated ahead of @p farFieldSteps
+     *
+     * In multi-rate mode, the far-field is stored per particle in the ax_far,ay_far,az_far,ugrav_far fields and
+     * linearly extrapolated in time from the last two evaluations in the steps in between. The near-field is computed
+     * every step. The far-field cells of each target group are kept fixed until the next far-field evaluation, such
+     * that each source contributes exactly once, also while moving across the classification radius. Particles
+     * record their target group at the evaluation in key_far. Particles that changed group or rank since then
+     * receive the full field. A change of the focus tree triggers a far-field evaluation. The far-field cache fields
+     * need to be conserved across domain syncs.
+     */
+    void setMultiRate(unsigned farFieldSteps, float tolerance)
+    {
+        farFieldSteps_ = std::max(farFieldSteps, 1u);
+        tolerance_     = tolerance;
+    }
+
+    //! @brief true if the far-field is evaluated at a lower rate than the near-field
+    bool multiRate() const { return farFieldSteps_ > 1; }
+
+    /*! @brief compute P2P and M2P interactions in single precision, see ryoanji::computeGravityGroupMixed
+     *
+     * Not combined with multi-rate gravity, which always uses the full precision of the particle data.
+     */
+    void setMixedPrecision(bool mixed) { mixedPrecision_ = mixed; }
+
+    /*! @brief only recompute multipoles of cells whose particles or expansion centers changed since the last step
+     *
+     * See ryoanji::IncrementalMultipoles. The resulting multipoles are identical to a full recomputation. Particles
+     * are flagged as changed based on the time-stepping, with a common time-step all of them move every step.
+     */
+    void setIncrementalUpsweep(bool incremental)
+    {
+        incrementalUpsweep_ = incremental;
+        incremental_.reset();
+    }
+
     template<class Dataset, class Domain>
     void upsweep(const Dataset& d, const Domain& domain)
     {
@@ -53,11 +98,21 @@ public:
         //! the focused octree, structure only
         const cstone::Octree<KeyType>& octree = focusTree.octree();
 
-        reallocate(multipoles_, octree.numTreeNodes(), 1.05);
+        if (incrementalUpsweep_)
+        {
+            // all particles move every step with a common time-step
+            incremental_.compute(d.x.data(), d.y.data(), d.z.data(), d.m.data(), nullptr, domain.globalTree(),
+                                 domain.focusTree(), domain.layout().data(), multipoles_);
+        }
+        else
+        {
+            reallocate(multipoles_, octree.numTreeNodes(), 1.05);
+            ryoanji::computeGlobalMultipoles(d.x.data(), d.y.data(), d.z.data(), d.m.data(), d.x.size(),
+                                             domain.globalTree(), domain.focusTree(), domain.layout().data(),
+                                             multipoles_.data());
+        }
 
-        ryoanji::computeGlobalMultipoles(d.x.data(), d.y.data(), d.z.data(), d.m.data(), d.x.size(),
-                                         domain.globalTree(), domain.focusTree(), domain.layout().data(),
-                                         multipoles_.data());
+        if (multiRate()) { multipoleChange_ = coarseMultipoleChange(focusTree, domain.box()); }
     }
 
     template<class Dataset, class Domain>
@@ -68,6 +123,21 @@ public:
         //! the focused octree, structure only
         const cstone::Octree<KeyType>& octree = focusTree.octree();
 
+        if (multiRate())
+        {
+            traverseMultiRate(d, domain);
+            return;
+        }
+
+        if (mixedPrecision_)
+        {
+            d.egrav = ryoanji::computeGravityMixed(octree, focusTree.expansionCenters().data(), multipoles_.data(),
+                                                   domain.layout().data(), domain.startCell(), domain.endCell(),
+                                                   d.x.data(), d.y.data(), d.z.data(), d.h.data(), d.m.data(), d.g,
+                                                   d.ax.data(), d.ay.data(), d.az.data());
+            return;
+        }
+
         d.egrav = ryoanji::computeGravity(octree, focusTree.expansionCenters().data(), multipoles_.data(),
                                           domain.layout().data(), domain.startCell(), domain.endCell(), d.x.data(),
                                           d.y.data(), d.z.data(), d.h.data(), d.m.data(), d.g, d.ax.data(), d.ay.data(),
@@ -76,8 +146,392 @@ public:
 
     const MType* multipoles() const { return multipoles_.data(); }
 
+    //! @brief true if the far-field was re-evaluated in the last call to traverse
+    bool farFieldUpdated() const { return stepsSinceFarField_ == 0; }
+
+    /*! @brief global RMS error of the multi-rate gravity at the last far-field re-evaluation
+     *
+     * The error of near-field plus extrapolated far-field is measured against the full evaluation with the same
+     * near-/far-field split and expressed relative to the RMS of the total particle acceleration. Negative if no
+     * extrapolation took place yet or the split changed with the focus tree.
+     */
+    double farFieldError() const { return farFieldError_; }
+
 private:
+    template<class Dataset, class Domain>
+    void traverseMultiRate(Dataset& d, const Domain& domain)
+    {
+        const auto& focusTree = domain.focusTree();
+        size_t      first     = domain.startIndex();
+        size_t      last      = domain.endIndex();
+        float       ratioSq   = farRatio_ * farRatio_;
+
+        auto leaves = focusTree.treeLeaves();
+        // the far-field cells of the last evaluation are only valid in the same tree
+        bool haveSplit =
+            !firstFarField_ && std::equal(leaves.begin(), leaves.end(), farLeaves_.begin(), farLeaves_.end());
+
+        int needUpdate = !haveSplit || stepsSinceFarField_ + 1 >= farFieldSteps_ || multipoleChange_ > tolerance_;
+        // all ranks need to update simultaneously, because far-field caches are exchanged along with particles
+        MPI_Allreduce(MPI_IN_PLACE, &needUpdate, 1, MPI_INT, MPI_MAX, domain.comm());
+
+        T extrapolation = extrapolationFactor(d.ttot);
+        frozen_.assign(last - first, 0);
+        if (haveSplit) { markFrozenSplit(d, domain); }
+
+        if (!needUpdate)
+        {
+            T egravNear = frozenNearField(d, domain);
+            T egravFar  = 0;
+#pragma omp parallel for schedule(static) reduction(+ : egravFar)
+            for (size_t i = first; i < last; ++i)
+            {
+                if (!frozen_[i - first]) { continue; }
+                d.ax[i] += extrapolate(d.ax_far[i], d.ax_far_m1[i], extrapolation);
+                d.ay[i] += extrapolate(d.ay_far[i], d.ay_far_m1[i], extrapolation);
+                d.az[i] += extrapolate(d.az_far[i], d.az_far_m1[i], extrapolation);
+                egravFar += d.m[i] * extrapolate(d.ugrav_far[i], d.ugrav_far_m1[i], extrapolation);
+            }
+
+            d.egrav = egravNear + T(0.5) * egravFar;
+            stepsSinceFarField_++;
+            return;
+        }
+
+        // far-field of the unchanged split at the current time, continues the history of the cached far-field
+        reallocate(frozenFar_, 4 * (last - first), 1.05);
+        if (haveSplit) { frozenFarField(d, domain); }
+
+        swap(d.ax_far, d.ax_far_m1);
+        swap(d.ay_far, d.ay_far_m1);
+        swap(d.az_far, d.az_far_m1);
+        swap(d.ugrav_far, d.ugrav_far_m1);
+        std::fill(d.ax_far.begin() + first, d.ax_far.begin() + last, T(0));
+        std::fill(d.ay_far.begin() + first, d.ay_far.begin() + last, T(0));
+        std::fill(d.az_far.begin() + first, d.az_far.begin() + last, T(0));
+        std::fill(d.ugrav_far.begin() + first, d.ugrav_far.begin() + last, T(0));
+
+        groupFarCells_.resize(domain.endCell() - domain.startCell());
+        T egravNear = ryoanji::computeGravity(
+            focusTree.octree(), focusTree.expansionCenters().data(), multipoles_.data(), domain.layout().data(),
+            domain.startCell(), domain.endCell(), d.x.data(), d.y.data(), d.z.data(), d.h.data(), d.m.data(), d.g,
+            d.ax.data(), d.ay.data(), d.az.data(), ratioSq, d.ax_far.data(), d.ay_far.data(), d.az_far.data(),
+            d.ugrav_far.data(), groupFarCells_.data());
+
+        // ax_far_m1 now holds the previous evaluation and prevAx_ the one before
+        double errorSq = 0, accSq = 0, numCompared = 0, egravFar = 0;
+#pragma omp parallel for schedule(static) reduction(+ : errorSq, accSq, numCompared, egravFar)
+        for (size_t i = first; i < last; ++i)
+        {
+            size_t j = i - first;
+            if (frozen_[j])
+            {
+                const T* farNow = frozenFar_.data() + 4 * j;
+                T        dx     = extrapolate(d.ax_far_m1[i], prevAx_[j], extrapolation) - farNow[0];
+                T        dy     = extrapolate(d.ay_far_m1[i], prevAy_[j], extrapolation) - farNow[1];
+                T        dz     = extrapolate(d.az_far_m1[i], prevAz_[j], extrapolation) - farNow[2];
+                errorSq += dx * dx + dy * dy + dz * dz;
+                numCompared += 1;
+
+                // shift the previous evaluation into the new split, such that the slope stems from a single split
+                d.ax_far_m1[i]    = d.ax_far[i] - (farNow[0] - d.ax_far_m1[i]);
+                d.ay_far_m1[i]    = d.ay_far[i] - (farNow[1] - d.ay_far_m1[i]);
+                d.az_far_m1[i]    = d.az_far[i] - (farNow[2] - d.az_far_m1[i]);
+                d.ugrav_far_m1[i] = d.ugrav_far[i] - (farNow[3] - d.ugrav_far_m1[i]);
+            }
+            else
+            {
+                // no history in this split: extrapolate with zero slope until the next evaluation
+                d.ax_far_m1[i]    = d.ax_far[i];
+                d.ay_far_m1[i]    = d.ay_far[i];
+                d.az_far_m1[i]    = d.az_far[i];
+                d.ugrav_far_m1[i] = d.ugrav_far[i];
+            }
+
+            d.ax[i] += d.ax_far[i];
+            d.ay[i] += d.ay_far[i];
+            d.az[i] += d.az_far[i];
+            accSq += d.ax[i] * d.ax[i] + d.ay[i] * d.ay[i] + d.az[i] * d.az[i];
+            egravFar += d.m[i] * d.ugrav_far[i];
+        }
+
+        double sums[3] = {errorSq, accSq, numCompared};
+        MPI_Allreduce(MPI_IN_PLACE, sums, 3, MPI_DOUBLE, MPI_SUM, domain.comm());
+        farFieldError_ = sums[2] > 0 ? std::sqrt(sums[0] / sums[1]) : -1.0;
+
+        d.egrav = egravNear + T(0.5) * egravFar;
+
+        tFar_m1_            = tFar_;
+        tFar_               = d.ttot;
+        stepsSinceFarField_ = 0;
+        firstFarField_      = false;
+        storeCoarseMultipoles(focusTree);
+        storeSplit(d, domain);
+    }
+
+    //! @brief linear extrapolation from the last two far-field evaluations @p a and @p a_m1
+    static T extrapolate(T a, T a_m1, T factor) { return a + (a - a_m1) * factor; }
+
+    //! @brief node key of leaf @p leafIdx of @p octree, unique across tree levels and never zero
+    static KeyType leafNodeKey(const cstone::Octree<KeyType>& octree, cstone::TreeNodeIndex leafIdx)
+    {
+        return octree.nodeKeys()[octree.internalOrder()[leafIdx]];
+    }
+
+    //! @brief flag the assigned particles that are still in the target group of the last far-field evaluation
+    template<class Dataset, class Domain>
+    void markFrozenSplit(const Dataset& d, const Domain& domain)
+    {
+        const auto& octree = domain.focusTree().octree();
+        const auto* layout = domain.layout().data();
+        size_t      first  = domain.startIndex();
+
+#pragma omp parallel for schedule(static)
+        for (cstone::TreeNodeIndex i = domain.startCell(); i < domain.endCell(); ++i)
+        {
+            if (i < farFirstLeaf_ || i >= farLastLeaf_) { continue; }
+            KeyType key = leafNodeKey(octree, i);
+            for (cstone::LocalIndex j = layout[i]; j < layout[i + 1]; ++j)
+            {
+                frozen_[j - first] = d.key_far[j] == key;
+            }
+        }
+    }
+
+    //! @brief frozen far-field cells of leaf @p leafIdx, empty if it was not assigned at the last evaluation
+    gsl::span<const cstone::TreeNodeIndex> frozenCells(cstone::TreeNodeIndex leafIdx) const
+    {
+        if (leafIdx < farFirstLeaf_ || leafIdx >= farLastLeaf_) { return {}; }
+        size_t i = leafIdx - farFirstLeaf_;
+        return {farCells_.data() + farOffsets_[i], farOffsets_[i + 1] - farOffsets_[i]};
+    }
+
+    /*! @brief add the near-field of the frozen split to flagged particles and the full field to all others
+     *
+     * @return  near-field gravitational energy of flagged particles plus the full one of all others
+     */
+    template<class Dataset, class Domain>
+    T frozenNearField(Dataset& d, const Domain& domain)
+    {
+        const auto& focusTree = domain.focusTree();
+        const auto* layout    = domain.layout().data();
+        size_t      first     = domain.startIndex();
+
+        T egrav = 0;
+#pragma omp parallel for reduction(+ : egrav)
+        for (cstone::TreeNodeIndex i = domain.startCell(); i < domain.endCell(); ++i)
+        {
+            cstone::LocalIndex firstTarget = layout[i];
+            cstone::LocalIndex numTargets  = layout[i + 1] - firstTarget;
+
+            const char* frozen    = frozen_.data() + firstTarget - first;
+            bool        anyFrozen = std::find(frozen, frozen + numTargets, 1) != frozen + numTargets;
+            bool        allFrozen = std::find(frozen, frozen + numTargets, 0) == frozen + numTargets;
+
+            // near-field of the frozen split in [0:4n], full field in [4n:8n]
+            T* buf = util::ThreadScratch<T, FrozenNearScratch>::get(8 * numTargets);
+            std::fill(buf, buf + 8 * numTargets, T(0));
+            T* nearField = buf;
+            T* fullField = buf + 4 * numTargets;
+
+            if (anyFrozen)
+            {
+                ryoanji::FarFieldSplit<T> split;
+                split.frozen = frozenCells(i);
+                ryoanji::computeGravityGroup(i, focusTree.octree(), focusTree.expansionCenters().data(),
+                                             multipoles_.data(), layout, d.x.data(), d.y.data(), d.z.data(),
+                                             d.h.data(), d.m.data(), d.g, nearField, nearField + numTargets,
+                                             nearField + 2 * numTargets, nearField + 3 * numTargets, split);
+            }
+            if (!allFrozen)
+            {
+                ryoanji::computeGravityGroup(i, focusTree.octree(), focusTree.expansionCenters().data(),
+                                             multipoles_.data(), layout, d.x.data(), d.y.data(), d.z.data(),
+                                             d.h.data(), d.m.data(), d.g, fullField, fullField + numTargets,
+                                             fullField + 2 * numTargets, fullField + 3 * numTargets);
+            }
+
+            for (cstone::LocalIndex t = 0; t < numTargets; ++t)
+            {
+                const T* field = frozen[t] ? nearField : fullField;
+                d.ax[firstTarget + t] += field[t];
+                d.ay[firstTarget + t] += field[numTargets + t];
+                d.az[firstTarget + t] += field[2 * numTargets + t];
+                egrav += d.m[firstTarget + t] * field[3 * numTargets + t];
+            }
+        }
+
+        return T(0.5) * egrav;
+    }
+
+    //! @brief evaluate the far-field of the frozen split, stored interleaved per particle in frozenFar_
+    template<class Dataset, class Domain>
+    void frozenFarField(const Dataset& d, const Domain& domain)
+    {
+        const auto& focusTree = domain.focusTree();
+        const auto* layout    = domain.layout().data();
+        size_t      first     = domain.startIndex();
+        size_t      last      = domain.endIndex();
+
+        // the extrapolation of the previous evaluations is needed after the cache fields are overwritten
+        prevAx_.resize(last - first);
+        prevAy_.resize(last - first);
+        prevAz_.resize(last - first);
+        std::copy(d.ax_far_m1.begin() + first, d.ax_far_m1.begin() + last, prevAx_.begin());
+        std::copy(d.ay_far_m1.begin() + first, d.ay_far_m1.begin() + last, prevAy_.begin());
+        std::copy(d.az_far_m1.begin() + first, d.az_far_m1.begin() + last, prevAz_.begin());
+
+#pragma omp parallel for
+        for (cstone::TreeNodeIndex i = domain.startCell(); i < domain.endCell(); ++i)
+        {
+            cstone::LocalIndex firstTarget = layout[i];
+            cstone::LocalIndex numTargets  = layout[i + 1] - firstTarget;
+
+            T* buf = util::ThreadScratch<T, FrozenNearScratch>::get(4 * numTargets);
+            std::fill(buf, buf + 4 * numTargets, T(0));
+            ryoanji::computeGravityCells(i, focusTree.expansionCenters().data(), multipoles_.data(), layout,
+                                         d.x.data(), d.y.data(), d.z.data(), d.g, frozenCells(i), buf,
+                                         buf + numTargets, buf + 2 * numTargets, buf + 3 * numTargets);
+            for (cstone::LocalIndex t = 0; t < numTargets; ++t)
+            {
+                T* farNow = frozenFar_.data() + 4 * (firstTarget + t - first);
+                for (int k = 0; k < 4; ++k)
+                {
+                    farNow[k] = buf[k * numTargets + t];
+                }
+            }
+        }
+    }
+
+    //! @brief keep the tree, the far-field cells of each target group and the group of each particle
+    template<class Dataset, class Domain>
+    void storeSplit(Dataset& d, const Domain& domain)
+    {
+        const auto& octree = domain.focusTree().octree();
+        const auto* layout = domain.layout().data();
+        auto        leaves = domain.focusTree().treeLeaves();
+
+        farLeaves_.assign(leaves.begin(), leaves.end());
+        farFirstLeaf_ = domain.startCell();
+        farLastLeaf_  = domain.endCell();
+
+        farOffsets_.resize(groupFarCells_.size() + 1);
+        farOffsets_[0] = 0;
+        for (size_t i = 0; i < groupFarCells_.size(); ++i)
+        {
+            farOffsets_[i + 1] = farOffsets_[i] + groupFarCells_[i].size();
+        }
+        farCells_.resize(farOffsets_.back());
+#pragma omp parallel for
+        for (cstone::TreeNodeIndex i = farFirstLeaf_; i < farLastLeaf_; ++i)
+        {
+            size_t g = i - farFirstLeaf_;
+            std::copy(groupFarCells_[g].begin(), groupFarCells_[g].end(), farCells_.begin() + farOffsets_[g]);
+
+            KeyType key = leafNodeKey(octree, i);
+            std::fill(d.key_far.begin() + layout[i], d.key_far.begin() + layout[i + 1], key);
+        }
+    }
+
+    //! @brief factor to multiply the difference between the last two far-field evaluations with for extrapolation
+    T extrapolationFactor(T time) const
+    {
+        T dtEval = tFar_ - tFar_m1_;
+        return dtEval > 0 ? (time - tFar_) / dtEval : T(0);
+    }
+
+    //! @brief number of multipoles on the two top levels of @p octree, these are identical on all ranks
+    static cstone::TreeNodeIndex numCoarseNodes(const cstone::Octree<KeyType>& octree)
+    {
+        auto levelRange = octree.levelRange();
+        return levelRange.size() > 2 ? levelRange[2] : octree.numTreeNodes();
+    }
+
+    template<class FocusTree>
+    void storeCoarseMultipoles(const FocusTree& focusTree)
+    {
+        cstone::TreeNodeIndex numNodes = numCoarseNodes(focusTree.octree());
+        auto                  centers  = focusTree.expansionCenters();
+
+        refMultipoles_.assign(multipoles_.begin(), multipoles_.begin() + numNodes);
+        refCenters_.assign(centers.begin(), centers.begin() + numNodes);
+    }
+
+    /*! @brief maximum relative change of the coarse multipoles since the last far-field evaluation
+     *
+     * For each node on the two top levels of the tree, adds up the relative mass change, the expansion center shift
+     * in units of the node size and the change of the higher order moments in units of mass times size squared.
+     */
+    template<class FocusTree>
+    double coarseMultipoleChange(const FocusTree& focusTree, const cstone::Box<T>& box) const
+    {
+        cstone::TreeNodeIndex numNodes = numCoarseNodes(focusTree.octree());
+        if (numNodes != cstone::TreeNodeIndex(refMultipoles_.size()))
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+
+        auto   centers   = focusTree.expansionCenters();
+        double boxLength = std::max({box.lx(), box.ly(), box.lz()});
+
+        double maxChange = 0;
+        for (cstone::TreeNodeIndex i = 0; i < numNodes; ++i)
+        {
+            double mass = refMultipoles_[i][0];
+            if (mass <= 0) { continue; }
+
+            double l       = (i == 0) ? boxLength : 0.5 * boxLength;
+            double dMass   = std::abs(multipoles_[i][0] - mass) / mass;
+            double dCenter = std::sqrt(util::norm2(util::makeVec3(centers[i]) - util::makeVec3(refCenters_[i]))) / l;
+
+            double dMoments = 0;
+            for (size_t k = 1; k < multipoles_[i].size(); ++k)
+            {
+                double delta = multipoles_[i][k] - refMultipoles_[i][k];
+                dMoments += delta * delta;
+            }
+            dMoments = std::sqrt(dMoments) / (mass * l * l);
+
+            maxChange = std::max(maxChange, dMass + dCenter + dMoments);
+        }
+        return maxChange;
+    }
+
     std::vector<MType> multipoles_;
+
+    bool mixedPrecision_{false};
+    bool incrementalUpsweep_{false};
+
+    ryoanji::IncrementalMultipoles<KeyType, Tf, MType> incremental_;
+
+    //! @brief maximum number of steps between far-field evaluations
+    unsigned farFieldSteps_{1};
+    //! @brief coarse multipole change tolerance that triggers a far-field evaluation
+    float tolerance_{0.01};
+    //! @brief cells further away than farRatio_ times their acceptance radius are considered far-field
+    float farRatio_{2.0f};
+
+    bool     firstFarField_{true};
+    unsigned stepsSinceFarField_{0};
+    //! @brief simulation times of the last and the previous far-field evaluation
+    T      tFar_{0}, tFar_m1_{0};
+    double multipoleChange_{0};
+    double farFieldError_{-1};
+
+    //! @brief coarse multipoles and centers at the last far-field evaluation
+    std::vector<MType>                       refMultipoles_;
+    std::vector<cstone::SourceCenterType<T>> refCenters_;
+    //! @brief focus tree leaves and assigned leaf range at the last far-field evaluation
+    std::vector<KeyType>  farLeaves_;
+    cstone::TreeNodeIndex farFirstLeaf_{0}, farLastLeaf_{0};
+    //! @brief far-field cells of the assigned leaves at the last evaluation, leaf i in farOffsets_[i:i+2]
+    std::vector<size_t>                             farOffsets_;
+    std::vector<cstone::TreeNodeIndex>              farCells_;
+    std::vector<std::vector<cstone::TreeNodeIndex>> groupFarCells_;
+    //! @brief 1 for assigned particles that are in the same target group as at the last evaluation
+    std::vector<char> frozen_;
+    //! @brief far-field of the frozen split at a re-evaluation, and the preceding evaluation
+    std::vector<T> frozenFar_, prevAx_, prevAy_, prevAz_;
 };
 
 template<class MType, class KeyType, class Tc, class Th, class Tm, class Ta, class Tf>
@@ -0,0 +1,332 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Plans the halo exchanges of a propagator from the field dependencies of its kernels
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cstone/fields/particles_get.hpp"
+
+namespace sphexa
+{
+
+//! @brief the fields that a kernel of a propagator reads and writes
+struct HaloKernel
+{
+    std::string name;
+    //! @brief fields read from neighbor particles, these need valid halos when the kernel runs
+    std::vector<std::string> neighborInputs;
+    //! @brief fields read only for the particle that is updated
+    std::vector<std::string> localInputs;
+    //! @brief fields written for the assigned particles
+    std::vector<std::string> outputs;
+    //! @brief true if the kernel has no neighbor inputs and can therefore also be evaluated on halos
+    bool pointwise{false};
+};
+
+/*! @brief halo exchanges and recomputations on halos, indexed by the kernel that they precede
+ *
+ * Before running kernel k, a propagator exchanges exchanges[k] in one call and then evaluates the pointwise kernels
+ * in recompute[k] on the halo particles.
+ */
+struct HaloSchedule
+{
+    std::vector<std::string>              kernels;
+    std::vector<std::vector<std::string>> exchanges;
+    std::vector<std::vector<std::string>> recompute;
+    //! @brief number of exchanges if the halos of each kernel's outputs were exchanged right after the kernel
+    int numUnmerged{0};
+
+    int numExchanges() const
+    {
+        return std::count_if(exchanges.begin(), exchanges.end(), [](const auto& e) { return !e.empty(); });
+    }
+
+    //! @brief print the decisions of the planner, one line per exchange
+    void report(std::ostream& out) const
+    {
+        out << "# Halo exchanges per step: " << numExchanges() << ", saved " << numUnmerged - numExchanges()
+            << std::endl;
+        for (size_t k = 0; k < kernels.size(); ++k)
+        {
+            if (exchanges[k].empty() && recompute[k].empty()) { continue; }
+            out << "#   before " << kernels[k] << ":";
+            if (!exchanges[k].empty()) { out << " exchange"; }
+            for (const auto& f : exchanges[k])
+            {
+                out << " " << f;
+            }
+            for (const auto& r : recompute[k])
+            {
+                out << ", recompute " << r << " on halos";
+            }
+            out << std::endl;
+        }
+    }
+};
+
+namespace detail
+{
+
+inline bool contains(const std::vector<std::string>& list, const std::string& item)
+{
+    return std::find(list.begin(), list.end(), item) != list.end();
+}
+
+} // namespace detail
+
+/*! @brief merge the halo exchanges of a sequence of kernels and replace exchanges by recomputation where cheaper
+ *
+ * @param kernels     the kernels of one step in execution order
+ * @param haloFields  fields with valid halos before the first kernel, e.g. coordinates exchanged during domain sync
+ * @return            the schedule to execute
+ *
+ * Each field read by a kernel from neighbors has to be exchanged after the kernel that writes it, or at any time if
+ * no kernel writes it, and before its first consumer. Exchanges are placed with the greedy interval-stabbing
+ * algorithm, which minimizes the number of exchanges. Outputs of a pointwise kernel are instead recomputed on halos
+ * if that needs fewer additional exchanged fields than the outputs themselves, assuming fields of equal size.
+ */
+inline HaloSchedule planHaloExchanges(const std::vector<HaloKernel>& kernels, const std::vector<std::string>& haloFields)
+{
+    int numKernels = kernels.size();
+
+    for (size_t k = 0; k < kernels.size(); ++k)
+    {
+        for (size_t l = k + 1; l < kernels.size(); ++l)
+        {
+            for (const auto& f : kernels[l].outputs)
+            {
+                if (detail::contains(kernels[k].outputs, f))
+                {
+                    throw std::runtime_error("Halo planner: field " + f + " has more than one producer\n");
+                }
+            }
+        }
+    }
+
+    auto producer = [&kernels](const std::string& field)
+    {
+        for (size_t k = 0; k < kernels.size(); ++k)
+        {
+            if (detail::contains(kernels[k].outputs, field)) { return int(k); }
+        }
+        return -1;
+    };
+
+    //! @brief fields that need valid halos and the index of their first consumer, in order of first use
+    std::vector<std::pair<std::string, int>> needed;
+    auto need = [&needed](const std::string& field, int deadline)
+    {
+        auto it = std::find_if(needed.begin(), needed.end(), [&field](const auto& n) { return n.first == field; });
+        if (it == needed.end()) { needed.emplace_back(field, deadline); }
+        else { it->second = std::min(it->second, deadline); }
+    };
+
+    for (int k = 0; k < numKernels; ++k)
+    {
+        for (const auto& f : kernels[k].neighborInputs)
+        {
+            if (detail::contains(haloFields, f)) { continue; }
+            if (producer(f) >= k)
+            {
+                throw std::runtime_error("Halo planner: " + kernels[k].name + " reads " + f + " before it is written\n");
+            }
+            need(f, k);
+        }
+    }
+
+    HaloSchedule schedule;
+    schedule.exchanges.resize(numKernels);
+    schedule.recompute.resize(numKernels);
+    for (const auto& kernel : kernels)
+    {
+        schedule.kernels.push_back(kernel.name);
+    }
+
+    std::vector<int> producers;
+    for (const auto& n : needed)
+    {
+        producers.push_back(producer(n.first));
+    }
+    std::sort(producers.begin(), producers.end());
+    schedule.numUnmerged = std::unique(producers.begin(), producers.end()) - producers.begin();
+
+    // pointwise kernels to evaluate on halos
+    std::vector<int> recomputed;
+    for (int k = 0; k < numKernels; ++k)
+    {
+        const auto& kernel = kernels[k];
+        if (!kernel.pointwise) { continue; }
+
+        int deadline = numKernels, exchangeCost = 0, recomputeCost = 0;
+        for (const auto& n : needed)
+        {
+            if (!detail::contains(kernel.outputs, n.first)) { continue; }
+            deadline = std::min(deadline, n.second);
+            exchangeCost++;
+        }
+        for (const auto& f : kernel.localInputs)
+        {
+            bool available = detail::contains(haloFields, f) ||
+                             std::any_of(needed.begin(), needed.end(), [&f](const auto& n) { return n.first == f; });
+            recomputeCost += !available;
+        }
+        if (exchangeCost == 0 || recomputeCost >= exchangeCost) { continue; }
+
+        needed.erase(std::remove_if(needed.begin(), needed.end(),
+                                    [&kernel](const auto& n) { return detail::contains(kernel.outputs, n.first); }),
+                     needed.end());
+        for (const auto& f : kernel.localInputs)
+        {
+            if (!detail::contains(haloFields, f)) { need(f, deadline); }
+        }
+        recomputed.push_back(k);
+    }
+
+    std::stable_sort(needed.begin(), needed.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+
+    int lastExchange = -1;
+    for (const auto& [field, deadline] : needed)
+    {
+        int available = producer(field) + 1;
+        if (lastExchange < available) { lastExchange = deadline; }
+        schedule.exchanges[lastExchange].push_back(field);
+    }
+
+    for (int k : recomputed)
+    {
+        int after = 0;
+        for (const auto& f : kernels[k].localInputs)
+        {
+            for (int e = 0; e < numKernels; ++e)
+            {
+                if (detail::contains(schedule.exchanges[e], f)) { after = std::max(after, e); }
+            }
+        }
+        schedule.recompute[after].push_back(kernels[k].name);
+    }
+
+    return schedule;
+}
+
+//! @brief bit i is set if field i of an exchange is not in @p exactFields, for use as HaloPrecision::arrays
+inline uint64_t reducibleFieldMask(const std::vector<std::string>& fields, const std::vector<std::string>& exactFields)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        if (!detail::contains(exactFields, fields[i])) { mask |= uint64_t(1) << i; }
+    }
+    return mask;
+}
+
+//! @brief maximum number of fields in one planned halo exchange
+constexpr size_t maxHaloExchangeFields = 12;
+
+namespace detail
+{
+
+//! @brief call f with a tuple of references to the vectors in @p fields
+template<size_t N, class Vector, class F>
+void applyFieldTuple(const std::vector<Vector*>& fields, F&& f)
+{
+    if constexpr (N == 0) { throw std::runtime_error("Too many fields in one halo exchange\n"); }
+    else
+    {
+        if (fields.size() == N)
+        {
+            [&fields, &f]<size_t... Is>(std::index_sequence<Is...>) { f(std::tie(*fields[Is]...)); }
+            (std::make_index_sequence<N>{});
+        }
+        else { applyFieldTuple<N - 1>(fields, f); }
+    }
+}
+
+} // namespace detail
+
+/*! @brief execute the part of @p schedule that precedes kernel @p k
+ *
+ * @param exchange   called as exchange(tuple of field vectors, field names), with the host vectors on CPUs and the
+ *                   device vectors on GPUs, like get<...>(d)
+ * @param recompute  called with the name of each pointwise kernel to evaluate on halos
+ * @return           true if fields were exchanged
+ *
+ * All exchanged fields must have the same type as the coordinates.
+ */
+template<class Dataset, class Exchange, class Recompute>
+bool runHaloStage(const HaloSchedule& schedule, size_t k, Dataset& d, Exchange&& exchange, Recompute&& recompute)
+{
+    const auto& names = schedule.exchanges[k];
+    if (!names.empty())
+    {
+        auto fields = [&d]()
+        {
+            if constexpr (cstone::HaveGpu<typename Dataset::AcceleratorType>{}) { return d.devData.dataTuple(); }
+            else { return d.dataTuple(); }
+        }();
+        using Vector = std::decay_t<decltype(std::get<cstone::getFieldIndex("x", Dataset::fieldNames)>(fields))>;
+
+        std::vector<Vector*> vectors(names.size(), nullptr);
+        size_t               fieldIndex = 0;
+        for_each_tuple(
+            [&](auto& field)
+            {
+                if constexpr (std::is_same_v<std::decay_t<decltype(field)>, Vector>)
+                {
+                    for (size_t i = 0; i < names.size(); ++i)
+                    {
+                        if (names[i] == Dataset::fieldNames[fieldIndex]) { vectors[i] = &field; }
+                    }
+                }
+                fieldIndex++;
+            },
+            fields);
+
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (!vectors[i]) { throw std::runtime_error("Cannot exchange halos of field " + names[i] + "\n"); }
+        }
+        detail::applyFieldTuple<maxHaloExchangeFields>(vectors, [&](auto tuple) { exchange(tuple, names); });
+    }
+
+    for (const auto& kernel : schedule.recompute[k])
+    {
+        recompute(kernel);
+    }
+    return !names.empty();
+}
+
+} // namespace sphexa
@@ -32,6 +32,7 @@
 
 #pragma once
 
+#include <stdexcept>
 #include <variant>
 
 #include "util/timer.hpp"
@@ -70,9 +71,42 @@ public:
     //! @brief this allows the possibility of saving propagator data to file if it is stateful
     virtual void dump(size_t, const std::string&){};
 
+    //! @brief true if dump() writes to the output file, which then needs to be complete beforehand
+    virtual bool dumpsState() const { return false; }
+
     //! @brief restore state from file if supported and it exists
     virtual void restoreState(const std::string&, MPI_Comm){};
 
+    /*! @brief evaluate the gravitational far-field at a lower rate than the near-field, if supported
+     *
+     * @param farFieldSteps  maximum number of steps between far-field evaluations, 1 evaluates every step
+     * @param tolerance      relative change of the coarse multipole moments that triggers an early evaluation
+     *
+     * Propagators without support reject anything other than an evaluation every step.
+     */
+    virtual void setMultiRateGravity(unsigned farFieldSteps, float /*tolerance*/)
+    {
+        if (farFieldSteps > 1) { throw std::runtime_error("Multi-rate gravity is not supported by this propagator\n"); }
+    }
+
+    //! @brief compute gravitational interactions in single precision, throws if not supported
+    virtual void setMixedPrecisionGravity(bool mixed)
+    {
+        if (mixed) { throw std::runtime_error("Mixed-precision gravity is not supported by this propagator\n"); }
+    }
+
+    //! @brief recompute only the multipoles of changed tree cells, throws if not supported
+    virtual void setIncrementalUpsweep(bool incremental)
+    {
+        if (incremental)
+        {
+            throw std::runtime_error("Incremental multipole upsweep is not supported by this propagator\n");
+        }
+    }
+
+    //! @brief exchange halos of derived fields that are only used as kernel inputs in @p format, if supported
+    virtual void setHaloPrecision(cstone::HaloPrecision::Format /*format*/){};
+
     virtual ~Propagator() = default;
 
     void printIterationTimings(const DomainType& domain, const ParticleDataType& simData)
@@ -84,7 +118,7 @@ public:
                        domain.nParticles(), domain.globalTree().numLeafNodes(),
                        domain.nParticlesWithHalos() - domain.nParticles(), d.totalNeighbors);
 
-            std::cout << "### Check ### Focus Tree Nodes: " << domain.focusTree().octree().numLeafNodes() << std::endl;
+            out << "### Check ### Focus Tree Nodes: " << domain.focusTree().octree().numLeafNodes() << std::endl;
             printTotalIterationTime(d.iteration, timer.duration());
         }
     }
@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Removal of particles that left the region of interest of a simulation
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "io/output_stream.hpp"
+
+namespace sphexa
+{
+
+/*! @brief remove the assigned particles outside @p region in the next sync of @p domain, CPU only
+ *
+ * @return  number of particles removed on the executing rank
+ *
+ * Removed particles no longer cost anything from the next step on. The global particle count is updated with the
+ * conserved quantities after the step.
+ */
+template<class Domain, class HydroData>
+size_t removeParticlesOutside(const OutputRegion& region, Domain& domain, const HydroData& d)
+{
+    size_t            first = domain.startIndex();
+    std::vector<char> keep(domain.nParticles());
+    size_t            numRemoved = 0;
+
+#pragma omp parallel for reduction(+ : numRemoved)
+    for (size_t i = 0; i < keep.size(); ++i)
+    {
+        size_t j = first + i;
+        keep[i]  = region.contains(d.x[j], d.y[j], d.z[j]);
+        numRemoved += !keep[i];
+    }
+
+    if (numRemoved > 0) { domain.changeParticles(keep, 0); }
+    return numRemoved;
+}
+
+} // namespace sphexa
@@ -40,6 +40,7 @@
 
 #include "ipropagator.hpp"
 #include "gravity_wrapper.hpp"
+#include "halo_plan.hpp"
 
 namespace sphexa
 {
@@ -76,10 +77,47 @@ class HydroProp final : public Propagator<DomainType, DataType>
     using DependentFields =
         FieldList<"rho", "p", "c", "ax", "ay", "az", "du", "c11", "c12", "c13", "c22", "c23", "c33", "nc">;
 
+    //! @brief format of derived fields in halo exchanges, velocities, density and pressure are always exact
+    cstone::HaloPrecision::Format haloFormat_{cstone::HaloPrecision::exact};
+
+    //! @brief the kernels of step with their field dependencies, in execution order
+    static std::vector<HaloKernel> haloKernels()
+    {
+        return {{"Density", {"m"}, {}, {"rho"}},
+                {"EquationOfState", {}, {"temp", "rho"}, {"p", "c"}, true},
+                {"IAD", {"m", "rho"}, {}, {"c11", "c12", "c13", "c22", "c23", "c33"}},
+                {"MomentumEnergyIAD",
+                 {"m", "vx", "vy", "vz", "rho", "p", "c", "c11", "c12", "c13", "c22", "c23", "c33"},
+                 {},
+                 {"ax", "ay", "az", "du"}}};
+    }
+
+    //! @brief halo exchanges of step, x, y, z, h and m have valid halos after domain sync
+    HaloSchedule haloSchedule_{planHaloExchanges(haloKernels(), {"x", "y", "z", "h", "m"})};
+
+    //! @brief exchange and recompute the halos needed by kernel @p k of haloKernels()
+    void haloStage(size_t k, DomainType& domain, typename DataType::HydroData& d)
+    {
+        auto exchange = [&](auto fields, const std::vector<std::string>& names)
+        {
+            domain.exchangeHalos(fields, get<"ax">(d), get<"ay">(d),
+                                 {haloFormat_, reducibleFieldMask(names, {"vx", "vy", "vz", "rho", "p", "temp"})});
+            timer.step("mpi::synchronizeHalos");
+        };
+        auto recompute = [&](const std::string&)
+        {
+            computeEOS_HydroStd(0, domain.startIndex(), d);
+            computeEOS_HydroStd(domain.endIndex(), domain.nParticlesWithHalos(), d);
+            timer.step("HaloEquationOfState");
+        };
+        runHaloStage(haloSchedule_, k, d, exchange, recompute);
+    }
+
 public:
     HydroProp(size_t ngmax, size_t ng0, std::ostream& output, size_t rank)
         : Base(ngmax, ng0, output, rank)
     {
+        if (rank == 0) { haloSchedule_.report(output); }
     }
 
     std::vector<std::string> conservedFields() const override
@@ -89,6 +127,8 @@ public:
         return ret;
     }
 
+    void setHaloPrecision(cstone::HaloPrecision::Format format) override { haloFormat_ = format; }
+
     void activateFields(DataType& simData) override
     {
         auto& d = simData.hydro;
@@ -139,22 +179,18 @@ public:
         findNeighborsSfc<T, KeyType>(first, last, ngmax_, d.x, d.y, d.z, d.h, d.keys, d.neighbors, d.nc, domain.box());
         timer.step("FindNeighbors");
 
+        haloStage(0, domain, d);
         computeDensity(first, last, ngmax_, d, domain.box());
         timer.step("Density");
+        haloStage(1, domain, d);
         computeEOS_HydroStd(first, last, d);
         timer.step("EquationOfState");
 
-        domain.exchangeHalos(get<"vx", "vy", "vz", "rho", "p", "c">(d), get<"ax">(d), get<"ay">(d));
-
-        timer.step("mpi::synchronizeHalos");
-
+        haloStage(2, domain, d);
         computeIAD(first, last, ngmax_, d, domain.box());
         timer.step("IAD");
 
-        domain.exchangeHalos(get<"c11", "c12", "c13", "c22", "c23", "c33">(d), get<"ax">(d), get<"ay">(d));
-
-        timer.step("mpi::synchronizeHalos");
-
+        haloStage(3, domain, d);
         computeMomentumEnergySTD(first, last, ngmax_, d, domain.box());
         timer.step("MomentumEnergyIAD");
 
@@ -166,7 +202,7 @@ public:
             timer.step("Gravity");
         }
 
-        computeTimestep(d);
+        computeTimestep(d, simData.reductions, simData.comm);
         timer.step("Timestep");
         computePositions(first, last, d, domain.box());
         timer.step("UpdateQuantities");
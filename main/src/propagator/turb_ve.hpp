@@ -41,6 +41,7 @@
 #include "sph/hydro_turb/turbulence_data.hpp"
 
 #include "io/mpi_file_utils.hpp"
+#include "io/native_snapshot.hpp"
 
 #include "ipropagator.hpp"
 #include "ve_hydro.hpp"
@@ -77,6 +78,10 @@ public:
     {
         // The file does not exist, we're starting from scratch. Nothing to do.
         if (!std::filesystem::exists(path)) { return; }
+        if (fileutils::isNativeSnapshot(path))
+        {
+            throw std::runtime_error("Turbulence state cannot be restored from native snapshot " + path + "\n");
+        }
 
         H5PartFile* h5_file = nullptr;
         h5_file             = fileutils::openH5Part(path, H5PART_READ, comm);
@@ -148,7 +153,7 @@ public:
         size_t first = domain.startIndex();
         size_t last  = domain.endIndex();
 
-        computeTimestep(d);
+        computeTimestep(d, simData.reductions, simData.comm);
         timer.step("Timestep");
         driveTurbulence(first, last, d, turbulenceData);
         timer.step("Turbulence Stirring");
@@ -161,6 +166,8 @@ public:
         timer.stop();
     }
 
+    bool dumpsState() const override { return true; }
+
     //! @brief save turbulence mode phases to file
     void dump(size_t iteration, const std::string& path) override
     {
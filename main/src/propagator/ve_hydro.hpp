@@ -40,6 +40,7 @@
 
 #include "ipropagator.hpp"
 #include "gravity_wrapper.hpp"
+#include "halo_plan.hpp"
 
 namespace sphexa
 {
@@ -82,10 +83,59 @@ protected:
     using DependentFieldsGpu =
         FieldList<"prho", "c", "ax", "ay", "az", "du", "c11", "c12", "c13", "c22", "c23", "c33", "xm", "kx", "nc">;
 
+    //! @brief cached far-field and its target groups, conserved in addition to ConservedFields with multi-rate gravity
+    using FarFieldCache = FieldList<"ax_far", "ay_far", "az_far", "ax_far_m1", "ay_far_m1", "az_far_m1", "ugrav_far",
+                                    "ugrav_far_m1", "key_far">;
+
+    //! @brief maximum number of steps between gravitational far-field evaluations
+    unsigned farFieldSteps_{1};
+    //! @brief scratch buffer for key_far in domain syncs
+    std::vector<KeyType> farKeyScratch_;
+
+    //! @brief format of derived fields in halo exchanges, velocities are always exact
+    cstone::HaloPrecision::Format haloFormat_{cstone::HaloPrecision::exact};
+
+    //! @brief the kernels of computeForces with their field dependencies, in execution order
+    static std::vector<HaloKernel> haloKernels()
+    {
+        return {{"XMass", {"m"}, {}, {"xm"}},
+                {"VeDefGradh", {"m", "xm"}, {}, {"kx", "gradh"}},
+                {"EquationOfState", {}, {"temp", "m", "kx", "xm", "gradh"}, {"prho", "c"}, true},
+                {"IadVelocityDivCurl", {"vx", "vy", "vz", "kx", "xm"}, {}, {"c11", "c12", "c13", "c22", "c23", "c33",
+                                                                          "divv", "curlv"}},
+                {"AVswitches", {"vx", "vy", "vz", "c", "divv", "kx", "xm"}, {"alpha"}, {"alpha"}},
+                {"MomentumAndEnergy",
+                 {"m", "vx", "vy", "vz", "prho", "c", "kx", "xm", "alpha", "c11", "c12", "c13", "c22", "c23", "c33"},
+                 {},
+                 {"ax", "ay", "az", "du"}}};
+    }
+
+    //! @brief halo exchanges of computeForces, x, y, z, h and m have valid halos after domain sync
+    HaloSchedule haloSchedule_{planHaloExchanges(haloKernels(), {"x", "y", "z", "h", "m"})};
+
+    //! @brief exchange and recompute the halos needed by kernel @p k of haloKernels()
+    void haloStage(size_t k, DomainType& domain, typename DataType::HydroData& d)
+    {
+        auto exchange = [&](auto fields, const std::vector<std::string>& names)
+        {
+            domain.exchangeHalos(fields, get<"az">(d), get<"du">(d),
+                                 {haloFormat_, reducibleFieldMask(names, {"vx", "vy", "vz", "temp", "gradh"})});
+            timer.step("mpi::synchronizeHalos");
+        };
+        auto recompute = [&](const std::string&)
+        {
+            computeEOS(0, domain.startIndex(), d);
+            computeEOS(domain.endIndex(), domain.nParticlesWithHalos(), d);
+            timer.step("HaloEquationOfState");
+        };
+        runHaloStage(haloSchedule_, k, d, exchange, recompute);
+    }
+
 public:
     HydroVeProp(size_t ngmax, size_t ng0, std::ostream& output, size_t rank)
         : Base(ngmax, ng0, output, rank)
     {
+        if (rank == 0) { haloSchedule_.report(output); }
     }
 
     std::vector<std::string> conservedFields() const override
@@ -95,6 +145,36 @@ public:
         return ret;
     }
 
+    void setMultiRateGravity(unsigned farFieldSteps, float tolerance) override
+    {
+        if constexpr (cstone::HaveGpu<Acc>{})
+        {
+            if (farFieldSteps > 1) { throw std::runtime_error("Multi-rate gravity is not supported on GPUs\n"); }
+        }
+        else { mHolder_.setMultiRate(farFieldSteps, tolerance); }
+        farFieldSteps_ = std::max(farFieldSteps, 1u);
+    }
+
+    void setMixedPrecisionGravity(bool mixed) override
+    {
+        if constexpr (cstone::HaveGpu<Acc>{})
+        {
+            if (mixed) { throw std::runtime_error("Mixed-precision gravity is not supported on GPUs\n"); }
+        }
+        else { mHolder_.setMixedPrecision(mixed); }
+    }
+
+    void setIncrementalUpsweep(bool incremental) override
+    {
+        if constexpr (cstone::HaveGpu<Acc>{})
+        {
+            if (incremental) { throw std::runtime_error("Incremental multipole upsweep is not supported on GPUs\n"); }
+        }
+        else { mHolder_.setIncrementalUpsweep(incremental); }
+    }
+
+    void setHaloPrecision(cstone::HaloPrecision::Format format) override { haloFormat_ = format; }
+
     void activateFields(DataType& simData) override
     {
         auto& d = simData.hydro;
@@ -103,6 +183,10 @@ public:
         d.setDependent("keys");
         std::apply([&d](auto... f) { d.setConserved(f.value...); }, make_tuple(ConservedFields{}));
         std::apply([&d](auto... f) { d.setDependent(f.value...); }, make_tuple(DependentFields{}));
+        if (farFieldSteps_ > 1)
+        {
+            std::apply([&d](auto... f) { d.setConserved(f.value...); }, make_tuple(FarFieldCache{}));
+        }
 
         d.devData.setConserved("x", "y", "z", "h", "m");
         d.devData.setDependent("keys");
@@ -113,7 +197,18 @@ public:
     void sync(DomainType& domain, DataType& simData) override
     {
         auto& d = simData.hydro;
-        if (d.g != 0.0)
+        if (d.g != 0.0 && farFieldSteps_ > 1)
+        {
+            if constexpr (!cstone::HaveGpu<Acc>{})
+            {
+                // key_far needs a scratch buffer of its own type, ahead of the last one that holds the SFC ordering
+                auto scratch = std::tuple_cat(discardLastElement(get<DependentFieldsGpu>(d)),
+                                              std::tie(farKeyScratch_), std::tie(get<"nc">(d)));
+                domain.syncGrav(get<"keys">(d), get<"x">(d), get<"y">(d), get<"z">(d), get<"h">(d), get<"m">(d),
+                                std::tuple_cat(get<ConservedFields>(d), get<FarFieldCache>(d)), scratch);
+            }
+        }
+        else if (d.g != 0.0)
         {
             domain.syncGrav(get<"keys">(d), get<"x">(d), get<"y">(d), get<"z">(d), get<"h">(d), get<"m">(d),
                             get<ConservedFields>(d), get<DependentFieldsGpu>(d));
@@ -144,24 +239,23 @@ public:
         findNeighborsSfc<T, KeyType>(first, last, ngmax_, d.x, d.y, d.z, d.h, d.keys, d.neighbors, d.nc, domain.box());
         timer.step("FindNeighbors");
 
+        haloStage(0, domain, d);
         computeXMass(first, last, ngmax_, d, domain.box());
         timer.step("XMass");
-        domain.exchangeHalos(std::tie(get<"xm">(d)), get<"ax">(d), get<"ay">(d));
-        timer.step("mpi::synchronizeHalos");
 
         d.release("ax");
         d.acquire("gradh");
         d.devData.release("ax");
         d.devData.acquire("gradh");
+        haloStage(1, domain, d);
         computeVeDefGradh(first, last, ngmax_, d, domain.box());
         timer.step("Normalization & Gradh");
 
+        haloStage(2, domain, d);
         computeEOS(first, last, d);
         timer.step("EquationOfState");
 
-        domain.exchangeHalos(get<"vx", "vy", "vz", "prho", "c", "kx">(d), get<"gradh">(d), get<"ay">(d));
-        timer.step("mpi::synchronizeHalos");
-
+        haloStage(3, domain, d);
         d.release("gradh");
         d.acquire("ax");
         d.devData.release("gradh", "ay");
@@ -169,15 +263,11 @@ public:
         computeIadDivvCurlv(first, last, ngmax_, d, domain.box());
         timer.step("IadVelocityDivCurl");
 
-        domain.exchangeHalos(get<"c11", "c12", "c13", "c22", "c23", "c33", "divv">(d), get<"az">(d), get<"du">(d));
-        timer.step("mpi::synchronizeHalos");
-
+        haloStage(4, domain, d);
         computeAVswitches(first, last, ngmax_, d, domain.box());
         timer.step("AVswitches");
 
-        domain.exchangeHalos(std::tie(get<"alpha">(d)), get<"az">(d), get<"du">(d));
-        timer.step("mpi::synchronizeHalos");
-
+        haloStage(5, domain, d);
         d.devData.release("divv", "curlv");
         d.devData.acquire("ax", "ay");
         computeMomentumEnergy(first, last, ngmax_, d, domain.box());
@@ -189,6 +279,15 @@ public:
             timer.step("Upsweep");
             mHolder_.traverse(d, domain);
             timer.step("Gravity");
+            if constexpr (!cstone::HaveGpu<Acc>{})
+            {
+                if (farFieldSteps_ > 1 && mHolder_.farFieldUpdated() && Base::rank_ == 0 &&
+                    mHolder_.farFieldError() >= 0)
+                {
+                    Base::out << "### Check ### Gravity far-field extrapolation error: " << mHolder_.farFieldError()
+                              << std::endl;
+                }
+            }
         }
     }
 
@@ -200,7 +299,7 @@ public:
         size_t first = domain.startIndex();
         size_t last  = domain.endIndex();
 
-        computeTimestep(d);
+        computeTimestep(d, simData.reductions, simData.comm);
         timer.step("Timestep");
         computePositions(first, last, d, domain.box());
         timer.step("UpdateQuantities");
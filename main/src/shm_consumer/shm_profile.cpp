@@ -0,0 +1,220 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Example consumer of a shared-memory in-situ channel that prints radial profiles
+ *
+ * Start the simulation with --insitu-shm NAME[:...] and this program with the same NAME on the same node. For each
+ * step that was published by all ranks, a radial profile is computed directly from the shared-memory frames.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io/arg_parser.hpp"
+#include "io/shm_channel.hpp"
+#include "io/snapshot_reader.hpp"
+
+using namespace sphexa;
+
+void printHelp(char* binName);
+
+//! @brief open the channel of @p rank, retrying until @p timeout has passed
+std::unique_ptr<ShmConsumer> openChannel(const std::string& name, int rank, std::chrono::milliseconds poll,
+                                         std::chrono::seconds timeout)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        try
+        {
+            return std::make_unique<ShmConsumer>(shmSegmentName(name, rank));
+        }
+        catch (const std::runtime_error&)
+        {
+            if (std::chrono::steady_clock::now() - start > timeout) { throw; }
+            std::this_thread::sleep_for(poll);
+        }
+    }
+}
+
+//! @brief add the particles of @p frame to @p profile
+void addToProfile(const ShmFrame& frame, const std::string& quantity, const double center[3], RadialProfile& profile)
+{
+    bool                     radialVelocity = quantity == "v";
+    std::vector<std::string> names{"x", "y", "z"};
+    if (radialVelocity) { names.insert(names.end(), {"vx", "vy", "vz"}); }
+    else { names.push_back(quantity); }
+
+    std::vector<const ShmField*> f;
+    for (const auto& name : names)
+    {
+        f.push_back(frame.findField(name));
+        if (f.back() == nullptr) { throw std::runtime_error("Field " + name + " is not published\n"); }
+    }
+
+    for (size_t i = 0; i < frame.info().numParticles; ++i)
+    {
+        double dx = frame.value(*f[0], i) - center[0];
+        double dy = frame.value(*f[1], i) - center[1];
+        double dz = frame.value(*f[2], i) - center[2];
+        double r  = std::sqrt(dx * dx + dy * dy + dz * dz);
+        double q  = frame.value(*f[3], i);
+        if (radialVelocity)
+        {
+            q = r > 0 ? (q * dx + frame.value(*f[4], i) * dy + frame.value(*f[5], i) * dz) / r : 0;
+        }
+        profile.add(r, q);
+    }
+}
+
+void printProfile(uint64_t step, double time, const RadialProfile& profile, const std::string& quantity)
+{
+    printf("# step %lu time %.8g\n", step, time);
+    printf("# %14s %16s %12s %16s\n", "r_inner", "r_outer", "count", ("mean_" + quantity).c_str());
+    for (size_t i = 0; i < profile.count.size(); ++i)
+    {
+        if (profile.count[i] == 0) { continue; }
+        printf("%16.8g %16.8g %12lu %16.8g\n", profile.radius(i), profile.radius(i + 1), profile.count[i],
+               profile.sum[i] / profile.count[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    const ArgParser parser(argc, argv);
+    if (argc < 2 || parser.exists("-h") || parser.exists("--help"))
+    {
+        printHelp(argv[0]);
+        return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    std::string name      = argv[1];
+    std::string quantity  = parser.get("--field", std::string("rho"));
+    size_t      numBins   = parser.get("--bins", 50);
+    double      rmax      = parser.get("--rmax", 1.0);
+    size_t      maxFrames = parser.get("--frames", 0);
+    auto        poll      = std::chrono::milliseconds(parser.get("--poll", 10));
+    auto        timeout   = std::chrono::seconds(parser.get("--timeout", 60));
+
+    double center[3] = {0, 0, 0};
+    if (parser.exists("--center"))
+    {
+        auto c = sphexa::detail::parseNumbers(parser.get("--center"), 3, "--center");
+        std::copy(c.begin(), c.end(), center);
+    }
+
+    struct PendingStep
+    {
+        RadialProfile profile;
+        double        time;
+        int           numRanks;
+    };
+
+    try
+    {
+        std::vector<std::unique_ptr<ShmConsumer>> channels;
+        channels.push_back(openChannel(name, 0, poll, timeout));
+
+        int                             numRanks = 0;
+        std::vector<uint64_t>           lastFrame(1, 0);
+        std::map<uint64_t, PendingStep> pending;
+        size_t                          numProfiles = 0;
+
+        while (maxFrames == 0 || numProfiles < maxFrames)
+        {
+            for (size_t r = 0; r < channels.size(); ++r)
+            {
+                ShmFrame frame = channels[r]->acquire(lastFrame[r]);
+                if (!frame.valid()) { continue; }
+                lastFrame[r] = frame.frame();
+
+                if (numRanks == 0)
+                {
+                    // the number of ranks is known once the first frame arrives
+                    numRanks = frame.info().numRanks;
+                    for (int i = 1; i < numRanks; ++i)
+                    {
+                        channels.push_back(openChannel(name, i, poll, timeout));
+                    }
+                    lastFrame.resize(numRanks, 0);
+                }
+
+                uint64_t step = frame.info().step;
+                auto     it   = pending.try_emplace(step, PendingStep{RadialProfile(rmax, numBins), 0, 0}).first;
+                addToProfile(frame, quantity, center, it->second.profile);
+                it->second.time = frame.info().time;
+                it->second.numRanks++;
+
+                if (it->second.numRanks == numRanks)
+                {
+                    printProfile(step, it->second.time, it->second.profile, quantity);
+                    numProfiles++;
+                    // older steps can no longer complete, because ranks only publish their latest frame
+                    pending.erase(pending.begin(), std::next(it));
+                }
+            }
+            std::this_thread::sleep_for(poll);
+        }
+
+        uint64_t dropped = 0;
+        for (const auto& c : channels)
+        {
+            dropped += c->droppedFrames();
+        }
+        std::cerr << "frames dropped by the publishers: " << dropped << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        // the simulation removes the channel when it finishes
+        std::cerr << e.what();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void printHelp(char* name)
+{
+    printf("\nUsage:\n\n");
+    printf("%s NAME [OPTIONS]\n", name);
+    printf("\nPrints radial profiles of the particles published by sphexa --insitu-shm NAME[:...]\n");
+    printf("\nWhere possible options are:\n\n");
+    printf("\t--field NAME \t Field to bin, v for the radial velocity [rho]\n");
+    printf("\t--bins NUM \t Number of radial bins [50]\n");
+    printf("\t--center X,Y,Z \t Center of the profile [0,0,0]\n");
+    printf("\t--rmax NUM \t Outer radius of the profile [1]\n");
+    printf("\t--frames NUM \t Stop after NUM profiles [0, run until the simulation ends]\n");
+    printf("\t--poll NUM \t Polling interval in milliseconds [10]\n");
+    printf("\t--timeout NUM \t Seconds to wait for the simulation to create the channel [60]\n");
+}
@@ -0,0 +1,324 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Inspect snapshots and extract fields, radial profiles and slices without loading entire steps
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "io/arg_parser.hpp"
+#include "io/snapshot_reader.hpp"
+
+#ifdef SPH_EXA_HAVE_H5PART
+#include "io/h5part_snapshot_reader.hpp"
+#endif
+
+using namespace sphexa;
+
+void printHelp(char* binName);
+
+//! @brief files are all arguments after the command up to the first option
+std::vector<std::string> inputFiles(int argc, char** argv)
+{
+    std::vector<std::string> files;
+    for (int i = 2; i < argc && argv[i][0] != '-'; ++i)
+    {
+        files.emplace_back(argv[i]);
+    }
+    if (files.empty()) { throw std::runtime_error("No input files\n"); }
+    return files;
+}
+
+std::unique_ptr<ISnapshotReader> openSnapshot(const std::vector<std::string>& files)
+{
+    if (fileutils::isNativeSnapshot(files[0])) { return std::make_unique<NativeSnapshotReader>(files); }
+#ifdef SPH_EXA_HAVE_H5PART
+    if (files.size() > 1) { throw std::runtime_error("Only native snapshots can be combined into a series\n"); }
+    return std::make_unique<H5PartSnapshotReader>(files[0]);
+#else
+    throw std::runtime_error(files[0] + " is not a native snapshot and H5Part support is not enabled\n");
+#endif
+}
+
+//! @brief parse "A:B" into two numbers
+template<class T>
+std::tuple<T, T> parsePair(const std::string& str)
+{
+    auto colon = str.find(':');
+    if (colon == std::string::npos) { throw std::runtime_error("Expected A:B, got " + str + "\n"); }
+    return {T(std::stoull(str.substr(0, colon))), T(std::stoull(str.substr(colon + 1)))};
+}
+
+void printRow(const std::vector<std::vector<double>>& columns, size_t i)
+{
+    for (size_t c = 0; c < columns.size(); ++c)
+    {
+        printf(c + 1 < columns.size() ? "%.10g " : "%.10g\n", columns[c][i]);
+    }
+}
+
+void listSnapshot(ISnapshotReader& reader, size_t selectedStep)
+{
+    printf("%10s %10s %16s %14s\n", "file step", "iteration", "time", "particles");
+    for (size_t s = 0; s < reader.numSteps(); ++s)
+    {
+        reader.setStep(s);
+        printf("%10zu %10.0f %16.8g %14lu\n", s, readAttribute(reader, "step")[0], readAttribute(reader, "time")[0],
+               reader.numParticles());
+    }
+
+    reader.setStep(selectedStep);
+    printf("\nstep %zu fields:", selectedStep);
+    for (const auto& name : reader.fieldNames())
+    {
+        printf(" %s", name.c_str());
+    }
+    printf("\n\nstep %zu attributes:\n", selectedStep);
+    for (const auto& [name, values] : reader.attributes())
+    {
+        printf("  %-14s", name.c_str());
+        for (double v : values)
+        {
+            printf(" %.10g", v);
+        }
+        printf("\n");
+    }
+
+    SfcIndex<uint64_t> index;
+    if (reader.sfcIndex(index)) { printf("\nSFC index with %zu leaves\n", index.counts.size()); }
+}
+
+void readSnapshot(ISnapshotReader& reader, const ArgParser& parser, size_t blockSize)
+{
+    auto fields = parser.getCommaList("--fields");
+    if (fields.empty()) { fields = reader.fieldNames(); }
+
+    printf("#");
+    for (const auto& name : fields)
+    {
+        printf(" %s", name.c_str());
+    }
+    printf("\n");
+
+    if (parser.exists("--range") || parser.exists("--sfc"))
+    {
+        size_t first, last;
+        if (parser.exists("--range")) { std::tie(first, last) = parsePair<size_t>(parser.get("--range")); }
+        else
+        {
+            SfcIndex<uint64_t> index;
+            if (!reader.sfcIndex(index)) { throw std::runtime_error("--sfc: the step has no SFC index\n"); }
+            auto [keyStart, keyEnd] = parsePair<uint64_t>(parser.get("--sfc"));
+            std::tie(first, last)   = sfcParticleRange(index, keyStart, keyEnd);
+        }
+        last = std::min(last, size_t(reader.numParticles()));
+
+        for (size_t blockStart = first; blockStart < last; blockStart += blockSize)
+        {
+            size_t count   = std::min(blockSize, last - blockStart);
+            auto   columns = readFields(reader, fields, blockStart, count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                printRow(columns, i);
+            }
+        }
+        return;
+    }
+
+    OutputRegion region;
+    if (parser.exists("--region")) { region = parseOutputStream("read:" + parser.get("--region")).region; }
+    forEachInRegion(reader, region, fields, blockSize,
+                    [](const std::vector<std::vector<double>>& columns, const std::vector<size_t>& selection)
+                    {
+                        for (size_t i : selection)
+                        {
+                            printRow(columns, i);
+                        }
+                    });
+}
+
+void profileSnapshot(ISnapshotReader& reader, const ArgParser& parser, size_t blockSize)
+{
+    std::string quantity = parser.get("--field", std::string("rho"));
+    size_t      numBins  = parser.get("--bins", 100);
+
+    double center[3] = {0, 0, 0};
+    if (parser.exists("--center"))
+    {
+        auto c = sphexa::detail::parseNumbers(parser.get("--center"), 3, "--center");
+        std::copy(c.begin(), c.end(), center);
+    }
+
+    // default: the distance from the center to the farthest corner of the box
+    auto   box  = readAttribute(reader, "box");
+    double rmax = 0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        double distSq = 0;
+        for (int dim = 0; dim < 3; ++dim)
+        {
+            double d = box[2 * dim + ((corner >> dim) & 1)] - center[dim];
+            distSq += d * d;
+        }
+        rmax = std::max(rmax, std::sqrt(distSq));
+    }
+    rmax = parser.get("--rmax", rmax);
+
+    auto profile = radialProfile(reader, quantity, center, rmax, numBins, blockSize);
+
+    printf("# %14s %16s %12s %16s %16s %16s %16s\n", "r_inner", "r_outer", "count", ("mean_" + quantity).c_str(), "std",
+           "min", "max");
+    for (size_t i = 0; i < numBins; ++i)
+    {
+        if (profile.count[i] == 0) { continue; }
+        double n    = profile.count[i];
+        double mean = profile.sum[i] / n;
+        double var  = std::max(profile.sumSq[i] / n - mean * mean, 0.0);
+        printf("%16.8g %16.8g %12lu %16.8g %16.8g %16.8g %16.8g\n", profile.radius(i), profile.radius(i + 1),
+               profile.count[i], mean, std::sqrt(var), profile.minimum[i], profile.maximum[i]);
+    }
+}
+
+//! @brief cross section with |coordinate| < width along the chosen axis, as in scripts/slice.py
+void sliceSnapshot(ISnapshotReader& reader, const ArgParser& parser, size_t blockSize)
+{
+    std::string quantity = parser.get("--field", std::string("rho"));
+    std::string axisName = parser.get("--axis", std::string("z"));
+    double      width    = parser.get("--width", 0.1);
+
+    auto axis = std::string("xyz").find(axisName);
+    if (axisName.size() != 1 || axis == std::string::npos) { throw std::runtime_error("--axis must be x, y or z\n"); }
+
+    OutputRegion region;
+    region.shape    = OutputRegion::Shape::slab;
+    region.axis     = int(axis);
+    region.param[0] = -width;
+    region.param[1] = width;
+
+    std::vector<std::string> fields;
+    for (int dim = 0; dim < 3; ++dim)
+    {
+        if (dim != region.axis) { fields.push_back(std::string(1, "xyz"[dim])); }
+    }
+    fields.push_back(quantity);
+
+    printf("# %s %s %s\n", fields[0].c_str(), fields[1].c_str(), fields[2].c_str());
+    forEachInRegion(reader, region, fields, blockSize,
+                    [](const std::vector<std::vector<double>>& columns, const std::vector<size_t>& selection)
+                    {
+                        for (size_t i : selection)
+                        {
+                            printRow(columns, i);
+                        }
+                    });
+}
+
+int run(int argc, char** argv)
+{
+    const ArgParser parser(argc, argv);
+
+    if (argc < 3 || parser.exists("-h") || parser.exists("--help"))
+    {
+        printHelp(argv[0]);
+        return argc < 3 && !parser.exists("-h") && !parser.exists("--help") ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    std::string command   = argv[1];
+    auto        files     = inputFiles(argc, argv);
+    size_t      blockSize = parser.get("--block", 1 << 20);
+
+    auto reader = openSnapshot(files);
+    // the last step by default
+    size_t step = parser.get("--step", int(reader->numSteps()) - 1);
+    reader->setStep(step);
+
+    if (command == "list") { listSnapshot(*reader, step); }
+    else if (command == "read") { readSnapshot(*reader, parser, blockSize); }
+    else if (command == "profile") { profileSnapshot(*reader, parser, blockSize); }
+    else if (command == "slice") { sliceSnapshot(*reader, parser, blockSize); }
+    else
+    {
+        printHelp(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+#ifdef SPH_EXA_HAVE_H5PART
+    MPI_Init(&argc, &argv);
+#endif
+
+    int status = EXIT_FAILURE;
+    try
+    {
+        status = run(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what();
+    }
+
+#ifdef SPH_EXA_HAVE_H5PART
+    MPI_Finalize();
+#endif
+    return status;
+}
+
+void printHelp(char* name)
+{
+    printf("\nUsage:\n\n");
+    printf("%s COMMAND FILE... [OPTIONS]\n", name);
+    printf("\nFILE is an H5Part file or a series of native snapshots, one step per file.\n");
+    printf("\nWhere possible commands are:\n\n");
+    printf("\tlist \t\t Print steps, fields, attributes and whether the step has an SFC index\n");
+    printf("\tread \t\t Print selected fields of selected particles as columns\n");
+    printf("\tprofile \t Print statistics of a field in radial bins\n");
+    printf("\tslice \t\t Print a 2D cross section of a field\n");
+    printf("\nand options:\n\n");
+    printf("\t--step NUM \t Step within the file, or file index of a native series [last step]\n");
+    printf("\t--block NUM \t Number of particles read at once [1048576]\n\n");
+    printf("\tread:\n");
+    printf("\t--fields LIST \t Comma separated list of fields to read [all fields]\n");
+    printf("\t--range A:B \t Read particles [A:B) only\n");
+    printf("\t--sfc A:B \t Read particles with SFC keys in [A:B), rounded out to the leaves of the SFC index\n");
+    printf("\t--region SPEC \t Read particles inside box=XMIN,XMAX,YMIN,YMAX,ZMIN,ZMAX, sphere=X,Y,Z,R or\n"
+           "\t\t\t slab=AXIS,MIN,MAX. With an SFC index, only leaves that overlap the region are read.\n\n");
+    printf("\tprofile:\n");
+    printf("\t--field NAME \t Field to bin, v for the radial velocity [rho]\n");
+    printf("\t--bins NUM \t Number of radial bins [100]\n");
+    printf("\t--center X,Y,Z \t Center of the profile [0,0,0]\n");
+    printf("\t--rmax NUM \t Outer radius of the profile [distance to the farthest box corner]\n\n");
+    printf("\tslice:\n");
+    printf("\t--field NAME \t Field to print in addition to the in-plane coordinates [rho]\n");
+    printf("\t--axis AXIS \t Normal of the slice, x, y or z [z]\n");
+    printf("\t--width NUM \t Particles with |AXIS| < NUM are printed [0.1]\n");
+}
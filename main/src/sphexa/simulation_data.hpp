@@ -32,7 +32,10 @@
 
 #include <mpi.h>
 
+#include "cstone/primitives/reduction_batch.hpp"
+
 #include "cooling/chemistry_data.hpp"
+#include "io/sfc_index.hpp"
 #include "sph/particles_data.hpp"
 
 namespace sphexa
@@ -59,7 +62,13 @@ public:
     //! @brief non-spacially distributed nuclear abundances
     // NuclearData nuclear;
 
+    //! @brief global domain decomposition, recorded in snapshots or restored from them
+    SfcIndex<KeyType> sfcIndex;
+
     MPI_Comm comm;
+
+    //! @brief global reductions of the current step, e.g. time-step and conserved quantities, started on comm
+    cstone::ReductionBatch reductions;
 };
 
 } // namespace sphexa
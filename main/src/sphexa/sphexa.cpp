@@ -32,18 +32,25 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <filesystem>
 #include <iostream>
 #include <string>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "cstone/domain/domain.hpp"
 
+#include "init/cached_init.hpp"
 #include "init/factory.hpp"
 #include "io/arg_parser.hpp"
 #include "io/ifile_writer.hpp"
+#include "io/shm_insitu.hpp"
+#include "io/stream_writer.hpp"
 #include "observables/factory.hpp"
 #include "propagator/factory.hpp"
+#include "propagator/outflow.hpp"
+#include "util/ensemble.hpp"
 #include "util/timer.hpp"
 #include "util/utils.hpp"
 
@@ -59,20 +66,37 @@ using AccType = cstone::CpuTag;
 
 using namespace sphexa;
 
-bool stopSimulation(size_t iteration, double time, const std::string& maxStepStr);
-void printHelp(char* binName, int rank);
+bool                          stopSimulation(size_t iteration, double time, const std::string& maxStepStr);
+cstone::HaloPrecision::Format haloPrecisionFormat(const std::string& format);
+void                          printHelp(char* binName, int rank);
 
 int main(int argc, char** argv)
 {
-    auto [rank, numRanks] = initMpi();
-    const ArgParser parser(argc, argv);
+    const ArgParser jobParser(argc, argv);
+    const bool      asyncIO =
+        jobParser.exists("--async-io") || ensembleArgsContain(jobParser.get("--ensemble-args"), "--async-io");
+    auto [worldRank, worldSize] = initMpi(asyncIO ? MPI_THREAD_MULTIPLE : MPI_THREAD_SINGLE);
 
-    if (parser.exists("-h") || parser.exists("--h") || parser.exists("-help") || parser.exists("--help"))
+    if (jobParser.exists("-h") || jobParser.exists("--h") || jobParser.exists("-help") || jobParser.exists("--help"))
     {
-        printHelp(argv[0], rank);
+        printHelp(argv[0], worldRank);
         return exitSuccess();
     }
 
+    // each member of an ensemble is an independent simulation on its own communicator
+    EnsembleMember           member     = splitEnsemble(jobParser.get("--ensemble", 1));
+    std::vector<std::string> memberArgs = memberArguments(argc, argv, jobParser.get("--ensemble-args"), member.index);
+    std::vector<char*>       memberArgv;
+    for (auto& arg : memberArgs)
+    {
+        memberArgv.push_back(arg.data());
+    }
+    const ArgParser parser(int(memberArgv.size()), memberArgv.data());
+
+    int rank, numRanks;
+    MPI_Comm_rank(member.comm, &rank);
+    MPI_Comm_size(member.comm, &numRanks);
+
     using Real    = double;
     using KeyType = uint64_t;
     using Dataset = SimulationData<Real, KeyType, AccType>;
@@ -87,33 +111,99 @@ int main(int argc, char** argv)
     std::vector<std::string> writeExtra        = parser.getCommaList("--wextra");
     std::vector<std::string> outputFields      = parser.getCommaList("-f");
     const bool               ascii             = parser.exists("--ascii");
-    const std::string        outDirectory      = parser.get("--outDir");
+    const bool               native            = parser.exists("--native");
+    const std::string        outDirectory      = memberDirectory(parser.get("--outDir"), member);
     const bool               quiet             = parser.exists("--quiet");
+    const unsigned           gravFarSteps      = parser.get("--grav-far-steps", 1u);
+    const float              gravFarTol        = parser.get("--grav-far-tol", 0.01f);
+    const bool               gravMixed         = parser.exists("--grav-mixed");
+    const bool               gravIncremental   = parser.exists("--grav-incremental");
+    const std::string        haloPrecision     = parser.get("--halo-precision", std::string("exact"));
+    const unsigned           treeCoarsening    = parser.get("--tree-coarsen", 1u);
+    const bool               predictAssignment = parser.exists("--predict-assignment");
+    const std::string        keepRegionSpec    = parser.get("--keep-region");
+    const size_t             asyncIOBudget     = parser.get("--async-io-mem", size_t(2048)) << 20;
+    const std::string        icCacheDir        = parser.get("--ic-cache");
+
+    fileutils::NativeCompression compression;
+    compression.enabled       = parser.exists("--compress");
+    compression.lossyFields   = parser.getCommaList("--compress-lossy");
+    compression.relativeError = parser.get("--compress-tol", 1e-5);
+
+    fileutils::NativeDeltaConfig deltaConfig;
+    deltaConfig.fullEvery         = parser.get("--native-delta", 1u);
+    deltaConfig.relativeTolerance = parser.get("--delta-tol", 0.0);
 
     size_t ngmax = 150;
     size_t ng0   = 100;
 
+    if (rank == 0 && member.numMembers > 1) { std::filesystem::create_directories(outDirectory); }
+    MPI_Barrier(member.comm);
+
     std::ofstream nullOutput("/dev/null");
-    std::ostream& output = quiet ? nullOutput : std::cout;
+    // members of an ensemble log into their output directory instead of sharing stdout
+    std::ofstream memberLog;
+    if (member.numMembers > 1 && !quiet && rank == 0) { memberLog.open(outDirectory + "output.txt"); }
+    std::ostream& output = quiet ? nullOutput : (member.numMembers > 1 ? memberLog : std::cout);
     std::ofstream constantsFile(outDirectory + "constants.txt");
 
     //! @brief evaluate user choice for different kind of actions
     auto simInit     = initializerFactory<Dataset>(initCond, glassBlock);
     auto propagator  = propagatorFactory<Domain, Dataset>(propChoice, ngmax, ng0, output, rank);
-    auto fileWriter  = fileWriterFactory<Dataset>(ascii);
+    auto fileWriter  = fileWriterFactory<Dataset>(ascii, native, compression, deltaConfig, asyncIO, asyncIOBudget,
+                                                  output, member.comm);
     auto observables = observablesFactory<Dataset>(initCond, constantsFile);
 
+    if (rank == 0 && !native && (compression.enabled || !compression.lossyFields.empty()))
+    {
+        std::cout << "Warning: output compression is only supported for native snapshots\n";
+    }
+
     Dataset simData;
-    simData.comm = MPI_COMM_WORLD;
+    simData.comm = member.comm;
 
+    propagator->setMultiRateGravity(gravFarSteps, gravFarTol);
+    propagator->setMixedPrecisionGravity(gravMixed);
+    propagator->setIncrementalUpsweep(gravIncremental);
+    propagator->setHaloPrecision(haloPrecisionFormat(haloPrecision));
     propagator->activateFields(simData);
     propagator->restoreState(initCond, simData.comm);
+
+    // initial conditions read from files are not cached
+    CachedInit<Dataset>* icCache = nullptr;
+    if (!icCacheDir.empty() && !std::filesystem::exists(initCond))
+    {
+        auto cached = std::make_unique<CachedInit<Dataset>>(std::move(simInit), icCacheDir, initCond, glassBlock,
+                                                            propagator->conservedFields());
+        icCache     = cached.get();
+        simInit     = std::move(cached);
+    }
     cstone::Box<Real> box = simInit->init(rank, numRanks, problemSize, simData);
 
     auto& d = simData.hydro;
     transferToDevice(d, 0, d.x.size(), propagator->conservedFields());
     d.setOutputFields(outputFields.empty() ? propagator->conservedFields() : outputFields);
 
+    std::vector<OutputStream> streamConfigs;
+    for (const auto& spec : parser.getAll("--stream"))
+    {
+        streamConfigs.push_back(parseOutputStream(spec));
+    }
+    OutputStreams<Dataset> outputStreams(streamConfigs, d.outputFieldNames, writeFrequencyStr);
+
+    std::unique_ptr<ShmInsitu<Dataset>> shmChannel;
+    if (parser.exists("--insitu-shm"))
+    {
+        OutputStream shmConfig = parseOutputStream(parser.get("--insitu-shm"));
+        if (member.numMembers > 1) { shmConfig.name += "-ensemble" + std::to_string(member.index); }
+        shmChannel = std::make_unique<ShmInsitu<Dataset>>(shmConfig, d.outputFieldNames, writeFrequencyStr, rank,
+                                                          numRanks);
+    }
+
+    // particles that leave this region are removed from the simulation
+    std::optional<OutputRegion> keepRegion;
+    if (!keepRegionSpec.empty()) { keepRegion = parseRegion(keepRegionSpec); }
+
     bool  haveGrav = (d.g != 0.0);
     float theta    = parser.get("--theta", haveGrav ? 0.5f : 1.0f);
 
@@ -122,15 +212,27 @@ int main(int argc, char** argv)
     {
         fileWriter->constants(simInit->constants(), outFile);
     }
-    if (rank == 0) { std::cout << "Data generated for " << d.numParticlesGlobal << " global particles\n"; }
+    if (rank == 0) { output << "Data generated for " << d.numParticlesGlobal << " global particles\n"; }
 
     size_t bucketSizeFocus = 64;
     // we want about 100 global nodes per rank to decompose the domain with +-1% accuracy
     size_t bucketSize = std::max(bucketSizeFocus, d.numParticlesGlobal / (100 * numRanks));
-    Domain domain(rank, numRanks, bucketSize, bucketSizeFocus, theta, box);
+    Domain domain(rank, numRanks, bucketSize, bucketSizeFocus, theta, box, member.comm);
+    if (!simData.sfcIndex.empty()) { domain.setGlobalTree(simData.sfcIndex.leaves, simData.sfcIndex.counts); }
+    // the focus trees are only used if all ranks have one, otherwise they are converged from scratch
+    int haveFocus = simData.sfcIndex.hasFocus();
+    MPI_Allreduce(MPI_IN_PLACE, &haveFocus, 1, MPI_INT, MPI_MIN, member.comm);
+    if (haveFocus)
+    {
+        domain.setFocusTree(simData.sfcIndex.focusLeaves, simData.sfcIndex.focusCounts,
+                            simData.sfcIndex.focusMacStatus());
+        if (rank == 0) { output << "Domain warm start from the stored focus trees" << std::endl; }
+    }
+    domain.setGlobalTreeCoarsening(treeCoarsening);
 
     propagator->sync(domain, simData);
-    if (rank == 0) std::cout << "Domain synchronized, nLocalParticles " << d.x.size() << std::endl;
+    if (rank == 0) output << "Domain synchronized, nLocalParticles " << d.x.size() << std::endl;
+    if (icCache) { icCache->store(simData, domain, box); }
 
     viz::init_catalyst(argc, argv);
     viz::init_ascent(d, domain.startIndex());
@@ -138,31 +240,99 @@ int main(int argc, char** argv)
     MasterProcessTimer totalTimer(output, rank);
     totalTimer.start();
     size_t startIteration = d.iteration;
+    // running statistics of the load imbalance and of the particle migration volume of domain.sync() per step
+    double   sumImbalance = 0, maxImbalance = 0;
+    uint64_t sumMigrated = 0, maxMigrated = 0, numSteps = 0;
     for (; !stopSimulation(d.iteration - 1, d.ttot, maxStepStr); d.iteration++)
     {
+        if (predictAssignment) { domain.predictAssignment(d.vx, d.vy, d.vz, d.minDt); }
+        if (keepRegion) { removeParticlesOutside(*keepRegion, domain, d); }
+        auto exchanged = domain.domainExchangeVolume();
         propagator->step(domain, simData);
+        uint64_t migrated = domain.domainExchangeVolume().intraNode + domain.domainExchangeVolume().interNode -
+                            exchanged.intraNode - exchanged.interNode;
+        uint64_t assigned     = domain.nParticles();
+        auto     maxAssigned  = simData.reductions.add(cstone::ReduceOp::max, assigned);
+        auto     sumAssigned  = simData.reductions.add(cstone::ReduceOp::sum, assigned);
+        auto     sumMigration = simData.reductions.add(cstone::ReduceOp::sum, migrated);
 
         observables->computeAndWrite(simData, domain.startIndex(), domain.endIndex(), box);
+        // observables that don't reduce anything leave the batch unstarted
+        simData.reductions.start(simData.comm);
+        double imbalance =
+            double(simData.reductions.get(maxAssigned)) * numRanks / simData.reductions.get(sumAssigned);
+        sumImbalance += imbalance;
+        maxImbalance = std::max(maxImbalance, imbalance);
+        sumMigrated += simData.reductions.get(sumMigration);
+        maxMigrated = std::max(maxMigrated, simData.reductions.get(sumMigration));
+        numSteps++;
+
         propagator->printIterationTimings(domain, simData);
 
-        if (isPeriodicOutputStep(d.iteration, writeFrequencyStr) ||
-            isPeriodicOutputTime(d.ttot - d.minDt, d.ttot, writeFrequencyStr) ||
-            isExtraOutputStep(d.iteration, d.ttot - d.minDt, d.ttot, writeExtra))
+        bool mainOutput   = isPeriodicOutputStep(d.iteration, writeFrequencyStr) ||
+                            isPeriodicOutputTime(d.ttot - d.minDt, d.ttot, writeFrequencyStr) ||
+                            isExtraOutputStep(d.iteration, d.ttot - d.minDt, d.ttot, writeExtra);
+        bool streamOutput = outputStreams.isOutputStep(d.iteration, d.ttot - d.minDt, d.ttot);
+        bool shmOutput    = shmChannel && shmChannel->isOutputStep(d.iteration, d.ttot - d.minDt, d.ttot);
+
+        if (mainOutput || streamOutput || shmOutput)
         {
             propagator->prepareOutput(simData, domain.startIndex(), domain.endIndex(), domain.box());
-            fileWriter->dump(simData, domain.startIndex(), domain.endIndex(), box, outFile);
-            propagator->dump(d.iteration, outFile);
+            if (mainOutput)
+            {
+                simData.sfcIndex.update(domain.globalTree().treeLeaves(), domain.globalCounts());
+                simData.sfcIndex.updateFocus(domain.focusTree().treeLeaves(), domain.focusTree().leafCounts(),
+                                             domain.focusTree().macs());
+                fileWriter->dump(simData, domain.startIndex(), domain.endIndex(), box, outFile);
+                if (propagator->dumpsState())
+                {
+                    // propagator state goes into the same file
+                    fileWriter->wait();
+                    propagator->dump(d.iteration, outFile);
+                }
+            }
+            if (streamOutput) { outputStreams.dump(simData, domain, box, *fileWriter, outFile, output); }
+            if (shmOutput) { shmChannel->publish(simData, domain, box); }
             propagator->finishOutput(simData);
         }
 
         viz::execute(d, domain.startIndex(), domain.endIndex());
     }
 
+    fileWriter->wait();
+
+    const auto& haloVolume     = domain.haloExchangeVolume();
+    auto        exchangeVolume = domain.domainExchangeVolume();
+    uint64_t    localVolume[4] = {haloVolume.intraNode, haloVolume.interNode, exchangeVolume.intraNode,
+                                  exchangeVolume.interNode};
+    uint64_t    globalVolume[4];
+    MPI_Reduce(localVolume, globalVolume, 4, MPI_UINT64_T, MPI_SUM, 0, member.comm);
+    if (rank == 0)
+    {
+        output << "# Halo exchange MiB intra-node: " << globalVolume[0] / 1048576.0
+               << ", inter-node: " << globalVolume[1] / 1048576.0 << std::endl;
+        output << "# Domain exchange MiB intra-node: " << globalVolume[2] / 1048576.0
+               << ", inter-node: " << globalVolume[3] / 1048576.0 << std::endl;
+    }
+
+    if (rank == 0 && numSteps > 0)
+    {
+        output << "# Assignment imbalance (max/mean particles per rank) average: " << sumImbalance / numSteps
+               << ", maximum: " << maxImbalance << std::endl;
+        output << "# Domain migration MiB per step average: " << sumMigrated / 1048576.0 / numSteps
+               << ", maximum: " << maxMigrated / 1048576.0 << std::endl;
+    }
+    if (shmChannel && rank == 0)
+    {
+        output << "# In-situ channel " << shmChannel->name() << ": " << shmChannel->droppedFrames()
+               << " frames dropped on rank 0" << std::endl;
+    }
     totalTimer.step("Total execution time of " + std::to_string(d.iteration - startIteration) + " iterations of " +
                     initCond + " up to t = " + std::to_string(d.ttot));
 
     constantsFile.close();
     viz::finalize();
+    freeEnsemble(member);
     return exitSuccess();
 }
 
@@ -175,6 +345,14 @@ bool stopSimulation(size_t iteration, double time, const std::string& maxStepStr
     return lastIteration || simTimeLimit;
 }
 
+cstone::HaloPrecision::Format haloPrecisionFormat(const std::string& format)
+{
+    if (format == "exact") { return cstone::HaloPrecision::exact; }
+    if (format == "float32") { return cstone::HaloPrecision::float32; }
+    if (format == "scaled16") { return cstone::HaloPrecision::scaled16; }
+    throw std::runtime_error("Unknown halo precision " + format + ", use exact, float32 or scaled16\n");
+}
+
 void printHelp(char* name, int rank)
 {
     if (rank == 0)
@@ -186,10 +364,28 @@ void printHelp(char* name, int rank)
         printf("\t--init \t\t Test case selection (evrard, sedov, noh, isobaric-cube, wind-shock, turbulence)\n"
                "\t\t\t or an HDF5 file with initial conditions\n\n");
         printf("\t-n NUM \t\t Initialize data with (approx when using glass blocks) NUM^3 global particles [50]\n");
-        printf("\t--glass FILE\t Use glass block as template to generate initial x,y,z configuration\n\n");
+        printf("\t--glass FILE\t Use glass block as template to generate initial x,y,z configuration\n");
+        printf("\t--ic-cache DIR \t Load generated initial conditions from DIR if they were generated before with the\n"
+               "\t\t\t same test case, -n, glass block and constants, otherwise store them in DIR\n\n");
 
         printf("\t--theta NUM \t Gravity accuracy parameter [default 0.5 when self-gravity is active]\n\n");
 
+        printf("\t--grav-far-steps NUM \t Evaluate the gravitational far-field at most every NUM steps and\n"
+               "\t\t\t extrapolate it in between [1, far-field evaluated every step]\n");
+        printf("\t--grav-far-tol NUM \t Relative change of the coarse multipoles that triggers\n"
+               "\t\t\t an early far-field evaluation [0.01]\n");
+        printf("\t--grav-mixed \t Compute gravitational interactions in single precision on CPUs\n");
+        printf("\t--grav-incremental \t Recompute only the multipoles of tree cells that changed on CPUs\n\n");
+
+        printf("\t--halo-precision STRING \t Format of derived fields in CPU halo exchanges that are only used as\n"
+               "\t\t\t kernel inputs, e.g. IAD, divv, alpha, xm, kx: exact, float32 or scaled16 [exact]\n\n");
+        printf("\t--tree-coarsen NUM \t Factor by which global tree leaves for domain decomposition are larger than\n"
+               "\t\t\t the bucket size away from rank boundaries, e.g. 10. Counts stay exact. CPU only [1]\n");
+        printf("\t--predict-assignment \t Place domain boundaries on particle positions extrapolated by one\n"
+               "\t\t\t time-step to follow bulk flows. CPU only\n");
+        printf("\t--keep-region SPEC \t Remove particles that leave the region box=XMIN,XMAX,YMIN,YMAX,ZMIN,ZMAX,\n"
+               "\t\t\t sphere=X,Y,Z,R or slab=AXIS,MIN,MAX from the simulation. CPU only\n\n");
+
         printf("\t--prop STRING \t Choice of SPH propagator [default: modern SPH]. For standard SPH, use \"std\" \n\n");
 
         printf("\t-s NUM \t\t int(NUM):  Number of iterations (time-steps) [200],\n\
@@ -208,12 +404,43 @@ void printHelp(char* name, int rank)
                "\t\t\t If omitted, the list will be set to all conserved fields,\n"
                "\t\t\t resulting in a restartable output file\n\n");
 
-        printf("\t--ascii \t Dump file in ASCII format [binary HDF5 by default]\n\n");
+        printf("\t--stream SPEC \t Additional output of a subset of particles to a separate file, can be repeated.\n"
+               "\t\t\t SPEC is NAME[:f=LIST][:w=NUM][:box=XMIN,XMAX,YMIN,YMAX,ZMIN,ZMAX|:sphere=X,Y,Z,R|\n"
+               "\t\t\t :slab=AXIS,MIN,MAX][:every=N], where f and w are as above and default to -f and -w,\n"
+               "\t\t\t the region restricts output to particles inside a box, sphere or slab normal to x, y or z\n"
+               "\t\t\t and every=N keeps one in N small SFC cells, such that the sample persists across frames\n"
+               "\t\t\t e.g: --stream core:f=x,y,z,rho:w=2:sphere=0,0,0,0.1 --stream all:every=100\n\n");
+
+        printf("\t--insitu-shm SPEC \t Publish particles into a POSIX shared-memory channel /sphexa-NAME-RANK\n"
+               "\t\t\t for asynchronous analysis by a separate process on the same node, e.g. shm_profile.\n"
+               "\t\t\t SPEC has the syntax of --stream. Frames are dropped if the consumer lags behind.\n\n");
+
+        printf("\t--ascii \t Dump file in ASCII format [binary HDF5 by default]\n");
+        printf("\t--native \t Dump one native binary snapshot per output step, readable without HDF5 and usable\n"
+               "\t\t\t as --init file for restarts\n");
+        printf("\t--compress \t Compress all fields of native snapshots losslessly\n");
+        printf("\t--compress-lossy LIST \t Comma-separated list of floating point fields to store in native snapshots\n"
+               "\t\t\t with bounded error, e.g. --compress-lossy divv,curlv,rho,p\n");
+        printf("\t--compress-tol NUM \t Error bound of --compress-lossy relative to the maximum of each field\n"
+               "\t\t\t [1e-5]\n");
+        printf("\t--native-delta NUM \t Write every NUM-th native snapshot in full and only the SFC leaves and\n"
+               "\t\t\t fields that changed since the previous snapshot in between. Restarts from a delta\n"
+               "\t\t\t need the files of the chain back to the last full snapshot in the same directory [1]\n");
+        printf("\t--delta-tol NUM \t Change of a field relative to its maximum below which it is considered\n"
+               "\t\t\t unchanged in delta snapshots [0, exact]\n\n");
+
+        printf("\t--async-io \t Write output files from a background thread while the simulation continues\n");
+        printf("\t--async-io-mem NUM \t Memory budget in MiB per rank for staging asynchronous output [2048]\n\n");
 
         printf("\t--outDir PATH \t Path to directory where output will be saved [./].\n\
                     \t Note that directory must exist and be provided with ending slash,\n\
                     \t e.g: --outDir /home/user/folderToSaveOutputFiles/\n\n");
 
         printf("\t--quiet \t Don't print anything to stdout\n\n");
+
+        printf("\t--ensemble NUM \t Split the job into NUM independent simulations of consecutive ranks. Each\n"
+               "\t\t\t simulation writes its output and log into the subdirectory ensemble_INDEX of --outDir\n");
+        printf("\t--ensemble-args FILE \t Line INDEX of FILE holds options for simulation INDEX of the ensemble\n"
+               "\t\t\t that take precedence over the options of the job, e.g. -n 40 --theta 0.6\n\n");
     }
 }
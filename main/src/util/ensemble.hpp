@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Split one MPI job into an ensemble of independent simulations
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+namespace sphexa
+{
+
+//! @brief the simulation of the ensemble that the executing rank belongs to
+struct EnsembleMember
+{
+    //! @brief communicator of all ranks of the member simulation
+    MPI_Comm comm;
+    //! @brief index of the member in [0:numMembers]
+    int index;
+    int numMembers;
+};
+
+/*! @brief split MPI_COMM_WORLD into @p numMembers simulations of contiguous ranks, collective on MPI_COMM_WORLD
+ *
+ * With numMembers == 1, the member communicator is MPI_COMM_WORLD itself. Ranks are distributed as evenly as
+ * possible, such that member sizes differ by at most one rank.
+ */
+inline EnsembleMember splitEnsemble(int numMembers)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+    if (numMembers < 1 || numMembers > numRanks)
+    {
+        throw std::runtime_error("The ensemble size " + std::to_string(numMembers) + " must be in [1:" +
+                                 std::to_string(numRanks) + "], the number of ranks\n");
+    }
+    if (numMembers == 1) { return {MPI_COMM_WORLD, 0, 1}; }
+
+    EnsembleMember member{MPI_COMM_NULL, int(int64_t(rank) * numMembers / numRanks), numMembers};
+    MPI_Comm_split(MPI_COMM_WORLD, member.index, rank, &member.comm);
+    return member;
+}
+
+//! @brief release the communicator of @p member, collective on the member
+inline void freeEnsemble(EnsembleMember& member)
+{
+    if (member.comm != MPI_COMM_WORLD && member.comm != MPI_COMM_NULL) { MPI_Comm_free(&member.comm); }
+}
+
+//! @brief output directory of @p member inside @p outDirectory
+inline std::string memberDirectory(const std::string& outDirectory, const EnsembleMember& member)
+{
+    if (member.numMembers == 1) { return outDirectory; }
+    return outDirectory + "ensemble_" + std::to_string(member.index) + "/";
+}
+
+/*! @brief command line of ensemble member @p index
+ *
+ * @param argc       number of arguments of the job
+ * @param argv       arguments of the job
+ * @param argsFile   if not empty, line @p index of this file holds whitespace-separated options for the member
+ * @param index      the ensemble member
+ * @return           argv[0], followed by the options of the member and the remaining arguments of the job
+ *
+ * Since options are looked up by their first occurrence, options of the member take precedence over those of
+ * the job, e.g. to scan a parameter range with one member per line of @p argsFile.
+ */
+inline std::vector<std::string> memberArguments(int argc, char** argv, const std::string& argsFile, int index)
+{
+    std::vector<std::string> args{argv[0]};
+    if (!argsFile.empty())
+    {
+        std::ifstream file(argsFile);
+        if (!file) { throw std::runtime_error("Cannot open ensemble arguments file " + argsFile + "\n"); }
+
+        std::string line;
+        for (int i = 0; i <= index; ++i)
+        {
+            if (!std::getline(file, line))
+            {
+                throw std::runtime_error("Ensemble arguments file " + argsFile + " has no line for member " +
+                                         std::to_string(index) + "\n");
+            }
+        }
+
+        std::istringstream tokens(line);
+        std::string        token;
+        while (tokens >> token)
+        {
+            args.push_back(token);
+        }
+    }
+    args.insert(args.end(), argv + 1, argv + argc);
+    return args;
+}
+
+/*! @brief whether any member line of @p argsFile contains @p option
+ *
+ * Can be called before MPI is initialized, e.g. to choose the thread level, since it does not depend on the member
+ * index. Missing files are reported by memberArguments.
+ */
+inline bool ensembleArgsContain(const std::string& argsFile, const std::string& option)
+{
+    if (argsFile.empty()) { return false; }
+
+    std::ifstream file(argsFile);
+    std::string   token;
+    while (file >> token)
+    {
+        if (token == option) { return true; }
+    }
+    return false;
+}
+
+} // namespace sphexa
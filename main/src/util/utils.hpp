@@ -7,11 +7,13 @@
 namespace sphexa
 {
 
-auto initMpi()
+//! @brief initialize MPI with the requested thread support level, e.g. MPI_THREAD_MULTIPLE for asynchronous output
+auto initMpi(int threadLevel = MPI_THREAD_SINGLE)
 {
     int rank     = 0;
     int numRanks = 0;
-    MPI_Init(NULL, NULL);
+    int provided = 0;
+    MPI_Init_thread(NULL, NULL, threadLevel, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
     if (rank == 0)
@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Tests for the keys of the initial condition cache
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <cstdio>
+#include <filesystem>
+
+#include "gtest/gtest.h"
+
+#include "init/ic_cache.hpp"
+
+using namespace sphexa;
+
+TEST(IcCache, fileName)
+{
+    std::map<std::string, double> constants{{"gamma", 5. / 3.}, {"G", 1.0}};
+    std::vector<std::string>      fields{"x", "y", "z", "h", "m", "temp"};
+
+    std::string name = icCacheFileName("evrard", 50, 42, constants, fields);
+    EXPECT_EQ(name.substr(0, 13), "ic_evrard_50_");
+    EXPECT_EQ(name.size(), 13 + 16 + 5);
+    EXPECT_EQ(name, icCacheFileName("evrard", 50, 42, constants, fields));
+
+    EXPECT_NE(name, icCacheFileName("evrard", 50, 43, constants, fields));
+    EXPECT_NE(name, icCacheFileName("evrard", 50, 42, constants, {"x", "y", "z", "h", "m", "u"}));
+
+    auto modified = constants;
+    modified["G"] = 1.0 + 1e-15;
+    EXPECT_NE(name, icCacheFileName("evrard", 50, 42, modified, fields));
+}
+
+TEST(IcCache, fileContentHash)
+{
+    std::string path = "ic_cache_hash_test.bin";
+    auto        writeFile = [&path](const std::string& content)
+    {
+        FILE* fp = std::fopen(path.c_str(), "wb");
+        std::fwrite(content.data(), 1, content.size(), fp);
+        std::fclose(fp);
+    };
+
+    writeFile("glass");
+    uint64_t hash = fileContentHash(path);
+    EXPECT_EQ(hash, fnv1aHash("glass", 5));
+    writeFile("glasS");
+    EXPECT_NE(hash, fileContentHash(path));
+
+    std::filesystem::remove(path);
+    EXPECT_THROW(fileContentHash(path), std::runtime_error);
+}
@@ -0,0 +1,69 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Unit tests for file utilities
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <sstream>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "io/file_utils.hpp"
+
+using namespace sphexa;
+
+TEST(IO, formatAscii)
+{
+    using FieldType = std::variant<double*, unsigned*>;
+
+    size_t                numRows = 10000;
+    std::vector<double>   x(numRows);
+    std::vector<unsigned> id(numRows);
+    for (size_t i = 0; i < numRows; ++i)
+    {
+        x[i]  = 0.1 * i;
+        id[i] = i;
+    }
+
+    std::vector<FieldType> fields{x.data(), id.data()};
+    std::string            formatted = fileutils::formatAscii(1, numRows, fields, ' ');
+
+    std::istringstream in(formatted);
+    for (size_t i = 1; i < numRows; ++i)
+    {
+        double   xi;
+        unsigned idi;
+        in >> xi >> idi;
+        EXPECT_EQ(xi, x[i]);
+        EXPECT_EQ(idi, id[i]);
+    }
+    EXPECT_EQ(formatted.substr(0, 14), " 0.1 1\n 0.2 2\n");
+}
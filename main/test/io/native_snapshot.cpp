@@ -0,0 +1,302 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 CSCS, ETH Zurich, University of Basel, University of Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Native snapshot layout and memory-mapped reader tests
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <numeric>
+
+#include "gtest/gtest.h"
+
+#include "io/native_delta.hpp"
+#include "io/native_snapshot.hpp"
+
+using namespace sphexa;
+using namespace sphexa::fileutils;
+
+TEST(NativeSnapshot, fieldTableIsPageAligned)
+{
+    auto table = nativeFieldTable({"x", "id"}, {NativeType::float64, NativeType::uint64}, 1000);
+
+    EXPECT_EQ(table[0].offset, nativePageSize);
+    EXPECT_EQ(table[1].offset, nativePageSize + nativePageAlign(8000));
+    EXPECT_EQ(nativeFileSize(table), table[1].offset + 8000);
+
+    EXPECT_THROW(nativeFieldTable({std::string(nativeMaxNameSize, 'a')}, {NativeType::int32}, 1), std::runtime_error);
+}
+
+TEST(NativeSnapshot, writeRead)
+{
+    std::string path = "native_snapshot_test.snap";
+
+    std::vector<double> x{1.0, 2.0, 3.0, 4.0};
+    std::vector<float>  h{0.5f, 0.25f, 0.125f, 0.0625f};
+
+    auto table = nativeFieldTable({"x", "h"}, {NativeType::float64, NativeType::float32}, x.size());
+
+    NativeHeader header{};
+    header.numParticles = x.size();
+    header.step         = 42;
+    header.time         = 0.5;
+    auto headerBytes    = serializeNativeHeader(header, table);
+
+    {
+        std::vector<char> file(nativeFileSize(table), 0);
+        std::copy(headerBytes.begin(), headerBytes.end(), file.begin());
+        std::memcpy(file.data() + table[0].offset, x.data(), x.size() * sizeof(double));
+        std::memcpy(file.data() + table[1].offset, h.data(), h.size() * sizeof(float));
+
+        FILE* fp = std::fopen(path.c_str(), "wb");
+        std::fwrite(file.data(), 1, file.size(), fp);
+        std::fclose(fp);
+    }
+
+    EXPECT_TRUE(isNativeSnapshot(path));
+    {
+        NativeSnapshot snap(path);
+        EXPECT_EQ(snap.header().step, 42);
+        EXPECT_EQ(snap.header().time, 0.5);
+        EXPECT_EQ(snap.fields().size(), 2);
+        EXPECT_TRUE(snap.hasField("h"));
+        EXPECT_FALSE(snap.hasField("y"));
+
+        auto xView = snap.field<double>("x");
+        EXPECT_TRUE(std::equal(xView.begin(), xView.end(), x.begin()));
+        EXPECT_THROW(snap.field<float>("x"), std::runtime_error);
+
+        std::vector<double> hSlice(2);
+        snap.readField("h", 1, 2, hSlice.data());
+        EXPECT_EQ(hSlice[0], 0.25);
+        EXPECT_EQ(hSlice[1], 0.125);
+        EXPECT_THROW(snap.readField("h", 3, 2, hSlice.data()), std::runtime_error);
+    }
+
+    std::filesystem::remove(path);
+    EXPECT_FALSE(isNativeSnapshot(path));
+}
+
+TEST(NativeSnapshot, losslessCodec)
+{
+    std::vector<double> smooth(10000);
+    for (size_t i = 0; i < smooth.size(); ++i)
+    {
+        smooth[i] = std::sin(1e-3 * i);
+    }
+    auto encoded = encodeShuffleDelta(smooth.data(), smooth.size());
+    EXPECT_LT(encoded.size(), smooth.size() * sizeof(double));
+
+    std::vector<double> decoded(smooth.size());
+    decodeShuffleDelta(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+    EXPECT_EQ(decoded, smooth);
+
+    // sorted keys compress well, runs longer than a PackBits block and wrap-around deltas are handled
+    std::vector<uint64_t> keys(5000, 42);
+    for (size_t i = 2500; i < keys.size(); ++i)
+    {
+        keys[i] = i * i;
+    }
+    keys.back() = 0;
+    auto encodedKeys = encodeShuffleDelta(keys.data(), keys.size());
+    EXPECT_LT(encodedKeys.size(), keys.size() * sizeof(uint64_t) / 2);
+
+    std::vector<uint64_t> decodedKeys(keys.size());
+    decodeShuffleDelta(encodedKeys.data(), encodedKeys.size(), decodedKeys.data(), decodedKeys.size());
+    EXPECT_EQ(decodedKeys, keys);
+
+    EXPECT_THROW(decodeShuffleDelta(encodedKeys.data(), encodedKeys.size() - 1, decodedKeys.data(), keys.size()),
+                 std::runtime_error);
+}
+
+TEST(NativeSnapshot, lossyCodec)
+{
+    std::vector<float> values(1000);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = 100.f * std::cos(0.01f * i) - 3.f;
+    }
+
+    double errorBound = 1e-3;
+    auto   encoded    = encodeQuantized(values.data(), values.size(), errorBound);
+
+    std::vector<float> decoded(values.size());
+    decodeQuantized(encoded.data(), encoded.size(), decoded.data(), decoded.size(), errorBound);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        // tolerance includes the rounding of the decoded value to float
+        EXPECT_NEAR(decoded[i], values[i], errorBound * (1 + 1e-3));
+    }
+
+    EXPECT_TRUE(quantizable(100, 1e-5));
+    EXPECT_FALSE(quantizable(1e20, 1e-5));
+    EXPECT_FALSE(quantizable(std::numeric_limits<double>::infinity(), 1e-5));
+}
+
+//! @brief compressed fields are decoded transparently by readField, but not accessible through field()
+TEST(NativeSnapshot, readCompressed)
+{
+    std::string path = "native_snapshot_compressed_test.snap";
+
+    size_t              numParticles = 3 * nativeChunkSize / 2;
+    std::vector<double> x(numParticles);
+    std::iota(x.begin(), x.end(), 0.5);
+
+    auto table = nativeFieldTable({"x"}, {NativeType::float64}, numParticles);
+
+    std::vector<NativeChunk>          chunks;
+    std::vector<std::vector<uint8_t>> encoded;
+    uint64_t                          offset = 2 * sizeof(NativeChunk);
+    for (size_t first = 0; first < numParticles; first += nativeChunkSize)
+    {
+        size_t count = std::min(nativeChunkSize, numParticles - first);
+        encoded.push_back(encodeShuffleDelta(x.data() + first, count));
+        chunks.push_back({first, count, offset, encoded.back().size()});
+        offset += encoded.back().size();
+    }
+    table[0].codec       = NativeCodec::shuffleDelta;
+    table[0].numChunks   = chunks.size();
+    table[0].storedBytes = offset;
+
+    NativeHeader header{};
+    header.numParticles = numParticles;
+    auto headerBytes    = serializeNativeHeader(header, table);
+
+    {
+        std::vector<char> file(nativeFileSize(table), 0);
+        std::copy(headerBytes.begin(), headerBytes.end(), file.begin());
+        std::memcpy(file.data() + table[0].offset, chunks.data(), chunks.size() * sizeof(NativeChunk));
+        for (size_t c = 0; c < chunks.size(); ++c)
+        {
+            std::copy(encoded[c].begin(), encoded[c].end(), file.begin() + table[0].offset + chunks[c].offset);
+        }
+
+        FILE* fp = std::fopen(path.c_str(), "wb");
+        std::fwrite(file.data(), 1, file.size(), fp);
+        std::fclose(fp);
+    }
+
+    {
+        NativeSnapshot snap(path);
+        EXPECT_THROW(snap.field<double>("x"), std::runtime_error);
+
+        std::vector<double> all(numParticles);
+        snap.readField("x", 0, numParticles, all.data());
+        EXPECT_EQ(all, x);
+
+        // a range across the chunk boundary
+        std::vector<float> slice(10);
+        snap.readField("x", nativeChunkSize - 5, slice.size(), slice.data());
+        for (size_t i = 0; i < slice.size(); ++i)
+        {
+            EXPECT_EQ(slice[i], float(x[nativeChunkSize - 5 + i]));
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+//! @brief write a snapshot with uncompressed columns of the given types and raw contents
+static void writeColumns(const std::string& path, uint64_t numParticles, const std::vector<std::string>& names,
+                         const std::vector<NativeType>& types, const std::vector<std::vector<char>>& columns)
+{
+    std::vector<uint64_t> counts;
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        counts.push_back(columns[i].size() / nativeTypeSize(types[i]));
+    }
+    auto table = nativeFieldTable(names, types, counts);
+
+    NativeHeader header{};
+    header.numParticles = numParticles;
+    auto headerBytes    = serializeNativeHeader(header, table);
+
+    std::vector<char> file(nativeFileSize(table), 0);
+    std::copy(headerBytes.begin(), headerBytes.end(), file.begin());
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        std::copy(columns[i].begin(), columns[i].end(), file.begin() + table[i].offset);
+    }
+
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    std::fwrite(file.data(), 1, file.size(), fp);
+    std::fclose(fp);
+}
+
+template<class T>
+static std::vector<char> toBytes(const std::vector<T>& v)
+{
+    auto* begin = reinterpret_cast<const char*>(v.data());
+    return {begin, begin + v.size() * sizeof(T)};
+}
+
+//! @brief a delta with one changed block between two unchanged blocks is resolved against the full snapshot
+TEST(NativeSnapshot, deltaChain)
+{
+    std::string fullPath  = "native_delta_test_full.snap";
+    std::string deltaPath = "native_delta_test_1.snap";
+
+    std::vector<double> x(10);
+    std::iota(x.begin(), x.end(), 0.0);
+    writeColumns(fullPath, x.size(), {"x"}, {NativeType::float64}, {toBytes(x)});
+
+    std::vector<double>   changed{40, 50, 60};
+    std::string           sources = fullPath + "\n" + deltaPath;
+    std::vector<uint64_t> blocks{0, 4, 0, 0, 4, 3, 1, 0, 7, 3, 0, 7};
+    writeColumns(deltaPath, x.size(), {"x", nativeDeltaSources, nativeDeltaBlocks},
+                 {NativeType::float64, NativeType::uint8, NativeType::uint64},
+                 {toBytes(changed), std::vector<char>(sources.begin(), sources.end()), toBytes(blocks)});
+
+    {
+        NativeCheckpoint full(fullPath);
+        EXPECT_FALSE(full.isDelta());
+
+        NativeCheckpoint delta(deltaPath);
+        EXPECT_TRUE(delta.isDelta());
+        EXPECT_EQ(delta.chainLength(), 2);
+
+        std::vector<double> all(x.size());
+        delta.readField("x", 0, x.size(), all.data());
+        EXPECT_EQ(all, (std::vector<double>{0, 1, 2, 3, 40, 50, 60, 7, 8, 9}));
+
+        std::vector<float> slice(4);
+        delta.readField("x", 3, slice.size(), slice.data());
+        EXPECT_EQ(slice, (std::vector<float>{3, 40, 50, 60}));
+
+        EXPECT_THROW(delta.readField("x", 8, 3, all.data()), std::runtime_error);
+    }
+
+    // block table that does not cover all particles
+    blocks.resize(8);
+    writeColumns(deltaPath, x.size(), {"x", nativeDeltaSources, nativeDeltaBlocks},
+                 {NativeType::float64, NativeType::uint8, NativeType::uint64},
+                 {toBytes(changed), std::vector<char>(sources.begin(), sources.end()), toBytes(blocks)});
+    EXPECT_THROW(NativeCheckpoint{deltaPath}, std::runtime_error);
+
+    std::filesystem::remove(fullPath);
+    std::filesystem::remove(deltaPath);
+}
@@ -0,0 +1,168 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 CSCS, ETH Zurich, University of Basel, University of Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Tests for the particle selection of output streams
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "cstone/sfc/sfc.hpp"
+#include "cstone/tree/octree.hpp"
+#include "io/output_stream.hpp"
+
+using namespace sphexa;
+
+TEST(OutputStream, parse)
+{
+    auto stream = parseOutputStream("core:f=x,y,z,rho:w=5:sphere=0,0.5,0,0.25:every=10");
+    EXPECT_EQ(stream.name, "core");
+    EXPECT_EQ(stream.fields, (std::vector<std::string>{"x", "y", "z", "rho"}));
+    EXPECT_EQ(stream.frequency, "5");
+    EXPECT_EQ(stream.decimation, 10);
+    EXPECT_EQ(stream.region.shape, OutputRegion::Shape::sphere);
+    EXPECT_EQ(stream.region.param[1], 0.5);
+    EXPECT_EQ(stream.region.param[3], 0.25);
+    EXPECT_TRUE(stream.isOutputStep(10, 0, 1));
+    EXPECT_FALSE(stream.isOutputStep(11, 0, 1));
+
+    auto slab = parseOutputStream("slice:slab=z,-0.1,0.1");
+    EXPECT_EQ(slab.region.shape, OutputRegion::Shape::slab);
+    EXPECT_EQ(slab.region.axis, 2);
+    EXPECT_TRUE(slab.fields.empty());
+    EXPECT_TRUE(slab.frequency.empty());
+
+    EXPECT_THROW(parseOutputStream("f=x,y"), std::runtime_error);
+    EXPECT_THROW(parseOutputStream("a:sphere=0,0,1"), std::runtime_error);
+    EXPECT_THROW(parseOutputStream("a:slab=w,0,1"), std::runtime_error);
+    EXPECT_THROW(parseOutputStream("a:color=red"), std::runtime_error);
+
+    auto region = parseRegion("box=0,1,0,2,0,3");
+    EXPECT_EQ(region.shape, OutputRegion::Shape::box);
+    EXPECT_TRUE(region.contains(0.5, 1.5, 2.5));
+    EXPECT_FALSE(region.contains(0.5, 1.5, 3.5));
+    EXPECT_THROW(parseRegion("0,1,0,1,0,1"), std::runtime_error);
+    EXPECT_THROW(parseRegion("every=2"), std::runtime_error);
+}
+
+TEST(OutputStream, overlap)
+{
+    cstone::FBox<double> cell{0.0, 0.25, 0.0, 0.25, 0.0, 0.25};
+
+    OutputRegion sphere = parseOutputStream("s:sphere=0,0,0,1").region;
+    EXPECT_EQ(sphere.overlap(cell), OutputRegion::inside);
+    sphere.param[3] = 0.2;
+    EXPECT_EQ(sphere.overlap(cell), OutputRegion::partial);
+    sphere.param[0] = -0.3;
+    EXPECT_EQ(sphere.overlap(cell), OutputRegion::outside);
+
+    OutputRegion box = parseOutputStream("b:box=0.1,1,-1,1,-1,1").region;
+    EXPECT_EQ(box.overlap(cell), OutputRegion::partial);
+    box.param[0] = 0.25;
+    EXPECT_EQ(box.overlap(cell), OutputRegion::outside);
+
+    OutputRegion slab = parseOutputStream("s:slab=y,-1,0.5").region;
+    EXPECT_EQ(slab.overlap(cell), OutputRegion::inside);
+}
+
+/*! @brief leaf-based selection gives the same result as testing each particle and decimation does not
+ *  depend on how the particles are split into ranges
+ */
+TEST(OutputStream, select)
+{
+    using KeyType = uint64_t;
+    using T       = double;
+
+    size_t                            n = 20000;
+    cstone::Box<T>                    box(-1, 1);
+    std::mt19937                      gen(42);
+    std::uniform_real_distribution<T> dis(-1, 1);
+
+    std::vector<T> x(n), y(n), z(n);
+    std::generate(x.begin(), x.end(), [&] { return dis(gen); });
+    std::generate(y.begin(), y.end(), [&] { return dis(gen); });
+    std::generate(z.begin(), z.end(), [&] { return dis(gen); });
+
+    std::vector<KeyType> keys(n);
+    cstone::computeSfcKeys(x.data(), y.data(), z.data(), cstone::sfcKindPointer(keys.data()), n, box);
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+    std::vector<T>       xs(n), ys(n), zs(n);
+    std::vector<KeyType> sortedKeys(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        xs[i]         = x[order[i]];
+        ys[i]         = y[order[i]];
+        zs[i]         = z[order[i]];
+        sortedKeys[i] = keys[order[i]];
+    }
+    auto [leaves, counts] = cstone::computeOctree(sortedKeys.data(), sortedKeys.data() + n, 64);
+
+    for (std::string spec : {"a:sphere=0.1,-0.2,0.3,0.4", "b:box=-0.5,0.2,0,1,-1,-0.3", "c:slab=x,0.25,0.5"})
+    {
+        auto stream    = parseOutputStream(spec);
+        auto selection = selectStreamParticles<KeyType>(stream, xs.data(), ys.data(), zs.data(), 0, n,
+                                                        leaves, counts, box);
+
+        std::vector<cstone::LocalIndex> reference;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (stream.region.contains(xs[i], ys[i], zs[i])) { reference.push_back(i); }
+        }
+        EXPECT_EQ(selection, reference);
+        EXPECT_GT(selection.size(), 0);
+    }
+
+    auto   every10   = parseOutputStream("d:every=10");
+    auto   selection = selectStreamParticles<KeyType>(every10, xs.data(), ys.data(), zs.data(), 0, n, leaves, counts,
+                                                      box);
+    double fraction  = double(selection.size()) / n;
+    EXPECT_NEAR(fraction, 0.1, 0.01);
+
+    // without leaf counts, the second half alone selects the same particles
+    auto secondHalf = selectStreamParticles<KeyType>(every10, xs.data(), ys.data(), zs.data(), n / 2, n,
+                                                     gsl::span<const KeyType>{}, gsl::span<const unsigned>{}, box);
+    std::vector<cstone::LocalIndex> reference;
+    std::copy_if(selection.begin(), selection.end(), std::back_inserter(reference),
+                 [n](cstone::LocalIndex i) { return i >= n / 2; });
+    EXPECT_EQ(secondHalf, reference);
+
+    // particles that move less than a decimation cell in the next frame mostly stay selected
+    std::vector<T> xm(n);
+    std::transform(xs.begin(), xs.end(), xm.begin(), [](T v) { return std::min(v + 1e-4, 1.0); });
+    auto moved = selectStreamParticles<KeyType>(every10, xm.data(), ys.data(), zs.data(), 0, n,
+                                                gsl::span<const KeyType>{}, gsl::span<const unsigned>{}, box);
+    std::vector<cstone::LocalIndex> common;
+    std::set_intersection(selection.begin(), selection.end(), moved.begin(), moved.end(), std::back_inserter(common));
+    EXPECT_GT(common.size(), 0.9 * selection.size());
+}
@@ -0,0 +1,92 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 CSCS, ETH Zurich, University of Basel, University of Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Snapshot SFC index tests
+ */
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/octree_util.hpp"
+#include "io/sfc_index.hpp"
+
+using namespace sphexa;
+
+TEST(SfcIndex, rankRanges)
+{
+    using KeyType = uint64_t;
+
+    SfcIndex<KeyType> index;
+    index.leaves = cstone::OctreeMaker<KeyType>{}.divide().makeTree();
+    index.counts = {10, 20, 30, 40, 10, 20, 30, 40};
+
+    EXPECT_TRUE(index.matches(200));
+    EXPECT_FALSE(index.matches(199));
+
+    // a single rank reads everything
+    EXPECT_EQ(index.range(0, 1), std::make_tuple(size_t(0), size_t(200)));
+
+    // ranges of consecutive ranks are contiguous, cover the file and follow leaf boundaries
+    int    numRanks = 3;
+    size_t prevEnd  = 0;
+    for (int rank = 0; rank < numRanks; ++rank)
+    {
+        auto [first, last] = index.range(rank, numRanks);
+        EXPECT_EQ(first, prevEnd);
+        prevEnd = last;
+    }
+    EXPECT_EQ(prevEnd, 200);
+    EXPECT_EQ(index.range(0, 2), std::make_tuple(size_t(0), size_t(100)));
+    EXPECT_EQ(index.range(1, 2), std::make_tuple(size_t(100), size_t(200)));
+
+    index.counts.pop_back();
+    EXPECT_FALSE(index.matches(160));
+}
+
+TEST(SfcIndex, focusTree)
+{
+    using KeyType = uint64_t;
+
+    SfcIndex<KeyType> index;
+    EXPECT_FALSE(index.hasFocus());
+
+    auto                  leaves = cstone::OctreeMaker<KeyType>{}.divide().divide(0).makeTree();
+    std::vector<unsigned> counts(cstone::nNodes(leaves), 1);
+    std::vector<char>     macs(cstone::nNodes(leaves) + 2, 0);
+    macs[3] = 1;
+
+    index.updateFocus(leaves, counts, macs);
+    EXPECT_TRUE(index.hasFocus());
+    EXPECT_TRUE(index.focusMatches());
+    EXPECT_EQ(index.numFocusLeaves, 15);
+    EXPECT_EQ(index.focusMacStatus(), macs);
+
+    // one MAC per node of an octree with 15 leaves and 2 internal nodes
+    index.focusMacs.pop_back();
+    EXPECT_FALSE(index.focusMatches());
+
+    index.clear();
+    EXPECT_FALSE(index.hasFocus());
+    EXPECT_EQ(index.numFocusLeaves, 0);
+}
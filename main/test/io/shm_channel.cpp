@@ -0,0 +1,165 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the shared-memory in-situ channel
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <memory>
+#include <numeric>
+
+#include "gtest/gtest.h"
+
+#include "io/shm_channel.hpp"
+
+using namespace sphexa;
+using fileutils::NativeType;
+
+//! @brief publish @p n particles with x = i + offset and id = i
+static bool publishFrame(ShmPublisher& publisher, uint64_t step, size_t n, double offset)
+{
+    ShmFrameInfo info{step, 0.1 * step, n, n, 0, 1, {0, 1, 0, 1, 0, 1}};
+    auto         fill = [n, offset](size_t f, void* dest)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (f == 0) { static_cast<double*>(dest)[i] = i + offset; }
+            else { static_cast<uint64_t*>(dest)[i] = i; }
+        }
+    };
+    return publisher.publish(info, {{"x", NativeType::float64, n}, {"id", NativeType::uint64, n}}, fill);
+}
+
+static std::string testSegment(const std::string& name) { return shmSegmentName(name, int(getpid())); }
+
+TEST(ShmChannel, publishConsume)
+{
+    ShmPublisher publisher(testSegment("publishConsume"));
+    EXPECT_THROW(ShmConsumer{publisher.name()}, std::runtime_error);
+
+    EXPECT_TRUE(publishFrame(publisher, 10, 100, 0.5));
+    ShmConsumer consumer(publisher.name());
+    {
+        ShmFrame frame = consumer.acquire(0);
+        ASSERT_TRUE(frame.valid());
+        EXPECT_EQ(frame.frame(), 1);
+        EXPECT_EQ(frame.info().step, 10);
+        EXPECT_EQ(frame.info().numParticles, 100);
+
+        auto x  = frame.field<double>("x");
+        auto id = frame.field<uint64_t>("id");
+        EXPECT_EQ(x.size(), 100);
+        EXPECT_EQ(x[42], 42.5);
+        EXPECT_EQ(id[99], 99);
+        EXPECT_EQ(frame.value(*frame.findField("id"), 7), 7.0);
+        EXPECT_THROW(frame.field<float>("x"), std::runtime_error);
+        EXPECT_EQ(frame.findField("y"), nullptr);
+    }
+    EXPECT_FALSE(consumer.acquire(1).valid());
+
+    EXPECT_TRUE(publishFrame(publisher, 11, 100, 1.5));
+    ShmFrame frame = consumer.acquire(1);
+    ASSERT_TRUE(frame.valid());
+    EXPECT_EQ(frame.info().step, 11);
+    EXPECT_EQ(frame.field<double>("x")[0], 1.5);
+}
+
+//! @brief the publisher drops frames instead of waiting for a consumer that holds a slot
+TEST(ShmChannel, dropWhenLocked)
+{
+    ShmPublisher publisher(testSegment("dropWhenLocked"));
+    EXPECT_TRUE(publishFrame(publisher, 1, 10, 0));
+
+    ShmConsumer consumer(publisher.name());
+    ShmFrame    held = consumer.acquire(0);
+    ASSERT_TRUE(held.valid());
+
+    // frame 2 goes into the other slot, frame 3 would overwrite the held frame
+    EXPECT_TRUE(publishFrame(publisher, 2, 10, 0));
+    EXPECT_FALSE(publishFrame(publisher, 3, 10, 0));
+    EXPECT_EQ(publisher.droppedFrames(), 1);
+    EXPECT_EQ(held.field<double>("x")[3], 3.0);
+
+    held = ShmFrame{};
+    EXPECT_TRUE(publishFrame(publisher, 4, 10, 0));
+    ShmFrame latest = consumer.acquire(1);
+    ASSERT_TRUE(latest.valid());
+    EXPECT_EQ(latest.frame(), 3);
+    EXPECT_EQ(latest.info().step, 4);
+}
+
+//! @brief frames that do not fit are published into a larger segment, consumers follow
+TEST(ShmChannel, grow)
+{
+    ShmPublisher publisher(testSegment("grow"), 1.0);
+    EXPECT_TRUE(publishFrame(publisher, 1, 10, 0));
+
+    ShmConsumer consumer(publisher.name());
+    EXPECT_TRUE(consumer.acquire(0).valid());
+
+    size_t n = 100000;
+    EXPECT_TRUE(publishFrame(publisher, 2, n, 0));
+    ShmFrame frame = consumer.acquire(1);
+    ASSERT_TRUE(frame.valid());
+    EXPECT_EQ(frame.info().step, 2);
+    EXPECT_EQ(frame.field<double>("x")[n - 1], double(n - 1));
+}
+
+//! @brief while the publisher replaces the segment, consumers see no new frame and keep the old one mapped
+TEST(ShmChannel, regrowWindow)
+{
+    std::string name = testSegment("regrowWindow");
+
+    auto publisher = std::make_unique<ShmPublisher>(name);
+    EXPECT_TRUE(publishFrame(*publisher, 1, 10, 0));
+    ShmConsumer consumer(name);
+    ShmFrame    held = consumer.acquire(0);
+    ASSERT_TRUE(held.valid());
+
+    // superseded and unlinked, the replacement does not exist yet
+    publisher.reset();
+    EXPECT_FALSE(consumer.acquire(1).valid());
+
+    // created, but not truncated yet
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    ASSERT_GE(fd, 0);
+    EXPECT_FALSE(consumer.acquire(1).valid());
+
+    // truncated, but the header is not initialized yet
+    ASSERT_EQ(ftruncate(fd, shmSlotOffset(shmNumSlots, 4096)), 0);
+    close(fd);
+    EXPECT_FALSE(consumer.acquire(1).valid());
+    EXPECT_EQ(held.field<double>("x")[3], 3.0);
+    shm_unlink(name.c_str());
+
+    publisher = std::make_unique<ShmPublisher>(name);
+    EXPECT_TRUE(publishFrame(*publisher, 2, 20, 0.5));
+    ShmFrame frame = consumer.acquire(0);
+    ASSERT_TRUE(frame.valid());
+    EXPECT_EQ(frame.info().step, 2);
+    EXPECT_EQ(frame.field<double>("x")[19], 19.5);
+    EXPECT_EQ(held.field<double>("x")[3], 3.0);
+}
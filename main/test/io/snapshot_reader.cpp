@@ -0,0 +1,161 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the field-selective snapshot reader
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "gtest/gtest.h"
+
+#include "io/snapshot_reader.hpp"
+
+using namespace sphexa;
+using namespace sphexa::fileutils;
+
+/*! @brief write a snapshot in the box [-1,1]^3 with one particle at the center of each octant
+ *
+ * Particles are in SFC order, field rho holds the particle index, the SFC index has one leaf per octant.
+ */
+static void writeOctantSnapshot(const std::string& path)
+{
+    using KeyType = uint64_t;
+    cstone::Box<double> box(-1, 1);
+
+    std::vector<KeyType>  leaves(9);
+    std::vector<unsigned> counts(8, 1);
+    std::vector<double>   x(8), y(8), z(8), rho(8);
+    for (int i = 0; i < 8; ++i)
+    {
+        leaves[i]   = i * cstone::nodeRange<KeyType>(1);
+        auto ibox   = cstone::sfcIBox(cstone::sfcKey(leaves[i]), 1);
+        auto center = cstone::createFpBox<KeyType>(ibox, box);
+        x[i]        = (center.xmin() + center.xmax()) / 2;
+        y[i]        = (center.ymin() + center.ymax()) / 2;
+        z[i]        = (center.zmin() + center.zmax()) / 2;
+        rho[i]      = i;
+    }
+    leaves[8] = cstone::nodeRange<KeyType>(0);
+
+    std::vector<std::string> names{"x", "y", "z", "rho", nativeSfcLeaves, nativeSfcCounts};
+    std::vector<NativeType>  types{NativeType::float64, NativeType::float64, NativeType::float64,
+                                  NativeType::float64, NativeType::uint64,  NativeType::uint32};
+    auto table = nativeFieldTable(names, types, {8, 8, 8, 8, leaves.size(), counts.size()});
+
+    NativeHeader header{};
+    header.numParticles = 8;
+    header.step         = 7;
+    for (int dim = 0; dim < 3; ++dim)
+    {
+        header.box[2 * dim]     = -1;
+        header.box[2 * dim + 1] = 1;
+    }
+    auto headerBytes = serializeNativeHeader(header, table);
+
+    std::vector<char> file(nativeFileSize(table), 0);
+    std::copy(headerBytes.begin(), headerBytes.end(), file.begin());
+    std::vector<const void*> columns{x.data(), y.data(), z.data(), rho.data(), leaves.data(), counts.data()};
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        std::memcpy(file.data() + table[i].offset, columns[i], table[i].count * table[i].elementSize);
+    }
+
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    std::fwrite(file.data(), 1, file.size(), fp);
+    std::fclose(fp);
+}
+
+TEST(SnapshotReader, readFields)
+{
+    std::string path = "snapshot_reader_test.snap";
+    writeOctantSnapshot(path);
+    {
+        NativeSnapshotReader reader({path});
+        EXPECT_EQ(reader.numSteps(), 1);
+        EXPECT_EQ(reader.numParticles(), 8);
+        EXPECT_EQ(reader.fieldNames(), (std::vector<std::string>{"x", "y", "z", "rho"}));
+        EXPECT_EQ(readAttribute(reader, "step")[0], 7);
+        EXPECT_EQ(readAttribute(reader, "box").size(), 6);
+
+        auto columns = readFields(reader, {"rho", "x"}, 2, 3);
+        EXPECT_EQ(columns[0], (std::vector<double>{2, 3, 4}));
+        EXPECT_EQ(columns[1].size(), 3);
+        EXPECT_THROW(readFields(reader, {"rho", "p"}, 0, 1), std::runtime_error);
+        EXPECT_THROW(readFields(reader, {nativeSfcCounts}, 0, 1), std::runtime_error);
+
+        SfcIndex<uint64_t> index;
+        ASSERT_TRUE(reader.sfcIndex(index));
+        uint64_t octant = cstone::nodeRange<uint64_t>(1);
+        EXPECT_EQ(sfcParticleRange(index, 3 * octant, 5 * octant), std::make_tuple(size_t(3), size_t(5)));
+        EXPECT_EQ(sfcParticleRange(index, 3 * octant + 1, 5 * octant - 1), std::make_tuple(size_t(3), size_t(5)));
+        EXPECT_EQ(sfcParticleRange(index, 0, 0), std::make_tuple(size_t(0), size_t(0)));
+    }
+    std::filesystem::remove(path);
+}
+
+//! @brief only the octants that overlap a region are read
+TEST(SnapshotReader, region)
+{
+    std::string path = "snapshot_reader_region_test.snap";
+    writeOctantSnapshot(path);
+    {
+        NativeSnapshotReader reader({path});
+
+        OutputRegion sphere;
+        sphere.shape = OutputRegion::Shape::sphere;
+        std::fill(sphere.param, sphere.param + 3, 0.5);
+        sphere.param[3] = 0.1;
+
+        auto ranges = regionParticleRanges(reader, sphere);
+        ASSERT_EQ(ranges.size(), 1);
+        EXPECT_EQ(std::get<1>(ranges[0]) - std::get<0>(ranges[0]), 1);
+
+        std::vector<double> selected;
+        forEachInRegion(reader, sphere, {"x", "rho"}, 4,
+                        [&selected](const std::vector<std::vector<double>>& c, const std::vector<size_t>& selection)
+                        {
+                            EXPECT_EQ(c.size(), 2);
+                            for (size_t i : selection)
+                            {
+                                EXPECT_EQ(c[0][i], 0.5);
+                                selected.push_back(c[1][i]);
+                            }
+                        });
+        EXPECT_EQ(selected, std::vector<double>{double(std::get<0>(ranges[0]))});
+
+        // all particles are at distance sqrt(3) / 2 from the origin
+        double center[3] = {0, 0, 0};
+        auto   profile   = radialProfile(reader, "rho", center, 1.0, 2, 3);
+        EXPECT_EQ(profile.count, (std::vector<uint64_t>{0, 8}));
+        EXPECT_EQ(profile.sum[1], 28);
+        EXPECT_EQ(profile.minimum[1], 0);
+        EXPECT_EQ(profile.maximum[1], 7);
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the halo exchange planner
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "propagator/halo_plan.hpp"
+#include "sph/particles_data.hpp"
+
+using namespace sphexa;
+
+using Fields = std::vector<std::string>;
+
+//! @brief the kernels of the standard SPH propagator
+static std::vector<HaloKernel> stdKernels()
+{
+    return {{"Density", {"m"}, {}, {"rho"}},
+            {"EOS", {}, {"temp", "rho"}, {"p", "c"}, true},
+            {"IAD", {"m", "rho"}, {}, {"c11", "c12"}},
+            {"MomentumEnergy", {"m", "vx", "rho", "p", "c", "c11", "c12"}, {}, {"ax", "du"}}};
+}
+
+TEST(HaloPlan, mergeAndRecompute)
+{
+    auto schedule = planHaloExchanges(stdKernels(), {"x", "m"});
+
+    // p and c are recomputed from the exchanged density and temperature before the momentum kernel
+    EXPECT_EQ(schedule.numUnmerged, 4);
+    EXPECT_EQ(schedule.numExchanges(), 2);
+    EXPECT_TRUE(schedule.exchanges[0].empty());
+    EXPECT_TRUE(schedule.exchanges[1].empty());
+    EXPECT_EQ(schedule.exchanges[2], (Fields{"rho", "vx"}));
+    EXPECT_EQ(schedule.exchanges[3], (Fields{"c11", "c12", "temp"}));
+    EXPECT_EQ(schedule.recompute[3], (Fields{"EOS"}));
+}
+
+//! @brief recomputation that needs as many additional fields as it saves is not chosen
+TEST(HaloPlan, exchangeOnTie)
+{
+    std::vector<HaloKernel> kernels{{"XMass", {"m"}, {}, {"xm"}},
+                                    {"Gradh", {"m", "xm"}, {}, {"kx", "gradh"}},
+                                    {"EOS", {}, {"temp", "kx", "xm", "gradh"}, {"prho", "c"}, true},
+                                    {"Iad", {"vx", "kx", "xm"}, {}, {"c11", "divv"}},
+                                    {"AV", {"vx", "c", "divv"}, {"alpha"}, {"alpha"}},
+                                    {"Momentum", {"vx", "prho", "c", "alpha", "c11"}, {}, {"ax"}}};
+
+    auto schedule = planHaloExchanges(kernels, {"x", "m"});
+
+    EXPECT_EQ(schedule.numUnmerged, 6);
+    EXPECT_EQ(schedule.numExchanges(), 4);
+    EXPECT_EQ(schedule.exchanges[1], (Fields{"xm", "vx"}));
+    EXPECT_EQ(schedule.exchanges[3], (Fields{"kx", "c"}));
+    EXPECT_EQ(schedule.exchanges[4], (Fields{"divv", "prho"}));
+    EXPECT_EQ(schedule.exchanges[5], (Fields{"alpha", "c11"}));
+    for (const auto& r : schedule.recompute)
+    {
+        EXPECT_TRUE(r.empty());
+    }
+}
+
+TEST(HaloPlan, invalidDependencies)
+{
+    EXPECT_THROW(planHaloExchanges({{"A", {"b"}, {}, {"a"}}, {"B", {}, {}, {"b"}}}, {}), std::runtime_error);
+    EXPECT_THROW(planHaloExchanges({{"A", {}, {}, {"a"}}, {"B", {}, {}, {"a"}}}, {}), std::runtime_error);
+}
+
+TEST(HaloPlan, runStage)
+{
+    ParticlesData<double, unsigned, cstone::CpuTag> d;
+    d.setConserved("x", "m", "vx", "temp");
+    d.setDependent("rho", "p", "c", "c11", "c12");
+    d.resize(10);
+
+    auto schedule = planHaloExchanges(stdKernels(), {"x", "m"});
+
+    std::vector<std::string> recomputed;
+    std::vector<const void*> exchanged;
+    auto exchange = [&](auto fields, const Fields& names)
+    {
+        EXPECT_EQ(std::tuple_size_v<decltype(fields)>, names.size());
+        for_each_tuple([&exchanged](auto& v) { exchanged.push_back(&v); }, fields);
+    };
+    auto recompute = [&recomputed](const std::string& kernel) { recomputed.push_back(kernel); };
+
+    EXPECT_FALSE(runHaloStage(schedule, 1, d, exchange, recompute));
+    EXPECT_TRUE(recomputed.empty());
+    EXPECT_TRUE(runHaloStage(schedule, 3, d, exchange, recompute));
+    EXPECT_EQ(exchanged, (std::vector<const void*>{&d.c11, &d.c12, &d.temp}));
+    EXPECT_EQ(recomputed, Fields{"EOS"});
+
+    EXPECT_EQ(reducibleFieldMask({"rho", "vx", "c11"}, {"vx"}), 5);
+}
@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*! @file
+ * @brief Conservation of a propagator with reduced-precision halo exchanges
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <cmath>
+#include <fstream>
+
+#include "gtest/gtest.h"
+
+#include "cstone/domain/domain.hpp"
+#include "init/sedov_init.hpp"
+#include "observables/conserved_quantities.hpp"
+#include "propagator/ve_hydro.hpp"
+#include "sphexa/simulation_data.hpp"
+
+using namespace sphexa;
+
+using Dataset = SimulationData<double, uint64_t, cstone::CpuTag>;
+using Domain  = cstone::Domain<uint64_t, double, cstone::CpuTag>;
+
+struct Conserved
+{
+    double   etot, ecin, linmom;
+    uint64_t haloBytes;
+};
+
+//! @brief conserved quantities and the halo bytes sent by this rank after @p numSteps steps of a Sedov blast
+static Conserved runSedov(cstone::HaloPrecision::Format format, int numSteps)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    std::ofstream nullOutput("/dev/null");
+    Dataset       simData;
+    simData.comm = MPI_COMM_WORLD;
+
+    HydroVeProp<Domain, Dataset> propagator(150, 100, nullOutput, rank);
+    propagator.setHaloPrecision(format);
+    propagator.activateFields(simData);
+
+    auto  box = SedovGrid<Dataset>{}.init(rank, numRanks, 16, simData);
+    auto& d   = simData.hydro;
+
+    Domain domain(rank, numRanks, 64, 64, 1.0, box);
+    propagator.sync(domain, simData);
+    for (int step = 0; step < numSteps; ++step)
+    {
+        propagator.step(domain, simData);
+    }
+
+    computeConservedQuantities(domain.startIndex(), domain.endIndex(), d, simData.reductions, simData.comm);
+    const auto& volume = domain.haloExchangeVolume();
+    return {d.etot, d.ecin, d.linmom, volume.intraNode + volume.interNode};
+}
+
+/*! @brief reduced-precision halos of derived fields send fewer bytes and conserve energy and momentum as well as
+ *         exact halos
+ *
+ * Sedov conserves the total energy of 1 and has no net momentum by symmetry. The blast wave is developing during
+ * the steps, such that differences in the kernel inputs show up in the kinetic energy.
+ *
+ * scaled16 is not less accurate than float32 here: most halo messages of the Sedov grid lie outside of the blast,
+ * where derived fields such as xm or kx are uniform. scaled16 sends the minimum of each message as a double, uniform
+ * messages therefore arrive exactly, while float32 rounds every value to 24 bits.
+ */
+TEST(HaloPrecision, conservation)
+{
+    int numSteps = 20;
+
+    Conserved exact = runSedov(cstone::HaloPrecision::exact, numSteps);
+    EXPECT_NEAR(exact.etot, 1.0, 1e-6);
+    EXPECT_GT(exact.ecin, 1e-6);
+
+    for (auto format : {cstone::HaloPrecision::float32, cstone::HaloPrecision::scaled16})
+    {
+        Conserved reduced = runSedov(format, numSteps);
+        EXPECT_LT(reduced.haloBytes, exact.haloBytes);
+        EXPECT_NE(reduced.ecin, exact.ecin);
+        EXPECT_NEAR(reduced.etot, exact.etot, 1e-8);
+        EXPECT_NEAR(reduced.ecin, exact.ecin, 1e-5 * exact.ecin);
+        // the momentum of unit mass with the kinetic energy of the blast is sqrt(2 * ecin)
+        EXPECT_LT(reduced.linmom, 1e-10 * std::sqrt(2 * exact.ecin));
+    }
+}
@@ -33,7 +33,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <vector>
 
 #include "cstone/focus/octree_focus_mpi.hpp"
 #include "ryoanji/nbody/upsweep_cpu.hpp"
@@ -68,4 +71,254 @@ void computeGlobalMultipoles(const Tc* x, const Tc* y, const Tc* z, const Tm* m,
     ryoanji::upsweepMultipoles(octree.levelRange(), octree.childOffsets(), centers.data(), multipoles);
 }
 
+/*! @brief Global multipoles, recomputed incrementally from the state of the previous call
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ * @tparam Tf       float or double, focus tree expansion center type
+ * @tparam MType    Multipole type, e.g. CartesianQuadrupole
+ *
+ * Produces the same multipoles as computeGlobalMultipoles. Cells of the current focus tree are matched to cells of
+ * the previous call by their SFC keys. A leaf cell of the local domain is dirty if it's new, if its expansion center
+ * or its particle count changed, or if it contains a particle flagged as changed by the caller. Leaves that were not
+ * part of the local domain in the previous call count as empty there. Only dirty leaves are recomputed with P2M, and
+ * M2M is only applied to cells with a dirty child or a changed center.
+ * Clean cells take their multipoles from the previous call. Leaf cells of peer ranks are only received if they
+ * changed on the owning rank, unless the peer treelet changed, in which case all of its cells are exchanged.
+ *
+ * All ranks need to call compute() in lockstep with the same history, i.e. either all or none have called reset().
+ */
+template<class KeyType, class Tf, class MType>
+class IncrementalMultipoles
+{
+public:
+    IncrementalMultipoles() = default;
+
+    //! @brief discard the state of the previous call, the next call will recompute all multipoles
+    void reset() { valid_ = false; }
+
+    /*! @brief compute the multipoles of all cells of @p focusTree into @p multipoles
+     *
+     * @param changed     per particle, nonzero if x, y, z or m changed since the previous call, in the same order as
+     *                    x. nullptr flags all particles, e.g. if all particles moved with a common time-step.
+     * @param multipoles  on entry, the result of the previous call, unless reset() was called since.
+     *                    Resized to the number of focus tree cells. Its previous content is kept as reference
+     *                    for the next call by swapping buffers, callers must not modify it in between.
+     */
+    template<class Tc, class Tm>
+    void compute(const Tc* x, const Tc* y, const Tc* z, const Tm* m, const uint8_t* changed,
+                 const cstone::Octree<KeyType>&                            globalOctree,
+                 const cstone::FocusedOctree<KeyType, Tf, cstone::CpuTag>& focusTree,
+                 const cstone::LocalIndex* layout, std::vector<MType>& multipoles)
+    {
+        const cstone::Octree<KeyType>& octree = focusTree.octree();
+
+        auto          centers       = focusTree.expansionCenters();
+        auto          globalCenters = focusTree.globalExpansionCenters();
+        auto          levelRange    = octree.levelRange();
+        auto          childOffsets  = octree.childOffsets();
+        auto          leafToInt     = octree.internalOrder();
+        TreeNodeIndex numNodes      = octree.numTreeNodes();
+
+        int myRank;
+        MPI_Comm_rank(focusTree.comm(), &myRank);
+        TreeNodeIndex firstLeaf  = focusTree.assignment()[myRank].start();
+        TreeNodeIndex lastLeaf   = focusTree.assignment()[myRank].end();
+        KeyType       focusStart = focusTree.treeLeaves()[firstLeaf];
+        KeyType       focusEnd   = focusTree.treeLeaves()[lastLeaf];
+
+        matchPrevious(octree);
+        std::swap(prevMultipoles_, multipoles);
+        multipoles.resize(numNodes);
+
+        dirty_.resize(numNodes);
+        own_.resize(numNodes);
+        counts_.assign(numNodes, 0);
+        numM2M_ = 0;
+
+#pragma omp parallel for schedule(static)
+        for (TreeNodeIndex i = 0; i < numNodes; ++i)
+        {
+            own_[i] = octree.codeStart(i) >= focusStart && octree.codeEnd(i) <= focusEnd;
+        }
+
+        //! P2M for changed leaves of the local domain
+        TreeNodeIndex numP2M = 0;
+#pragma omp parallel for schedule(static) reduction(+ : numP2M)
+        for (TreeNodeIndex leafIdx = firstLeaf; leafIdx < lastLeaf; ++leafIdx)
+        {
+            TreeNodeIndex i = leafToInt[leafIdx];
+            TreeNodeIndex j = prevIndex_[i];
+            counts_[i]      = layout[leafIdx + 1] - layout[leafIdx];
+            bool clean      = j >= 0 && prevCounts_[j] == counts_[i] && sameBits(centers[i], prevCenters_[j]) &&
+                              !anyChanged(changed, layout[leafIdx], layout[leafIdx + 1]);
+            dirty_[i]       = !clean;
+            if (clean) { multipoles[i] = prevMultipoles_[j]; }
+            else
+            {
+                particle2Multipole(x, y, z, m, layout[leafIdx], layout[leafIdx + 1], makeVec3(centers[i]),
+                                   multipoles[i]);
+                numP2M++;
+            }
+        }
+        numP2M_ = numP2M;
+
+        //! first upsweep, restricted to cells that only contain leaves of the local domain
+        upsweepDirty(levelRange, childOffsets, centers, multipoles.data(),
+                     [this](TreeNodeIndex i) { return !own_[i]; });
+
+        auto ryUpsweep = [](auto levelRange, auto childOffsets, auto M, auto centers)
+        { ryoanji::upsweepMultipoles(levelRange, childOffsets, centers, M); };
+        gsl::span multipoleSpan{multipoles.data(), size_t(numNodes)};
+        cstone::globalFocusExchange(globalOctree, focusTree, multipoleSpan, ryUpsweep, globalCenters.data());
+
+        //! peer leaf cells that are not received keep the values from the previous call
+        std::vector<char> sendAll(focusTree.treelets().size(), 1);
+        if (valid_)
+        {
+            for (size_t rank = 0; rank < sendAll.size(); ++rank)
+            {
+                sendAll[rank] = focusTree.treelets()[rank] != prevTreelets_[rank];
+                if (int(rank) == myRank) { continue; }
+
+                auto range = focusTree.assignment()[rank];
+                for (TreeNodeIndex leafIdx = range.start(); leafIdx < range.end(); ++leafIdx)
+                {
+                    TreeNodeIndex i = leafToInt[leafIdx];
+                    if (prevIndex_[i] >= 0) { multipoles[i] = prevMultipoles_[prevIndex_[i]]; }
+                }
+            }
+        }
+        focusTree.peerExchangeChanged(multipoleSpan, gsl::span<const char>(dirty_), gsl::span<const char>(sendAll),
+                                      static_cast<int>(cstone::P2pTags::focusPeerCenters) + 2);
+
+        //! leaves outside the local domain are dirty if they received a different value
+#pragma omp parallel for schedule(static)
+        for (TreeNodeIndex leafIdx = 0; leafIdx < TreeNodeIndex(leafToInt.size()); ++leafIdx)
+        {
+            if (firstLeaf <= leafIdx && leafIdx < lastLeaf) { continue; }
+
+            TreeNodeIndex i = leafToInt[leafIdx];
+            TreeNodeIndex j = prevIndex_[i];
+            dirty_[i]       = j < 0 || !sameBits(multipoles[i], prevMultipoles_[j]);
+        }
+
+        //! second upsweep with leaf data from peer and global ranks in place
+        upsweepDirty(levelRange, childOffsets, centers, multipoles.data(),
+                     [this](TreeNodeIndex i) { return bool(own_[i]); });
+
+        saveState(octree, focusTree);
+    }
+
+    //! @brief number of leaf cells recomputed with P2M in the last call
+    TreeNodeIndex numP2M() const { return numP2M_; }
+    //! @brief number of internal cells recomputed with M2M in the last call
+    TreeNodeIndex numM2M() const { return numM2M_; }
+
+private:
+    template<class V>
+    static bool sameBits(const V& a, const V& b)
+    {
+        return std::memcmp(&a, &b, sizeof(V)) == 0;
+    }
+
+    //! @brief whether any particle in [first:last] is flagged in @p changed
+    static bool anyChanged(const uint8_t* changed, LocalIndex first, LocalIndex last)
+    {
+        if (changed == nullptr) { return first < last; }
+        return std::any_of(changed + first, changed + last, [](uint8_t c) { return c != 0; });
+    }
+
+    //! @brief map each cell of @p octree to the index of the same cell in the previous call, or -1 if new
+    void matchPrevious(const cstone::Octree<KeyType>& octree)
+    {
+        auto nodeKeys   = octree.nodeKeys();
+        auto levelRange = octree.levelRange();
+        prevIndex_.assign(octree.numTreeNodes(), -1);
+        if (!valid_) { return; }
+
+        for (size_t level = 0; level + 1 < levelRange.size() && level + 1 < prevLevelRange_.size(); ++level)
+        {
+            auto first = prevKeys_.begin() + prevLevelRange_[level];
+            auto last  = prevKeys_.begin() + prevLevelRange_[level + 1];
+#pragma omp parallel for schedule(static)
+            for (TreeNodeIndex i = levelRange[level]; i < levelRange[level + 1]; ++i)
+            {
+                auto it = std::lower_bound(first, last, nodeKeys[i]);
+                if (it != last && *it == nodeKeys[i]) { prevIndex_[i] = it - prevKeys_.begin(); }
+            }
+        }
+    }
+
+    /*! @brief M2M for cells with a dirty child or a changed expansion center, bottom-up
+     *
+     * Cells for which @p skip returns true are left untouched. Clean cells take their value from the previous call.
+     */
+    template<class F>
+    void upsweepDirty(gsl::span<const TreeNodeIndex> levelRange, gsl::span<const TreeNodeIndex> childOffsets,
+                      gsl::span<const cstone::SourceCenterType<Tf>> centers, MType* multipoles, F&& skip)
+    {
+        TreeNodeIndex numM2M = 0;
+        for (int level = int(levelRange.size()) - 2; level >= 0; --level)
+        {
+#pragma omp parallel for schedule(static) reduction(+ : numM2M)
+            for (TreeNodeIndex i = levelRange[level]; i < levelRange[level + 1]; ++i)
+            {
+                TreeNodeIndex firstChild = childOffsets[i];
+                if (!firstChild || skip(i)) { continue; }
+
+                TreeNodeIndex j     = prevIndex_[i];
+                bool          dirty = j < 0 || !sameBits(centers[i], prevCenters_[j]);
+                for (TreeNodeIndex c = firstChild; c < firstChild + 8; ++c)
+                {
+                    dirty |= bool(dirty_[c]);
+                }
+
+                dirty_[i] = dirty;
+                if (dirty)
+                {
+                    multipole2Multipole(firstChild, firstChild + 8, centers[i], centers.data(), multipoles,
+                                        multipoles[i]);
+                    numM2M++;
+                }
+                else { multipoles[i] = prevMultipoles_[j]; }
+            }
+        }
+        numM2M_ += numM2M;
+    }
+
+    void saveState(const cstone::Octree<KeyType>& octree,
+                   const cstone::FocusedOctree<KeyType, Tf, cstone::CpuTag>& focusTree)
+    {
+        prevKeys_.assign(octree.nodeKeys().begin(), octree.nodeKeys().end());
+        prevLevelRange_.assign(octree.levelRange().begin(), octree.levelRange().end());
+        prevCenters_.assign(focusTree.expansionCenters().begin(), focusTree.expansionCenters().end());
+        prevTreelets_.resize(focusTree.treelets().size());
+        for (size_t rank = 0; rank < prevTreelets_.size(); ++rank)
+        {
+            prevTreelets_[rank].assign(focusTree.treelets()[rank].begin(), focusTree.treelets()[rank].end());
+        }
+        std::swap(prevCounts_, counts_);
+        valid_ = true;
+    }
+
+    bool valid_{false};
+
+    //! @brief focus tree structure, centers, multipoles and treelets of the previous call
+    std::vector<KeyType>                      prevKeys_;
+    std::vector<TreeNodeIndex>                prevLevelRange_;
+    std::vector<cstone::SourceCenterType<Tf>> prevCenters_;
+    std::vector<MType>                        prevMultipoles_;
+    std::vector<std::vector<KeyType>>         prevTreelets_;
+    //! @brief particle counts of the local leaf cells, 0 for all other cells
+    std::vector<LocalIndex> prevCounts_;
+
+    std::vector<TreeNodeIndex> prevIndex_;
+    std::vector<LocalIndex>    counts_;
+    std::vector<char>          dirty_;
+    std::vector<char>          own_;
+
+    TreeNodeIndex numP2M_{0};
+    TreeNodeIndex numM2M_{0};
+};
+
 } // namespace ryoanji
@@ -31,15 +31,45 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "cstone/traversal/traversal.hpp"
 #include "cstone/traversal/macs.hpp"
 #include "cstone/tree/octree_internal.hpp"
 #include "cstone/focus/source_center.hpp"
+#include "cstone/util/scratch_arena.hpp"
 #include "cartesian_qpole.hpp"
 
 namespace ryoanji
 {
 
+/*! @brief near- and far-field split of the interactions of one target group, see computeGravityGroup
+ *
+ * With @a ratioSq > 0, source cells that pass the MAC also with their acceptance radius enlarged by sqrt(ratioSq)
+ * are far-field. Their M2P contributions go to the far-field outputs, or are skipped if @a ax is nullptr.
+ *
+ * Alternatively, the far-field cells of an earlier classification can be kept fixed with @a frozen. These cells are
+ * skipped and their ancestors are always opened, while all remaining interactions are near-field. Near-field and
+ * the far-field of the frozen cells then add up to the full field, also after source cells moved across the
+ * classification radius.
+ */
+template<class T>
+struct FarFieldSplit
+{
+    //! @brief squared enlargement of the acceptance radius for far-field cells, 0 disables the classification
+    float ratioSq{0};
+    //! @brief locations to add the far-field accelerations and potential of the target group to
+    T* ax{nullptr};
+    T* ay{nullptr};
+    T* az{nullptr};
+    T* ugrav{nullptr};
+    //! @brief if not nullptr, the far-field cells found by the classification are appended here
+    std::vector<TreeNodeIndex>* cells{nullptr};
+    //! @brief far-field cells of an earlier classification, sorted by their SFC keys
+    gsl::span<const TreeNodeIndex> frozen{};
+};
+
 /*! @brief computes gravitational acceleration for all particles in the specified group
  *
  * @tparam KeyType            unsigned 32- or 64-bit integer type
@@ -63,14 +93,19 @@ namespace ryoanji
  * @param[inout] ay           location to add y-acceleration to
  * @param[inout] az           location to add z-acceleration to
  * @param[inout] ugrav        location to add gravitational potential to
+ * @param[inout] far          near- and far-field split, by default all interactions are near-field
  *
  * Note: acceleration output is added to destination
+ *
+ * With a far-field split, the near-field (P2P and M2P with close cells) is added to ax,ay,az,ugrav, while
+ * M2P contributions of distant cells go to the outputs of @p far. This allows evaluating the slowly changing
+ * far-field at a lower rate than the near-field.
  */
 template<class KeyType, class MType, class T1, class T2, class Tm>
 void computeGravityGroup(TreeNodeIndex groupIdx, const cstone::Octree<KeyType>& octree,
                          const cstone::SourceCenterType<T1>* centers, MType* multipoles, const LocalIndex* layout,
                          const T1* x, const T1* y, const T1* z, const T2* h, const Tm* m, float G, T1* ax, T1* ay,
-                         T1* az, T1* ugrav)
+                         T1* az, T1* ugrav, const FarFieldSplit<T1>& far = {})
 {
     LocalIndex firstTarget = layout[groupIdx];
     LocalIndex lastTarget  = layout[groupIdx + 1];
@@ -94,16 +129,35 @@ void computeGravityGroup(TreeNodeIndex groupIdx, const cstone::Octree<KeyType>&
      * the traversal routine to keep going. If the MAC passed, the multipole moments are applied
      * to the particles in the target box and traversal is stopped.
      */
-    auto descendOrM2P = [firstTarget, lastTarget, centers, multipoles, x, y, z, G, ax, ay, az, ugrav, &targetCenter,
-                         &targetSize](TreeNodeIndex idx)
+    auto descendOrM2P = [firstTarget, lastTarget, centers, multipoles, x, y, z, G, ax, ay, az, ugrav, &octree, &far,
+                         &targetCenter, &targetSize](TreeNodeIndex idx)
     {
         const auto& com = centers[idx];
         const auto& p   = multipoles[idx];
 
+        if (!far.frozen.empty())
+        {
+            // first frozen far-field cell that is not located before idx along the SFC
+            auto startsBefore = [&octree](TreeNodeIndex cell, KeyType key) { return octree.codeStart(cell) < key; };
+            auto it = std::lower_bound(far.frozen.begin(), far.frozen.end(), octree.codeStart(idx), startsBefore);
+            if (it != far.frozen.end() && *it == idx) { return false; }
+            if (it != far.frozen.end() && octree.codeStart(*it) < octree.codeEnd(idx)) { return true; }
+        }
+
         bool violatesMac = cstone::evaluateMac(makeVec3(com), com[3], targetCenter, targetSize);
 
         if (!violatesMac)
         {
+            bool isFar = far.ratioSq > 0 &&
+                         !cstone::evaluateMac(makeVec3(com), T1(far.ratioSq) * com[3], targetCenter, targetSize);
+            if (isFar && far.cells) { far.cells->push_back(idx); }
+            if (isFar && far.ax == nullptr) { return false; }
+
+            T1* ax_ = isFar ? far.ax : ax;
+            T1* ay_ = isFar ? far.ay : ay;
+            T1* az_ = isFar ? far.az : az;
+            T1* u_  = isFar ? far.ugrav : ugrav;
+
             LocalIndex numTargets = lastTarget - firstTarget;
 
 // apply multipole to all particles in group
@@ -112,12 +166,12 @@ void computeGravityGroup(TreeNodeIndex groupIdx, const cstone::Octree<KeyType>&
 #endif
             for (LocalIndex t = 0; t < numTargets; ++t)
             {
-                LocalIndex offset        = t + firstTarget;
-                auto [ax_, ay_, az_, u_] = multipole2Particle(x[offset], y[offset], z[offset], makeVec3(com), p);
-                *(ax + t) += G * ax_;
-                *(ay + t) += G * ay_;
-                *(az + t) += G * az_;
-                *(ugrav + t) += G * u_;
+                LocalIndex offset = t + firstTarget;
+                auto [axp, ayp, azp, up] = multipole2Particle(x[offset], y[offset], z[offset], makeVec3(com), p);
+                *(ax_ + t) += G * axp;
+                *(ay_ + t) += G * ayp;
+                *(az_ + t) += G * azp;
+                *(u_ + t) += G * up;
             }
         }
 
@@ -181,6 +235,140 @@ void computeGravityGroup(TreeNodeIndex groupIdx, const cstone::Octree<KeyType>&
     cstone::singleTraversal(octree.childOffsets().data(), descendOrM2P, leafP2P);
 }
 
+//! @brief tags for the per-thread single precision coordinate buffers of computeGravityGroupMixed
+struct MixedTargetScratch;
+struct MixedSourceScratch;
+
+/*! @brief mixed precision variant of computeGravityGroup
+ *
+ * Arguments as in computeGravityGroup. Tree traversal and MAC evaluation take place in the precision of the inputs,
+ * while P2P and M2P interactions are computed in single precision with coordinates relative to the center of the
+ * target group. The contributions of each source cell are summed in single precision and then added to the
+ * outputs in their original precision, such that rounding errors do not accumulate over the whole interaction list.
+ * Relative coordinates are small compared to absolute ones, which keeps the single precision distance vectors
+ * accurate for the close P2P interactions.
+ */
+template<class KeyType, class MType, class T1, class T2, class Tm>
+void computeGravityGroupMixed(TreeNodeIndex groupIdx, const cstone::Octree<KeyType>& octree,
+                              const cstone::SourceCenterType<T1>* centers, MType* multipoles, const LocalIndex* layout,
+                              const T1* x, const T1* y, const T1* z, const T2* h, const Tm* m, float G, T1* ax,
+                              T1* ay, T1* az, T1* ugrav)
+{
+    using Tf = float;
+
+    LocalIndex firstTarget = layout[groupIdx];
+    LocalIndex lastTarget  = layout[groupIdx + 1];
+    LocalIndex numTargets  = lastTarget - firstTarget;
+
+    Vec3<T1> tMin{x[firstTarget], y[firstTarget], z[firstTarget]};
+    Vec3<T1> tMax = tMin;
+    for (LocalIndex i = firstTarget; i < lastTarget; ++i)
+    {
+        Vec3<T1> tp{x[i], y[i], z[i]};
+        tMin = min(tp, tMin);
+        tMax = max(tp, tMax);
+    }
+
+    Vec3<T1> targetCenter = (tMax + tMin) * T2(0.5);
+    Vec3<T1> targetSize   = (tMax - tMin) * T2(0.5);
+
+    // target x,y,z,h,m in single precision, relative to the target center
+    Tf* tx = util::ThreadScratch<Tf, MixedTargetScratch>::get(5 * numTargets);
+    Tf* ty = tx + numTargets;
+    Tf* tz = ty + numTargets;
+    Tf* th = tz + numTargets;
+    Tf* tm = th + numTargets;
+    for (LocalIndex t = 0; t < numTargets; ++t)
+    {
+        tx[t] = Tf(x[t + firstTarget] - targetCenter[0]);
+        ty[t] = Tf(y[t + firstTarget] - targetCenter[1]);
+        tz[t] = Tf(z[t + firstTarget] - targetCenter[2]);
+        th[t] = Tf(h[t + firstTarget]);
+        tm[t] = Tf(m[t + firstTarget]);
+    }
+
+    auto descendOrM2P = [centers, multipoles, G, ax, ay, az, ugrav, numTargets, tx, ty, tz, &targetCenter,
+                         &targetSize](TreeNodeIndex idx)
+    {
+        const auto& com = centers[idx];
+
+        bool violatesMac = cstone::evaluateMac(makeVec3(com), com[3], targetCenter, targetSize);
+
+        if (!violatesMac)
+        {
+            Vec3<Tf> center{Tf(com[0] - targetCenter[0]), Tf(com[1] - targetCenter[1]), Tf(com[2] - targetCenter[2])};
+            CartesianQuadrupole<Tf> p;
+            std::copy(multipoles[idx].begin(), multipoles[idx].end(), p.begin());
+
+            for (LocalIndex t = 0; t < numTargets; ++t)
+            {
+                auto [axp, ayp, azp, up] = multipole2Particle(tx[t], ty[t], tz[t], center, p);
+                *(ax + t) += G * axp;
+                *(ay + t) += G * ayp;
+                *(az + t) += G * azp;
+                *(ugrav + t) += G * up;
+            }
+        }
+
+        return violatesMac;
+    };
+
+    auto leafP2P = [groupIdx, toLeaf = octree.toLeafOrder(), layout, x, y, z, h, m, G, ax, ay, az, ugrav, numTargets,
+                    tx, ty, tz, th, tm, &targetCenter](TreeNodeIndex idx)
+    {
+        TreeNodeIndex lidx = toLeaf[idx];
+
+        if (groupIdx != lidx)
+        {
+            LocalIndex firstSource = layout[lidx];
+            LocalIndex numSources  = layout[lidx + 1] - firstSource;
+
+            Tf* sx = util::ThreadScratch<Tf, MixedSourceScratch>::get(5 * numSources);
+            Tf* sy = sx + numSources;
+            Tf* sz = sy + numSources;
+            Tf* sh = sz + numSources;
+            Tf* sm = sh + numSources;
+            for (LocalIndex j = 0; j < numSources; ++j)
+            {
+                sx[j] = Tf(x[j + firstSource] - targetCenter[0]);
+                sy[j] = Tf(y[j + firstSource] - targetCenter[1]);
+                sz[j] = Tf(z[j + firstSource] - targetCenter[2]);
+                sh[j] = Tf(h[j + firstSource]);
+                sm[j] = Tf(m[j + firstSource]);
+            }
+
+            for (LocalIndex t = 0; t < numTargets; ++t)
+            {
+                auto [ax_, ay_, az_, u_] =
+                    particle2Particle(tx[t], ty[t], tz[t], th[t], sx, sy, sz, sh, sm, numSources);
+                *(ax + t) += G * ax_;
+                *(ay + t) += G * ay_;
+                *(az + t) += G * az_;
+                *(ugrav + t) += G * u_;
+            }
+        }
+        else
+        {
+            // source node == target node -> source contains target, avoid self gravity
+            for (LocalIndex t = 0; t < numTargets; ++t)
+            {
+                // 2 splits: [0:t] and [t+1:numTargets]
+                auto [ax_, ay_, az_, u_] = particle2Particle(tx[t], ty[t], tz[t], th[t], tx, ty, tz, th, tm, t);
+
+                LocalIndex tp1               = t + 1;
+                auto [ax2_, ay2_, az2_, u2_] = particle2Particle(tx[t], ty[t], tz[t], th[t], tx + tp1, ty + tp1,
+                                                                 tz + tp1, th + tp1, tm + tp1, numTargets - tp1);
+                *(ax + t) += G * (ax_ + ax2_);
+                *(ay + t) += G * (ay_ + ay2_);
+                *(az + t) += G * (az_ + az2_);
+                *(ugrav + t) += G * (u_ + u2_);
+            }
+        }
+    };
+
+    cstone::singleTraversal(octree.childOffsets().data(), descendOrM2P, leafP2P);
+}
+
 //! @brief repeats computeGravityGroup for all leaf node indices specified
 template<class KeyType, class MType, class T1, class T2, class Tm>
 void computeGravity(const cstone::Octree<KeyType>& octree, const cstone::SourceCenterType<T1>* centers,
@@ -197,6 +385,9 @@ void computeGravity(const cstone::Octree<KeyType>& octree, const cstone::SourceC
     }
 }
 
+//! @brief tag for the per-thread leaf potential buffers used to compute the gravitational energy
+struct GravityScratch;
+
 /*! @brief repeats computeGravityGroup for all leaf node indices specified
  *
  * only computes total gravitational energy, no potential per particle
@@ -220,12 +411,21 @@ void computeGravity(const cstone::Octree<KeyType>& octree, const cstone::SourceC
  * @param[inout] ax              location to add x-acceleration to
  * @param[inout] ay              location to add y-acceleration to
  * @param[inout] az              location to add z-acceleration to
- * @return                       total gravitational energy
+ * @param[in]    farRatioSq      far-field classification parameter, see FarFieldSplit
+ * @param[inout] axFar           location to add far-field x-acceleration to, or nullptr to skip the far-field
+ * @param[inout] ayFar           location to add far-field y-acceleration to
+ * @param[inout] azFar           location to add far-field z-acceleration to
+ * @param[inout] ugravFar        location to add the far-field potential per particle to
+ * @param[out]   farCells        if not nullptr, farCells[i - firstLeafIndex] will contain the far-field cells of
+ *                               target group i, sorted by their SFC keys
+ * @return                       total gravitational energy, excluding the far-field part if @p farRatioSq > 0
  */
 template<class KeyType, class MType, class T1, class T2, class Tm>
 T2 computeGravity(const cstone::Octree<KeyType>& octree, const cstone::SourceCenterType<T1>* centers, MType* multipoles,
                   const LocalIndex* layout, TreeNodeIndex firstLeafIndex, TreeNodeIndex lastLeafIndex, const T1* x,
-                  const T1* y, const T1* z, const T2* h, const Tm* m, float G, T1* ax, T1* ay, T1* az)
+                  const T1* y, const T1* z, const T2* h, const Tm* m, float G, T1* ax, T1* ay, T1* az,
+                  float farRatioSq = 0, T1* axFar = nullptr, T1* ayFar = nullptr, T1* azFar = nullptr,
+                  T1* ugravFar = nullptr, std::vector<TreeNodeIndex>* farCells = nullptr)
 {
     T1 egravTot = 0.0;
 
@@ -237,10 +437,12 @@ T2 computeGravity(const cstone::Octree<KeyType>& octree, const cstone::SourceCen
         maxNodeCount = std::max(maxNodeCount, std::size_t(layout[i + 1] - layout[i]));
     }
 
+    bool haveFar = axFar != nullptr;
+
 #pragma omp parallel
     {
-        T1 ugravThread[maxNodeCount];
-        T1 egravThread = 0.0;
+        T1* ugravThread = util::ThreadScratch<T1, GravityScratch>::get(maxNodeCount);
+        T1  egravThread = 0.0;
 
 #pragma omp for
         for (TreeNodeIndex leafIdx = firstLeafIndex; leafIdx < lastLeafIndex; ++leafIdx)
@@ -248,9 +450,109 @@ T2 computeGravity(const cstone::Octree<KeyType>& octree, const cstone::SourceCen
             LocalIndex firstTarget = layout[leafIdx];
             LocalIndex numTargets  = layout[leafIdx + 1] - firstTarget;
 
-            std::fill(ugravThread, ugravThread + maxNodeCount, 0);
+            FarFieldSplit<T1> far{farRatioSq};
+            if (haveFar)
+            {
+                far.ax    = axFar + firstTarget;
+                far.ay    = ayFar + firstTarget;
+                far.az    = azFar + firstTarget;
+                far.ugrav = ugravFar + firstTarget;
+            }
+            if (farCells)
+            {
+                far.cells = farCells + leafIdx - firstLeafIndex;
+                far.cells->clear();
+            }
+
+            std::fill(ugravThread, ugravThread + numTargets, 0);
             computeGravityGroup(leafIdx, octree, centers, multipoles, layout, x, y, z, h, m, G, ax + firstTarget,
-                                ay + firstTarget, az + firstTarget, ugravThread);
+                                ay + firstTarget, az + firstTarget, ugravThread, far);
+
+            for (LocalIndex i = 0; i < numTargets; ++i)
+            {
+                egravThread += m[i + firstTarget] * ugravThread[i];
+            }
+            if (farCells)
+            {
+                std::sort(far.cells->begin(), far.cells->end(), [&octree](TreeNodeIndex a, TreeNodeIndex b)
+                          { return octree.codeStart(a) < octree.codeStart(b); });
+            }
+        }
+
+#pragma omp atomic
+        egravTot += egravThread;
+    }
+
+    return 0.5 * egravTot;
+}
+
+/*! @brief add the M2P interactions of a list of source cells with the particles of target group @p groupIdx
+ *
+ * @param[in]    cells      source cell indices into @p centers and @p multipoles, e.g. frozen far-field cells
+ * @param[inout] ax         location to add x-acceleration of the first particle in @p groupIdx to
+ * @param[inout] ay         location to add y-acceleration to
+ * @param[inout] az         location to add z-acceleration to
+ * @param[inout] ugrav      location to add gravitational potential to
+ *
+ * Remaining arguments as in computeGravityGroup.
+ */
+template<class MType, class T1>
+void computeGravityCells(TreeNodeIndex groupIdx, const cstone::SourceCenterType<T1>* centers, const MType* multipoles,
+                         const LocalIndex* layout, const T1* x, const T1* y, const T1* z, float G,
+                         gsl::span<const TreeNodeIndex> cells, T1* ax, T1* ay, T1* az, T1* ugrav)
+{
+    LocalIndex firstTarget = layout[groupIdx];
+    LocalIndex numTargets  = layout[groupIdx + 1] - firstTarget;
+
+    for (TreeNodeIndex cell : cells)
+    {
+        const auto& com = centers[cell];
+        const auto& p   = multipoles[cell];
+        for (LocalIndex t = 0; t < numTargets; ++t)
+        {
+            LocalIndex offset = t + firstTarget;
+            auto [axp, ayp, azp, up] = multipole2Particle(x[offset], y[offset], z[offset], makeVec3(com), p);
+            ax[t] += G * axp;
+            ay[t] += G * ayp;
+            az[t] += G * azp;
+            ugrav[t] += G * up;
+        }
+    }
+}
+
+/*! @brief mixed precision variant of the energy-returning computeGravity, see computeGravityGroupMixed
+ *
+ * @return  total gravitational energy
+ */
+template<class KeyType, class MType, class T1, class T2, class Tm>
+T2 computeGravityMixed(const cstone::Octree<KeyType>& octree, const cstone::SourceCenterType<T1>* centers,
+                       MType* multipoles, const LocalIndex* layout, TreeNodeIndex firstLeafIndex,
+                       TreeNodeIndex lastLeafIndex, const T1* x, const T1* y, const T1* z, const T2* h, const Tm* m,
+                       float G, T1* ax, T1* ay, T1* az)
+{
+    T1 egravTot = 0.0;
+
+    std::size_t maxNodeCount = 0;
+#pragma omp parallel for reduction(max : maxNodeCount)
+    for (TreeNodeIndex i = 0; i < octree.numLeafNodes(); ++i)
+    {
+        maxNodeCount = std::max(maxNodeCount, std::size_t(layout[i + 1] - layout[i]));
+    }
+
+#pragma omp parallel
+    {
+        T1* ugravThread = util::ThreadScratch<T1, GravityScratch>::get(maxNodeCount);
+        T1  egravThread = 0.0;
+
+#pragma omp for
+        for (TreeNodeIndex leafIdx = firstLeafIndex; leafIdx < lastLeafIndex; ++leafIdx)
+        {
+            LocalIndex firstTarget = layout[leafIdx];
+            LocalIndex numTargets  = layout[leafIdx + 1] - firstTarget;
+
+            std::fill(ugravThread, ugravThread + numTargets, 0);
+            computeGravityGroupMixed(leafIdx, octree, centers, multipoles, layout, x, y, z, h, m, G, ax + firstTarget,
+                                     ay + firstTarget, az + firstTarget, ugravThread);
 
             for (LocalIndex i = 0; i < numTargets; ++i)
             {
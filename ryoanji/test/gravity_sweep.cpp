@@ -0,0 +1,382 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 CSCS, ETH Zurich
+ *               2022 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Accuracy vs. cost sweep of the CPU gravity tree walk against a direct-sum reference
+ *
+ * Usage: gravity_sweep [-n NUM] [--dist plummer,evrard,cube] [--theta LIST] [--bucket LIST] [--order LIST]
+ *                      [--precision double,mixed] [--cache DIR]
+ *
+ * For each particle distribution, the direct-sum reference accelerations are computed once and cached in DIR.
+ * One CSV line per configuration of (theta, multipole order, bucket size, precision) is written to stdout.
+ * Supported multipole orders are 0 (monopole) and 2 (quadrupole). Mixed precision computes P2P and M2P
+ * interactions in single precision, see computeGravityGroupMixed.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cstone/sfc/box.hpp"
+#include "coord_samples/plummer.hpp"
+#include "coord_samples/random.hpp"
+#include "ryoanji/nbody/traversal_cpu.hpp"
+#include "ryoanji/nbody/upsweep_cpu.hpp"
+
+using namespace cstone;
+using namespace ryoanji;
+
+using T             = double;
+using KeyType       = uint64_t;
+using MultipoleType = ryoanji::CartesianQuadrupole<T>;
+
+//! @brief particle coordinates in SFC order with masses and smoothing lengths
+struct ParticleSet
+{
+    std::string    name;
+    Box<T>         box{0, 1};
+    std::vector<T> x, y, z, h, m;
+
+    std::vector<KeyType> keys;
+};
+
+//! @brief uniform sphere contracted radially to a 1/r density profile, as in the Evrard collapse test
+std::array<std::vector<T>, 3> evrardSphere(size_t n)
+{
+    std::mt19937                      gen(42);
+    std::uniform_real_distribution<T> dist(-1.0, 1.0);
+
+    std::array<std::vector<T>, 3> pos;
+    for (auto& p : pos)
+    {
+        p.reserve(n);
+    }
+
+    while (pos[0].size() < n)
+    {
+        T px = dist(gen), py = dist(gen), pz = dist(gen);
+        T r  = std::sqrt(px * px + py * py + pz * pz);
+        if (r > 1.0 || r == 0) { continue; }
+
+        // mass within radius r of a uniform sphere is r^3, for a 1/r density profile it's r^2
+        T scale = std::sqrt(r);
+        pos[0].push_back(px * scale);
+        pos[1].push_back(py * scale);
+        pos[2].push_back(pz * scale);
+    }
+    return pos;
+}
+
+ParticleSet makeParticleSet(const std::string& name, size_t n)
+{
+    ParticleSet p;
+    p.name = name;
+
+    if (name == "plummer")
+    {
+        auto pos = plummer<T>(n);
+        p.x      = std::move(pos[0]);
+        p.y      = std::move(pos[1]);
+        p.z      = std::move(pos[2]);
+    }
+    else if (name == "evrard")
+    {
+        auto pos = evrardSphere(n);
+        p.x      = std::move(pos[0]);
+        p.y      = std::move(pos[1]);
+        p.z      = std::move(pos[2]);
+    }
+    else if (name == "cube")
+    {
+        RandomCoordinates<T, SfcKind<KeyType>> coords(n, Box<T>(-1, 1));
+        p.x = coords.x();
+        p.y = coords.y();
+        p.z = coords.z();
+    }
+    else { throw std::runtime_error("unknown particle distribution " + name); }
+
+    auto [xmin, xmax] = std::minmax_element(p.x.begin(), p.x.end());
+    auto [ymin, ymax] = std::minmax_element(p.y.begin(), p.y.end());
+    auto [zmin, zmax] = std::minmax_element(p.z.begin(), p.z.end());
+    p.box             = Box<T>(*xmin, *xmax, *ymin, *ymax, *zmin, *zmax);
+
+    p.keys.resize(n);
+    computeSfcKeys(p.x.data(), p.y.data(), p.z.data(), sfcKindPointer(p.keys.data()), n, p.box);
+
+    std::vector<LocalIndex> sfcOrder(n);
+    std::iota(begin(sfcOrder), end(sfcOrder), LocalIndex(0));
+    sort_by_key(begin(p.keys), end(p.keys), begin(sfcOrder));
+
+    std::vector<T> temp(n);
+    gather<LocalIndex>(sfcOrder, p.x.data(), temp.data());
+    swap(p.x, temp);
+    gather<LocalIndex>(sfcOrder, p.y.data(), temp.data());
+    swap(p.y, temp);
+    gather<LocalIndex>(sfcOrder, p.z.data(), temp.data());
+    swap(p.z, temp);
+
+    // softening of about a tenth of the mean inter-particle spacing in the bulk of the distribution,
+    // the bounding box of the Plummer sphere is dominated by a few outliers, its core has unit size
+    T volume = (name == "plummer") ? T(1) : p.box.lx() * p.box.ly() * p.box.lz();
+    p.h = std::vector<T>(n, 0.1 * std::cbrt(volume / n));
+    p.m = std::vector<T>(n, 1.0 / n);
+
+    return p;
+}
+
+/*! @brief return direct-sum accelerations for @p p, read from @p cacheDir if present, otherwise compute and store
+ *
+ * @return  ax, ay, az, followed by the potential of each particle
+ */
+std::array<std::vector<T>, 4> directReference(const ParticleSet& p, const std::string& cacheDir)
+{
+    size_t      n        = p.x.size();
+    std::string fileName = cacheDir + "/gravity_direct_" + p.name + "_" + std::to_string(n) + ".bin";
+
+    std::array<std::vector<T>, 4> ref;
+    for (auto& v : ref)
+    {
+        v.resize(n);
+    }
+
+    std::ifstream in(fileName, std::ios::binary);
+    if (in)
+    {
+        uint64_t numStored = 0;
+        in.read(reinterpret_cast<char*>(&numStored), sizeof(uint64_t));
+        if (numStored == n)
+        {
+            for (auto& v : ref)
+            {
+                in.read(reinterpret_cast<char*>(v.data()), n * sizeof(T));
+            }
+            if (in) { return ref; }
+        }
+    }
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    directSum(p.x.data(), p.y.data(), p.z.data(), p.h.data(), p.m.data(), n, 1.0f, ref[0].data(), ref[1].data(),
+              ref[2].data(), ref[3].data());
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::cerr << "# direct sum for " << p.name << ", " << n
+              << " particles: " << std::chrono::duration<double>(t1 - t0).count() << "s, stored in " << fileName
+              << std::endl;
+
+    std::ofstream out(fileName, std::ios::binary);
+    uint64_t      numStored = n;
+    out.write(reinterpret_cast<char*>(&numStored), sizeof(uint64_t));
+    for (const auto& v : ref)
+    {
+        out.write(reinterpret_cast<const char*>(v.data()), n * sizeof(T));
+    }
+
+    return ref;
+}
+
+/*! @brief count particle-particle and multipole-particle interactions of the tree walk
+ *
+ * Repeats the traversal of computeGravityGroup for each leaf without evaluating any interactions.
+ */
+std::array<uint64_t, 2> countInteractions(const Octree<KeyType>& octree, const SourceCenterType<T>* centers,
+                                          const LocalIndex* layout, const T* x, const T* y, const T* z)
+{
+    uint64_t numP2P = 0, numM2P = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : numP2P, numM2P)
+    for (TreeNodeIndex leafIdx = 0; leafIdx < octree.numLeafNodes(); ++leafIdx)
+    {
+        LocalIndex firstTarget = layout[leafIdx];
+        LocalIndex lastTarget  = layout[leafIdx + 1];
+        LocalIndex numTargets  = lastTarget - firstTarget;
+        if (numTargets == 0) { continue; }
+
+        cstone::Vec3<T> tMin{x[firstTarget], y[firstTarget], z[firstTarget]};
+        cstone::Vec3<T> tMax = tMin;
+        for (LocalIndex i = firstTarget; i < lastTarget; ++i)
+        {
+            cstone::Vec3<T> tp{x[i], y[i], z[i]};
+            tMin = min(tp, tMin);
+            tMax = max(tp, tMax);
+        }
+
+        cstone::Vec3<T> targetCenter = (tMax + tMin) * T(0.5);
+        cstone::Vec3<T> targetSize   = (tMax - tMin) * T(0.5);
+
+        auto countM2P = [&](TreeNodeIndex idx)
+        {
+            const auto& com         = centers[idx];
+            bool        violatesMac = evaluateMac(makeVec3(com), com[3], targetCenter, targetSize);
+            if (!violatesMac) { numM2P += numTargets; }
+            return violatesMac;
+        };
+
+        auto countP2P = [&, toLeaf = octree.toLeafOrder()](TreeNodeIndex idx)
+        {
+            TreeNodeIndex lidx = toLeaf[idx];
+            numP2P += uint64_t(numTargets) * (layout[lidx + 1] - layout[lidx]);
+        };
+
+        singleTraversal(octree.childOffsets().data(), countM2P, countP2P);
+    }
+
+    return {numP2P, numM2P};
+}
+
+std::vector<std::string> commaList(const std::string& list)
+{
+    std::vector<std::string> ret;
+    std::stringstream        ss(list);
+    std::string              item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty()) { ret.push_back(item); }
+    }
+    return ret;
+}
+
+std::string getArg(int argc, char** argv, const std::string& option, const std::string& def)
+{
+    for (int i = 1; i < argc - 1; ++i)
+    {
+        if (argv[i] == option) { return argv[i + 1]; }
+    }
+    return def;
+}
+
+int main(int argc, char** argv)
+{
+    size_t      numParticles = std::stoul(getArg(argc, argv, "-n", "20000"));
+    auto        distNames    = commaList(getArg(argc, argv, "--dist", "plummer,evrard,cube"));
+    auto        thetas       = commaList(getArg(argc, argv, "--theta", "0.3,0.4,0.5,0.6,0.7,0.8,1.0"));
+    auto        buckets      = commaList(getArg(argc, argv, "--bucket", "16,32,64,128"));
+    auto        orders       = commaList(getArg(argc, argv, "--order", "0,2"));
+    auto        precisions   = commaList(getArg(argc, argv, "--precision", "double,mixed"));
+    std::string cacheDir     = getArg(argc, argv, "--cache", ".");
+
+    std::cout << "distribution,numParticles,bucketSize,theta,order,precision,rmsError,p99Error,maxError,numP2P,numM2P,"
+                 "time"
+              << std::endl;
+
+    for (const auto& distName : distNames)
+    {
+        ParticleSet p   = makeParticleSet(distName, numParticles);
+        auto        ref = directReference(p, cacheDir);
+
+        const T* x = p.x.data();
+        const T* y = p.y.data();
+        const T* z = p.z.data();
+
+        for (const auto& bucketStr : buckets)
+        {
+            unsigned bucketSize = std::stoul(bucketStr);
+
+            auto [treeLeaves, counts] = computeOctree(p.keys.data(), p.keys.data() + numParticles, bucketSize);
+
+            Octree<KeyType> octree;
+            octree.update(treeLeaves.data(), nNodes(treeLeaves));
+
+            std::vector<LocalIndex> layout(octree.numLeafNodes() + 1);
+            stl::exclusive_scan(counts.begin(), counts.end() + 1, layout.begin(), LocalIndex(0));
+
+            for (const auto& thetaStr : thetas)
+            {
+                float theta = std::stof(thetaStr);
+
+                std::vector<SourceCenterType<T>> centers(octree.numTreeNodes());
+                computeLeafMassCenter<T, T, T, KeyType>(p.x, p.y, p.z, p.m, p.keys, octree, centers);
+                upsweep(octree.levelRange(), octree.childOffsets(), centers.data(), CombineSourceCenter<T>{});
+                setMac<T>(octree.nodeKeys(), centers, 1.0 / theta, p.box);
+
+                auto [numP2P, numM2P] = countInteractions(octree, centers.data(), layout.data(), x, y, z);
+
+                for (const auto& orderStr : orders)
+                {
+                    int order = std::stoi(orderStr);
+
+                    std::vector<MultipoleType> multipoles(octree.numTreeNodes());
+                    computeLeafMultipoles(x, y, z, p.m.data(), octree.internalOrder(), layout.data(), centers.data(),
+                                          multipoles.data());
+                    upsweepMultipoles(octree.levelRange(), octree.childOffsets(), centers.data(), multipoles.data());
+                    for (auto& mp : multipoles)
+                    {
+                        mp = ryoanji::normalize(mp);
+                        // expansions are centered on the center of mass, so dropping the quadrupole yields order 0
+                        if (order == 0) { std::fill(mp.begin() + Cqi::qxx, mp.end(), T(0)); }
+                    }
+
+                    for (const auto& precision : precisions)
+                    {
+                        std::vector<T> ax(numParticles, 0), ay(numParticles, 0), az(numParticles, 0);
+
+                        auto t0 = std::chrono::high_resolution_clock::now();
+                        if (precision == "mixed")
+                        {
+                            computeGravityMixed(octree, centers.data(), multipoles.data(), layout.data(), 0,
+                                                octree.numLeafNodes(), x, y, z, p.h.data(), p.m.data(), 1.0f,
+                                                ax.data(), ay.data(), az.data());
+                        }
+                        else
+                        {
+                            computeGravity(octree, centers.data(), multipoles.data(), layout.data(), 0,
+                                           octree.numLeafNodes(), x, y, z, p.h.data(), p.m.data(), 1.0f, ax.data(),
+                                           ay.data(), az.data());
+                        }
+                        auto   t1      = std::chrono::high_resolution_clock::now();
+                        double elapsed = std::chrono::duration<double>(t1 - t0).count();
+
+                        std::vector<double> delta(numParticles);
+                        for (size_t i = 0; i < numParticles; ++i)
+                        {
+                            T dx = ax[i] - ref[0][i];
+                            T dy = ay[i] - ref[1][i];
+                            T dz = az[i] - ref[2][i];
+                            T a2 = ref[0][i] * ref[0][i] + ref[1][i] * ref[1][i] + ref[2][i] * ref[2][i];
+
+                            delta[i] = std::sqrt((dx * dx + dy * dy + dz * dz) / a2);
+                        }
+
+                        double rms = std::sqrt(std::inner_product(delta.begin(), delta.end(), delta.begin(), 0.0) /
+                                               numParticles);
+                        std::sort(delta.begin(), delta.end());
+
+                        std::cout << p.name << "," << numParticles << "," << bucketSize << "," << theta << ","
+                                  << order << "," << precision << "," << rms << ","
+                                  << delta[size_t(0.99 * (numParticles - 1))] << "," << delta.back() << "," << numP2P
+                                  << "," << numM2P << "," << elapsed << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
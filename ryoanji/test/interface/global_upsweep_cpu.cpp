@@ -109,6 +109,82 @@ static int multipoleExchangeTest(int thisRank, int numRanks)
     else { return EXIT_FAILURE; }
 }
 
+//! @brief incremental multipoles are bitwise identical to a full recomputation after changing a few particles
+template<class T, class KeyType>
+static int incrementalUpsweepTest(int thisRank, int numRanks)
+{
+    using MultipoleType              = CartesianQuadrupole<T>;
+    const LocalIndex numParticles    = 1000;
+    unsigned         bucketSize      = 64;
+    unsigned         bucketSizeLocal = 16;
+    float            theta           = 0.5;
+
+    cstone::Box<T> box{-1, 1};
+
+    cstone::RandomGaussianCoordinates<T, cstone::SfcKind<KeyType>> coords(numRanks * numParticles, box);
+
+    std::vector<T> globalH(numRanks * numParticles, 0.1);
+    adjustSmoothingLength<KeyType>(globalH.size(), 5, 10, coords.x(), coords.y(), coords.z(), globalH, box);
+
+    auto firstIndex = numParticles * thisRank;
+    auto lastIndex  = numParticles * thisRank + numParticles;
+
+    std::vector<T> x(coords.x().begin() + firstIndex, coords.x().begin() + lastIndex);
+    std::vector<T> y(coords.y().begin() + firstIndex, coords.y().begin() + lastIndex);
+    std::vector<T> z(coords.z().begin() + firstIndex, coords.z().begin() + lastIndex);
+    std::vector<T> h(globalH.begin() + firstIndex, globalH.begin() + lastIndex);
+    std::vector<T> m(numParticles, 1.0 / (numRanks * numParticles));
+
+    std::vector<KeyType> particleKeys(x.size());
+    cstone::Domain<KeyType, T> domain(thisRank, numRanks, bucketSize, bucketSizeLocal, theta, box);
+
+    IncrementalMultipoles<KeyType, T, MultipoleType> incremental;
+
+    std::vector<MultipoleType> probe;
+
+    bool pass        = true;
+    bool partialStep = false;
+    for (int step = 0; step < 4; ++step)
+    {
+        std::vector<T> s1, s2, s3;
+        domain.syncGrav(particleKeys, x, y, z, h, m, std::tuple{}, std::tie(s1, s2, s3));
+
+        // move a single particle of the local domain after the first step
+        std::vector<uint8_t> changed(x.size(), 0);
+        if (step > 0)
+        {
+            LocalIndex i = domain.startIndex() + (domain.endIndex() - domain.startIndex()) / 2;
+            x[i] += 1e-4;
+            changed[i] = 1;
+        }
+
+        const cstone::Octree<KeyType>& octree = domain.focusTree().octree();
+        std::vector<MultipoleType>     reference(octree.numTreeNodes());
+
+        ryoanji::computeGlobalMultipoles(x.data(), y.data(), z.data(), m.data(), x.size(), domain.globalTree(),
+                                         domain.focusTree(), domain.layout().data(), reference.data());
+        incremental.compute(x.data(), y.data(), z.data(), m.data(), changed.data(), domain.globalTree(),
+                            domain.focusTree(), domain.layout().data(), probe);
+
+        pass &= probe.size() == reference.size() &&
+                std::memcmp(reference.data(), probe.data(), reference.size() * sizeof(MultipoleType)) == 0;
+        partialStep |= incremental.numP2M() < octree.numLeafNodes() / 2;
+    }
+
+    pass &= partialStep;
+    int numPassed = pass;
+    mpiAllreduce(MPI_IN_PLACE, &numPassed, 1, MPI_SUM);
+
+    if (thisRank == 0)
+    {
+        std::string testResult = (numPassed == numRanks) ? "PASS" : "FAIL";
+        std::cout << "Incremental upsweep test result: " << testResult << std::endl;
+    }
+
+    if (numPassed == numRanks) { return EXIT_SUCCESS; }
+    else { return EXIT_FAILURE; }
+}
+
 int main(int argc, char** argv)
 {
     MPI_Init(NULL, NULL);
@@ -118,6 +194,7 @@ int main(int argc, char** argv)
     MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
 
     int testResult = multipoleExchangeTest<double, uint64_t>(rank, numRanks);
+    testResult |= incrementalUpsweepTest<double, uint64_t>(rank, numRanks);
 
     MPI_Finalize();
 
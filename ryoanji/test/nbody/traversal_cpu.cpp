@@ -168,4 +168,75 @@ TEST(Gravity, TreeWalk)
     // 99% of particles have an error smaller than this
     std::cout << "1st percentile: " << delta[numParticles * 0.99] << std::endl;
     std::cout << "max Error: " << delta[numParticles - 1] << std::endl;
+
+    // mixed precision must reach an accuracy comparable to the full precision traversal
+    {
+        std::vector<T> axMixed(numParticles, 0), ayMixed(numParticles, 0), azMixed(numParticles, 0);
+
+        double egravMixed = computeGravityMixed(octree, centers.data(), multipoles.data(), layout.data(), 0,
+                                                octree.numLeafNodes(), x, y, z, h.data(), masses.data(), G,
+                                                axMixed.data(), ayMixed.data(), azMixed.data());
+        EXPECT_NEAR(std::abs(refPotSum - egravMixed) / refPotSum, 0, 1e-2);
+
+        std::vector<T> deltaMixed(numParticles);
+        for (LocalIndex i = 0; i < numParticles; ++i)
+        {
+            T dx = axMixed[i] - Ax[i];
+            T dy = ayMixed[i] - Ay[i];
+            T dz = azMixed[i] - Az[i];
+
+            deltaMixed[i] = std::sqrt((dx * dx + dy * dy + dz * dz) / (Ax[i] * Ax[i] + Ay[i] * Ay[i] + Az[i] * Az[i]));
+        }
+        std::sort(begin(deltaMixed), end(deltaMixed));
+
+        EXPECT_TRUE(deltaMixed[numParticles * 0.99] < 3e-3);
+        EXPECT_TRUE(deltaMixed[numParticles - 1] < 2e-2);
+    }
+
+    // splitting into near- and far-field must not change the sum of both
+    std::vector<T> axNear(numParticles, 0), ayNear(numParticles, 0), azNear(numParticles, 0);
+    std::vector<T> axFar(numParticles, 0), ayFar(numParticles, 0), azFar(numParticles, 0), uFar(numParticles, 0);
+    std::vector<std::vector<TreeNodeIndex>> farCells(octree.numLeafNodes());
+
+    double egravNear = computeGravity(octree, centers.data(), multipoles.data(), layout.data(), 0,
+                                      octree.numLeafNodes(), x, y, z, h.data(), masses.data(), G, axNear.data(),
+                                      ayNear.data(), azNear.data(), 4.0f, axFar.data(), ayFar.data(), azFar.data(),
+                                      uFar.data(), farCells.data());
+
+    double egravFar = 0;
+    for (LocalIndex i = 0; i < numParticles; ++i)
+    {
+        egravFar += 0.5 * masses[i] * uFar[i];
+    }
+
+    EXPECT_NEAR(egravNear + egravFar, egravTot, 1e-10 * std::abs(egravTot));
+    EXPECT_NE(egravFar, 0.0);
+    for (LocalIndex i = 0; i < numParticles; ++i)
+    {
+        EXPECT_NEAR(axNear[i] + axFar[i], ax[i], 1e-10 * std::abs(Ax[i]));
+        EXPECT_NEAR(ayNear[i] + ayFar[i], ay[i], 1e-10 * std::abs(Ay[i]));
+        EXPECT_NEAR(azNear[i] + azFar[i], az[i], 1e-10 * std::abs(Az[i]));
+    }
+
+    // near-field with the far-field cells kept fixed plus the M2P of these cells reproduces the same interactions
+    for (TreeNodeIndex leafIdx = 0; leafIdx < octree.numLeafNodes(); ++leafIdx)
+    {
+        LocalIndex first = layout[leafIdx];
+        LocalIndex n     = layout[leafIdx + 1] - first;
+
+        std::vector<T> axg(n, 0), ayg(n, 0), azg(n, 0), ug(n, 0);
+        FarFieldSplit<T> frozen;
+        frozen.frozen = farCells[leafIdx];
+        computeGravityGroup(leafIdx, octree, centers.data(), multipoles.data(), layout.data(), x, y, z, h.data(),
+                            masses.data(), G, axg.data(), ayg.data(), azg.data(), ug.data(), frozen);
+        computeGravityCells(leafIdx, centers.data(), multipoles.data(), layout.data(), x, y, z, G,
+                            gsl::span<const TreeNodeIndex>(farCells[leafIdx]), axg.data(), ayg.data(), azg.data(),
+                            ug.data());
+        for (LocalIndex i = 0; i < n; ++i)
+        {
+            EXPECT_NEAR(axg[i], ax[first + i], 1e-10 * std::abs(Ax[first + i]));
+            EXPECT_NEAR(ayg[i], ay[first + i], 1e-10 * std::abs(Ay[first + i]));
+            EXPECT_NEAR(azg[i], az[first + i], 1e-10 * std::abs(Az[first + i]));
+        }
+    }
 }
@@ -122,6 +122,11 @@ public:
     FieldVector<KeyType>  keys;                         // Particle space-filling-curve keys
     FieldVector<unsigned> nc;                           // number of neighbors of each particle
 
+    //! @brief cached far-field gravitational acceleration and potential of the last and the previous evaluation
+    FieldVector<T> ax_far, ay_far, az_far, ax_far_m1, ay_far_m1, az_far_m1, ugrav_far, ugrav_far_m1;
+    //! @brief node key of the target group of each particle at the last far-field evaluation
+    FieldVector<KeyType> key_far;
+
     //! @brief Indices of neighbors for each particle, length is number of assigned particles * ngmax. CPU version only.
     std::vector<cstone::LocalIndex> neighbors;
 
@@ -136,7 +141,8 @@ public:
     inline static constexpr std::array fieldNames{
         "x",   "y",   "z",   "x_m1", "y_m1", "z_m1", "vx", "vy",    "vz",    "rho",   "u",     "p",    "prho",
         "h",   "m",   "c",   "ax",   "ay",   "az",   "du", "du_m1", "c11",   "c12",   "c13",   "c22",  "c23",
-        "c33", "mue", "mui", "temp", "cv",   "xm",   "kx", "divv",  "curlv", "alpha", "gradh", "keys", "nc"};
+        "c33", "mue", "mui", "temp", "cv",   "xm",   "kx", "divv",  "curlv", "alpha", "gradh", "keys", "nc",
+        "ax_far", "ay_far", "az_far", "ax_far_m1", "ay_far_m1", "az_far_m1", "ugrav_far", "ugrav_far_m1", "key_far"};
 
     static_assert(!cstone::HaveGpu<AcceleratorType>{} ||
                       fieldNames.size() == DeviceData_t<AccType, T, KeyType>::fieldNames.size(),
@@ -149,7 +155,8 @@ public:
     auto dataTuple()
     {
         auto ret = std::tie(x, y, z, x_m1, y_m1, z_m1, vx, vy, vz, rho, u, p, prho, h, m, c, ax, ay, az, du, du_m1, c11,
-                            c12, c13, c22, c23, c33, mue, mui, temp, cv, xm, kx, divv, curlv, alpha, gradh, keys, nc);
+                            c12, c13, c22, c23, c33, mue, mui, temp, cv, xm, kx, divv, curlv, alpha, gradh, keys, nc,
+                            ax_far, ay_far, az_far, ax_far_m1, ay_far_m1, az_far_m1, ugrav_far, ugrav_far_m1, key_far);
 
         static_assert(std::tuple_size_v<decltype(ret)> == fieldNames.size());
         return ret;
@@ -38,19 +38,24 @@
 
 #include <mpi.h>
 
+#include "cstone/primitives/reduction_batch.hpp"
 #include "kernels.hpp"
 
 namespace sph
 {
 
+/*! @brief advance the time by the minimum time-step across all ranks of @p comm
+ *
+ * The time-step is reduced together with any other values that were added to @p reductions earlier in the step.
+ */
 template<class Dataset>
-void computeTimestep(Dataset& d)
+void computeTimestep(Dataset& d, cstone::ReductionBatch& reductions, MPI_Comm comm)
 {
     using T = typename Dataset::RealType;
 
-    T minDt = std::min(d.minDt_loc, d.maxDtIncrease * d.minDt);
-
-    MPI_Allreduce(MPI_IN_PLACE, &minDt, 1, MpiType<T>{}, MPI_MIN, MPI_COMM_WORLD);
+    auto dtSlot = reductions.add(cstone::ReduceOp::min, std::min(d.minDt_loc, d.maxDtIncrease * d.minDt));
+    reductions.start(comm);
+    T minDt = reductions.get(dtSlot);
 
     d.ttot += minDt;
 